@@ -1935,10 +1935,10 @@ static void dumptree(Node* n, bool recurse, int depth, const char* title, ofstre
                     stream << ", has file attributes " << p + 1;
                 }
 
-                if (showattrs && n->attrs.map.size())
+                if (showattrs && n->attrs().map.size())
                 {
                     stream << ", has name";
-                    for (auto& a : n->attrs.map)
+                    for (auto& a : n->attrs().map)
                     {
                         char namebuf[100]{};
                         AttrMap::nameid2string(a.first, namebuf);
@@ -2038,10 +2038,10 @@ static void dumptree(Node* n, bool recurse, int depth, const char* title, ofstre
                     stream << ", inbound " << getAccessLevelStr(n->inshare->access) << " share";
                 }
 
-                if (showattrs && n->attrs.map.size())
+                if (showattrs && n->attrs().map.size())
                 {
                     stream << ", has name";
-                    for (auto& a : n->attrs.map)
+                    for (auto& a : n->attrs().map)
                     {
                         char namebuf[100]{};
                         AttrMap::nameid2string(a.first, namebuf);
@@ -2209,7 +2209,7 @@ public:
             key.setkey((const byte*) t->nodekey.data(), n->type);
 
             AttrMap tattrs;
-            tattrs.map = n->attrs.map;
+            tattrs.map = n->attrs().map;
             nameid rrname = AttrMap::string2nameid("rr");
             attr_map::iterator it = tattrs.map.find(rrname);
             if (it != tattrs.map.end())
@@ -3349,7 +3349,7 @@ void exec_showattributes(autocomplete::ACState& s)
 {
     if (const Node* n = nodeFromRemotePath(s.words[1].s))
     {
-        for (auto pair : n->attrs.map)
+        for (auto pair : n->attrs().map)
         {
             char namebuf[10]{};
             AttrMap::nameid2string(pair.first, namebuf);
@@ -4741,7 +4741,7 @@ void exec_mv(autocomplete::ACState& s)
                             }
 
                             // overwrite existing target file: rename source...
-                            e = client->setattr(n, attr_map('n', tn->attrs.map['n']), setattr_result, false);
+                            e = client->setattr(n, attr_map('n', tn->attrs().map['n']), setattr_result, false);
 
                             if (e)
                             {
@@ -4887,8 +4887,8 @@ void exec_cp(autocomplete::ACState& s)
             }
             else
             {
-                attr_map::iterator it = n->attrs.map.find('n');
-                if (it != n->attrs.map.end())
+                attr_map::iterator it = n->attrs().map.find('n');
+                if (it != n->attrs().map.end())
                 {
                     sname = it->second;
                 }
@@ -4926,7 +4926,7 @@ void exec_cp(autocomplete::ACState& s)
                 // copy source attributes and rename
                 AttrMap attrs;
 
-                attrs.map = n->attrs.map;
+                attrs.map = n->attrs().map;
                 attrs.map['n'] = sname;
 
                 key.setkey((const byte*)tc.nn[0].nodekey.data(), tc.nn[0].type);
@@ -70,20 +70,54 @@ public:
 class MEGA_API BackoffTimerTracked;
 
 // This class keeps track of a group of BackoffTimerTracked, which register and deregister themselves.
-// Timers are in the multimap when they have non-0 non-NEVER timeouts set, giving us a much smaller group should we need to iterate it.
+// Timers are in the group when they have non-0 non-NEVER timeouts set, giving us a much smaller group should we need to iterate it.
+// They are kept in a hierarchical timing wheel (intrusive lists, no allocation) so that arming and cancelling
+// a timer is O(1), and the soonest pending timeout is cached rather than searched for on every wait.
 class MEGA_API BackoffTimerGroupTracker
 {
-    std::multimap<dstime, BackoffTimerTracked*> timeouts;
-
 public:
-    typedef std::multimap<dstime, BackoffTimerTracked*>::iterator Iter;
+    // each wheel level resolves 6 bits of the deadline, four levels cover about 19 days of deciseconds
+    static const int WHEEL_BITS = 6;
+    static const int WHEEL_SLOTS = 1 << WHEEL_BITS;
+    static const int WHEEL_LEVELS = 4;
+
+    // pseudo slots for timers that are already due and for those too far away for the wheel
+    static const int SLOT_DUE = WHEEL_LEVELS * WHEEL_SLOTS;
+    static const int SLOT_OVERFLOW = SLOT_DUE + 1;
+    static const int SLOT_NONE = -1;
 
-    inline Iter add(BackoffTimerTracked* bt);
-    inline void remove(Iter i) { timeouts.erase(i); }
+    BackoffTimerGroupTracker();
+
+    void add(BackoffTimerTracked* bt);
+    void remove(BackoffTimerTracked* bt);
 
     // Find out the soonest (non-0 and non-NEVER) timeout in the group.
     // For transfers, it calls set(0) on any timed out timers, as the old code did.
     void update(dstime* waituntil, bool transfers);
+
+    // soonest timeout still in the future as of the last update(), or NEVER
+    dstime nextTimeout();
+
+    size_t size() const { return mCount; }
+
+private:
+    BackoffTimerTracked* mSlots[SLOT_OVERFLOW + 1];
+
+    // bitmap of non-empty slots per level
+    uint64_t mOccupied[WHEEL_LEVELS];
+
+    // the time the wheel was last advanced to
+    dstime mNow;
+
+    dstime mEarliest;
+    bool mEarliestValid;
+    size_t mCount;
+
+    int slotFor(dstime deadline) const;
+    void link(BackoffTimerTracked* bt, int slot);
+    void unlink(BackoffTimerTracked* bt);
+    void replaceSlot(int slot);
+    void advance(dstime now);
 };
 
 
@@ -94,7 +128,13 @@ class MEGA_API BackoffTimerTracked
     bool mIsEnabled;
     BackoffTimer bt;
     BackoffTimerGroupTracker& mTracker;
-    BackoffTimerGroupTracker::Iter mTrackerPos;
+
+    // position in the tracker's timing wheel, managed by BackoffTimerGroupTracker
+    friend class BackoffTimerGroupTracker;
+    BackoffTimerTracked* mWheelPrev = nullptr;
+    BackoffTimerTracked* mWheelNext = nullptr;
+    dstime mWheelDeadline = 0;
+    int mWheelSlot = BackoffTimerGroupTracker::SLOT_NONE;
 
     void untrack();
     void track();
@@ -118,17 +158,11 @@ public:
     inline bool enabled()           { return mIsEnabled; }
 };
 
-inline auto BackoffTimerGroupTracker::add(BackoffTimerTracked* bt) -> Iter
-{
-    return timeouts.emplace(bt->nextset() ? bt->nextset() : NEVER, bt);
-}
-
 inline void BackoffTimerTracked::untrack()
 {
     if (mIsEnabled && bt.nextset() != 0 && bt.nextset() != NEVER)
     {
-        mTracker.remove(mTrackerPos);
-        mTrackerPos = BackoffTimerGroupTracker::Iter();
+        mTracker.remove(this);
     }
 }
 
@@ -136,7 +170,7 @@ inline void BackoffTimerTracked::track()
 {
     if (mIsEnabled && bt.nextset() != 0 && bt.nextset() != NEVER)
     {
-        mTrackerPos = mTracker.add(this);
+        mTracker.add(this);
     }
 }
 
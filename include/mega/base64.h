@@ -46,6 +46,17 @@ public:
     // 1. Trailing(s) '=' if needed to have a "correct" length (ex: from 32 to 44)
     // 2. '+/' instead of '-_'
     static void toStandard(string& b64str);
+
+    // vector instructions used for the bulk of long inputs (the best available, detected at runtime, by default)
+    enum Simd { SIMD_NONE, SIMD_SSSE3, SIMD_AVX2, SIMD_NEON };
+    static Simd simd();
+    static Simd bestSimd();
+
+    // for tests and benchmarks: returns false if `level` isn't available on this CPU
+    static bool setSimd(Simd level);
+
+private:
+    static int decode(const char* a, size_t alen, byte* b, int blen);
 };
 
 template <unsigned BINARYSIZE>
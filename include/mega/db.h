@@ -29,6 +29,7 @@
 namespace mega {
 // generic host transactional database access interface
 class DBTableTransactionCommitter;
+struct MegaClientAsyncQueue;
 
 // Class to load serialized node from data base
 class NodeSerialized
@@ -38,6 +39,15 @@ public:
     std::string mNodeCounter;
 };
 
+// size, type and flags of a node, as read by bulk passes over the 'nodes' table
+struct NodeSizeTypeAndFlags
+{
+    NodeHandle handle;
+    m_off_t size = 0;
+    uint64_t flags = 0;
+    nodetype_t type = TYPE_UNKNOWN;
+};
+
 enum class DBError
 {
     DB_ERROR_UNKNOWN = 0,
@@ -71,6 +81,19 @@ public:
     virtual bool next(uint32_t*, string*) = 0;
     bool next(uint32_t*, string*, SymmCipher*);
 
+    // get up to `maxRecords` next records in sequence (still encrypted)
+    virtual bool nextBatch(std::vector<std::pair<uint32_t, string>>& records, size_t maxRecords);
+
+    // bulk equivalent of a next(uint32_t*, string*, SymmCipher*) loop: records are fetched in batches,
+    // decrypted in parallel by the worker threads of `queue`, and passed to `apply` in sequence order
+    // on the calling thread. Stops at the first record that fails to decrypt, like next() does.
+    // Returns false only if `apply` returned false (which also stops the iteration).
+    bool nextAllDecrypted(MegaClientAsyncQueue& queue, SymmCipher* key, std::function<bool(uint32_t, string&)> apply);
+
+    // records fetched per batch by nextAllDecrypted(), and records per job for the worker threads
+    static const size_t BULK_LOAD_BATCH = 8192;
+    static const size_t BULK_LOAD_JOB = 512;
+
     // get specific record by key
     virtual bool get(uint32_t, string*) = 0;
 
@@ -100,6 +123,9 @@ public:
     // whether an unmatched begin() has been issued
     virtual bool inTransaction() const = 0;
 
+    // rows inserted, updated or deleted since the last begin() (0 if not tracked)
+    virtual uint64_t transactionChanges() const { return 0; }
+
     void checkCommitter(DBTableTransactionCommitter*);
 
     // autoincrement
@@ -155,10 +181,19 @@ public:
 
     virtual bool getNodeSizeTypeAndFlags(NodeHandle node, m_off_t& size, nodetype_t& nodeType, uint64_t& oldFlags) = 0;
 
-    virtual void updateCounter(NodeHandle nodeHandle, const std::string& nodeCounterBlob) = 0;
+    // the same for the children of a node, passed to `cursor` row by row with whether each one has children
+    // of its own. Meant to be used once the indexes are created
+    virtual bool getChildrenSizeTypeAndFlags(NodeHandle parentHandle, const std::function<void(const NodeSizeTypeAndFlags&, bool hasChildren)>& cursor) = 0;
+
+    // update just the counter of a node, false if the node is not in the table
+    virtual bool updateCounter(NodeHandle nodeHandle, const std::string& nodeCounterBlob) = 0;
 
     virtual void updateCounterAndFlags(NodeHandle nodeHandle, uint64_t flags, const std::string& nodeCounterBlob) = 0;
 
+    // the same for all the children of a node that have no children of their own, in one statement:
+    // their counter is only themselves (as versions if `areVersions`), and the bits in `flagsMask` are set to `flags`
+    virtual void updateLeafChildrenCounterAndFlags(NodeHandle parentHandle, bool areVersions, uint64_t flagsMask, uint64_t flags) = 0;
+
     virtual void createIndexes() = 0;
 };
 
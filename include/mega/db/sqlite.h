@@ -60,7 +60,11 @@ public:
     virtual ~SqliteDbTable();
 
     bool inTransaction() const override;
+    uint64_t transactionChanges() const override;
 
+private:
+    // sqlite3_total_changes() at the last begin()
+    int mTotalChangesAtBegin = 0;
 };
 
 /**
@@ -88,6 +92,7 @@ public:
     bool getFavouritesHandles(NodeHandle node, uint32_t count, std::vector<mega::NodeHandle>& nodes) override;
     bool childNodeByNameType(NodeHandle parentHanlde, const std::string& name, nodetype_t nodeType, std::pair<NodeHandle, NodeSerialized>& node) override;
     bool getNodeSizeTypeAndFlags(NodeHandle node, m_off_t& size, nodetype_t& nodeType, uint64_t &oldFlags) override;
+    bool getChildrenSizeTypeAndFlags(NodeHandle parentHandle, const std::function<void(const NodeSizeTypeAndFlags&, bool hasChildren)>& cursor) override;
     bool isAncestor(mega::NodeHandle node, mega::NodeHandle ancestor, CancelToken cancelFlag) override;
     uint64_t getNumberOfNodes() override;
     uint64_t getNumberOfChildrenByType(NodeHandle parentHandle, nodetype_t nodeType) override;
@@ -97,8 +102,9 @@ public:
     bool remove(mega::NodeHandle nodehandle) override;
     bool removeNodes() override;
 
-    void updateCounter(NodeHandle nodeHandle, const std::string& nodeCounterBlob) override;
+    bool updateCounter(NodeHandle nodeHandle, const std::string& nodeCounterBlob) override;
     void updateCounterAndFlags(NodeHandle nodeHandle, uint64_t flags, const std::string& nodeCounterBlob) override;
+    void updateLeafChildrenCounterAndFlags(NodeHandle parentHandle, bool areVersions, uint64_t flagsMask, uint64_t flags) override;
     void createIndexes() override;
 
     void remove() override;
@@ -119,6 +125,10 @@ public:
     // It checks if received mimetype is the same as extension extracted from file name
     static void userIsMimetype(sqlite3_context* context, int argc, sqlite3_value** argv);
 
+    // Method called when query use method 'leafcounter'
+    // It returns the serialized NodeCounter of a node without children, from its type, size and whether it's a version
+    static void userLeafCounter(sqlite3_context* context, int argc, sqlite3_value** argv);
+
 private:
     // Iterate over a SQL query row by row and fill the map
     // Allow at least the following containers:
@@ -128,7 +138,9 @@ private:
     sqlite3_stmt* mStmtPutNode = nullptr;
     sqlite3_stmt* mStmtUpdateNode = nullptr;
     sqlite3_stmt* mStmtUpdateNodeAndFlags = nullptr;
+    sqlite3_stmt* mStmtUpdateLeafChildren = nullptr;
     sqlite3_stmt* mStmtTypeAndSizeNode = nullptr;
+    sqlite3_stmt* mStmtChildrenTypeAndSize = nullptr;
     sqlite3_stmt* mStmtGetNode = nullptr;
     sqlite3_stmt* mStmtChildren = nullptr;
     sqlite3_stmt* mStmtChildrenFromType = nullptr;
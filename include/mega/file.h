@@ -174,6 +174,22 @@ struct MEGA_API SyncFileGet: public File
     ~SyncFileGet();
 };
 
+// upload of a synced file, owned by its LocalNode for the duration of the transfer
+struct MEGA_API SyncFilePut: public File
+{
+    LocalNode* localNode;
+
+    // set localfilename from the LocalNode's current path, update treestate
+    void prepare(FileSystemAccess&) override;
+
+    // put the node in place of the LocalNode's, then self-destruct
+    void completed(Transfer*, putsource_t source) override;
+
+    void terminated(error e) override;
+
+    SyncFilePut(LocalNode*);
+};
+
 } // namespace
 
 #endif
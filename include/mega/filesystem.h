@@ -474,6 +474,38 @@ private:
 #endif
 };
 
+// Local files believed to hold a given content, keyed by fingerprint (fed by synced files and
+// completed downloads), so that a download of the same content can copy one of them instead.
+// Entries are only hints: files change behind our back, so a candidate must be verified before use.
+class MEGA_API LocalContentIndex
+{
+public:
+    // bound on the number of entries, the oldest are dropped beyond it
+    static const size_t MAX_ENTRIES = 100000;
+
+    // (re)records path as holding the content of fingerprint
+    void add(const FileFingerprint& fingerprint, const LocalPath& path);
+
+    void remove(const FileFingerprint& fingerprint, const LocalPath& path);
+
+    // candidate paths for that content, the most recently recorded first
+    vector<LocalPath> find(const FileFingerprint& fingerprint) const;
+
+    size_t size() const;
+    void clear();
+
+private:
+    struct Entry
+    {
+        FileFingerprint fingerprint;
+        LocalPath path;
+    };
+
+    // most recent first
+    std::list<Entry> mEntries;
+    std::multimap<FileFingerprint, std::list<Entry>::iterator, FileFingerprintCmp> mByFingerprint;
+};
+
 
 struct MEGA_API AsyncIOContext
 {
@@ -597,6 +629,12 @@ struct MEGA_API FileAccess
     // absolute position read to byte buffer
     bool frawread(byte *, unsigned, m_off_t, bool caller_opened, FSLogging);
 
+    // how the file is going to be read, so the OS can tune its readahead.
+    // Kept across openf()/closef(); no effect where the platform has no such hint.
+    enum ReadPattern { READ_NORMAL, READ_SEQUENTIAL, READ_RANDOM };
+    void setreadpattern(ReadPattern);
+    ReadPattern readpattern() const { return mReadPattern; }
+
     // After a successful nonblocking fopen(), call openf() to really open the file (by localname)
     // (this is a lazy-type approach in case we don't actually need to open the file after finding out type/size/mtime).
     // If the size or mtime changed, it will fail.
@@ -638,12 +676,14 @@ protected:
     static void asyncopfinished(void *param);
     bool isAsyncOpened;
     int numAsyncReads;
+    ReadPattern mReadPattern = READ_NORMAL;
 
     // system-specific raw read/open/close to be provided by platform implementation.   fopen / openf / fread etc are implemented by calling these.
     virtual bool sysread(byte *, unsigned, m_off_t) = 0;
     virtual bool sysstat(m_time_t*, m_off_t*, FSLogging) = 0;
     virtual bool sysopen(bool async, FSLogging) = 0;
     virtual void sysclose() = 0;
+    virtual void sysreadpattern() { }   // apply mReadPattern to the open file, if any
     virtual void asyncsysopen(AsyncIOContext*);
     virtual void asyncsysread(AsyncIOContext*);
     virtual void asyncsyswrite(AsyncIOContext*);
@@ -866,6 +906,12 @@ struct MEGA_API FileSystemAccess : public EventTrigger
     // Set when an operation fails because the target file name is too long.
     bool target_name_too_long = false;
 
+    // how the data was copied by the last successful copylocal()
+    enum CopyMethod { COPY_NONE, COPY_CLONE, COPY_FILE_RANGE, COPY_SENDFILE, COPY_READWRITE, COPY_SYSTEM };
+    CopyMethod last_copy_method = COPY_NONE;
+
+    static const char* copyMethodName(CopyMethod);
+
     // append local operating system version information to string.
     // Set includeArchExtraInfo to know if the app is 32 bit running on 64 bit (on windows, that is via the WOW subsystem)
     virtual void osversion(string*, bool includeArchExtraInfo) const { }
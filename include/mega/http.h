@@ -302,10 +302,83 @@ struct MEGA_API HttpIO : public EventTrigger
 
     virtual bool cacheresolvedurls(const std::vector<string>&, std::vector<string>&&) { return false; }
 
+    // multiplex HTTPS requests to the same host over HTTP/2 connections, with up to maxStreamsPerConnection
+    // requests in flight on each (plain HTTP, and servers without HTTP/2, are still reached over HTTP/1.1)
+    virtual bool sethttp2(bool /*enable*/, long /*maxStreamsPerConnection*/) { return false; }
+
     HttpIO();
     virtual ~HttpIO() { }
 };
 
+// Process-wide pool of the buffers that downloaded data is received into and written from.
+// Buffers are page aligned and their sizes are rounded up to classes (eight per power of two),
+// so buffers released after each write can be reused for the next requests instead of going
+// back to the heap. Idle buffers are kept while the total stays under the memory cap. The cap
+// also bounds the buffers in use: allocations never fail, but once it's reached downloads don't
+// start new requests until some buffers are released.
+class MEGA_API TransferBufferPool
+{
+public:
+    static const size_t ALIGNMENT = 4096;
+
+    // buffers outside this range aren't kept for reuse
+    static const size_t MIN_POOLED_SIZE = 64 * 1024;
+    static const size_t MAX_POOLED_SIZE = 128 * 1024 * 1024;
+
+    // idle memory kept when there is no cap
+    static const size_t DEFAULT_IDLE_LIMIT = 64 * 1024 * 1024;
+
+    struct Stats
+    {
+        size_t inUseBytes = 0;
+        size_t idleBytes = 0;
+        uint64_t allocations = 0;
+        uint64_t reuses = 0;
+    };
+
+    static TransferBufferPool& instance();
+
+    TransferBufferPool() = default;
+    ~TransferBufferPool();
+
+    // buffer of at least `size` bytes, aligned to ALIGNMENT
+    byte* acquire(size_t size);
+
+    // give back a buffer obtained from acquire(size)
+    void release(byte* buf, size_t size);
+
+    // cap for the memory of buffers in use and idle, 0 for none
+    void setLimit(size_t bytes);
+    size_t limit() const;
+
+    // whether the buffers in use have reached the cap
+    bool overLimit() const;
+
+    // have waiter notified once the buffers in use are under the cap again (right away if they are)
+    void notifyWhenAvailable(const std::shared_ptr<Waiter>& waiter);
+
+    Stats stats() const;
+
+    // size actually allocated for a request of `size` bytes
+    static size_t classSize(size_t size);
+
+private:
+    static byte* allocate(size_t size);
+    static void deallocate(byte* buf);
+    void trim();
+
+    bool underLimit() const { return !mLimit || mStats.inUseBytes < mLimit; }
+    void notifyWaiters(std::unique_lock<std::mutex>& lock);
+
+    mutable std::mutex mMutex;
+    std::map<size_t, std::vector<byte*>> mIdle;
+    size_t mLimit = 0;
+    Stats mStats;
+
+    // clients with downloads held back by the cap
+    std::vector<std::weak_ptr<Waiter>> mWaiters;
+};
+
 // outgoing HTTP request
 struct MEGA_API HttpReq
 {
@@ -391,13 +464,15 @@ struct MEGA_API HttpReq
         size_t start;
         size_t end;
 
-        http_buf_t(byte* b, size_t s, size_t e);  // takes ownership of the byte*, which must have been allocated with new[]
+        // takes ownership of the byte*, which must have been obtained from TransferBufferPool::acquire(capacity)
+        http_buf_t(byte* b, size_t s, size_t e, size_t capacity);
         ~http_buf_t();
         void swap(http_buf_t& other);
         bool isNull() const;
 
     private:
         byte* buf;
+        size_t capacity;
     };
 
     // give up ownership of the buffer for client to use.  The caller is the new owner of the http_buf_t, and the HttpReq no longer has the buffer or any info about it.
@@ -28,6 +28,7 @@
 #include "filefingerprint.h"
 #include "request.h"
 #include "transfer.h"
+#include "transferslot.h"
 #include "treeproc.h"
 #include "sharenodekeys.h"
 #include "account.h"
@@ -223,6 +224,9 @@ struct SyncdownContext
 {
     bool mBackupActionsPerformed = false;
     bool mBackupForeignChangeDetected = false;
+
+    // skip folders without syncdownDirty/syncdownDescendantDirty
+    bool mDirtyOnly = false;
 }; // SyncdownContext
 
 // Class to help with upload of file attributes
@@ -750,6 +754,7 @@ public:
     // start/stop/pause file transfer
     bool startxfer(direction_t, File*, TransferDbCommitter&, bool skipdupes, bool startfirst, bool donotpersist, VersioningOption, error* cause, int tag);
     void stopxfer(File* f, TransferDbCommitter* committer);
+    void stopxfer(LocalNode*, TransferDbCommitter* committer);
     void pausexfers(direction_t, bool pause, bool hard, TransferDbCommitter& committer);
 
     // maximum number of connections per transfer
@@ -778,6 +783,18 @@ public:
     // number of parallel connections per transfer (PUT/GET)
     unsigned char connections[2];
 
+    // adapt the connections in use and the request size of each non-raid transfer to its measured speed
+    // (connections[] becomes the upper bound)
+    bool adaptivetransferslots = false;
+
+    // serve downloads by copying local files with the same content, when one is known and verifies
+    bool localcopydownloads = false;
+    LocalContentIndex localcontentindex;
+
+    // start filling a fresh download's temporary file from a local copy of its content, on a worker
+    // thread while an active slot waits for it; false if there is no candidate copy
+    bool startLocalContentCopy(Transfer*);
+
     // helpfer function for preparing a putnodes call for new node
     error putnodes_prepareOneFile(NewNode* newnode, Node* parentNode, const char *utf8Name, const UploadToken& binaryUploadToken,
                                   const byte *theFileKey, const char *megafingerprint, const char *fingerprintOriginal,
@@ -1554,6 +1571,30 @@ public:
     // there is data to commit to the database when possible
     bool pendingsccommit;
 
+    // group commit: the commit due at an actionpacket scsn may be held back so that the next scsns
+    // share it, until sccommitgroupds deciseconds passed since the first of them or the transaction
+    // changed sccommitgrouprows rows (0: no limit). sccommitgroupds == 0 commits every scsn.
+    // Commits only ever happen at scsn boundaries, so the statecache and the nodes stay consistent.
+    dstime sccommitgroupds = 0;
+    uint64_t sccommitgrouprows = 0;
+
+    // scsns waiting for the next commit, and when the first of them arrived
+    unsigned sccommitgroupscsns = 0;
+    dstime sccommitgroupstart = 0;
+    std::chrono::steady_clock::time_point sccommitgroupsince;
+
+    // whether the scsns held back must be committed now
+    bool sccommitgroupdue();
+
+    // commit the statecache transaction and open the next one
+    void commitsc();
+
+    // an actionpacket scsn was applied: commit it, or hold it back for the next scsns to share
+    void scsncommit();
+
+    // commit the scsns held back once their window closed
+    void commitscgroup();
+
     // transfer cache table
     unique_ptr<DbTable> tctable;
 
@@ -1706,6 +1747,9 @@ public:
     // transfer list to manage the priority of transfers
     TransferList transferlist;
 
+    // decides how queued transfers of different app-defined groups share the transfer slots
+    unique_ptr<TransferScheduler> transferScheduler;
+
     // cached transfers (PUT/GET)
     transfer_multimap multi_cachedtransfers[2];
 
@@ -1870,6 +1914,14 @@ public:
     // scan required flag
     bool syncdownrequired;
 
+    // syncdown() only needs to visit subtrees marked by LocalNode::setSyncdownDirty()
+    bool syncdowndirty;
+
+    // last full syncdown() pass, and how often a pass for dirty subtrees is turned into a
+    // full one, in case some change was never marked
+    dstime syncdownfullds;
+    static const dstime SYNCDOWN_FULL_INTERVAL_DS = 3000;
+
     bool syncuprequired;
 
     // block local fs updates processing while locked ops are in progress
@@ -1950,7 +2002,10 @@ public:
 
     // start downloading/copy missing files, create missing directories
     bool syncdown(LocalNode*, LocalPath&, SyncdownContext& cxt);
-    bool syncdown(LocalNode*, LocalPath&);
+    bool syncdown(LocalNode*, LocalPath&, bool dirtyOnly = false);
+
+    // compare one linked folder with its remote node (dirty/descendantDirty: the marks taken for this pass)
+    bool syncdownfolder(LocalNode*, LocalPath&, SyncdownContext& cxt, bool dirty, bool descendantDirty);
 
     // move nodes to //bin/SyncDebris/yyyy-mm-dd/ or unlink directly
     void movetosyncdebris(Node*, bool unlink, bool canChangeVault);
@@ -2311,9 +2366,11 @@ public:
         CodeCounter::ScopeStats csResponseProcessingTime = { "cs batch response processing" };
         CodeCounter::ScopeStats csSuccessProcessingTime = { "cs batch received processing" };
         CodeCounter::ScopeStats scProcessingTime = { "sc processing" };
+        CodeCounter::ScopeStats notifyPurge = { "MegaClient_notifyPurge" };
         uint64_t transferStarts = 0, transferFinishes = 0;
         uint64_t transferTempErrors = 0, transferFails = 0;
         uint64_t prepwaitImmediate = 0, prepwaitZero = 0, prepwaitHttpio = 0, prepwaitFsaccess = 0, nonzeroWait = 0;
+        TransferSlotTuner::Stats transferSlotTuning;
         CodeCounter::DurationSum csRequestWaitTime;
         CodeCounter::DurationSum transfersActiveTime;
         std::string report(bool reset, HttpIO* httpio, Waiter* waiter, const RequestDispatcher& reqs);
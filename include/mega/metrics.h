@@ -0,0 +1,136 @@
+/**
+ * @file mega/metrics.h
+ * @brief Always-on registry of performance counters and latency histograms
+ *
+ * (c) 2013-2023 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "types.h"
+
+namespace mega {
+
+struct MetricsThreadShard;
+
+// Process-wide registry of named counters and latency histograms, cheap enough for hot paths
+// and available in every build (unlike the MEGA_MEASURE_CODE reports).
+// Every thread accumulates into its own shard of plain slots, so recording needs no lock and no
+// atomic read-modify-write; a snapshot sums the shards of running threads plus what exited threads left.
+// Instruments are named "<subsystem>_<what>", and registering a name twice returns the same instrument.
+// CodeCounter::ScopeStats registers a histogram for itself, so its ScopeTimers are recorded here too.
+class MEGA_API MetricsRegistry
+{
+public:
+    typedef uint32_t Id;
+    static const Id NONE = ~Id(0);
+
+    enum Kind { COUNTER, HISTOGRAM };
+
+    // bucket i counts durations under 2^i microseconds, the last bucket everything longer
+    static const unsigned HISTOGRAM_BUCKETS = 24;
+
+    // slots per thread shard: a counter takes one, a histogram its buckets plus count and sum
+    static const unsigned MAX_SLOTS = 2048;
+
+    static MetricsRegistry& instance();
+
+    Id counter(const std::string& name, const std::string& help = std::string());
+    Id histogram(const std::string& name, const std::string& help = std::string());
+
+    inline void add(Id id, uint64_t n = 1);
+    void recordDuration(Id id, std::chrono::steady_clock::duration d);
+
+    struct Metric
+    {
+        std::string name;
+        std::string help;
+        Kind kind = COUNTER;
+
+        // counter value, or number of samples for histograms
+        uint64_t count = 0;
+        uint64_t sumNanoseconds = 0;
+        uint64_t buckets[HISTOGRAM_BUCKETS] = {};
+    };
+
+    std::vector<Metric> snapshot();
+
+    // {"<name>":{"type":"counter","value":N}, "<name>":{"type":"histogram","count":N,"sum_us":N,"buckets":{"<le_us>":N,...}}}
+    std::string toJson();
+
+    // Prometheus text exposition format, names prefixed with "mega_"
+    std::string toPrometheus();
+
+    // times the enclosing scope into a histogram
+    class ScopedTimer
+    {
+        Id mId;
+        std::chrono::steady_clock::time_point mStart;
+    public:
+        explicit ScopedTimer(Id id) : mId(id), mStart(std::chrono::steady_clock::now()) { }
+        ~ScopedTimer() { MetricsRegistry::instance().recordDuration(mId, std::chrono::steady_clock::now() - mStart); }
+    };
+
+private:
+    struct Shard
+    {
+        std::atomic<uint64_t> slots[MAX_SLOTS];
+        Shard();
+    };
+
+    struct Instrument
+    {
+        std::string name;
+        std::string help;
+        Kind kind;
+        Id firstSlot;
+    };
+
+    // the calling thread's shard (see metrics.cpp)
+    friend struct MetricsThreadShard;
+
+    std::mutex mMutex;
+    std::vector<Instrument> mInstruments;
+    std::vector<Shard*> mShards;
+    Id mNextSlot = 0;
+
+    // totals carried over from threads that have exited
+    Shard mRetired;
+
+    MetricsRegistry() = default;
+    Id registerInstrument(const std::string& name, const std::string& help, Kind kind, unsigned slots);
+    Shard& threadShard();
+    void retire(Shard* shard);
+};
+
+// the owning thread is the only writer of its slots, so a relaxed load and store is enough
+inline void MetricsRegistry::add(Id id, uint64_t n)
+{
+    if (id != NONE)
+    {
+        std::atomic<uint64_t>& slot = threadShard().slots[id];
+        slot.store(slot.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+}
+
+} // namespace
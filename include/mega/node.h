@@ -30,7 +30,16 @@
 
 namespace mega {
 
-typedef map<LocalPath, LocalNode*> localnode_map;
+struct LocalPathCmp
+{
+    bool operator()(const LocalPath* a, const LocalPath* b) const
+    {
+        return *a < *b;
+    }
+};
+
+// keyed by the name each child holds itself, so it isn't stored twice
+typedef map<const LocalPath*, LocalNode*, LocalPathCmp> localnode_map;
 typedef map<const string*, Node*, StringCmp> remotenode_map;
 
 struct MEGA_API NodeCore
@@ -101,6 +110,10 @@ struct NodeCounter
     size_t versions = 0;
     void operator += (const NodeCounter&);
     void operator -= (const NodeCounter&);
+
+    // count a node itself, not its children: a file (or a version of one) or a folder
+    void addNode(nodetype_t type, m_off_t size, bool isVersion);
+
     std::string serialize() const;
     NodeCounter(const std::string& blob);
     NodeCounter() = default;
@@ -120,6 +133,32 @@ public:
 };
 typedef std::map<NodeHandle, NodeManagerNode>::iterator NodePosition;
 
+// Key and attributes of a node in a fetchnodes response, decrypted on a worker thread before
+// MegaClient::readnodes reaches the node. The subkey and the key that wraps it are picked with
+// the keys known when the node is queued, so Node::applykey() only uses the result if it would
+// pick the same ones, which keeps the outcome identical to decrypting inline.
+struct PrefetchedNodeKey
+{
+    // nodekeydata and attrstring as received
+    string keydata;
+    string attrstring;
+
+    // position of the chosen subkey within keydata, and the key it is decrypted with
+    size_t keyOffset = 0;
+    byte wrappingKey[SymmCipher::KEYLENGTH];
+    unsigned keyLength = 0;
+
+    bool keyDecrypted = false;
+    byte key[FILENODEKEYLENGTH];
+
+    // parsed attributes, if they could be decrypted with the key
+    bool attrsDecrypted = false;
+    AttrMap attrs;
+
+    // thread safe: only uses `sc` and the members above
+    void decrypt(SymmCipher& sc);
+};
+
 // filesystem node
 struct MEGA_API Node : public NodeCore, FileFingerprint
 {
@@ -146,8 +185,12 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     // Node's depth, counting from the cloud root.
     unsigned depth() const;
 
-    // try to resolve node key string
-    bool applykey();
+    // try to resolve node key string (`prefetched`, if it matches the key that would be used, saves the decryption)
+    bool applykey(PrefetchedNodeKey* prefetched = nullptr);
+
+    // locate the subkey in `keydata` that can be decrypted with the keys currently available, and the cipher for it
+    // (returns nullptr if no suitable key is available yet; `foreign` is set if it's a share key)
+    static const char* findkey(MegaClient& client, const string& keydata, SymmCipher*& sc, bool& foreign);
 
     // Returns false if the share key can't correctly decrypt the key and the
     // attributes of the node. Otherwise, it returns true. There are cases in
@@ -164,6 +207,15 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     // decrypt attribute string, set fileattrs and save fingerprint
     void setattr();
 
+    // same, with the attributes already decrypted and parsed by PrefetchedNodeKey::decrypt()
+    void setattr(PrefetchedNodeKey& prefetched);
+
+    // parse decrypted attributes (as returned by decryptattr) into `attrs`
+    static void parseattrjson(const char* decrypted, AttrMap& attrs);
+
+    // replace the attributes with freshly decrypted ones and clear attrstring
+    void setattrs(AttrMap& newAttrs);
+
     // display name (UTF-8)
     const char* displayname() const;
 
@@ -180,8 +232,15 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
     // checkPreview flag is only compatible with MimeType_t::MIME_TYPE_PHOTO
     bool isIncludedForMimetype(MimeType_t mimetype, bool checkPreview = false) const;
 
-    // node attributes
-    AttrMap attrs;
+    // node attributes (those of a node loaded from the DB are unpacked on first access)
+    AttrMap& attrs();
+    const AttrMap& attrs() const;
+
+    // value of a single attribute, or nullptr if not present, without unpacking the others
+    const string* attr(nameid name) const;
+
+    // names of the attributes present, in order, without unpacking them
+    vector<nameid> attrNames() const;
 
     static const vector<string> attributesToCopyIntoPreviousVersions;
 
@@ -258,6 +317,9 @@ struct MEGA_API Node : public NodeCore, FileFingerprint
         // this field also only used internally, for reporting new NO_KEY occurrences
         bool modifiedByThisClient : 1;
 
+        // internal: notified only because the counter changed, so only the counter is written to DB
+        bool counterOnly : 1;
+
     } changed;
 
 
@@ -387,6 +449,23 @@ private:
     // keeps track of counts of files, folder, versions, storage and version's storage
     NodeCounter mCounter;
 
+    mutable AttrMap mAttrs;
+
+    // attributes of a node loaded from the DB until attrs() is called.
+    // Attributes requested by attr() meanwhile are copied to mAttrs.
+    struct PackedAttrs
+    {
+        // as serialized by AttrMap
+        string data;
+
+        // names attr() didn't find, so the data isn't scanned for them again
+        vector<nameid> absent;
+    };
+    mutable unique_ptr<PackedAttrs> mPackedAttrs;
+
+    const char* packAttrs(const char* ptr, const char* end);
+    void unpackAttrs() const;
+
     static nameid getExtensionNameId(const std::string& ext);
 };
 
@@ -408,10 +487,23 @@ inline bool Node::keyApplied() const
 
 
 #ifdef ENABLE_SYNC
-struct MEGA_API LocalNode : public File
+// One per synced item, so its size matters for large syncs.
+// Most of it is still the File base (transfer state), which sync uploads use directly.
+struct MEGA_API LocalNode : public FileFingerprint
 {
     class Sync* sync = nullptr;
 
+    // normalized name (UTF-8 with unescaped special chars)
+    string name;
+
+    // local name within the parent folder (also read by the transfer and app threads, so guarded by File::localname_mutex)
+    LocalPath localname_multithreaded;
+    LocalPath getLocalname() const;
+    void setLocalname(const LocalPath&);
+
+    // upload in progress, if any - the transfer state only exists while the file is being sent
+    std::unique_ptr<SyncFilePut> upload;
+
     // parent linkage
     LocalNode* parent = nullptr;
 
@@ -430,11 +522,13 @@ struct MEGA_API LocalNode : public File
     // for botched filesystems with legacy secondary ("short") names
     // Filesystem notifications could arrive with long or short names, and we need to recognise which LocalNode corresponds.
     std::unique_ptr<LocalPath> slocalname;   // null means either the entry has no shortname or it's the same as the (normal) longname
-    localnode_map schildren;
+    std::unique_ptr<localnode_map> schildren;   // only allocated once a child has a shortname
+
+    // our key in the parent's children (the name is only changed while unlinked from it)
+    const LocalPath* childkey() const { return &localname_multithreaded; }
 
     // local filesystem node ID (inode...) for rename/move detection
     handle fsid = mega::UNDEF;
-    handlelocalnode_map::iterator fsid_it{};
 
     // related cloud node, if any
     crossref_ptr<Node, LocalNode> node;
@@ -451,6 +545,10 @@ struct MEGA_API LocalNode : public File
     // number of iterations since last seen
     int notseen = 0;
 
+    // folders: mtime and number of entries (excluded ones too) when last fully scanned (0: none)
+    uint32_t scanSnapshotEntries = 0;
+    m_time_t scanSnapshotMtime = 0;
+
     // global sync reference
     handle syncid = mega::UNDEF;
 
@@ -470,8 +568,20 @@ struct MEGA_API LocalNode : public File
 
         // set after the cloud node is created
         bool needsRescan : 1;
+
+        // children of this folder changed since the last syncdown() visit
+        bool syncdownDirty : 1;
+
+        // some descendant folder has syncdownDirty set
+        bool syncdownDescendantDirty : 1;
     };
 
+    // mark for the next syncdown() pass over dirty subtrees
+    void setSyncdownDirty();
+
+    // put back the marks a syncdown() pass took from this folder but did not get through
+    void restoreSyncdownDirty(bool dirty, bool descendantDirty);
+
     // current subtree sync state: current and displayed
     treestate_t ts = TREESTATE_NONE;
     treestate_t dts = TREESTATE_NONE;
@@ -486,6 +596,10 @@ struct MEGA_API LocalNode : public File
     dstime nagleds = 0;
     void bumpnagleds();
 
+    // like genfingerprint(), but while the file is still being written only its size and mtime
+    // are taken: the CRCs are left invalid until syncup() finds it stable
+    bool updatefingerprint(FileAccess*);
+
     // if delage > 0, own iterator inside MegaClient::localsyncnotseen
     localnode_set::iterator notseen_it{};
 
@@ -504,10 +618,6 @@ struct MEGA_API LocalNode : public File
     handle dirnotifytag = mega::UNDEF;
 #endif
 
-    void prepare(FileSystemAccess&) override;
-    void completed(Transfer*, putsource_t source) override;
-    void terminated(error e) override;
-
     void setnode(Node*);
 
     void setnotseen(int);
@@ -516,11 +626,36 @@ struct MEGA_API LocalNode : public File
     // fsidnodes is a map from fsid to LocalNode, keeping track of all fs ids.
     void setfsid(handle newfsid, handlelocalnode_map& fsidnodes);
 
+    // drop our fsid from fsidnodes, if we are the LocalNode it maps to
+    void unlinkfsid(handlelocalnode_map& fsidnodes);
+
     void setnameparent(LocalNode*, const LocalPath* newlocalpath, std::unique_ptr<LocalPath>);
 
     LocalNode(Sync*);
     void init(nodetype_t, LocalNode*, const LocalPath&, std::unique_ptr<LocalPath>);
 
+    // the sync state cache record: what serialize() stores, with handles in place of live links
+    struct CacheRecord
+    {
+        nodetype_t type = TYPE_UNKNOWN;
+        m_off_t size = 0;
+        handle fsid = mega::UNDEF;
+        uint32_t parent_dbid = 0;
+        handle nodehandle = mega::UNDEF;
+        string localname;           // platform encoded
+        string shortname;           // platform encoded, empty if none
+        bool shortnameInDb = true;
+        std::array<int32_t, 4> crc{};
+        m_time_t mtime = 0;
+        bool syncable = true;
+        bool crcStale = false;      // file still being written when stored: recompute the CRCs
+        m_time_t snapshotMtime = 0;
+        uint32_t snapshotEntries = 0;
+
+        void serialize(string*) const;
+        bool unserialize(const string&);
+    };
+
     bool serialize(string*) const override;
     static LocalNode* unserialize( Sync* sync, const string* sData );
 
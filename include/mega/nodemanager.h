@@ -284,8 +284,9 @@ private:
     // reads from DB and loads the node in memory
     Node* unserializeNode(const string*, bool fromOldCache);
 
-    // returns the counter for the specified node, calculating it recursively and accessing to DB if it's neccesary
-    NodeCounter calculateNodeCounter(const NodeHandle &nodehandle, nodetype_t parentType, Node *node, bool isInRubbish);
+    // calculate the counters (and DB flags) of the subtrees of the given roots, reading the nodes
+    // not in RAM from DB in one pass, and write them to DB
+    void calculateNodeCounters(const node_vector& roots);
 
     // Container storing FileFingerprint* (Node* in practice) ordered by fingerprint
     FingerprintContainer mFingerPrints;
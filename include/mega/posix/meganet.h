@@ -118,6 +118,27 @@ protected:
     std::map<string, CurlDNSEntry> dnscache;
     int pkpErrors;
 
+    // opt-in HTTP/2 multiplexing (see sethttp2): until it's configured, cURL defaults apply
+    bool http2configured = false;
+    bool http2 = false;
+    long http2MaxStreams = 100; // per connection: cURL opens another one to the same host when it is full
+    int http2ConsecutiveErrors = 0;
+    void sethttp2options(CURLM*);
+
+    // HTTP/2 stream errors in a row that make us fall back to HTTP/1.1
+    static const int HTTP2_MAX_CONSECUTIVE_ERRORS = 3;
+
+    struct ConnectionStats
+    {
+        uint64_t requests = 0;
+        uint64_t http2Requests = 0;
+        uint64_t newConnections = 0;
+        uint64_t reusedConnections = 0;
+        uint64_t http2Errors = 0;
+    };
+    ConnectionStats connectionStats;
+    void updateconnectionstats(CURL*, CURLcode);
+
     void send_pending_requests();
     void drop_pending_requests();
 
@@ -240,6 +261,8 @@ public:
 
     bool cacheresolvedurls(const std::vector<string>& urls, std::vector<string>&& ips) override;
 
+    bool sethttp2(bool enable, long maxStreamsPerConnection) override;
+
     CurlHttpIO();
     ~CurlHttpIO();
 
@@ -22,6 +22,9 @@
 #ifndef MEGA_SYNC_H
 #define MEGA_SYNC_H 1
 
+#include <unordered_map>
+#include <unordered_set>
+
 #include "db.h"
 
 #ifdef ENABLE_SYNC
@@ -47,6 +50,55 @@ int computeReversePathMatchScore(const LocalPath& path1, const LocalPath& path2,
 bool assignFilesystemIds(Sync& sync, MegaApp& app, FileSystemAccess& fsaccess, handlelocalnode_map& fsidnodes,
                          LocalPath& localdebris);
 
+// Name and path exclusion rules, compiled once so that each scanned entry costs
+// a few hash lookups instead of a wildcard match per rule and path component.
+class MEGA_API SyncExclusionMatcher
+{
+public:
+    SyncExclusionMatcher() = default;
+
+    // names are matched against each path component below the sync root, paths
+    // exclude themselves and their descendants (wildcards match the whole path)
+    SyncExclusionMatcher(const vector<string>& names, const vector<string>& paths);
+
+    // whether localpath, inside the sync rooted at root, is excluded.
+    // consecutive calls for entries of the same folder reuse the result for that folder.
+    bool excluded(const LocalPath& root, const LocalPath& localpath);
+
+    bool nameExcluded(const string& name) const;
+
+private:
+    // path below root: its own name or an exact path rule excludes it
+    bool componentExcluded(const LocalPath& path, const string& name) const;
+
+    // an exact path rule contains path
+    bool containedInPathRule(const LocalPath& path) const;
+
+    // path or any of its ancestors up to root (not checking root's name) is excluded
+    bool inheritedExcluded(const LocalPath& root, const LocalPath& path) const;
+
+    static string leafKey(const string& name);
+
+    // names: exact, "*suffix", "prefix*", anything else
+    std::unordered_set<string> mNames;
+    std::unordered_set<string> mNameSuffixes;
+    std::set<size_t> mNameSuffixLengths;
+    std::unordered_set<string> mNamePrefixes;
+    std::set<size_t> mNamePrefixLengths;
+    vector<string> mNamePatterns;
+
+    // paths without wildcards, indexed by leaf name (case folded where paths match case insensitively)
+    vector<LocalPath> mPaths;
+    std::unordered_multimap<string, size_t> mPathsByLeaf;
+    vector<size_t> mUnindexedPaths;
+    vector<string> mPathPatterns;
+
+    // result for the last folder whose entries were checked
+    LocalPath mLastRoot;
+    LocalPath mLastFolder;
+    bool mLastFolderExcluded = false;
+};
+
 class SyncConfig
 {
 public:
@@ -334,8 +386,16 @@ public:
     bool assignfsids();
 
     // scan items in specified path and add as children of the specified
-    // LocalNode
-    bool scan(LocalPath, FileAccess*);
+    // LocalNode (entries, if given, receives the number of items, excluded or not)
+    bool scan(LocalPath, FileAccess*, size_t* entries = nullptr);
+
+    // scan the folder of LocalNode l (fa: the open folder), recording its mtime and
+    // number of entries. while initializing, a folder that still matches that
+    // snapshot, with all of its entries known, only has the known ones checked.
+    bool scanfolder(LocalNode* l, const LocalPath&, FileAccess* fa);
+
+    // check the cached children of l as if they had been found by scan()
+    void scanknownentries(LocalNode* l, LocalPath);
 
     // rescan sequence number (incremented when a full rescan or a new
     // notification batch starts)
@@ -389,6 +449,7 @@ public:
     static const int EXTRA_SCANNING_DELAY_DS;
     static const int FILE_UPDATE_DELAY_DS;
     static const int FILE_UPDATE_MAX_DELAY_SECS;
+    static const int FINGERPRINT_SETTLE_SECS;
     static const dstime RECENT_VERSION_INTERVAL_SECS;
 
     // Change state to (DISABLED, BACKUP_MODIFIED).
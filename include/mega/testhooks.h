@@ -44,6 +44,7 @@ namespace mega {
     class DebugTestHook;
     struct Transfer;
     class TransferDbCommitter;
+    struct LocalNode;
 
     struct MegaTestHooks
     {
@@ -53,6 +54,8 @@ namespace mega {
         std::function<bool(Transfer*, TransferDbCommitter&)> onUploadChunkSucceeded;
         std::function<void(error e)> onDownloadFailed;
         std::function<void(std::unique_ptr<HttpReq>&)> interceptSCRequest;
+        std::function<void(LocalNode*)> onSyncdownFolder;
+        std::function<void(unsigned batchesInFlight)> onFolderUploadBatchSent;
     };
 
     extern MegaTestHooks globalMegaTestHooks;
@@ -76,6 +79,12 @@ namespace mega {
     // watch out for download issues
     #define DEBUG_TEST_HOOK_DOWNLOAD_FAILED(X)  { if (globalMegaTestHooks.onDownloadFailed) globalMegaTestHooks.onDownloadFailed(X); }
 
+    // see which folders syncdown() compares with the cloud
+    #define DEBUG_TEST_HOOK_SYNCDOWN_FOLDER(LOCALNODEPTR)  { if (globalMegaTestHooks.onSyncdownFolder) globalMegaTestHooks.onSyncdownFolder(LOCALNODEPTR); }
+
+    // see how many folder creation batches a folder upload keeps in flight
+    #define DEBUG_TEST_HOOK_FOLDER_UPLOAD_BATCH_SENT(INFLIGHT)  { if (globalMegaTestHooks.onFolderUploadBatchSent) globalMegaTestHooks.onFolderUploadBatchSent(INFLIGHT); }
+
 
 #else
     #define DEBUG_TEST_HOOK_HTTPREQ_POST(x)
@@ -83,6 +92,8 @@ namespace mega {
     #define DEBUG_TEST_HOOK_UPLOADCHUNK_FAILED(X)
     #define DEBUG_TEST_HOOK_UPLOADCHUNK_SUCCEEDED(transfer, committer)
     #define DEBUG_TEST_HOOK_DOWNLOAD_FAILED(X)
+    #define DEBUG_TEST_HOOK_SYNCDOWN_FOLDER(x)
+    #define DEBUG_TEST_HOOK_FOLDER_UPLOAD_BATCH_SENT(x)
 #endif
 
 
@@ -181,6 +181,91 @@ struct LazyEraseTransferPtr
     bool operator==(const LazyEraseTransferPtr& e) { return transfer && transfer == e.transfer; }
 };
 
+// Fair scheduling of queued transfers across groups defined by the app (eg. one per tenant or per folder).
+// Groups in a lower priority class are always served first. Within a class, groups share the dispatching
+// by weight, with start-time fair queueing on transfer size, so one group with a huge backlog can't
+// starve the others. Within a group, transfers are taken in TransferList order, so priorities and moves
+// keep their meaning. Until a group is configured, TransferList dispatches in plain list order.
+// Subclass and override groupOf() to map transfers to groups, and install it in MegaClient::transferScheduler.
+class MEGA_API TransferScheduler
+{
+public:
+    typedef uint32_t GroupId;
+
+    // cost of a transfer for fairness purposes is its size, bounded to these values:
+    // tiny transfers still cost something, and one huge transfer doesn't lock its group out for ages
+    static const m_off_t MIN_COST = 64 * 1024;
+    static const m_off_t MAX_COST = 256 * 1024 * 1024;
+
+    // queued transfers worth gathering per group and size type for one dispatch, as no more than
+    // MAXTRANSFERS / 2 are started in each direction at once
+    static const size_t MAX_READY_PER_GROUP = 16;
+
+    struct GroupStats
+    {
+        // queued transfers ready to start, and their bytes, as seen by the last dispatch
+        size_t queued = 0;
+        m_off_t queuedBytes = 0;
+
+        // transfers handed to dispatchTransfers, and their bytes
+        uint64_t dispatched = 0;
+        m_off_t dispatchedBytes = 0;
+    };
+
+    virtual ~TransferScheduler() = default;
+
+    // the group of a transfer. All transfers are in group 0 by default
+    virtual GroupId groupOf(Transfer*);
+
+    // configure the share of a group (weight > 0) and its priority class (lower classes are served first)
+    void setGroup(GroupId group, unsigned weight, unsigned priorityClass = 0);
+    void removeGroup(GroupId group);
+
+    // whether any group has been configured, ie. whether fair scheduling is in use
+    bool hasGroups() const { return !mConfigured.empty(); }
+
+    // the ready transfers of one group in one direction
+    struct Ready
+    {
+        // the first MAX_READY_PER_GROUP of each size type (indexed by filesizetype_t), in list order.
+        // Dispatch limits are per size type, so a type that's full doesn't hide the other
+        std::array<std::deque<Transfer*>, 2> bySize;
+
+        // all of the group's ready transfers, including those beyond the ones gathered
+        size_t queued = 0;
+        m_off_t queuedBytes = 0;
+
+        void add(Transfer*);
+    };
+    typedef std::map<GroupId, Ready> ReadyMap;
+
+    // pick the transfers for one direction from what each group has ready.
+    // accept() decides whether a candidate is taken (and is charged to its group), more() whether to go on
+    void choose(ReadyMap& ready,
+                const std::function<bool(Transfer*)>& accept,
+                const std::function<bool()>& more);
+
+    std::map<GroupId, GroupStats> groupStats() const;
+
+private:
+    struct Group
+    {
+        unsigned weight = 1;
+        unsigned priorityClass = 0;
+
+        // virtual time at which the group's next transfer starts
+        double finishTag = 0;
+
+        GroupStats stats;
+    };
+
+    std::set<GroupId> mConfigured;
+
+    // configured groups, plus the others while they have queued transfers
+    std::map<GroupId, Group> mGroups;
+    double mVirtualTime = 0;
+};
+
 class MEGA_API TransferList
 {
 public:
@@ -208,6 +293,8 @@ public:
     transfer_list::iterator begin(direction_t direction);
     transfer_list::iterator end(direction_t direction);
     bool getIterator(Transfer *transfer, transfer_list::iterator&, bool canHandleErasedElements = false);
+
+    // chooses the transfers to start next, per TransferCategory: in list order, or as per MegaClient::transferScheduler if it has groups
     std::array<vector<Transfer*>, 6> nexttransfers(std::function<bool(Transfer*)>& continuefunction,
 	                                               std::function<bool(direction_t)>& directionContinuefunction,
                                                    TransferDbCommitter& committer);
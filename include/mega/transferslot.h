@@ -46,6 +46,101 @@ public:
 
 class TransferDbCommitter;
 
+// Fills a download's temporary file from a local copy of its content (MegaClient::localcontentindex).
+// It runs on a worker thread while the slot waits, and the copy is only kept if its MAC matches the node's.
+struct MEGA_API LocalContentCopy
+{
+    // set before it is queued
+    vector<LocalPath> candidates;
+    LocalPath target;
+    m_off_t size = 0;
+    m_time_t mtime = 0;
+    std::array<byte, SymmCipher::KEYLENGTH> transferkey;
+    int64_t ctriv = 0;
+    int64_t metamac = 0;
+
+    // results, valid once finished is set
+    std::atomic<bool> finished{false};
+    bool verified = false;
+    LocalPath source;
+    FileSystemAccess::CopyMethod method = FileSystemAccess::COPY_NONE;
+
+    // candidates that no longer hold the content, to be dropped from the index
+    vector<LocalPath> rejected;
+
+    // set when the slot goes away first, so the copy is discarded
+    std::atomic<bool> abandoned{false};
+
+    void run(FileSystemAccess&, SymmCipher&);
+};
+
+// Adapts the number of connections in use and the request size of a (non-raid) transfer slot
+// to the throughput it achieves, by hill climbing: every evaluation period the windowed speed
+// is compared with the previous period's. A change that paid off is repeated, a change that
+// didn't is undone and the tuner holds for a while before probing again.
+// The slot still allocates its connections as per MegaClient::connections, which is the upper bound.
+class MEGA_API TransferSlotTuner
+{
+public:
+    // the windowed speed of SpeedController covers this period, so each evaluation only sees the effect of the last decision
+    static const dstime EVALUATION_PERIOD_DS = SpeedController::SPEED_MEAN_MAX_INTERVAL_DS;
+
+    // throughput changes below this percentage are considered noise
+    static const int SIGNIFICANT_CHANGE_PERCENT = 10;
+
+    // evaluations to wait after undoing a change, before probing again
+    static const unsigned HOLD_EVALUATIONS = 3;
+
+    // smallest request size the tuner will shrink to
+    static const m_off_t MIN_REQUEST_SIZE = 1024 * 1024;
+
+    struct Stats
+    {
+        uint64_t evaluations = 0;
+        uint64_t connectionIncreases = 0;
+        uint64_t connectionDecreases = 0;
+        uint64_t requestSizeIncreases = 0;
+        uint64_t requestSizeDecreases = 0;
+
+        void add(const Stats& other);
+    };
+
+    // start tuning, bounded by the given number of connections and request size
+    // tuneRequestSize is false for uploads, as their request size comes from the upload speed heuristic
+    void start(unsigned maxConnections, m_off_t maxRequestSize, bool tuneRequestSize, dstime now);
+
+    bool enabled() const { return mMaxConnections > 0; }
+
+    // re-evaluate with the latest windowed speed; returns true if the connections or request size changed
+    bool evaluate(m_off_t speed, dstime now);
+
+    unsigned activeConnections() const { return mActiveConnections; }
+    m_off_t requestSize() const { return mRequestSize; }
+    const Stats& stats() const { return mStats; }
+
+private:
+    enum Action { NONE, ADD_CONNECTION, REMOVE_CONNECTION, GROW_REQUEST, SHRINK_REQUEST };
+
+    // apply the action if within bounds; returns false if it can't be applied
+    bool apply(Action action);
+    static Action opposite(Action action);
+    Action nextProbe() const;
+
+    unsigned mMaxConnections = 0;
+    unsigned mActiveConnections = 0;
+    m_off_t mMaxRequestSize = 0;
+    m_off_t mRequestSize = 0;
+    bool mTuneRequestSize = false;
+
+    Action mLastAction = NONE;
+    m_off_t mLastSpeed = 0;
+    dstime mLastEvaluation = 0;
+    unsigned mHoldEvaluations = 0;
+    bool mProbeRequestSizeNext = false;
+
+    Stats mStats;
+};
+
 // active transfer
 struct MEGA_API TransferSlot
 {
@@ -97,6 +192,9 @@ struct MEGA_API TransferSlot
     vector<SpeedController> mReqSpeeds;
     SpeedController mTransferSpeed;
 
+    // adapts the connections in use and the request size to the measured speed, if MegaClient::adaptivetransferslots is set
+    TransferSlotTuner mTuner;
+
     // only swap channels twice for speed issues, to prevent endless non-progress (counter is reset if we make overall progress, ie data reassembled)
     unsigned mRaidChannelSwapsForSlowness = 0;
 
@@ -135,11 +233,15 @@ struct MEGA_API TransferSlot
     // transfer failure flag. MegaClient will increment the transfer->errorcount when it sees this set.
     bool failure;
 
+    // local copy of the content being made instead of downloading it, if any
+    std::shared_ptr<LocalContentCopy> mLocalCopy;
+
     TransferSlot(Transfer*);
     ~TransferSlot();
 
 private:
     void toggleport(HttpReqXfer* req);
+    void finishLocalContentCopy(MegaClient*, TransferDbCommitter&);
     bool checkDownloadTransferFinished(TransferDbCommitter& committer, MegaClient* client);
     bool checkMetaMacWithMissingLateEntries();
     bool tryRaidRecoveryFromHttpGetError(unsigned i, bool incrementErrors);
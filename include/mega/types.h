@@ -84,6 +84,7 @@ typedef unsigned char byte;
 #include <string>
 #include <chrono>
 #include <mutex>
+#include <unordered_map>
 
 namespace mega {
 
@@ -541,7 +542,7 @@ typedef enum { SYNCDEL_NONE, SYNCDEL_DELETED, SYNCDEL_INFLIGHT, SYNCDEL_BIN,
 
 typedef vector<LocalNode*> localnode_vector;
 
-typedef map<handle, LocalNode*> handlelocalnode_map;
+typedef std::unordered_map<handle, LocalNode*> handlelocalnode_map;
 
 typedef set<LocalNode*> localnode_set;
 
@@ -881,11 +882,18 @@ namespace CodeCounter
     // Some classes that allow us to easily measure the number of times a block of code is called, and the sum of the time it takes.
     // Only enabled if MEGA_MEASURE_CODE is turned on.
     // Usage generally doesn't need to be protected by the macro as the classes and methods will be empty when not enabled.
+    // Independently of that, each ScopeStats is a histogram in the MetricsRegistry (see metrics.h) that ScopeTimer feeds in every build,
+    // unless it is constructed with alwaysMeasured == false because the scope is too hot to pay for two clock reads.
 
     using namespace std::chrono;
 
+    const uint32_t NO_METRIC = ~uint32_t(0);
+    MEGA_API uint32_t registerScope(const std::string& name);
+    MEGA_API void recordScope(uint32_t metric, steady_clock::duration d);
+
     struct ScopeStats
     {
+        uint32_t metric;
 #ifdef MEGA_MEASURE_CODE
         uint64_t count = 0;
         uint64_t starts = 0;
@@ -893,7 +901,7 @@ namespace CodeCounter
         high_resolution_clock::duration timeSpent{};
         high_resolution_clock::duration longest{};
         std::string name;
-        ScopeStats(std::string s) : name(std::move(s)) {}
+        ScopeStats(std::string s, bool alwaysMeasured = true) : metric(alwaysMeasured ? registerScope(s) : NO_METRIC), name(std::move(s)) {}
 
         inline string report(bool reset = false)
         {
@@ -911,7 +919,7 @@ namespace CodeCounter
             return s;
         }
 #else
-        ScopeStats(std::string s) {}
+        ScopeStats(std::string s, bool alwaysMeasured = true) : metric(alwaysMeasured ? registerScope(s) : NO_METRIC) {}
 #endif
     };
 
@@ -938,41 +946,48 @@ namespace CodeCounter
 
     struct ScopeTimer
     {
-#ifdef MEGA_MEASURE_CODE
         ScopeStats& scope;
+        steady_clock::time_point metricStart;
+        bool done = false;
+#ifdef MEGA_MEASURE_CODE
         high_resolution_clock::time_point blockStart;
         high_resolution_clock::duration diff{};
-        bool done = false;
 
         ScopeTimer(ScopeStats& sm) : scope(sm), blockStart(high_resolution_clock::now())
         {
+            if (scope.metric != NO_METRIC) metricStart = steady_clock::now();
             ++scope.starts;
         }
-        ~ScopeTimer()
-        {
-            complete();
-        }
         high_resolution_clock::duration timeSpent()
         {
             return high_resolution_clock::now() - blockStart;
         }
+#else
+        ScopeTimer(ScopeStats& sm) : scope(sm)
+        {
+            if (scope.metric != NO_METRIC) metricStart = steady_clock::now();
+        }
+#endif
+        ~ScopeTimer()
+        {
+            complete();
+        }
         void complete()
         {
             // can be called early in which case the destructor's call is ignored
             if (!done)
             {
+                if (scope.metric != NO_METRIC) recordScope(scope.metric, steady_clock::now() - metricStart);
+#ifdef MEGA_MEASURE_CODE
                 ++scope.count;
                 ++scope.finishes;
                 diff = high_resolution_clock::now() - blockStart;
                 scope.timeSpent += diff;
                 if (diff > scope.longest) scope.longest = diff;
+#endif
                 done = true;
             }
         }
-#else
-        ScopeTimer(ScopeStats& sm) {}
-        void complete() {}
-#endif
     };
 }
 
@@ -703,6 +703,9 @@ struct MegaClientAsyncQueue
     void push(std::function<void(SymmCipher&)> f, bool discardable);
     void clearDiscardable();
 
+    // 0 if queued functions run synchronously
+    size_t threadCount() const { return mThreads.size(); }
+
     MegaClientAsyncQueue(Waiter& w, unsigned threadCount);
     ~MegaClientAsyncQueue();
 
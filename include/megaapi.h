@@ -9130,6 +9130,11 @@ class MegaApi
             TRANSFER_METHOD_AUTO_ALTERNATIVE = 4
         };
 
+        enum {
+            METRICS_FORMAT_JSON = 0,
+            METRICS_FORMAT_PROMETHEUS = 1
+        };
+
         enum {
             PUSH_NOTIFICATION_ANDROID = 1,
             PUSH_NOTIFICATION_IOS_VOIP = 2,
@@ -14751,6 +14756,117 @@ class MegaApi
          */
         void setMaxConnections(int connections, MegaRequestListener* listener = NULL);
 
+        /**
+         * @brief Enable or disable the adaptive tuning of transfers
+         *
+         * When enabled, each (non-raid) transfer adjusts the number of connections in use and,
+         * for downloads, the size of each request, following the throughput it is measuring.
+         * The maximum number of connections set by MegaApi::setMaxConnections becomes the upper
+         * limit. Only transfers started after this call are affected.
+         *
+         * The default value is false.
+         *
+         * @param enable True to enable the adaptive tuning, false to use fixed values
+         */
+        void setAdaptiveTransferTuning(bool enable);
+
+        /**
+         * @brief Enable or disable serving downloads from local copies of the same content
+         *
+         * When enabled, the SDK remembers where completed downloads and synced files are stored.
+         * A later download whose fingerprint matches one of them is served by copying that local
+         * file (a cheap clone where the filesystem supports it) instead of fetching it from MEGA.
+         * The copy is only used when its content matches the MAC of the file in the cloud;
+         * otherwise the download proceeds normally.
+         *
+         * The default value is false. Disabling it forgets the known local copies.
+         *
+         * @param enable True to serve downloads from local copies when possible
+         */
+        void setDownloadsFromLocalCopies(bool enable);
+
+        /**
+         * @brief Group the local cache commits of consecutive action packets
+         *
+         * By default, the local cache of the account is committed to disk after each batch
+         * of action packets (remote changes) is applied. With many remote changes, for example
+         * in folders shared with many active users, that means many small transactions, each
+         * one synced to disk.
+         *
+         * With a window set, a commit may be held back so that the batches that follow share
+         * it. The commit happens when \c windowMs milliseconds have passed since the first
+         * batch held back, or when \c maxRows rows of the cache have changed. Commits still
+         * happen only between batches, so the cache always reflects a consistent state. If the
+         * app exits within a window, the batches held back are fetched again from MEGA.
+         *
+         * The number of commits, batches and rows committed, and the delay of the commits, are
+         * reported by MegaApi::getPerformanceMetrics.
+         *
+         * @param windowMs Longest time to hold a commit back, in milliseconds. It is rounded up
+         * to tenths of a second. 0 (the default) commits after every batch.
+         * @param maxRows Commit once this many rows changed, regardless of the window. 0 means no limit.
+         */
+        void setActionPacketGroupCommit(int windowMs, int maxRows);
+
+        /**
+         * @brief Enable or disable HTTP/2 multiplexing of requests
+         *
+         * When enabled, HTTPS requests to the same host share HTTP/2 connections, instead of
+         * opening a connection per request. HTTP/2 is only negotiated over HTTPS: this covers API
+         * requests, and transfers only when they use HTTPS (see MegaApi::useHttpsOnly). Transfers
+         * over plain HTTP keep using HTTP/1.1 connections.
+         *
+         * \c maxStreamsPerConnection limits the requests in flight on each HTTP/2 connection, not
+         * per host: when a connection is full, a new one to the same host may be opened. Hosts
+         * that don't support HTTP/2 are still reached over HTTP/1.1, and the SDK falls back to
+         * HTTP/1.1 if HTTP/2 connections keep failing.
+         *
+         * When disabled, requests use HTTP/1.1. Until this function is called, the defaults
+         * of the network library apply.
+         *
+         * @param enable True to use HTTP/2, false to use HTTP/1.1
+         * @param maxStreamsPerConnection Maximum number of concurrent requests on each HTTP/2 connection
+         * @return False if the network library of the SDK doesn't support HTTP/2
+         */
+        bool setHttp2Multiplexing(bool enable, int maxStreamsPerConnection = 100);
+
+        /**
+         * @brief Limit the memory used by download buffers
+         *
+         * Downloads keep received data in buffers until it is written to disk. When the
+         * buffers in use reach this limit, no new requests are started for downloads until
+         * some data has been written. Cloudraid downloads aren't throttled.
+         *
+         * The default value is 0 (no limit).
+         *
+         * @param bytes Maximum memory for download buffers, in bytes. 0 to disable the limit.
+         */
+        void setTransferMemoryLimit(long long bytes);
+
+        /**
+         * @brief Get the performance metrics collected by the SDK
+         *
+         * The SDK keeps counters and latency histograms for its main operations (the client loop,
+         * transfer dispatching, database commits, node notifications, sync scans, encryption...).
+         * They are collected in every build, for all the MegaApi instances of the process, since
+         * it started.
+         *
+         * Valid formats are:
+         * - METRICS_FORMAT_JSON = 0
+         * A JSON object with one member per metric. Counters are {"type":"counter","value":N}.
+         * Histograms are {"type":"histogram","count":N,"sum_us":N,"buckets":{...}}, where each
+         * bucket is keyed by its upper bound in microseconds (not cumulative).
+         *
+         * - METRICS_FORMAT_PROMETHEUS = 1
+         * Prometheus text exposition format, with durations in seconds
+         *
+         * You take the ownership of the returned value
+         *
+         * @param format Format of the result
+         * @return The metrics in the requested format, or NULL if the format is not valid
+         */
+        char* getPerformanceMetrics(int format = METRICS_FORMAT_JSON);
+
         /**
          * @brief Set the transfer method for downloads
          *
@@ -18748,6 +18864,26 @@ class MegaApi
          */
         bool httpServerIsOfflineAttributeEnabled();
 
+        /**
+         * @brief Serve the performance metrics of the SDK at the /metrics path
+         *
+         * By default, it is not enabled
+         *
+         * When enabled, GET requests to /metrics receive the same data as
+         * MegaApi::getPerformanceMetrics with METRICS_FORMAT_PROMETHEUS, so that the
+         * app can be scraped by a Prometheus server.
+         *
+         * @param enable true to serve the metrics, false to disable it
+         */
+        void httpServerEnableMetrics(bool enable);
+
+        /**
+         * @brief Check if the performance metrics are served at the /metrics path
+         *
+         * @return true if the metrics are served, otherwise false
+         */
+        bool httpServerIsMetricsEnabled();
+
         /**
          * @brief Enable/disable the restricted mode of the HTTP server
          *
@@ -233,7 +233,7 @@ public:
     bool isCancelledByFolderTransferToken() const;
 
     // check if we have received onTransferFinishCallback for every transfersTotalCount
-    bool allSubtransfersResolved()              { return  transfersFinishedCount >= transfersTotalCount; }
+    bool allSubtransfersResolved()              { return  !mQueuingSubtransfers && transfersFinishedCount >= transfersTotalCount; }
 
     // setter/getter for transfersTotalCount
     void setTransfersTotalCount (size_t count)  { transfersTotalCount = count; }
@@ -268,6 +268,12 @@ protected:
     // flag to notify STAGE_TRANSFERRING_FILES to apps, when all sub-transfers have been queued in SDK core already
     bool startedTransferring = false;
 
+    // more sub-transfers may still be added to transfersTotalCount, so the operation can't complete yet
+    bool mQueuingSubtransfers = false;
+
+    // notify STAGE_TRANSFERRING_FILES once every sub-transfer has been queued and started
+    void checkAllSubtransfersStarted();
+
     // If the thread was started, it queues a completion before exiting
     // That will be executed when the queued request is procesed
     // We also keep a pointer to it here, so cancel() can execute it early.
@@ -335,6 +341,16 @@ protected:
         // Otherwise this is the record we will send to create this folder
         NewNode newnode;
 
+        // newnode was sent in a batch that hasn't completed yet
+        bool creationInFlight = false;
+
+        // files of this folder still to be fingerprinted by the worker threads
+        std::atomic<size_t> filesToFingerprint { 0 };
+
+        // all files are fingerprinted, and their transfers were queued (set on the MegaApiImpl's thread)
+        bool filesFingerprinted = false;
+        bool filesQueued = false;
+
         // files to upload to this folder
         struct FileRecord {
             LocalPath lp;
@@ -358,18 +374,71 @@ protected:
     /* Scan entire tree recursively, and retrieve folder structure and files to be uploaded.
      * A putnodes command can only add subtrees under same target, so in case we need to add
      * subtrees under different targets, this method will generate a subtree for each one.
+     * Files are only collected in `files`, fingerprintFiles() does the rest.
      * This happens on the worker thread.
      */
     enum scanFolder_result { scanFolder_succeeded, scanFolder_cancelled, scanFolder_failed };
-    scanFolder_result scanFolder(Tree& tree, LocalPath& localPath, uint32_t& foldercount, uint32_t& filecount);
+    scanFolder_result scanFolder(Tree& tree, LocalPath& localPath, uint32_t& foldercount, uint32_t& filecount, vector<Tree*>& folders);
+
+    // Fingerprint the files of the scanned folders on several threads, while the MegaApiImpl's thread creates the folders.
+    // Each folder is handed over to the MegaApiImpl's thread as soon as its files are done.
+    // Returns false if stopped or cancelled. This happens on the worker thread.
+    bool fingerprintFiles(const vector<Tree*>& folders, weak_ptr<MegaFolderUploadController> weak_this);
+
+    // folders whose files were fingerprinted, waiting for the MegaApiImpl's thread to pick them up
+    std::mutex mFingerprintedFoldersMutex;
+    vector<Tree*> mFingerprintedFolders;
+    void onFoldersFingerprinted();
+
+    // posted by the worker thread once the folder structure is known
+    shared_ptr<ExecuteOnce> mTreeReadyForMegaApiThread;
+    bool mTreeReady = false;
+
+    // the worker thread has finished (set on the MegaApiImpl's thread)
+    bool mScanComplete = false;
+
+    // all folders exist in the cloud
+    bool mFoldersCreated = false;
+
+    // files whose transfers were not started yet
+    size_t mFilesNotQueued = 0;
+
+    // folders that exist in the cloud and have all their files fingerprinted
+    vector<Tree*> mFoldersReady;
+
+    // complete() was called, or will be when the worker thread is done
+    bool mFinished = false;
+    bool mPendingCompletion = false;
+    Error mPendingError;
+    bool mPendingCancelledByUser = false;
+
+    // complete now, or once the worker thread has stopped
+    void completeWhenScanned(Error e, bool cancelledByUser = false);
+
+    // no more sub-transfers will be added: complete now, or when the last started one finishes
+    void finishQueuing(Error e, bool cancelledByUser = false);
+
+    // the file transfers of a folder can start once it exists in the cloud and its files are fingerprinted
+    void queueFolderFiles(Tree& tree);
+
+    // start the file transfers of the folders that became ready
+    void startReadyFileTransfers();
+
+    // stop queuing once every folder was created and every file was queued
+    void checkQueuingComplete();
 
     // Gathers up enough (but not too many) newnode records that are all descendants of a single folder
-    // and can be created in a single operation.
+    // and can be created in a single operation. Subtrees whose creation is in flight are skipped.
     // Called from the main thread just before we send the next set of folder creation commands.
-    enum batchResult { batchResult_cancelled, batchResult_requestSent, batchResult_batchesComplete, batchResult_stillRecursing };
-    batchResult createNextFolderBatch(Tree& tree, vector<NewNode>& newnodes, bool isBatchRootLevel);
+    enum batchResult { batchResult_cancelled, batchResult_requestSent, batchResult_batchesComplete, batchResult_stillRecursing, batchResult_waitingForBatches };
+    batchResult createNextFolderBatch(Tree& tree, vector<NewNode>& newnodes, vector<Tree*>& batchTrees, bool isBatchRootLevel);
+
+    // Keep up to MAX_FOLDER_BATCHES_IN_FLIGHT independent folder batches being created
+    static const unsigned MAX_FOLDER_BATCHES_IN_FLIGHT = 4;
+    unsigned mFolderBatchesInFlight = 0;
+    void sendFolderBatches();
 
-    // Iterate through all pending files of each uploaded folder, and start all upload transfers
+    // Add upload transfers for the files of one folder. Returns false if the folder transfer was cancelled
     bool genUploadTransfersForFiles(Tree& tree, TransferQueue& transferQueue);
 };
 
@@ -2739,6 +2808,12 @@ class MegaApiImpl : public MegaApp
         bool areTransfersPaused(int direction);
         void setUploadLimit(int bpslimit);
         void setMaxConnections(int direction, int connections, MegaRequestListener* listener = NULL);
+        void setAdaptiveTransferTuning(bool enable);
+        void setDownloadsFromLocalCopies(bool enable);
+        void setActionPacketGroupCommit(int windowMs, int maxRows);
+        bool setHttp2Multiplexing(bool enable, int maxStreamsPerConnection);
+        void setTransferMemoryLimit(long long bytes);
+        char* getPerformanceMetrics(int format);
         void setDownloadMethod(int method);
         void setUploadMethod(int method);
         bool setMaxDownloadSpeed(m_off_t bpslimit);
@@ -3075,6 +3150,8 @@ class MegaApiImpl : public MegaApp
         int httpServerGetRestrictedMode();
         bool httpServerIsLocalOnly();
         void httpServerEnableOfflineAttribute(bool enable);
+        void httpServerEnableMetrics(bool enable);
+        bool httpServerIsMetricsEnabled();
         void httpServerEnableSubtitlesSupport(bool enable);
         bool httpServerIsSubtitlesSupportEnabled();
 
@@ -3318,6 +3395,7 @@ private:
         bool httpServerEnableFiles;
         bool httpServerEnableFolders;
         bool httpServerOfflineAttributeEnabled;
+        bool httpServerMetricsEnabled;
         int httpServerRestrictedMode;
         bool httpServerSubtitlesSupportEnabled;
         set<MegaTransferListener *> httpServerListeners;
@@ -3362,6 +3440,10 @@ private:
         retryreason_t waitingRequest;
         vector<string> excludedNames;
         vector<string> excludedPaths;
+#ifdef ENABLE_SYNC
+        // excludedNames and excludedPaths, rebuilt whenever they change
+        SyncExclusionMatcher exclusionMatcher;
+#endif
         long long syncLowerSizeLimit;
         long long syncUpperSizeLimit;
         std::recursive_timed_mutex sdkMutex;
@@ -4060,6 +4142,7 @@ protected:
     bool fileServerEnabled;
     bool folderServerEnabled;
     bool offlineAttribute;
+    bool metricsEnabled;
     bool subtitlesSupportEnabled;
 
     //virtual methods:
@@ -4116,6 +4199,8 @@ public:
     bool isFolderServerEnabled();
     void enableOfflineAttribute(bool enable);
     bool isOfflineAttributeEnabled();
+    void enableMetrics(bool enable);
+    bool isMetricsEnabled();
     bool isSubtitlesSupportEnabled();
     void enableSubtitlesSupport(bool enable);
 
@@ -137,64 +137,268 @@ TimerWithBackoff::TimerWithBackoff(PrnGen &rng, int tag)
 }
 
 
-void BackoffTimerGroupTracker::update(dstime* waituntil, bool transfers)
+const int BackoffTimerGroupTracker::WHEEL_BITS;
+const int BackoffTimerGroupTracker::WHEEL_SLOTS;
+const int BackoffTimerGroupTracker::WHEEL_LEVELS;
+const int BackoffTimerGroupTracker::SLOT_DUE;
+const int BackoffTimerGroupTracker::SLOT_OVERFLOW;
+const int BackoffTimerGroupTracker::SLOT_NONE;
+
+// index of the lowest set bit of a non-zero mask
+static int lowestSlot(uint64_t mask)
 {
-    // This function performs a similar action as calling BackoffTimer::update for all the timers in the group,
-    // which is to say, the `waituntil` parameter will be updated with the soonest time that we would need to
-    // wake up from any of the timers in this group, should any of them be in a back-off state.
-    // There are also some side-effects specfic to transfers which are preserved from the old system.
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(mask);
+#else
+    int i = 0;
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
 
-    vector<BackoffTimerTracked*> v;
-    v.reserve(timeouts.size());
+BackoffTimerGroupTracker::BackoffTimerGroupTracker()
+    : mNow(0)
+    , mEarliest(NEVER)
+    , mEarliestValid(true)
+    , mCount(0)
+{
+    for (auto& s : mSlots)
+    {
+        s = nullptr;
+    }
 
-    if (transfers)
+    for (auto& o : mOccupied)
     {
-        for (auto t : timeouts)
+        o = 0;
+    }
+}
+
+// A deadline lives at the level of the highest 6-bit digit in which it differs from the wheel's current time.
+// Deadlines at or before the current time are due, and those differing above the top level overflow.
+int BackoffTimerGroupTracker::slotFor(dstime deadline) const
+{
+    if (deadline <= mNow)
+    {
+        return SLOT_DUE;
+    }
+
+    for (int level = 0; level < WHEEL_LEVELS; level++)
+    {
+        int shift = WHEEL_BITS * (level + 1);
+        if ((deadline >> shift) == (mNow >> shift))
         {
-            // put the ones to work on in a vector, as working on them changes their position in the map
-            if (t.first <= Waiter::ds)
-            {
-                v.push_back(t.second);
-            }
-            else
-            {
-                break;
-            }
+            return level * WHEEL_SLOTS + int((deadline >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+        }
+    }
+
+    return SLOT_OVERFLOW;
+}
+
+void BackoffTimerGroupTracker::link(BackoffTimerTracked* bt, int slot)
+{
+    bt->mWheelSlot = slot;
+    bt->mWheelPrev = nullptr;
+    bt->mWheelNext = mSlots[slot];
+    if (bt->mWheelNext)
+    {
+        bt->mWheelNext->mWheelPrev = bt;
+    }
+    mSlots[slot] = bt;
+
+    if (slot < SLOT_DUE)
+    {
+        mOccupied[slot / WHEEL_SLOTS] |= uint64_t(1) << (slot % WHEEL_SLOTS);
+    }
+
+    if (slot != SLOT_DUE && mEarliestValid && bt->mWheelDeadline < mEarliest)
+    {
+        mEarliest = bt->mWheelDeadline;
+    }
+}
+
+void BackoffTimerGroupTracker::unlink(BackoffTimerTracked* bt)
+{
+    int slot = bt->mWheelSlot;
+
+    if (bt->mWheelPrev)
+    {
+        bt->mWheelPrev->mWheelNext = bt->mWheelNext;
+    }
+    else
+    {
+        mSlots[slot] = bt->mWheelNext;
+    }
+
+    if (bt->mWheelNext)
+    {
+        bt->mWheelNext->mWheelPrev = bt->mWheelPrev;
+    }
+
+    if (slot < SLOT_DUE && !mSlots[slot])
+    {
+        mOccupied[slot / WHEEL_SLOTS] &= ~(uint64_t(1) << (slot % WHEEL_SLOTS));
+    }
+
+    if (slot != SLOT_DUE && bt->mWheelDeadline == mEarliest)
+    {
+        mEarliestValid = false;
+    }
+
+    bt->mWheelPrev = bt->mWheelNext = nullptr;
+    bt->mWheelSlot = SLOT_NONE;
+}
+
+void BackoffTimerGroupTracker::add(BackoffTimerTracked* bt)
+{
+    assert(bt->mWheelSlot == SLOT_NONE);
+    bt->mWheelDeadline = bt->nextset() ? bt->nextset() : NEVER;
+    link(bt, slotFor(bt->mWheelDeadline));
+    mCount++;
+}
+
+void BackoffTimerGroupTracker::remove(BackoffTimerTracked* bt)
+{
+    if (bt->mWheelSlot != SLOT_NONE)
+    {
+        unlink(bt);
+        mCount--;
+    }
+}
+
+// redistribute the timers of one slot after the wheel's time moved (they always leave the slot, except for overflow)
+void BackoffTimerGroupTracker::replaceSlot(int slot)
+{
+    BackoffTimerTracked* bt = mSlots[slot];
+    mSlots[slot] = nullptr;
+
+    if (slot < SLOT_DUE)
+    {
+        mOccupied[slot / WHEEL_SLOTS] &= ~(uint64_t(1) << (slot % WHEEL_SLOTS));
+    }
+
+    while (bt)
+    {
+        BackoffTimerTracked* next = bt->mWheelNext;
+        link(bt, slotFor(bt->mWheelDeadline));
+        bt = next;
+    }
+}
+
+void BackoffTimerGroupTracker::advance(dstime now)
+{
+    if (now <= mNow)
+    {
+        return;
+    }
+
+    // the highest digit that changes decides how much of the wheel has to be redistributed:
+    // lower levels are entirely in the past, and at that level only the slots up to the new digit
+    dstime changed = mNow ^ now;
+    int top = WHEEL_LEVELS;
+    if (!(changed >> (WHEEL_BITS * WHEEL_LEVELS)))
+    {
+        top = WHEEL_LEVELS - 1;
+        while (top > 0 && !((changed >> (WHEEL_BITS * top)) & (WHEEL_SLOTS - 1)))
+        {
+            top--;
         }
+    }
+
+    mNow = now;
 
-        for (auto t : v)
+    if (mEarliestValid && mEarliest <= now)
+    {
+        mEarliestValid = false;
+    }
+
+    for (int level = 0; level < WHEEL_LEVELS && level <= top; level++)
+    {
+        uint64_t mask = mOccupied[level];
+        if (level == top)
         {
-            t->update(waituntil);
-            if (t->armed())
-            {
-                // fire the timer only once but keeping it armed
-                t->set(0);
-                LOG_debug << "Disabling armed transfer backoff";
-            }
+            int digit = int((now >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1));
+            mask &= (digit == WHEEL_SLOTS - 1) ? ~uint64_t(0) : ((uint64_t(1) << (digit + 1)) - 1);
+        }
+
+        while (mask)
+        {
+            int s = lowestSlot(mask);
+            mask &= mask - 1;
+            replaceSlot(level * WHEEL_SLOTS + s);
         }
+    }
 
+    if (top == WHEEL_LEVELS && mSlots[SLOT_OVERFLOW])
+    {
+        replaceSlot(SLOT_OVERFLOW);
     }
-    else
+}
+
+dstime BackoffTimerGroupTracker::nextTimeout()
+{
+    if (!mEarliestValid)
     {
-        // put the ones to work on in a vector, as working on them changes their position in the map
-        for (auto t : timeouts)
+        // the lowest occupied level holds the soonest timers, and its first occupied slot covers the earliest of them
+        BackoffTimerTracked* bt = mSlots[SLOT_OVERFLOW];
+        for (int level = 0; level < WHEEL_LEVELS; level++)
         {
-            if (t.second->armed())
+            if (mOccupied[level])
             {
-                v.push_back(t.second);
+                bt = mSlots[level * WHEEL_SLOTS + lowestSlot(mOccupied[level])];
+                break;
             }
-            if (t.first > Waiter::ds)
+        }
+
+        mEarliest = NEVER;
+        for (; bt; bt = bt->mWheelNext)
+        {
+            if (bt->mWheelDeadline < mEarliest)
             {
-                break;
+                mEarliest = bt->mWheelDeadline;
             }
         }
+        mEarliestValid = true;
+    }
+
+    return mEarliest;
+}
 
-        for (auto t : v)
+void BackoffTimerGroupTracker::update(dstime* waituntil, bool transfers)
+{
+    // This function performs a similar action as calling BackoffTimer::update for all the timers in the group,
+    // which is to say, the `waituntil` parameter will be updated with the soonest time that we would need to
+    // wake up from any of the timers in this group, should any of them be in a back-off state.
+    // There are also some side-effects specfic to transfers which are preserved from the old system.
+
+    advance(Waiter::ds);
+
+    // put the ones to work on in a vector, as working on them changes their position in the wheel
+    vector<BackoffTimerTracked*> v;
+    for (BackoffTimerTracked* bt = mSlots[SLOT_DUE]; bt; bt = bt->mWheelNext)
+    {
+        v.push_back(bt);
+    }
+
+    for (auto t : v)
+    {
+        // update may set next=1 so we can't just call the first one.
+        t->update(waituntil);
+        if (transfers && t->armed())
         {
-            // update may set next=1 so we can't just call the first one.
-            t->update(waituntil);
+            // fire the timer only once but keeping it armed
+            t->set(0);
+            LOG_debug << "Disabling armed transfer backoff";
         }
+    }
 
+    dstime next = nextTimeout();
+    if (next < *waituntil)
+    {
+        *waituntil = next;
     }
 }
 
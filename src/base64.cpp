@@ -22,70 +22,381 @@
 #include "mega/base64.h"
 #include "mega/utils.h"
 
+#include <atomic>
+#include <cstring>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define MEGA_BASE64_X86 1
+#include <immintrin.h>
+#define MEGA_TARGET_SSSE3 __attribute__((target("ssse3")))
+#define MEGA_TARGET_AVX2 __attribute__((target("avx2")))
+#elif defined(__aarch64__)
+#define MEGA_BASE64_NEON 1
+#include <arm_neon.h>
+#endif
+
 namespace mega {
-// modified base64 conversion (no trailing '=' and '-_' instead of '+/')
-unsigned char Base64::to64(byte c)
+
+namespace {
+
+const char kEncode[65] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// 6-bit value of each character, 255 for those that end the input ('+' and '/' are accepted too)
+constexpr byte kDecode[256] = {
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,  62, 255,  62, 255,  63,
+     52,  53,  54,  55,  56,  57,  58,  59,  60,  61, 255, 255, 255, 255, 255, 255,
+    255,   0,   1,   2,   3,   4,   5,   6,   7,   8,   9,  10,  11,  12,  13,  14,
+     15,  16,  17,  18,  19,  20,  21,  22,  23,  24,  25, 255, 255, 255, 255,  63,
+    255,  26,  27,  28,  29,  30,  31,  32,  33,  34,  35,  36,  37,  38,  39,  40,
+     41,  42,  43,  44,  45,  46,  47,  48,  49,  50,  51, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255,
+    255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255, 255
+};
+
+// The vector kernels below only handle whole blocks of valid characters, and leave the end of
+// the input (and whatever follows the first invalid character) to the scalar code.
+// Encoders return the number of input bytes consumed, decoders the number of characters consumed.
+
+#ifdef MEGA_BASE64_X86
+
+// 12 input bytes (in a 16 byte load) to 16 characters
+MEGA_TARGET_SSSE3 inline __m128i encodeBlock(__m128i in)
 {
-    c &= 63;
+    in = _mm_shuffle_epi8(in, _mm_setr_epi8(1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10));
 
-    if (c < 26)
+    // 6-bit indices, one per byte
+    __m128i t0 = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i t1 = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(t0, t1);
+
+    // offset to add to each index: 0 for A-Z, 13 for a-z, 1..12 for the rest
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+
+    const __m128i offsets = _mm_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+
+    return _mm_add_epi8(_mm_shuffle_epi8(offsets, range), indices);
+}
+
+// 16 characters to their 6-bit values, `valid` gets 0xFF for the characters in the alphabet
+MEGA_TARGET_SSSE3 inline __m128i decodeValues(__m128i in, __m128i& valid)
+{
+    // signed comparisons: bytes above 0x7F are negative and never in range
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(in, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(in, _mm_set1_epi8('9' + 1)));
+    __m128i is62 = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('-')), _mm_cmpeq_epi8(in, _mm_set1_epi8('+')));
+    __m128i is63 = _mm_or_si128(_mm_cmpeq_epi8(in, _mm_set1_epi8('_')), _mm_cmpeq_epi8(in, _mm_set1_epi8('/')));
+
+    valid = _mm_or_si128(_mm_or_si128(_mm_or_si128(upper, lower), digit), _mm_or_si128(is62, is63));
+
+    __m128i shift = _mm_or_si128(_mm_or_si128(
+        _mm_and_si128(upper, _mm_set1_epi8(static_cast<char>(-'A'))),
+        _mm_and_si128(lower, _mm_set1_epi8(static_cast<char>(26 - 'a')))),
+        _mm_and_si128(digit, _mm_set1_epi8(static_cast<char>(52 - '0'))));
+
+    __m128i values = _mm_andnot_si128(_mm_or_si128(is62, is63), _mm_add_epi8(in, shift));
+    return _mm_or_si128(values, _mm_or_si128(_mm_and_si128(is62, _mm_set1_epi8(62)), _mm_and_si128(is63, _mm_set1_epi8(63))));
+}
+
+// 16 6-bit values to 12 bytes, in the low bytes of the result
+MEGA_TARGET_SSSE3 inline __m128i packValues(__m128i values)
+{
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    return _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+}
+
+MEGA_TARGET_SSSE3 size_t encodeSsse3(const byte* b, size_t blen, char* a)
+{
+    size_t i = 0;
+    for (; i + 16 <= blen; i += 12, a += 16)
     {
-        return static_cast<unsigned char>(c + 'A');
+        __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(a), encodeBlock(in));
     }
+    return i;
+}
 
-    if (c < 52)
+MEGA_TARGET_SSSE3 size_t decodeSsse3(const char* a, size_t alen, byte* b, size_t blen)
+{
+    size_t i = 0;
+    for (; i + 16 <= alen && i / 4 * 3 + 16 <= blen; i += 16)
     {
-        return static_cast<unsigned char>(c - 26 + 'a');
+        __m128i valid;
+        __m128i values = decodeValues(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)), valid);
+        if (_mm_movemask_epi8(valid) != 0xFFFF)
+        {
+            break;
+        }
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i / 4 * 3), packValues(values));
     }
+    return i;
+}
 
-    if (c < 62)
+// the AVX2 versions run the same steps on two blocks at once, one per 128-bit lane
+MEGA_TARGET_AVX2 size_t encodeAvx2(const byte* b, size_t blen, char* a)
+{
+    const __m256i shuffle = _mm256_setr_epi8(
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+        1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10);
+    const __m256i offsets = _mm256_setr_epi8(
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0,
+        'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+        '0' - 52, '0' - 52, '0' - 52, '-' - 62, '_' - 63, 'A', 0, 0);
+
+    size_t i = 0;
+    for (; i + 28 <= blen; i += 24, a += 32)
     {
-        return static_cast<unsigned char>(c - 52 + '0');
+        __m256i in = _mm256_inserti128_si256(
+            _mm256_castsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i))),
+            _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i + 12)), 1);
+        in = _mm256_shuffle_epi8(in, shuffle);
+
+        __m256i t0 = _mm256_mulhi_epu16(_mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00)), _mm256_set1_epi32(0x04000040));
+        __m256i t1 = _mm256_mullo_epi16(_mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0)), _mm256_set1_epi32(0x01000010));
+        __m256i indices = _mm256_or_si256(t0, t1);
+
+        __m256i range = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+        range = _mm256_or_si256(range, _mm256_and_si256(_mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices), _mm256_set1_epi8(13)));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(a), _mm256_add_epi8(_mm256_shuffle_epi8(offsets, range), indices));
+    }
+    return i;
+}
+
+MEGA_TARGET_AVX2 size_t decodeAvx2(const char* a, size_t alen, byte* b, size_t blen)
+{
+    size_t i = 0;
+    for (; i + 32 <= alen && i / 4 * 3 + 32 <= blen; i += 32)
+    {
+        __m256i in = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+
+        __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), in));
+        __m256i lower = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), in));
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(in, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), in));
+        __m256i is62 = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('-')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('+')));
+        __m256i is63 = _mm256_or_si256(_mm256_cmpeq_epi8(in, _mm256_set1_epi8('_')), _mm256_cmpeq_epi8(in, _mm256_set1_epi8('/')));
+
+        __m256i valid = _mm256_or_si256(_mm256_or_si256(_mm256_or_si256(upper, lower), digit), _mm256_or_si256(is62, is63));
+        if (_mm256_movemask_epi8(valid) != -1)
+        {
+            break;
+        }
+
+        __m256i shift = _mm256_or_si256(_mm256_or_si256(
+            _mm256_and_si256(upper, _mm256_set1_epi8(static_cast<char>(-'A'))),
+            _mm256_and_si256(lower, _mm256_set1_epi8(static_cast<char>(26 - 'a')))),
+            _mm256_and_si256(digit, _mm256_set1_epi8(static_cast<char>(52 - '0'))));
+
+        __m256i values = _mm256_andnot_si256(_mm256_or_si256(is62, is63), _mm256_add_epi8(in, shift));
+        values = _mm256_or_si256(values, _mm256_or_si256(_mm256_and_si256(is62, _mm256_set1_epi8(62)), _mm256_and_si256(is63, _mm256_set1_epi8(63))));
+
+        __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+        merged = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+        merged = _mm256_shuffle_epi8(merged, _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        // bring the 12 bytes of each lane together
+        merged = _mm256_permutevar8x32_epi32(merged, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(b + i / 4 * 3), merged);
     }
+    return i;
+}
+
+#endif // MEGA_BASE64_X86
 
-    if (c == 62)
+#ifdef MEGA_BASE64_NEON
+
+// 48 input bytes to 64 characters
+size_t encodeNeon(const byte* b, size_t blen, char* a)
+{
+    const uint8_t* table = reinterpret_cast<const uint8_t*>(kEncode);
+    uint8x16x4_t lookup;
+    lookup.val[0] = vld1q_u8(table);
+    lookup.val[1] = vld1q_u8(table + 16);
+    lookup.val[2] = vld1q_u8(table + 32);
+    lookup.val[3] = vld1q_u8(table + 48);
+    const uint8x16_t mask = vdupq_n_u8(63);
+
+    size_t i = 0;
+    for (; i + 48 <= blen; i += 48, a += 64)
     {
-        return '-';
+        uint8x16x3_t in = vld3q_u8(b + i);
+        uint8x16x4_t out;
+        out.val[0] = vqtbl4q_u8(lookup, vshrq_n_u8(in.val[0], 2));
+        out.val[1] = vqtbl4q_u8(lookup, vandq_u8(vorrq_u8(vshlq_n_u8(in.val[0], 4), vshrq_n_u8(in.val[1], 4)), mask));
+        out.val[2] = vqtbl4q_u8(lookup, vandq_u8(vorrq_u8(vshlq_n_u8(in.val[1], 2), vshrq_n_u8(in.val[2], 6)), mask));
+        out.val[3] = vqtbl4q_u8(lookup, vandq_u8(in.val[2], mask));
+        vst4q_u8(reinterpret_cast<uint8_t*>(a), out);
     }
+    return i;
+}
 
-    return '_';
+// 16 characters to their 6-bit values, `valid` gets 0xFF for the characters in the alphabet
+inline uint8x16_t decodeValuesNeon(uint8x16_t in, uint8x16_t& valid)
+{
+    uint8x16_t upper = vandq_u8(vcgeq_u8(in, vdupq_n_u8('A')), vcleq_u8(in, vdupq_n_u8('Z')));
+    uint8x16_t lower = vandq_u8(vcgeq_u8(in, vdupq_n_u8('a')), vcleq_u8(in, vdupq_n_u8('z')));
+    uint8x16_t digit = vandq_u8(vcgeq_u8(in, vdupq_n_u8('0')), vcleq_u8(in, vdupq_n_u8('9')));
+    uint8x16_t is62 = vorrq_u8(vceqq_u8(in, vdupq_n_u8('-')), vceqq_u8(in, vdupq_n_u8('+')));
+    uint8x16_t is63 = vorrq_u8(vceqq_u8(in, vdupq_n_u8('_')), vceqq_u8(in, vdupq_n_u8('/')));
+
+    valid = vorrq_u8(vorrq_u8(vorrq_u8(upper, lower), digit), vorrq_u8(is62, is63));
+
+    uint8x16_t values = vandq_u8(upper, vsubq_u8(in, vdupq_n_u8('A')));
+    values = vorrq_u8(values, vandq_u8(lower, vsubq_u8(in, vdupq_n_u8('a' - 26))));
+    values = vorrq_u8(values, vandq_u8(digit, vaddq_u8(in, vdupq_n_u8(52 - '0'))));
+    values = vorrq_u8(values, vandq_u8(is62, vdupq_n_u8(62)));
+    return vorrq_u8(values, vandq_u8(is63, vdupq_n_u8(63)));
 }
 
-unsigned char Base64::from64(byte c)
+// 64 characters to 48 bytes
+size_t decodeNeon(const char* a, size_t alen, byte* b, size_t blen)
 {
-    if ((c >= 'A') && (c <= 'Z'))
+    size_t i = 0;
+    for (; i + 64 <= alen && i / 4 * 3 + 48 <= blen; i += 64)
     {
-        return static_cast<unsigned char>(c - 'A');
+        uint8x16x4_t in = vld4q_u8(reinterpret_cast<const uint8_t*>(a + i));
+        uint8x16_t valid0, valid1, valid2, valid3;
+        uint8x16_t v0 = decodeValuesNeon(in.val[0], valid0);
+        uint8x16_t v1 = decodeValuesNeon(in.val[1], valid1);
+        uint8x16_t v2 = decodeValuesNeon(in.val[2], valid2);
+        uint8x16_t v3 = decodeValuesNeon(in.val[3], valid3);
+
+        if (vminvq_u8(vandq_u8(vandq_u8(valid0, valid1), vandq_u8(valid2, valid3))) != 0xFF)
+        {
+            break;
+        }
+
+        uint8x16x3_t out;
+        out.val[0] = vorrq_u8(vshlq_n_u8(v0, 2), vshrq_n_u8(v1, 4));
+        out.val[1] = vorrq_u8(vshlq_n_u8(v1, 4), vshrq_n_u8(v2, 2));
+        out.val[2] = vorrq_u8(vshlq_n_u8(v2, 6), v3);
+        vst3q_u8(b + i / 4 * 3, out);
     }
+    return i;
+}
 
-    if ((c >= 'a') && (c <= 'z'))
+#endif // MEGA_BASE64_NEON
+
+Base64::Simd detectSimd()
+{
+#if defined(MEGA_BASE64_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+    {
+        return Base64::SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("ssse3"))
     {
-        return static_cast<unsigned char>(c - 'a' + 26);
+        return Base64::SIMD_SSSE3;
     }
+#elif defined(MEGA_BASE64_NEON)
+    return Base64::SIMD_NEON;
+#endif
+    return Base64::SIMD_NONE;
+}
+
+std::atomic<int>& currentSimd()
+{
+    static std::atomic<int> level(Base64::bestSimd());
+    return level;
+}
 
-    if ((c >= '0') && (c <= '9'))
+size_t encodeBlocks(const byte* b, size_t blen, char* a)
+{
+    switch (Base64::simd())
     {
-        return static_cast<unsigned char>(c - '0' + 52);
+#ifdef MEGA_BASE64_X86
+        case Base64::SIMD_AVX2:
+            return encodeAvx2(b, blen, a);
+        case Base64::SIMD_SSSE3:
+            return encodeSsse3(b, blen, a);
+#endif
+#ifdef MEGA_BASE64_NEON
+        case Base64::SIMD_NEON:
+            return encodeNeon(b, blen, a);
+#endif
+        default:
+            return 0;
     }
+}
 
-    if (c == '-' || c == '+')
+size_t decodeBlocks(const char* a, size_t alen, byte* b, size_t blen)
+{
+    switch (Base64::simd())
     {
-        return static_cast<unsigned char>(62);
+#ifdef MEGA_BASE64_X86
+        case Base64::SIMD_AVX2:
+            return decodeAvx2(a, alen, b, blen);
+        case Base64::SIMD_SSSE3:
+            return decodeSsse3(a, alen, b, blen);
+#endif
+#ifdef MEGA_BASE64_NEON
+        case Base64::SIMD_NEON:
+            return decodeNeon(a, alen, b, blen);
+#endif
+        default:
+            return 0;
     }
+}
+
+// below this, the vector kernels have nothing to do
+const int MIN_SIMD_BYTES = 12;
+
+} // anonymous
+
+Base64::Simd Base64::bestSimd()
+{
+    static const Simd best = detectSimd();
+    return best;
+}
+
+Base64::Simd Base64::simd()
+{
+    return static_cast<Simd>(currentSimd().load(std::memory_order_relaxed));
+}
 
-    if (c == '_' || c == '/')
+bool Base64::setSimd(Simd level)
+{
+    Simd best = bestSimd();
+    if (level != SIMD_NONE && level != best && !(best == SIMD_AVX2 && level == SIMD_SSSE3))
     {
-        return static_cast<unsigned char>(63);
+        return false;
     }
+    currentSimd().store(level, std::memory_order_relaxed);
+    return true;
+}
+
+// modified base64 conversion (no trailing '=' and '-_' instead of '+/')
+unsigned char Base64::to64(byte c)
+{
+    return static_cast<unsigned char>(kEncode[c & 63]);
+}
 
-    return static_cast<unsigned char>(255);
+unsigned char Base64::from64(byte c)
+{
+    return kDecode[c];
 }
 
 
 int Base64::atob(const string &in, string &out)
 {
     out.resize(in.size() * 3 / 4 + 3);
-    out.resize(Base64::atob(in.data(), (byte *) out.data(), (int)out.size()));
+    out.resize(Base64::decode(in.data(), in.size(), (byte *) out.data(), (int)out.size()));
 
     return (int)out.size();
 }
@@ -94,25 +405,46 @@ std::string Base64::atob(const std::string &in)
 {
     string out;
     out.resize(in.size() * 3 / 4 + 3);
-    out.resize(Base64::atob(in.data(), (byte *) out.data(), (int)out.size()));
+    out.resize(Base64::decode(in.data(), in.size(), (byte *) out.data(), (int)out.size()));
 
     return out;
 }
 
 int Base64::atob(const char* a, byte* b, int blen)
+{
+    if (blen < MIN_SIMD_BYTES)
+    {
+        return decode(a, SIZE_MAX, b, blen);
+    }
+
+    // the characters that can contribute to `blen` bytes, so the vector kernels never read beyond
+    // what the caller expects to be decoded (or beyond the terminating NUL)
+    return decode(a, strnlen(a, size_t(blen + 2) / 3 * 4), b, blen);
+}
+
+// decodes the characters before `alen` (those after it are taken as invalid)
+int Base64::decode(const char* a, size_t alen, byte* b, int blen)
 {
     byte c[4]={};
     int i;
     int p = 0;
+    size_t pos = 0;
+
+    if (blen >= MIN_SIMD_BYTES && alen != SIZE_MAX)
+    {
+        pos = decodeBlocks(a, alen, b, size_t(blen));
+        p = int(pos / 4 * 3);
+    }
 
     for (;;)
     {
         for (i = 0; i < 4; i++)
         {
-            if ((c[i] = from64(*a++)) == 255)
+            if ((c[i] = pos < alen ? kDecode[static_cast<byte>(a[pos])] : 255) == 255)
             {
                 break;
             }
+            pos++;
         }
 
         if ((p >= blen) || !i)
@@ -223,6 +555,14 @@ int Base64::btoa(const byte* b, int blen, char* a)
 {
     int p = 0;
 
+    if (blen >= MIN_SIMD_BYTES)
+    {
+        size_t done = encodeBlocks(b, size_t(blen), a);
+        b += done;
+        blen -= int(done);
+        p = int(done / 3 * 4);
+    }
+
     for (;;)
     {
         if (blen <= 0)
@@ -123,7 +123,7 @@ bool CommandPutFA::procresult(Result r, JSON& json)
             Base64::btoa((const byte*)&client->me, MegaClient::USERHANDLE, me64);
 
             if (n && client->checkaccess(n, FULL) &&
-                    (n->attrs.map.find('f') == n->attrs.map.end() || n->attrs.map['f'] != me64) )
+                    (n->attrs().map.find('f') == n->attrs().map.end() || n->attrs().map['f'] != me64) )
             {
                 LOG_debug << "Restoration of file attributes is not allowed for current user (" << me64 << ").";
 
@@ -937,7 +937,7 @@ CommandSetAttr::CommandSetAttr(MegaClient* client, Node* n, SymmCipher* cipher,
 
     string at;
 
-    n->attrs.getjson(&at);
+    n->attrs().getjson(&at);
     client->makeattr(cipher, &at, at.c_str(), int(at.size()));
 
     arg("n", (byte*)&n->nodehandle, MegaClient::NODEHANDLE);
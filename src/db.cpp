@@ -19,6 +19,9 @@
  * program.
  */
 
+#include <array>
+#include <condition_variable>
+
 #include "mega/db.h"
 #include "mega/utils.h"
 #include "mega/logging.h"
@@ -91,6 +94,115 @@ bool DbTable::next(uint32_t* type, string* data, SymmCipher* key)
     return false;
 }
 
+bool DbTable::nextBatch(std::vector<std::pair<uint32_t, string>>& records, size_t maxRecords)
+{
+    records.clear();
+
+    uint32_t id;
+    string data;
+    while (records.size() < maxRecords && next(&id, &data))
+    {
+        records.emplace_back(id, std::move(data));
+    }
+
+    return !records.empty();
+}
+
+bool DbTable::nextAllDecrypted(MegaClientAsyncQueue& queue, SymmCipher* key, std::function<bool(uint32_t, string&)> apply)
+{
+    // A batch is decrypted by the worker threads while the next one is read from the table,
+    // and is then applied on this thread. The batch outlives us if a worker is still on it.
+    struct Batch
+    {
+        std::vector<std::pair<uint32_t, string>> records;
+        std::vector<char> decrypted;
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t pendingJobs = 0;
+    };
+
+    std::array<byte, SymmCipher::KEYLENGTH> keyBytes;
+    std::copy(key->key, key->key + SymmCipher::KEYLENGTH, keyBytes.begin());
+
+    auto dispatch = [&queue, &keyBytes](shared_ptr<Batch> batch)
+    {
+        size_t n = batch->records.size();
+        batch->decrypted.assign(n, 0);
+        {
+            std::lock_guard<std::mutex> g(batch->mutex);
+            batch->pendingJobs = (n + BULK_LOAD_JOB - 1) / BULK_LOAD_JOB;
+        }
+
+        for (size_t begin = 0; begin < n; begin += BULK_LOAD_JOB)
+        {
+            size_t end = std::min(n, begin + BULK_LOAD_JOB);
+            auto k = keyBytes;
+            queue.push([batch, begin, end, k](SymmCipher& sc)
+            {
+                sc.setkey(k.data());
+                for (size_t i = begin; i < end; ++i)
+                {
+                    // record 0 is never encrypted (see next(uint32_t*, string*, SymmCipher*))
+                    batch->decrypted[i] = !batch->records[i].first
+                                          || PaddedCBC::decrypt(&batch->records[i].second, &sc);
+                }
+
+                std::lock_guard<std::mutex> g(batch->mutex);
+                if (!--batch->pendingJobs)
+                {
+                    batch->cv.notify_all();
+                }
+            }, false);
+        }
+    };
+
+    auto current = std::make_shared<Batch>();
+    if (!nextBatch(current->records, BULK_LOAD_BATCH))
+    {
+        return true;
+    }
+    dispatch(current);
+
+    for (;;)
+    {
+        auto following = std::make_shared<Batch>();
+        bool hasFollowing = nextBatch(following->records, BULK_LOAD_BATCH);
+
+        {
+            std::unique_lock<std::mutex> g(current->mutex);
+            current->cv.wait(g, [&current]() { return !current->pendingJobs; });
+        }
+
+        for (size_t i = 0; i < current->records.size(); ++i)
+        {
+            uint32_t id = current->records[i].first;
+            if (id > nextid)
+            {
+                nextid = id & - IDSPACING;
+            }
+
+            if (!current->decrypted[i])
+            {
+                LOG_err << "Failed to decrypt record " << id << ". Bulk load stopped";
+                return true;
+            }
+
+            if (!apply(id, current->records[i].second))
+            {
+                return false;
+            }
+        }
+
+        if (!hasFollowing)
+        {
+            return true;
+        }
+
+        current = std::move(following);
+        dispatch(current);
+    }
+}
+
 DBTableTransactionCommitter *DbTable::getTransactionCommitter() const
 {
     return mTransactionCommitter;
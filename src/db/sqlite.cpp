@@ -177,6 +177,14 @@ DbTable *SqliteDbAccess::openTableWithNodes(PrnGen &rng, FileSystemAccess &fsAcc
         return nullptr;
     }
 
+    result = sqlite3_create_function(db, "leafcounter", 3, SQLITE_ANY,0, &SqliteAccountState::userLeafCounter, 0, 0);
+    if (result)
+    {
+        LOG_debug << "Data base error(sqlite3_create_function userLeafCounter): " << sqlite3_errmsg(db);
+        sqlite3_close(db);
+        return nullptr;
+    }
+
     return new SqliteAccountState(rng,
                                 db,
                                 fsAccess,
@@ -357,6 +365,11 @@ bool SqliteDbTable::inTransaction() const
     return sqlite3_get_autocommit(db) == 0;
 }
 
+uint64_t SqliteDbTable::transactionChanges() const
+{
+    return db ? uint64_t(sqlite3_total_changes(db) - mTotalChangesAtBegin) : 0;
+}
+
 // set cursor to first record
 void SqliteDbTable::rewind()
 {
@@ -540,9 +553,12 @@ void SqliteDbTable::begin()
     LOG_debug << "DB transaction BEGIN " << dbfile;
     int rc = sqlite3_exec(db, "BEGIN", 0, 0, NULL);
     errorHandler(rc, "Begin transaction", false);
+    mTotalChangesAtBegin = sqlite3_total_changes(db);
 }
 
 // commit transaction
+CodeCounter::ScopeStats g_dbCommitTime("DbTable_commit");
+
 void SqliteDbTable::commit()
 {
     if (!db)
@@ -550,6 +566,8 @@ void SqliteDbTable::commit()
         return;
     }
 
+    CodeCounter::ScopeTimer ccst(g_dbCommitTime);
+
     LOG_debug << "DB transaction COMMIT " << dbfile;
 
     int rc = sqlite3_exec(db, "COMMIT", 0, 0, NULL);
@@ -723,11 +741,11 @@ bool SqliteAccountState::removeNodes()
     return sqlResult == SQLITE_OK;
 }
 
-void SqliteAccountState::updateCounter(NodeHandle nodeHandle, const std::string& nodeCounterBlob)
+bool SqliteAccountState::updateCounter(NodeHandle nodeHandle, const std::string& nodeCounterBlob)
 {
     if (!db)
     {
-        return;
+        return false;
     }
 
     checkTransaction();
@@ -753,6 +771,8 @@ void SqliteAccountState::updateCounter(NodeHandle nodeHandle, const std::string&
     errorHandler(sqlResult, "Update counter", false);
 
     sqlite3_reset(mStmtUpdateNode);
+
+    return sqlResult == SQLITE_DONE && sqlite3_changes(db) > 0;
 }
 
 void SqliteAccountState::updateCounterAndFlags(NodeHandle nodeHandle, uint64_t flags, const std::string& nodeCounterBlob)
@@ -789,6 +809,45 @@ void SqliteAccountState::updateCounterAndFlags(NodeHandle nodeHandle, uint64_t f
     sqlite3_reset(mStmtUpdateNodeAndFlags);
 }
 
+void SqliteAccountState::updateLeafChildrenCounterAndFlags(NodeHandle parentHandle, bool areVersions, uint64_t flagsMask, uint64_t flags)
+{
+    if (!db)
+    {
+        return;
+    }
+
+    checkTransaction();
+
+    int sqlResult = SQLITE_OK;
+    if (!mStmtUpdateLeafChildren)
+    {
+        sqlResult = sqlite3_prepare_v2(db, "UPDATE nodes SET counter = leafcounter(type, size, ?), flags = (flags & ~?) | ? "
+                                           "WHERE parenthandle = ? AND NOT EXISTS (SELECT 1 FROM nodes AS c WHERE c.parenthandle = nodes.nodehandle)",
+                                       -1, &mStmtUpdateLeafChildren, NULL);
+    }
+
+    if (sqlResult == SQLITE_OK)
+    {
+        if ((sqlResult = sqlite3_bind_int(mStmtUpdateLeafChildren, 1, areVersions)) == SQLITE_OK)
+        {
+            if ((sqlResult = sqlite3_bind_int64(mStmtUpdateLeafChildren, 2, static_cast<sqlite3_int64>(flagsMask))) == SQLITE_OK)
+            {
+                if ((sqlResult = sqlite3_bind_int64(mStmtUpdateLeafChildren, 3, static_cast<sqlite3_int64>(flags & flagsMask))) == SQLITE_OK)
+                {
+                    if ((sqlResult = sqlite3_bind_int64(mStmtUpdateLeafChildren, 4, parentHandle.as8byte())) == SQLITE_OK)
+                    {
+                        sqlResult = sqlite3_step(mStmtUpdateLeafChildren);
+                    }
+                }
+            }
+        }
+    }
+
+    errorHandler(sqlResult, "Update counter and flags of leaf children", false);
+
+    sqlite3_reset(mStmtUpdateLeafChildren);
+}
+
 void SqliteAccountState::createIndexes()
 {
     if (!db)
@@ -859,9 +918,15 @@ void SqliteAccountState::finalise()
     sqlite3_finalize(mStmtUpdateNodeAndFlags);
     mStmtUpdateNodeAndFlags = nullptr;
 
+    sqlite3_finalize(mStmtUpdateLeafChildren);
+    mStmtUpdateLeafChildren = nullptr;
+
     sqlite3_finalize(mStmtTypeAndSizeNode);
     mStmtTypeAndSizeNode = nullptr;
 
+    sqlite3_finalize(mStmtChildrenTypeAndSize);
+    mStmtChildrenTypeAndSize = nullptr;
+
     sqlite3_finalize(mStmtGetNode);
     mStmtGetNode = nullptr;
 
@@ -945,10 +1010,9 @@ bool SqliteAccountState::put(Node *node)
         sqlite3_bind_blob(mStmtPutNode, 4, fp.data(), static_cast<int>(fp.size()), SQLITE_STATIC);
 
         std::string origFingerprint;
-        attr_map::const_iterator attrIt = node->attrs.map.find(MAKENAMEID2('c', '0'));
-        if (attrIt != node->attrs.map.end())
+        if (const string* c0 = node->attr(MAKENAMEID2('c', '0')))
         {
-           origFingerprint = attrIt->second;
+           origFingerprint = *c0;
         }
         sqlite3_bind_blob(mStmtPutNode, 5, origFingerprint.data(), static_cast<int>(origFingerprint.size()), SQLITE_STATIC);
 
@@ -960,8 +1024,8 @@ bool SqliteAccountState::put(Node *node)
 
         // node->attrstring has value => node is encrypted
         nameid favId = AttrMap::string2nameid("fav");
-        auto favIt = node->attrs.map.find(favId);
-        bool fav = (favIt != node->attrs.map.end() && favIt->second == "1"); // test 'fav' attr value (only "1" is valid)
+        const string* favValue = node->attr(favId);
+        bool fav = (favValue && *favValue == "1"); // test 'fav' attr value (only "1" is valid)
         sqlite3_bind_int(mStmtPutNode, 9, fav);
         sqlite3_bind_int64(mStmtPutNode, 10, node->ctime);
         sqlite3_bind_int64(mStmtPutNode, 11, node->getDBFlags());
@@ -1606,6 +1670,48 @@ bool SqliteAccountState::getNodeSizeTypeAndFlags(NodeHandle node, m_off_t& size,
     return sqlResult == SQLITE_ROW;
 }
 
+bool SqliteAccountState::getChildrenSizeTypeAndFlags(NodeHandle parentHandle, const std::function<void(const NodeSizeTypeAndFlags&, bool hasChildren)>& cursor)
+{
+    if (!db)
+    {
+        return false;
+    }
+
+    int sqlResult = SQLITE_OK;
+    if (!mStmtChildrenTypeAndSize)
+    {
+        sqlResult = sqlite3_prepare_v2(db, "SELECT n.nodehandle, n.type, n.size, n.flags, "
+                                           "EXISTS (SELECT 1 FROM nodes AS c WHERE c.parenthandle = n.nodehandle) "
+                                           "FROM nodes AS n WHERE n.parenthandle = ?",
+                                       -1, &mStmtChildrenTypeAndSize, NULL);
+    }
+
+    if (sqlResult == SQLITE_OK)
+    {
+        if ((sqlResult = sqlite3_bind_int64(mStmtChildrenTypeAndSize, 1, parentHandle.as8byte())) == SQLITE_OK)
+        {
+            while ((sqlResult = sqlite3_step(mStmtChildrenTypeAndSize)) == SQLITE_ROW)
+            {
+                NodeSizeTypeAndFlags node;
+                node.handle.set6byte(sqlite3_column_int64(mStmtChildrenTypeAndSize, 0));
+                node.type = (nodetype_t)sqlite3_column_int(mStmtChildrenTypeAndSize, 1);
+                node.size = sqlite3_column_int64(mStmtChildrenTypeAndSize, 2);
+                node.flags = static_cast<uint64_t>(sqlite3_column_int64(mStmtChildrenTypeAndSize, 3));
+                cursor(node, sqlite3_column_int(mStmtChildrenTypeAndSize, 4) != 0);
+            }
+        }
+    }
+
+    if (sqlResult != SQLITE_DONE)
+    {
+        errorHandler(sqlResult, "Get size, type and flags of children", false);
+    }
+
+    sqlite3_reset(mStmtChildrenTypeAndSize);
+
+    return sqlResult == SQLITE_DONE;
+}
+
 bool SqliteAccountState::isAncestor(NodeHandle node, NodeHandle ancestor, CancelToken cancelFlag)
 {
     bool result = false;
@@ -2003,6 +2109,23 @@ void SqliteAccountState::userIsMimetype(sqlite3_context* context, int argc, sqli
     sqlite3_result_int(context, result);
 }
 
+void SqliteAccountState::userLeafCounter(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    if (argc != 3)
+    {
+        LOG_err << "Invalid parameters for user leafCounter";
+        assert(false);
+        sqlite3_result_null(context);
+        return;
+    }
+
+    NodeCounter nc;
+    nc.addNode(static_cast<nodetype_t>(sqlite3_value_int(argv[0])), sqlite3_value_int64(argv[1]), sqlite3_value_int(argv[2]) != 0);
+
+    std::string blob = nc.serialize();
+    sqlite3_result_blob(context, blob.data(), static_cast<int>(blob.size()), SQLITE_TRANSIENT);
+}
+
 } // namespace
 
 #endif
@@ -450,7 +450,7 @@ void File::sendPutnodesToCloneNode(MegaClient* client, Node* nodeToClone,
 
     // copy attrs
     AttrMap attrs;
-    attrs.map = nodeToClone->attrs.map;
+    attrs.map = nodeToClone->attrs().map;
     attr_map::iterator it = attrs.map.find(AttrMap::string2nameid("rr"));
     if (it != attrs.map.end())
     {
@@ -669,7 +669,7 @@ void SyncFileGet::updatelocalname()
 {
     attr_map::iterator ait;
 
-    if ((ait = n->attrs.map.find('n')) != n->attrs.map.end())
+    if ((ait = n->attrs().map.find('n')) != n->attrs().map.end())
     {
         if (n->parent && n->parent->localnode)
         {
@@ -705,5 +705,90 @@ void SyncFileGet::terminated(error e)
 
     delete this;
 }
+
+SyncFilePut::SyncFilePut(LocalNode* l)
+{
+    localNode = l;
+    *(FileFingerprint*)this = *l;
+
+    name = l->name;
+    setLocalname(l->getLocalPath());
+
+    if (l->parent && l->parent->node)
+    {
+        h = l->parent->node->nodeHandle();
+    }
+
+    previousNode = l->node;
+    syncxfer = true;
+}
+
+void SyncFilePut::prepare(FileSystemAccess&)
+{
+    localNode->getlocalpath(transfer->localfilename);
+    assert(transfer->localfilename.isAbsolute());
+
+    // is this transfer in progress? update file's filename.
+    if (transfer->slot && transfer->slot->fa && !transfer->slot->fa->nonblocking_localname.empty())
+    {
+        transfer->slot->fa->updatelocalname(transfer->localfilename, false);
+    }
+
+    localNode->treestate(TREESTATE_SYNCING);
+}
+
+// complete a sync upload: complete to //bin if a newer node exists (which
+// would have been caused by a race condition), then self-destruct
+void SyncFilePut::completed(Transfer* t, putsource_t source)
+{
+    LocalNode* l = localNode;
+    Sync* sync = l->sync;
+
+    sync->threadSafeState->transferComplete(PUT, size);
+
+    // the LocalNode may have been renamed while uploading
+    name = l->name;
+    *(FileFingerprint*)this = *l;
+    previousNode = l->node;
+
+    // complete to rubbish for later retrieval if the parent node does not
+    // exist or is newer
+    if (!l->parent || !l->parent->node || (l->node && mtime < l->node->mtime))
+    {
+        h = t->client->mNodeManager.getRootNodeRubbish();
+    }
+    else
+    {
+        // otherwise, overwrite node if it already exists and complete in its
+        // place
+        h = l->parent->node->nodeHandle();
+    }
+
+    bool canChangeVault = sync->isBackup();
+
+    // we are overriding completed() for sync upload, we don't use the File::completed version at all.
+    assert(t->type == PUT);
+    sendPutnodesOfUpload(t->client, t->uploadhandle, *t->ultoken, t->filekey, source, NodeHandle(), nullptr, l, nullptr, canChangeVault);
+
+    // unless the LocalNode is already releasing us
+    if (l->upload.get() == this)
+    {
+        l->upload.reset();
+    }
+}
+
+void SyncFilePut::terminated(error e)
+{
+    LocalNode* l = localNode;
+
+    l->sync->threadSafeState->transferFailed(PUT, size);
+
+    File::terminated(e);
+
+    if (l->upload.get() == this)
+    {
+        l->upload.reset();
+    }
+}
 #endif
 } // namespace
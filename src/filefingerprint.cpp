@@ -188,6 +188,10 @@ bool FileFingerprint::genfingerprint(FileAccess* fa, bool ignoremtime)
         byte block[4 * sizeof crc];
         const unsigned blocks = MAXFULL / unsigned(sizeof block * crc.size());
 
+        // each sample is a single block far from the others: don't have the OS read ahead around them
+        auto pattern = fa->readpattern();
+        fa->setreadpattern(FileAccess::READ_RANDOM);
+
         for (unsigned i = 0; i < crc.size(); i++)
         {
             for (unsigned j = 0; j < blocks; j++)
@@ -198,6 +202,7 @@ bool FileFingerprint::genfingerprint(FileAccess* fa, bool ignoremtime)
                                   / (crc.size() * blocks - 1), true, FSLogging::logOnError))
                 {
                     size = -1;
+                    fa->setreadpattern(pattern);
                     fa->closef();
                     return true;
                 }
@@ -208,6 +213,8 @@ bool FileFingerprint::genfingerprint(FileAccess* fa, bool ignoremtime)
             crc32.get((byte*)&crcval);
             newcrc[i] = htonl(crcval);
         }
+
+        fa->setreadpattern(pattern);
     }
 
     if (crc != newcrc)
@@ -42,7 +42,7 @@ namespace mega {
 std::atomic<int> FileSystemAccess::mMinimumDirectoryPermissions{0700};
 std::atomic<int> FileSystemAccess::mMinimumFilePermissions{0600};
 
-CodeCounter::ScopeStats g_compareUtfTimings("compareUtfTimings");
+CodeCounter::ScopeStats g_compareUtfTimings("compareUtfTimings", false);
 
 FSLogging FSLogging::noLogging(eNoLogging);
 FSLogging FSLogging::logOnError(eLogOnError);
@@ -666,6 +666,27 @@ const char *FileSystemAccess::fstypetostring(FileSystemType type)
     return "UNKNOWN FS";
 }
 
+const char* FileSystemAccess::copyMethodName(CopyMethod method)
+{
+    switch (method)
+    {
+        case COPY_CLONE:
+            return "reflink";
+        case COPY_FILE_RANGE:
+            return "copy_file_range";
+        case COPY_SENDFILE:
+            return "sendfile";
+        case COPY_READWRITE:
+            return "read/write";
+        case COPY_SYSTEM:
+            return "system copy";
+        case COPY_NONE:
+            break;
+    }
+
+    return "none";
+}
+
 FileSystemType FileSystemAccess::getlocalfstype(const LocalPath& path) const
 {
     // Not enough information to determine path.
@@ -1235,6 +1256,12 @@ bool FileAccess::frawread(byte* dst, unsigned len, m_off_t pos, bool caller_open
     return r;
 }
 
+void FileAccess::setreadpattern(ReadPattern pattern)
+{
+    mReadPattern = pattern;
+    sysreadpattern();
+}
+
 AsyncIOContext::~AsyncIOContext()
 {
     finish();
@@ -2185,6 +2212,7 @@ bool FileDistributor::distributeTo(LocalPath& lp, FileSystemAccess& fsaccess, Ta
                 LOG_debug << "Moving instead of renaming temporary file to target path";
                 if (copyTo(theFile, lp, mMtime, method, fsaccess, transient_error, name_too_long, syncForDebris, confirmFingerprint))
                 {
+                    LOG_debug << "Copied temporary file to " << lp << " via " << FileSystemAccess::copyMethodName(fsaccess.last_copy_method);
                     if (!fsaccess.unlinklocal(theFile))
                     {
                         LOG_debug << "Could not remove temp file after final destination copy: " << theFile;
@@ -2200,6 +2228,7 @@ bool FileDistributor::distributeTo(LocalPath& lp, FileSystemAccess& fsaccess, Ta
             // otherwise copy
             if (copyTo(theFile, lp, mMtime, method, fsaccess, transient_error, name_too_long, syncForDebris, confirmFingerprint))
             {
+                LOG_debug << "Copied temporary file to " << lp << " via " << FileSystemAccess::copyMethodName(fsaccess.last_copy_method);
                 removeTarget();
                 return true;
             }
@@ -2220,6 +2249,65 @@ void FileDistributor::removeTarget()
         theFile.clear();
 }
 
+const size_t LocalContentIndex::MAX_ENTRIES;
+
+void LocalContentIndex::add(const FileFingerprint& fingerprint, const LocalPath& path)
+{
+    if (!fingerprint.isvalid || path.empty())
+    {
+        return;
+    }
+
+    remove(fingerprint, path);
+
+    mEntries.push_front(Entry{fingerprint, path});
+    mByFingerprint.emplace(fingerprint, mEntries.begin());
+
+    if (mEntries.size() > MAX_ENTRIES)
+    {
+        Entry oldest = mEntries.back();
+        remove(oldest.fingerprint, oldest.path);
+    }
+}
+
+void LocalContentIndex::remove(const FileFingerprint& fingerprint, const LocalPath& path)
+{
+    auto range = mByFingerprint.equal_range(fingerprint);
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (it->second->path == path)
+        {
+            mEntries.erase(it->second);
+            mByFingerprint.erase(it);
+            return;
+        }
+    }
+}
+
+vector<LocalPath> LocalContentIndex::find(const FileFingerprint& fingerprint) const
+{
+    vector<LocalPath> result;
+
+    // equal keys keep their insertion order, so the most recent is last
+    auto range = mByFingerprint.equal_range(fingerprint);
+    for (auto it = range.second; it != range.first; )
+    {
+        result.push_back((--it)->second->path);
+    }
+    return result;
+}
+
+size_t LocalContentIndex::size() const
+{
+    return mEntries.size();
+}
+
+void LocalContentIndex::clear()
+{
+    mByFingerprint.clear();
+    mEntries.clear();
+}
+
 bool isNetworkFilesystem(FileSystemType type)
 {
     return type == FS_CIFS
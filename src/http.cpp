@@ -22,6 +22,7 @@
 #include "mega/http.h"
 #include "mega/megaclient.h"
 #include "mega/logging.h"
+#include "mega/metrics.h"
 #include "mega/proxy.h"
 #include "mega/base64.h"
 #include "mega/testhooks.h"
@@ -481,6 +482,12 @@ HttpReq::HttpReq(bool b)
     init();
 }
 
+// download buffers are padded for SymmCipher::ctr_crypt
+static size_t downloadBufferSize(m_off_t len)
+{
+    return size_t((len + SymmCipher::BLOCKSIZE - 1) & - SymmCipher::BLOCKSIZE);
+}
+
 HttpReq::~HttpReq()
 {
     if (httpio)
@@ -488,7 +495,10 @@ HttpReq::~HttpReq()
         httpio->cancel(this);
     }
 
-    delete[] buf;
+    if (buf)
+    {
+        TransferBufferPool::instance().release(buf, downloadBufferSize(buflen));
+    }
 }
 
 void HttpReq::init()
@@ -559,14 +569,17 @@ void HttpReq::put(void* data, unsigned len, bool purge)
 }
 
 
-HttpReq::http_buf_t::http_buf_t(byte* b, size_t s, size_t e)
-    : start(s), end(e), buf(b)
+HttpReq::http_buf_t::http_buf_t(byte* b, size_t s, size_t e, size_t c)
+    : start(s), end(e), buf(b), capacity(c)
 {
 }
 
 HttpReq::http_buf_t::~http_buf_t()
 {
-    delete[] buf;
+    if (buf)
+    {
+        TransferBufferPool::instance().release(buf, capacity);
+    }
 }
 
 void HttpReq::http_buf_t::swap(http_buf_t& other)
@@ -574,6 +587,7 @@ void HttpReq::http_buf_t::swap(http_buf_t& other)
     byte* tb = buf; buf = other.buf; other.buf = tb;
     size_t ts = start; start = other.start; other.start = ts;
     size_t te = end; end = other.end; other.end = te;
+    size_t tc = capacity; capacity = other.capacity; other.capacity = tc;
 }
 
 bool HttpReq::http_buf_t::isNull() const
@@ -595,7 +609,7 @@ size_t HttpReq::http_buf_t::datalen() const
 // give up ownership of the buffer for client to use.
 struct HttpReq::http_buf_t* HttpReq::release_buf()
 {
-    HttpReq::http_buf_t* result = new HttpReq::http_buf_t(buf, inpurge, (size_t)bufpos);
+    HttpReq::http_buf_t* result = new HttpReq::http_buf_t(buf, inpurge, (size_t)bufpos, buf ? downloadBufferSize(buflen) : 0);
     buf = NULL;
     inpurge = 0;
     buflen = 0;
@@ -706,13 +720,13 @@ void HttpReqDL::prepare(const char* tempurl, SymmCipher* /*key*/,
         // (re)allocate buffer
         if (buf)
         {
-            delete[] buf;
+            TransferBufferPool::instance().release(buf, downloadBufferSize(buflen));
             buf = NULL;
         }
 
         if (size)
         {
-            buf = new byte[(size + SymmCipher::BLOCKSIZE - 1) & - SymmCipher::BLOCKSIZE];
+            buf = TransferBufferPool::instance().acquire(downloadBufferSize(size));
         }
         buflen = size;
     }
@@ -720,6 +734,193 @@ void HttpReqDL::prepare(const char* tempurl, SymmCipher* /*key*/,
 
 
 
+const size_t TransferBufferPool::ALIGNMENT;
+const size_t TransferBufferPool::MIN_POOLED_SIZE;
+const size_t TransferBufferPool::MAX_POOLED_SIZE;
+const size_t TransferBufferPool::DEFAULT_IDLE_LIMIT;
+
+TransferBufferPool& TransferBufferPool::instance()
+{
+    // never destroyed, as buffers may still be released while statics are being torn down
+    static TransferBufferPool* pool = new TransferBufferPool;
+    return *pool;
+}
+
+TransferBufferPool::~TransferBufferPool()
+{
+    for (auto& c : mIdle)
+    {
+        for (byte* b : c.second)
+        {
+            deallocate(b);
+        }
+    }
+}
+
+size_t TransferBufferPool::classSize(size_t size)
+{
+    if (size <= MIN_POOLED_SIZE)
+    {
+        return MIN_POOLED_SIZE;
+    }
+
+    // eight classes per power of two, so no more than 12.5% is wasted
+    size_t octave = MIN_POOLED_SIZE;
+    while (octave < size)
+    {
+        octave <<= 1;
+    }
+    size_t step = octave / 16;
+    return (size + step - 1) / step * step;
+}
+
+byte* TransferBufferPool::allocate(size_t size)
+{
+    void* p = nullptr;
+#ifdef _WIN32
+    p = _aligned_malloc(size, ALIGNMENT);
+#else
+    if (posix_memalign(&p, ALIGNMENT, size))
+    {
+        p = nullptr;
+    }
+#endif
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return static_cast<byte*>(p);
+}
+
+void TransferBufferPool::deallocate(byte* buf)
+{
+#ifdef _WIN32
+    _aligned_free(buf);
+#else
+    free(buf);
+#endif
+}
+
+byte* TransferBufferPool::acquire(size_t size)
+{
+    size_t csize = classSize(size);
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        mStats.inUseBytes += csize;
+
+        auto it = mIdle.find(csize);
+        if (it != mIdle.end() && !it->second.empty())
+        {
+            byte* b = it->second.back();
+            it->second.pop_back();
+            mStats.idleBytes -= csize;
+            mStats.reuses++;
+            return b;
+        }
+        mStats.allocations++;
+    }
+
+    return allocate(csize);
+}
+
+void TransferBufferPool::release(byte* buf, size_t size)
+{
+    size_t csize = classSize(size);
+    std::unique_lock<std::mutex> g(mMutex);
+    assert(mStats.inUseBytes >= csize);
+    mStats.inUseBytes -= csize;
+
+    size_t cap = mLimit ? mLimit : mStats.inUseBytes + DEFAULT_IDLE_LIMIT;
+    if (csize <= MAX_POOLED_SIZE && mStats.inUseBytes + mStats.idleBytes + csize <= cap)
+    {
+        mIdle[csize].push_back(buf);
+        mStats.idleBytes += csize;
+        buf = nullptr;
+    }
+
+    notifyWaiters(g);
+
+    if (buf)
+    {
+        deallocate(buf);
+    }
+}
+
+void TransferBufferPool::setLimit(size_t bytes)
+{
+    std::unique_lock<std::mutex> g(mMutex);
+    mLimit = bytes;
+    trim();
+    notifyWaiters(g);
+}
+
+void TransferBufferPool::notifyWhenAvailable(const std::shared_ptr<Waiter>& waiter)
+{
+    std::unique_lock<std::mutex> g(mMutex);
+    if (std::none_of(mWaiters.begin(), mWaiters.end(), [&waiter](const std::weak_ptr<Waiter>& w) { return w.lock() == waiter; }))
+    {
+        mWaiters.push_back(waiter);
+    }
+
+    // buffers may have been released since the caller found the cap reached
+    notifyWaiters(g);
+}
+
+// wake the waiting clients if buffers can be acquired again (unlocks)
+void TransferBufferPool::notifyWaiters(std::unique_lock<std::mutex>& lock)
+{
+    if (mWaiters.empty() || !underLimit())
+    {
+        lock.unlock();
+        return;
+    }
+
+    std::vector<std::weak_ptr<Waiter>> waiters;
+    waiters.swap(mWaiters);
+    lock.unlock();
+
+    for (auto& w : waiters)
+    {
+        if (auto waiter = w.lock())
+        {
+            waiter->notify();
+        }
+    }
+}
+
+size_t TransferBufferPool::limit() const
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return mLimit;
+}
+
+bool TransferBufferPool::overLimit() const
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return !underLimit();
+}
+
+TransferBufferPool::Stats TransferBufferPool::stats() const
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    return mStats;
+}
+
+// free idle buffers, largest first, until we are under the cap
+void TransferBufferPool::trim()
+{
+    size_t cap = mLimit ? mLimit : mStats.inUseBytes + DEFAULT_IDLE_LIMIT;
+    for (auto it = mIdle.rbegin(); it != mIdle.rend() && mStats.inUseBytes + mStats.idleBytes > cap; ++it)
+    {
+        while (!it->second.empty() && mStats.inUseBytes + mStats.idleBytes > cap)
+        {
+            deallocate(it->second.back());
+            it->second.pop_back();
+            mStats.idleBytes -= it->first;
+        }
+    }
+}
+
 EncryptByChunks::EncryptByChunks(SymmCipher* k, chunkmac_map* m, uint64_t iv) : key(k), macs(m), ctriv(iv)
 {
     memset(crc, 0, CRCSIZE);
@@ -769,8 +970,14 @@ void EncryptByChunks::updateCRC(byte* data, unsigned size, unsigned offset)
     }
 }
 
+CodeCounter::ScopeStats g_encryptTime("Transfer_encrypt");
+
 bool EncryptByChunks::encrypt(m_off_t pos, m_off_t npos, string& urlSuffix)
 {
+    CodeCounter::ScopeTimer ccst(g_encryptTime);
+    static const MetricsRegistry::Id encryptedBytes = MetricsRegistry::instance().counter("Transfer_encryptedBytes", "Bytes encrypted for upload");
+    MetricsRegistry::instance().add(encryptedBytes, uint64_t(npos - pos));
+
     byte* buf;
     m_off_t startpos = pos;
     m_off_t finalpos = npos;
@@ -27,13 +27,227 @@
 #include "mega/logging.h"
 #include "mega/mega_utf8proc.h"
 
+#if defined(__SSE2__) || defined(_M_X64)
+#define MEGA_JSON_SSE2 1
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#define MEGA_JSON_NEON 1
+#include <arm_neon.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#if defined(__clang__) || defined(__GNUC__)
+#define MEGA_JSON_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define MEGA_JSON_NO_ASAN
+#endif
+
 namespace mega {
+
+namespace {
+
+#if defined(MEGA_JSON_SSE2) || defined(MEGA_JSON_NEON)
+
+// Bulk skipping for storeobject(), in the style of simdjson's first stage: classify 64 bytes at a time
+// into bitmasks (one bit per byte), work out which bytes are inside strings from the quote mask, and
+// only count brackets outside them. Windows that need a closer look (backslashes, characters the
+// parser rejects or treats specially, the terminating NUL, or brackets that could close the value)
+// are left to the byte by byte loop.
+struct StructuralMasks
+{
+    uint64_t quote = 0;
+    uint64_t backslash = 0;
+    uint64_t open[2] = {};      // '{', '['
+    uint64_t close[2] = {};     // '}', ']'
+    uint64_t other = 0;         // anything but the above, digits and ":,-."
+};
+
+#if defined(MEGA_JSON_SSE2)
+
+struct Chunk
+{
+    __m128i v;
+
+    // 16 byte loads are aligned so they never cross into an unmapped page past the NUL
+    MEGA_JSON_NO_ASAN explicit Chunk(const char* p) : v(_mm_load_si128(reinterpret_cast<const __m128i*>(p))) { }
+
+    uint64_t eq(char c) const { return uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8(c)))); }
+
+    // digits and ':' are '0'..'0'+10, and ',', '-', '.' are ','..','+2
+    uint64_t plain() const
+    {
+        __m128i digit = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+        __m128i punct = _mm_sub_epi8(v, _mm_set1_epi8(','));
+        return uint64_t(_mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(10)), digit),
+            _mm_cmpeq_epi8(_mm_min_epu8(punct, _mm_set1_epi8(2)), punct))));
+    }
+};
+
+#else
+
+struct Chunk
+{
+    uint8x16_t v;
+
+    MEGA_JSON_NO_ASAN explicit Chunk(const char* p) : v(vld1q_u8(reinterpret_cast<const uint8_t*>(p))) { }
+
+    static uint64_t movemask(uint8x16_t m)
+    {
+        static const uint8_t bits[16] = { 1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128 };
+        uint8x16_t masked = vandq_u8(m, vld1q_u8(bits));
+        return uint64_t(vaddv_u8(vget_low_u8(masked))) | (uint64_t(vaddv_u8(vget_high_u8(masked))) << 8);
+    }
+
+    uint64_t eq(char c) const { return movemask(vceqq_u8(v, vdupq_n_u8(uint8_t(c)))); }
+
+    uint64_t plain() const
+    {
+        return movemask(vorrq_u8(
+            vcleq_u8(vsubq_u8(v, vdupq_n_u8('0')), vdupq_n_u8(10)),
+            vcleq_u8(vsubq_u8(v, vdupq_n_u8(',')), vdupq_n_u8(2))));
+    }
+};
+
+#endif
+
+// masks for the 64 bytes at `block` (16 byte aligned); false if they include the terminating NUL
+bool classify(const char* block, StructuralMasks& m)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        Chunk c(block + 16 * i);
+        if (c.eq(0))
+        {
+            return false;
+        }
+
+        int shift = 16 * i;
+        uint64_t quote = c.eq('"');
+        uint64_t open0 = c.eq('{'), open1 = c.eq('[');
+        uint64_t close0 = c.eq('}'), close1 = c.eq(']');
+
+        m.quote |= quote << shift;
+        m.backslash |= c.eq('\\') << shift;
+        m.open[0] |= open0 << shift;
+        m.open[1] |= open1 << shift;
+        m.close[0] |= close0 << shift;
+        m.close[1] |= close1 << shift;
+        m.other |= (~(c.plain() | quote | open0 | open1 | close0 | close1) & 0xFFFF) << shift;
+    }
+    return true;
+}
+
+// bit i set if there is an odd number of bits set in 0..i
+inline uint64_t prefixXor(uint64_t m)
+{
+    m ^= m << 1;
+    m ^= m << 2;
+    m ^= m << 4;
+    m ^= m << 8;
+    m ^= m << 16;
+    m ^= m << 32;
+    return m;
+}
+
+inline int popcount(uint64_t m)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return int(__popcnt64(m));
+#else
+    return __builtin_popcountll(m);
+#endif
+}
+
+inline int highestBit(uint64_t m)
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long i;
+    _BitScanReverse64(&i, m);
+    return int(i);
+#else
+    return 63 - __builtin_clzll(m);
+#endif
+}
+
+// Skips whole windows inside an array or object, starting at `ptr` (between tokens, not in a string),
+// while none of them can bring both counts in `openobject` back to zero or make one negative.
+// Returns where the byte by byte loop should resume: the end of the last skipped window, or the
+// opening quote of a string that runs past it. `retryAt` is set to the end of the window that stopped it.
+const char* skipStructure(const char* ptr, int openobject[2], const char*& retryAt)
+{
+    const char* block = ptr - (reinterpret_cast<uintptr_t>(ptr) & 15);
+    uint64_t before = (uint64_t(1) << (ptr - block)) - 1;   // bytes preceding ptr
+    const char* resume = ptr;
+    const char* stringStart = nullptr;
+    uint64_t inString = 0;
+
+    for (;; block += 64, before = 0)
+    {
+        retryAt = block + 64;
+
+        StructuralMasks m;
+        if (!classify(block, m) || (m.backslash & ~before))
+        {
+            break;
+        }
+
+        uint64_t quote = m.quote & ~before;
+        uint64_t string = prefixXor(quote) ^ inString;
+        uint64_t outside = ~(string | quote | before);
+
+        if (m.other & outside)
+        {
+            break;
+        }
+
+        int open0 = popcount(m.open[0] & outside), close0 = popcount(m.close[0] & outside);
+        int open1 = popcount(m.open[1] & outside), close1 = popcount(m.close[1] & outside);
+
+        // safe if neither count can go negative and one of them stays positive throughout
+        if (openobject[0] < close0 || openobject[1] < close1
+            || (openobject[0] == close0 && openobject[1] == close1))
+        {
+            break;
+        }
+
+        openobject[0] += open0 - close0;
+        openobject[1] += open1 - close1;
+
+        inString = uint64_t(0) - (string >> 63);
+        if (quote && inString)
+        {
+            stringStart = block + highestBit(quote);
+        }
+
+        resume = inString ? stringStart : block + 64;
+    }
+
+    return resume;
+}
+
+#else
+
+const char* skipStructure(const char* ptr, int[2], const char*& retryAt)
+{
+    retryAt = nullptr;
+    return ptr;
+}
+
+#endif
+
+} // anonymous
+
 // store array or object in string s
 // reposition after object
 bool JSON::storeobject(string* s)
 {
     int openobject[2] = { 0 };
     const char* ptr;
+    const char* bulkFrom = nullptr;
     bool escaped = false;
 
     while (*(const signed char*)pos > 0 && *pos <= ' ')
@@ -55,6 +269,11 @@ bool JSON::storeobject(string* s)
 
     for (;;)
     {
+        if ((openobject[0] || openobject[1]) && ptr >= bulkFrom)
+        {
+            ptr = skipStructure(ptr, openobject, bulkFrom);
+        }
+
         if ((*ptr == '[') || (*ptr == '{'))
         {
             openobject[*ptr == '[']++;
@@ -94,6 +313,11 @@ bool JSON::storeobject(string* s)
 
             ptr--;
         }
+        else if ((*ptr == 'e' || *ptr == 'E') && ptr > pos
+                 && ((ptr[-1] >= '0' && ptr[-1] <= '9') || ptr[-1] == '.' || ptr[-1] == '-'))
+        {
+            // exponent of a number whose mantissa was skipped in bulk
+        }
         else if (*ptr != ':' && *ptr != ',')
         {
             LOG_err << "Parse error (unexpected " << *ptr << ")";
@@ -3322,6 +3322,36 @@ void MegaApi::setMaxConnections(int connections, MegaRequestListener *listener)
     pImpl->setMaxConnections(-1,  connections, listener);
 }
 
+void MegaApi::setAdaptiveTransferTuning(bool enable)
+{
+    pImpl->setAdaptiveTransferTuning(enable);
+}
+
+void MegaApi::setDownloadsFromLocalCopies(bool enable)
+{
+    pImpl->setDownloadsFromLocalCopies(enable);
+}
+
+void MegaApi::setActionPacketGroupCommit(int windowMs, int maxRows)
+{
+    pImpl->setActionPacketGroupCommit(windowMs, maxRows);
+}
+
+bool MegaApi::setHttp2Multiplexing(bool enable, int maxStreamsPerConnection)
+{
+    return pImpl->setHttp2Multiplexing(enable, maxStreamsPerConnection);
+}
+
+void MegaApi::setTransferMemoryLimit(long long bytes)
+{
+    pImpl->setTransferMemoryLimit(bytes);
+}
+
+char* MegaApi::getPerformanceMetrics(int format)
+{
+    return pImpl->getPerformanceMetrics(format);
+}
+
 void MegaApi::setDownloadMethod(int method)
 {
     pImpl->setDownloadMethod(method);
@@ -4607,6 +4637,16 @@ bool MegaApi::httpServerIsOfflineAttributeEnabled()
     return pImpl->httpServerIsOfflineAttributeEnabled();
 }
 
+void MegaApi::httpServerEnableMetrics(bool enable)
+{
+    pImpl->httpServerEnableMetrics(enable);
+}
+
+bool MegaApi::httpServerIsMetricsEnabled()
+{
+    return pImpl->httpServerIsMetricsEnabled();
+}
+
 bool MegaApi::httpServerIsFolderServerEnabled()
 {
     return pImpl->httpServerIsFolderServerEnabled();
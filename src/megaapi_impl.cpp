@@ -29,6 +29,7 @@
 #include "megaapi_impl.h"
 #include "megaapi.h"
 #include "mega/mediafileattribute.h"
+#include "mega/testhooks.h"
 
 #include <iomanip>
 #include <algorithm>
@@ -245,10 +246,16 @@ MegaNodePrivate::MegaNodePrivate(Node *node)
     this->mFavourite = false;
     this->mLabel = LBL_UNKNOWN;
 
+    // attributes are read one by one, so those of nodes loaded from the DB don't need to be unpacked
+    auto attr = [node](const char* name)
+    {
+        return node->attr(AttrMap::string2nameid(name));
+    };
+
     char buf[10];
-    for (attr_map::iterator it = node->attrs.map.begin(); it != node->attrs.map.end(); it++)
+    for (nameid id : node->attrNames())
     {
-        int attrlen = node->attrs.nameid2string(it->first, buf);
+        int attrlen = AttrMap::nameid2string(id, buf);
         buf[attrlen] = '\0';
         if (buf[0] == '_')
         {
@@ -257,171 +264,189 @@ MegaNodePrivate::MegaNodePrivate(Node *node)
                customAttrs = new attr_map();
            }
 
-           nameid id = AttrMap::string2nameid(&buf[1]);
-           (*customAttrs)[id] = it->second;
+           (*customAttrs)[AttrMap::string2nameid(&buf[1])] = *node->attr(id);
         }
-        else
+    }
+
+    if (node->type == FILENODE)
+    {
+        if (const string* d = attr("d"))
         {
-            if (it->first == AttrMap::string2nameid("d"))
+            string value = *d;
+            duration = int(Base64::atoi(&value));
+        }
+
+        for (const char* coordsName : { "l", "gp" })
+        {
+            const string* value = attr(coordsName);
+            if (!value)
             {
-               if (node->type == FILENODE)
-               {
-                   duration = int(Base64::atoi(&it->second));
-               }
+                continue;
             }
-            else if (it->first == AttrMap::string2nameid("l") || it->first == AttrMap::string2nameid("gp"))
+
+            bool isGp = !strcmp(coordsName, "gp");
+            string coords = *value;
+            if ((!isGp && coords.size() != 8) ||
+                (isGp && coords.size() != Base64Str<16>::STRLEN))
             {
-                if (node->type == FILENODE)
+               LOG_warn << "Malformed GPS coordinates attribute";
+            }
+            else
+            {
+                bool ok = true;
+                if (isGp)
                 {
-                    string coords = it->second;
-                    if ((it->first == AttrMap::string2nameid("l") && coords.size() != 8) ||
-                        (it->first == AttrMap::string2nameid("gp") && coords.size() != Base64Str<16>::STRLEN))
-                    {
-                       LOG_warn << "Malformed GPS coordinates attribute";
-                    }
-                    else
+                    if (node->client && node->client->unshareablekey.size() == Base64Str<SymmCipher::KEYLENGTH>::STRLEN && coords.size() == Base64Str<16>::STRLEN)
                     {
-                        bool ok = true;
-                        if (it->first == AttrMap::string2nameid("gp"))
-                        {
-                            if (node->client && node->client->unshareablekey.size() == Base64Str<SymmCipher::KEYLENGTH>::STRLEN && coords.size() == Base64Str<16>::STRLEN)
-                            {
-                                SymmCipher c;
-                                byte data[SymmCipher::BLOCKSIZE] = { 0 };
-                                Base64::atob(coords.data(), data, Base64Str<SymmCipher::BLOCKSIZE>::STRLEN);
-
-                                node->client->setkey(&c, node->client->unshareablekey.data());
-                                c.ctr_crypt(data, SymmCipher::BLOCKSIZE, 0, 0, NULL, false);
-                                ok = !memcmp(data, "unshare/", 8);
-                                if (ok)
-                                {
-                                    coords = string((char*)data + 8, 8);
-                                }
-                            }
-                            else
-                            {
-                                ok = false;
-                            }
-                        }
+                        SymmCipher c;
+                        byte data[SymmCipher::BLOCKSIZE] = { 0 };
+                        Base64::atob(coords.data(), data, Base64Str<SymmCipher::BLOCKSIZE>::STRLEN);
 
+                        node->client->setkey(&c, node->client->unshareablekey.data());
+                        c.ctr_crypt(data, SymmCipher::BLOCKSIZE, 0, 0, NULL, false);
+                        ok = !memcmp(data, "unshare/", 8);
                         if (ok)
                         {
-                            byte buf[3];
-                            int number = 0;
-                            if (Base64::atob((const char *)coords.substr(0, 4).data(), buf, sizeof(buf)) == sizeof(buf))
-                            {
-                                number = (buf[2] << 16) | (buf[1] << 8) | (buf[0]);
-                                latitude = -90 + 180 * (double)number / 0xFFFFFF;
-                            }
-
-                            if (Base64::atob((const char *)coords.substr(4, 4).data(), buf, sizeof(buf)) == sizeof(buf))
-                            {
-                                number = (buf[2] << 16) | (buf[1] << 8) | (buf[0]);
-                                longitude = -180 + 360 * (double)number / 0x01000000;
-                            }
+                            coords = string((char*)data + 8, 8);
                         }
                     }
-
-                    if (longitude < -180 || longitude > 180)
+                    else
                     {
-                        longitude = INVALID_COORDINATE;
+                        ok = false;
                     }
-                    if (latitude < -90 || latitude > 90)
+                }
+
+                if (ok)
+                {
+                    byte buf[3];
+                    int number = 0;
+                    if (Base64::atob((const char *)coords.substr(0, 4).data(), buf, sizeof(buf)) == sizeof(buf))
                     {
-                        latitude = INVALID_COORDINATE;
+                        number = (buf[2] << 16) | (buf[1] << 8) | (buf[0]);
+                        latitude = -90 + 180 * (double)number / 0xFFFFFF;
                     }
-                    if (longitude == INVALID_COORDINATE || latitude == INVALID_COORDINATE)
+
+                    if (Base64::atob((const char *)coords.substr(4, 4).data(), buf, sizeof(buf)) == sizeof(buf))
                     {
-                        longitude = INVALID_COORDINATE;
-                        latitude = INVALID_COORDINATE;
+                        number = (buf[2] << 16) | (buf[1] << 8) | (buf[0]);
+                        longitude = -180 + 360 * (double)number / 0x01000000;
                     }
-               }
+                }
             }
-            else if (it->first == AttrMap::string2nameid("rr"))
+
+            if (longitude < -180 || longitude > 180)
             {
-                handle rr = 0;
-                if (Base64::atob(it->second.c_str(), (byte *)&rr, sizeof(rr)) == MegaClient::NODEHANDLE)
-                {
-                    restorehandle = rr;
-                }
+                longitude = INVALID_COORDINATE;
             }
-            else if (it->first == AttrMap::string2nameid("c") && !fingerprint)
+            if (latitude < -90 || latitude > 90)
             {
-                fingerprint = MegaApi::strdup(it->second.c_str());
+                latitude = INVALID_COORDINATE;
             }
-            else if (it->first == AttrMap::string2nameid("c0"))
+            if (longitude == INVALID_COORDINATE || latitude == INVALID_COORDINATE)
             {
-                originalfingerprint = MegaApi::strdup(it->second.c_str());
+                longitude = INVALID_COORDINATE;
+                latitude = INVALID_COORDINATE;
             }
-            else if (it->first == AttrMap::string2nameid("fav"))
+        }
+    }
+
+    if (const string* rrValue = attr("rr"))
+    {
+        handle rr = 0;
+        if (Base64::atob(rrValue->c_str(), (byte *)&rr, sizeof(rr)) == MegaClient::NODEHANDLE)
+        {
+            restorehandle = rr;
+        }
+    }
+
+    if (const string* c = attr("c"))
+    {
+        if (!fingerprint)
+        {
+            fingerprint = MegaApi::strdup(c->c_str());
+        }
+    }
+
+    if (const string* c0 = attr("c0"))
+    {
+        originalfingerprint = MegaApi::strdup(c0->c_str());
+    }
+
+    if (const string* favValue = attr("fav"))
+    {
+        try
+        {
+            int fav = favValue->empty() ? 0 : std::stoi(*favValue);
+            if (fav != 1 && *favValue != "0")
             {
-                try
-                {
-                    int fav = it->second.empty() ? 0 : std::stoi(it->second);
-                    if (fav != 1 && it->second != "0")
-                    {
-                        LOG_err << "Invalid value for node attr fav: " << fav;
-                    }
-                    else
-                    {
-                        mFavourite = fav;
-                    }
-                }
-                catch (std::exception& ex)
-                {
-                    LOG_err << "Conversion failure for node attr fav: " << ex.what();
-                }
+                LOG_err << "Invalid value for node attr fav: " << fav;
             }
-            else if (it->first == AttrMap::string2nameid("sen"))
+            else
             {
-                try
-                {
-                    int sen = it->second.empty() ? 0 : std::stoi(it->second);
-                    if (sen != 1 && it->second != "0")
-                    {
-                        LOG_err << "Invalid value for node attr sen: " << sen;
-                    }
-                    else
-                    {
-                        mMarkedSensitive = sen;
-                    }
-                }
-                catch (std::exception& ex)
-                {
-                    LOG_err << "Conversion failure for node attr sen: " << ex.what();
-                }
+                mFavourite = fav;
             }
-            else if (it->first == AttrMap::string2nameid("lbl"))
+        }
+        catch (std::exception& ex)
+        {
+            LOG_err << "Conversion failure for node attr fav: " << ex.what();
+        }
+    }
+
+    if (const string* senValue = attr("sen"))
+    {
+        try
+        {
+            int sen = senValue->empty() ? 0 : std::stoi(*senValue);
+            if (sen != 1 && *senValue != "0")
             {
-                try
-                {
-                    int lbl = it->second.empty() ? LBL_UNKNOWN : std::stoi(it->second);
-                    if ((lbl < LBL_RED || lbl > LBL_GREY)  && it->second != "0")
-                    {
-                        LOG_err << "Invalid value for node attr lbl: " << lbl;
-                    }
-                    else
-                    {
-                        mLabel = static_cast<nodelabel_t>(lbl);
-                    }
-                }
-                catch (std::exception& ex)
-                {
-                    LOG_err << "Conversion failure for node attr lbl: " << ex.what();
-                }
+                LOG_err << "Invalid value for node attr sen: " << sen;
             }
-            else if (it->first == AttrMap::string2nameid("dev-id") ||
-                     it->first == AttrMap::string2nameid("drv-id"))
+            else
             {
-                mDeviceId = it->second;
+                mMarkedSensitive = sen;
             }
-            else if (it->first == AttrMap::string2nameid("s4"))
+        }
+        catch (std::exception& ex)
+        {
+            LOG_err << "Conversion failure for node attr sen: " << ex.what();
+        }
+    }
+
+    if (const string* lblValue = attr("lbl"))
+    {
+        try
+        {
+            int lbl = lblValue->empty() ? LBL_UNKNOWN : std::stoi(*lblValue);
+            if ((lbl < LBL_RED || lbl > LBL_GREY)  && *lblValue != "0")
             {
-                mS4 = it->second;
+                LOG_err << "Invalid value for node attr lbl: " << lbl;
             }
+            else
+            {
+                mLabel = static_cast<nodelabel_t>(lbl);
+            }
+        }
+        catch (std::exception& ex)
+        {
+            LOG_err << "Conversion failure for node attr lbl: " << ex.what();
         }
     }
 
+    // "drv-id" sorts after "dev-id", and took precedence when both were present
+    if (const string* drvId = attr("drv-id"))
+    {
+        mDeviceId = *drvId;
+    }
+    else if (const string* devId = attr("dev-id"))
+    {
+        mDeviceId = *devId;
+    }
+
+    if (const string* s4 = attr("s4"))
+    {
+        mS4 = *s4;
+    }
+
     this->type = node->type;
     this->size = node->size;
     this->ctime = node->ctime;
@@ -1286,63 +1311,7 @@ byte *EncryptFilePieceByChunks::nextbuffer(unsigned bufsize)
 
 bool MegaApiImpl::is_syncable(Sync *sync, const char *, const LocalPath& localpath)
 {
-    // Is this path excluded by any path filters?
-    if (!excludedPaths.empty())
-    {
-        // Translate current path into something we can match.
-        auto temp = localpath.toPath(true);
-
-        // Is this path excluded by any path filters?
-        for (const auto& xpath : excludedPaths)
-        {
-            auto xp = LocalPath::fromAbsolutePath(xpath);
-
-            if (xp.isContainingPathOf(localpath))
-            {
-                return false;
-            }
-
-            if (wildcardMatch(temp.c_str(), xpath.c_str()))
-            {
-                return false;
-            }
-        }
-    }
-
-    // Check whether any path components are excluded.
-    auto path = localpath;
-
-    // Convenience.
-    auto root = sync->localroot->getLocalname();
-
-    while (root.isContainingPathOf(path) && path != root)
-    {
-        // Where does this component's name start?
-        auto nameIndex = path.getLeafnameByteIndex();
-
-        // Extract component's name.
-        auto name = path.subpathFrom(nameIndex).toPath(false);
-
-        // Skip these system files on OS X.
-        if (name == "Icon\x0d")
-        {
-            return false;
-        }
-
-        // Is this component's name excluded by any filename filters?
-        for (const auto& xname : excludedNames)
-        {
-            if (wildcardMatch(name.c_str(), xname.c_str()))
-            {
-                return false;
-            }
-        }
-
-        // Climb to the next component.
-        path.truncate(nameIndex - 1);
-    }
-
-    return true;
+    return !exclusionMatcher.excluded(sync->localroot->getLocalname(), localpath);
 }
 
 bool MegaApiImpl::is_syncable(long long size)
@@ -5728,6 +5697,7 @@ void MegaApiImpl::init(MegaApi *api, const char *appKey, MegaGfxProcessor* proce
     httpServerEnableFiles = true;
     httpServerEnableFolders = false;
     httpServerOfflineAttributeEnabled = false;
+    httpServerMetricsEnabled = false;
     httpServerRestrictedMode = MegaApi::TCP_SERVER_ALLOW_CREATED_LOCAL_LINKS;
     httpServerSubtitlesSupportEnabled = false;
 
@@ -9148,6 +9118,7 @@ void MegaApiImpl::setExcludedNames(vector<string> *excludedNames)
     if (!excludedNames)
     {
         this->excludedNames.clear();
+        exclusionMatcher = SyncExclusionMatcher(this->excludedNames, this->excludedPaths);
         return;
     }
 
@@ -9166,6 +9137,8 @@ void MegaApiImpl::setExcludedNames(vector<string> *excludedNames)
             LOG_warn << "Invalid excluded name: " << excludedNames->at(i);
         }
     }
+
+    exclusionMatcher = SyncExclusionMatcher(this->excludedNames, this->excludedPaths);
 }
 
 void MegaApiImpl::setExcludedPaths(vector<string> *excludedPaths)
@@ -9174,6 +9147,7 @@ void MegaApiImpl::setExcludedPaths(vector<string> *excludedPaths)
     if (!excludedPaths)
     {
         this->excludedPaths.clear();
+        exclusionMatcher = SyncExclusionMatcher(this->excludedNames, this->excludedPaths);
         return;
     }
 
@@ -9192,6 +9166,8 @@ void MegaApiImpl::setExcludedPaths(vector<string> *excludedPaths)
             LOG_warn << "Invalid excluded path: " << excludedPaths->at(i);
         }
     }
+
+    exclusionMatcher = SyncExclusionMatcher(this->excludedNames, this->excludedPaths);
 }
 
 void MegaApiImpl::setExclusionLowerSizeLimit(long long limit)
@@ -9754,6 +9730,7 @@ bool MegaApiImpl::httpServerStart(bool localOnly, int port, bool useTLS, const c
     httpServer->setMaxOutputSize(httpServerMaxOutputSize);
     httpServer->enableFileServer(httpServerEnableFiles);
     httpServer->enableOfflineAttribute(httpServerOfflineAttributeEnabled);
+    httpServer->enableMetrics(httpServerMetricsEnabled);
     httpServer->enableFolderServer(httpServerEnableFolders);
     httpServer->setRestrictedMode(httpServerRestrictedMode);
     httpServer->enableSubtitlesSupport(httpServerRestrictedMode);
@@ -9987,6 +9964,21 @@ bool MegaApiImpl::httpServerIsOfflineAttributeEnabled()
     return httpServerOfflineAttributeEnabled;
 }
 
+void MegaApiImpl::httpServerEnableMetrics(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    this->httpServerMetricsEnabled = enable;
+    if (httpServer)
+    {
+        httpServer->enableMetrics(enable);
+    }
+}
+
+bool MegaApiImpl::httpServerIsMetricsEnabled()
+{
+    return httpServerMetricsEnabled;
+}
+
 void MegaApiImpl::httpServerSetRestrictedMode(int mode)
 {
     if (mode != MegaApi::TCP_SERVER_DENY_ALL
@@ -12319,7 +12311,8 @@ void MegaApiImpl::file_added(File *f)
         else
         {
 #ifdef ENABLE_SYNC
-            LocalNode *ll = dynamic_cast<LocalNode *>(f);
+            SyncFilePut *sfp = dynamic_cast<SyncFilePut *>(f);
+            LocalNode *ll = sfp ? sfp->localNode : nullptr;
             if (ll && ll->parent && ll->parent->node)
             {
                 transfer->setParentHandle(ll->parent->node->nodehandle);
@@ -12334,10 +12327,10 @@ void MegaApiImpl::file_added(File *f)
 
         string path;
 #ifdef ENABLE_SYNC
-        LocalNode *l = dynamic_cast<LocalNode *>(f);
-        if (l)
+        SyncFilePut *sfp = dynamic_cast<SyncFilePut *>(f);
+        if (sfp)
         {
-            path = l->getLocalPath().toPath(false);
+            path = sfp->localNode->getLocalPath().toPath(false);
         }
         else
 #endif
@@ -14526,6 +14519,9 @@ void MegaApiImpl::logout_result(error e, MegaRequestPrivate* request)
         waitingRequest = RETRY_NONE;
         excludedNames.clear();
         excludedPaths.clear();
+#ifdef ENABLE_SYNC
+        exclusionMatcher = SyncExclusionMatcher();
+#endif
         syncLowerSizeLimit = 0;
         syncUpperSizeLimit = 0;
 
@@ -17208,17 +17204,15 @@ bool MegaApiImpl::nodeComparatorLabelASC(Node *i, Node *j)
 
     nameid labelId = AttrMap::string2nameid("lbl");
     int iLabel = MegaNode::NODE_LBL_UNKNOWN;
-    auto iAttrIt = i->attrs.map.find(labelId);
-    if (iAttrIt != i->attrs.map.end())
+    if (const string* iAttr = i->attr(labelId))
     {
-       iLabel = std::atoi(iAttrIt->second.c_str());
+       iLabel = std::atoi(iAttr->c_str());
     }
 
     int jLabel = MegaNode::NODE_LBL_UNKNOWN;
-    auto jAttrIt = j->attrs.map.find(labelId);
-    if (jAttrIt != j->attrs.map.end())
+    if (const string* jAttr = j->attr(labelId))
     {
-       jLabel = std::atoi(jAttrIt->second.c_str());
+       jLabel = std::atoi(jAttr->c_str());
     }
 
     if (iLabel == MegaNode::NODE_LBL_UNKNOWN && jLabel ==  MegaNode::NODE_LBL_UNKNOWN)
@@ -17255,17 +17249,15 @@ bool MegaApiImpl::nodeComparatorLabelDESC(Node *i, Node *j)
 
     nameid labelId = AttrMap::string2nameid("lbl");
     int iLabel = MegaNode::NODE_LBL_UNKNOWN;
-    auto iAttrIt = i->attrs.map.find(labelId);
-    if (iAttrIt != i->attrs.map.end())
+    if (const string* iAttr = i->attr(labelId))
     {
-       iLabel = std::atoi(iAttrIt->second.c_str());
+       iLabel = std::atoi(iAttr->c_str());
     }
 
     int jLabel = MegaNode::NODE_LBL_UNKNOWN;
-    auto jAttrIt = j->attrs.map.find(labelId);
-    if (jAttrIt != j->attrs.map.end())
+    if (const string* jAttr = j->attr(labelId))
     {
-       jLabel = std::atoi(jAttrIt->second.c_str());
+       jLabel = std::atoi(jAttr->c_str());
     }
 
     if (iLabel == MegaNode::NODE_LBL_UNKNOWN && jLabel == MegaNode::NODE_LBL_UNKNOWN)
@@ -17302,8 +17294,8 @@ bool MegaApiImpl::nodeComparatorFavASC(Node *i, Node *j)
     }
 
     nameid favId = AttrMap::string2nameid("fav");
-    bool iFav = (i->attrs.map.find(favId) != i->attrs.map.end());
-    bool jFav = (j->attrs.map.find(favId) != j->attrs.map.end());
+    bool iFav = i->attr(favId) != nullptr;
+    bool jFav = j->attr(favId) != nullptr;
 
     if (!(iFav ^ jFav))
     {
@@ -17329,8 +17321,8 @@ bool MegaApiImpl::nodeComparatorFavDESC(Node *i, Node *j)
     }
 
     nameid favId = AttrMap::string2nameid("fav");
-    bool iFav = (i->attrs.map.find(favId) != i->attrs.map.end());
-    bool jFav = (j->attrs.map.find(favId) != j->attrs.map.end());
+    bool iFav = i->attr(favId) != nullptr;
+    bool jFav = j->attr(favId) != nullptr;
 
     if (!(iFav ^ jFav))
     {
@@ -18118,7 +18110,7 @@ unsigned MegaApiImpl::sendPendingTransfers(TransferQueue *queue, MegaRecursiveOp
                             AttrMap attrs;
                             string attrstring;
                             key.setkey((const byte*)tc.nn[0].nodekey.data(), samenode->type);
-                            attrs = samenode->attrs;
+                            attrs = samenode->attrs();
                             string sname = fileName;
                             LocalPath::utf8_normalize(&sname);
                             attrs.map['n'] = sname;
@@ -18289,8 +18281,8 @@ unsigned MegaApiImpl::sendPendingTransfers(TransferQueue *queue, MegaRecursiveOp
                     {
                         if (!fileName)
                         {
-                            attr_map::iterator ait = node->attrs.map.find('n');
-                            if (ait == node->attrs.map.end())
+                            attr_map::iterator ait = node->attrs().map.find('n');
+                            if (ait == node->attrs().map.end())
                             {
                                 name = LocalPath::fromRelativePath("CRYPTO_ERROR");
                             }
@@ -19178,8 +19170,8 @@ void MegaApiImpl::moveNode(MegaNode* node, MegaNode* newParent, const char* newN
                     }
                     else
                     {
-                        attr_map::iterator it = node->attrs.map.find('n');
-                        if (it != node->attrs.map.end())
+                        attr_map::iterator it = node->attrs().map.find('n');
+                        if (it != node->attrs().map.end())
                         {
                             newName = it->second;
                         }
@@ -19222,7 +19214,7 @@ void MegaApiImpl::moveNode(MegaNode* node, MegaNode* newParent, const char* newN
                     string newName(name);
                     LocalPath::utf8_normalize(&newName);
 
-                    AttrMap attrs = node->attrs;
+                    AttrMap attrs = node->attrs();
                     attrs.map['n'] = newName;
 
                     string attrstring;
@@ -19240,7 +19232,7 @@ void MegaApiImpl::moveNode(MegaNode* node, MegaNode* newParent, const char* newN
                     nameid rrname = AttrMap::string2nameid("rr");
                     Base64Str<MegaClient::NODEHANDLE> rrvalue(node->parent->nodehandle);
                     // Add attribute to a copy of old attributes
-                    AttrMap attrs = node->attrs;
+                    AttrMap attrs = node->attrs();
                     attrs.map[rrname] = rrvalue;
 
                     // Magic incantations for setting attributes
@@ -19391,8 +19383,8 @@ error MegaApiImpl::performRequest_copy(MegaRequestPrivate* request)
                 }
                 else
                 {
-                    attr_map::iterator it = node->attrs.map.find('n');
-                    if (it != node->attrs.map.end())
+                    attr_map::iterator it = node->attrs().map.find('n');
+                    if (it != node->attrs().map.end())
                     {
                         sname = it->second;
                     }
@@ -19430,7 +19422,7 @@ error MegaApiImpl::performRequest_copy(MegaRequestPrivate* request)
                     string attrstring;
 
                     key.setkey((const byte*)tc.nn[0].nodekey.data(), node->type);
-                    attrs = node->attrs;
+                    attrs = node->attrs();
 
                     attrs.map['n'] = sname;
 
@@ -19497,7 +19489,7 @@ void MegaApiImpl::restoreVersion(MegaNode* version, MegaRequestListener* listene
             if (newnode->nodekey.size())
             {
                 key.setkey((const byte*)version->nodekey().data(), version->type);
-                version->attrs.getjson(&attrstring);
+                version->attrs().getjson(&attrstring);
                 client->makeattr(&key, newnode->attrstring, attrstring.c_str());
             }
 
@@ -20702,8 +20694,8 @@ void MegaApiImpl::getFavourites(MegaNode* node, int count, MegaRequestListener*
                 // Check if 'node' is favourite, DB query starts at 'node' children
                 std::vector<NodeHandle> favouriteNodes;
                 nameid nid = AttrMap::string2nameid("fav");
-                auto attrMapIterator = node->attrs.map.find(nid);
-                if (attrMapIterator != node->attrs.map.end() && attrMapIterator->second == "1")
+                auto attrMapIterator = node->attrs().map.find(nid);
+                if (attrMapIterator != node->attrs().map.end() && attrMapIterator->second == "1")
                 {
                     favouriteNodes.push_back(node->nodeHandle());
                 }
@@ -21565,6 +21557,53 @@ void MegaApiImpl::setMaxConnections(int direction, int connections, MegaRequestL
     waiter->notify();
 }
 
+void MegaApiImpl::setAdaptiveTransferTuning(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->adaptivetransferslots = enable;
+}
+
+void MegaApiImpl::setDownloadsFromLocalCopies(bool enable)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->localcopydownloads = enable;
+    if (!enable)
+    {
+        client->localcontentindex.clear();
+    }
+}
+
+void MegaApiImpl::setActionPacketGroupCommit(int windowMs, int maxRows)
+{
+    SdkMutexGuard g(sdkMutex);
+    client->sccommitgroupds = windowMs > 0 ? dstime((windowMs + 99) / 100) : 0;
+    client->sccommitgrouprows = maxRows > 0 ? uint64_t(maxRows) : 0;
+}
+
+bool MegaApiImpl::setHttp2Multiplexing(bool enable, int maxStreamsPerConnection)
+{
+    SdkMutexGuard g(sdkMutex);
+    return client->httpio->sethttp2(enable, maxStreamsPerConnection);
+}
+
+void MegaApiImpl::setTransferMemoryLimit(long long bytes)
+{
+    TransferBufferPool::instance().setLimit(bytes > 0 ? size_t(bytes) : 0);
+}
+
+char* MegaApiImpl::getPerformanceMetrics(int format)
+{
+    switch (format)
+    {
+    case MegaApi::METRICS_FORMAT_JSON:
+        return MegaApi::strdup(MetricsRegistry::instance().toJson().c_str());
+    case MegaApi::METRICS_FORMAT_PROMETHEUS:
+        return MegaApi::strdup(MetricsRegistry::instance().toPrometheus().c_str());
+    default:
+        return NULL;
+    }
+}
+
 error MegaApiImpl::performTransferRequest_cancelTransfer(MegaRequestPrivate* request, TransferDbCommitter& committer)
 {
             int transferTag = request->getTransferTag();
@@ -24763,7 +24802,7 @@ void MegaApiImpl::update()
     LOG_debug << "PendingCS? " << (client->pendingcs != NULL);
     LOG_debug << "PendingFA? " << client->activefa.size() << " active, " << client->queuedfa.size() << " queued";
     LOG_debug << "FLAGS: " << client->syncactivity
-              << " " << client->syncdownrequired << " " << client->syncdownretry
+              << " " << client->syncdownrequired << " " << client->syncdowndirty << " " << client->syncdownretry
               << " " << client->syncfslockretry << " " << client->syncfsopsfailed
               << " " << client->syncnagleretry << " " << client->syncscanfailed
               << " " << client->syncops << " " << client->syncscanstate
@@ -25660,7 +25699,7 @@ void TreeProcCopy::proc(MegaClient* client, Node* n)
             key.setkey((const byte*)t->nodekey.data(),n->type);
 
             AttrMap tattrs;
-            tattrs.map = n->attrs.map;
+            tattrs.map = n->attrs().map;
             nameid rrname = AttrMap::string2nameid("rr");
             attr_map::iterator it = tattrs.map.find(rrname);
             if (it != tattrs.map.end())
@@ -27135,20 +27174,50 @@ void MegaFolderUploadController::start(MegaNode*)
     // it's mandatory to notify stage change from MegaApiImpl's thread to avoid deadlocks and other issues
     notifyStage(MegaTransfer::STAGE_SCAN);
 
-    mWorkerThread = std::thread ([this, path]() {
+    // file transfers are started folder by folder, so keep the operation open until all of them are
+    mQueuingSubtransfers = true;
+
+    weak_ptr<MegaFolderUploadController> weak_this = shared_from_this();
+
+    mWorkerThread = std::thread ([this, path, weak_this]() {
         // recurse all subfolders on disk, building up tree structure to match
         // not yet existing folders get a temporary upload id instead of a handle
         uint32_t foldercount = 0;
         uint32_t filecount = 0;
         LocalPath lp = path;
-        scanFolder_result scanResult = scanFolder(*mUploadTree.subtrees.front(), lp, foldercount, filecount);
+        vector<Tree*> folders;
+        scanFolder_result scanResult = scanFolder(*mUploadTree.subtrees.front(), lp, foldercount, filecount, folders);
+
+        if (scanResult == scanFolder_succeeded)
+        {
+            // the folder structure won't change anymore: create it in the cloud
+            // while the (slower) fingerprinting of the files goes on here
+            mTreeReadyForMegaApiThread.reset(new ExecuteOnce([this, weak_this, filecount]() {
+                if (!weak_this.lock() || mFinished) return;
+                assert(mMainThreadId == std::this_thread::get_id());
+
+                mTreeReady = true;
+                mFilesNotQueued = filecount;
+
+                // create folders in batches, not too many at once
+                // the files of each folder are uploaded as soon as it's created and they are fingerprinted
+                notifyStage(MegaTransfer::STAGE_CREATE_TREE);
+                sendFolderBatches();
+            }));
+            megaApi->executeOnThread(mTreeReadyForMegaApiThread);
+
+            if (!fingerprintFiles(folders, weak_this))
+            {
+                scanResult = scanFolder_cancelled;
+            }
+        }
 
         // if the thread runs, we always queue a function to execute on MegaApi thread for onFinish()
         // we keep a pointer to it in case we need to execute it early and directly on cancel()
         mCompletionForMegaApiThread.reset(new ExecuteOnce([this, scanResult]() {
 
             // these next parts must run on MegaApiImpl's thread again, as
-            // genUploadTransfersForFiles or checkCompletion may call the fireOnXYZ() functions
+            // finishQueuing or checkQueuingComplete may call the fireOnXYZ() functions
             assert(mMainThreadId == std::this_thread::get_id());
 
             // make sure the thread is joined.  This lets us add error-catching asserts elsewhere.
@@ -27156,31 +27225,31 @@ void MegaFolderUploadController::start(MegaNode*)
             {
                 mWorkerThread.join();
             }
+            mScanComplete = true;
+
+            if (mPendingCompletion)
+            {
+                // folder creation failed or was cancelled meanwhile
+                finishQueuing(mPendingError, mPendingCancelledByUser);
+                return;
+            }
 
             if (scanResult == scanFolder_failed)
             {
                 // scan stage could not finish properly, because some dir could not be accessed
-                complete(API_EACCESS);
+                mFinished = true;
+                finishQueuing(API_EACCESS);
                 return;
             }
             else if (scanResult == scanFolder_cancelled)
             {
-                complete(API_EINCOMPLETE, true);
+                mFinished = true;
+                finishQueuing(API_EINCOMPLETE, true);
                 return;
             }
 
-            // create folders in batches, not too many at once
-            // createNextFolderBatch is responsible for starting the transfers once all needed folders (if any) are created.
-            notifyStage(MegaTransfer::STAGE_CREATE_TREE);
-            vector<NewNode> newnodes;
-#ifndef NDEBUG
-            batchResult r =
-#endif
-            createNextFolderBatch(mUploadTree, newnodes, true);
-
-            assert(r == batchResult_cancelled ||
-                   r == batchResult_requestSent ||
-                   r == batchResult_batchesComplete);
+            // the last folders may still be waiting for their batch or their fingerprints
+            checkQueuingComplete();
         }));
 
         // Queue that function.
@@ -27188,6 +27257,44 @@ void MegaFolderUploadController::start(MegaNode*)
     });
 }
 
+void MegaFolderUploadController::completeWhenScanned(Error e, bool cancelledByUser)
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+    mFinished = true;
+
+    if (mScanComplete)
+    {
+        finishQueuing(e, cancelledByUser);
+        return;
+    }
+
+    // the worker thread is still fingerprinting: stop it, its completion reports this result
+    mPendingCompletion = true;
+    mPendingError = e;
+    mPendingCancelledByUser = cancelledByUser;
+    mWorkerThreadStopFlag = true;
+}
+
+void MegaFolderUploadController::finishQueuing(Error e, bool cancelledByUser)
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+    assert(mScanComplete && mFinished);
+    mQueuingSubtransfers = false;
+
+    if (allSubtransfersResolved())
+    {
+        complete(e ? e : Error(mIncompleteTransfers ? API_EINCOMPLETE : API_OK), cancelledByUser);
+        return;
+    }
+
+    // the last sub-transfer to finish completes the folder transfer
+    if (e && !cancelledByUser)
+    {
+        mIncompleteTransfers++;
+    }
+    checkAllSubtransfersStarted();
+}
+
 // this method provides a temporal handle useful to indicate putnodes()-local parent linkage
 handle MegaFolderUploadController::nextUploadId()
 {
@@ -27202,16 +27309,7 @@ void MegaRecursiveOperation::onTransferStart(MegaApi *, MegaTransfer *t)
     assert(transfer);
 
     ++transfersStartedCount;
-    if (transfersStartedCount == transfersTotalCount &&
-        !transfer->accessCancelToken().isCancelled() &&
-        !startedTransferring)
-    {
-        // Apps expect this one called when all sub-transfers have
-        // been queued in SDK core already
-        notifyStage(MegaTransfer::STAGE_TRANSFERRING_FILES);
-        megaApi->fireOnFolderTransferUpdate(transfer, MegaTransfer::STAGE_TRANSFERRING_FILES, 0, 0, unsigned(transfersTotalCount), nullptr, nullptr);
-        startedTransferring = true;
-    }
+    checkAllSubtransfersStarted();
 
     if (transfer)
     {
@@ -27223,6 +27321,22 @@ void MegaRecursiveOperation::onTransferStart(MegaApi *, MegaTransfer *t)
     }
 }
 
+void MegaRecursiveOperation::checkAllSubtransfersStarted()
+{
+    if (transfersStartedCount &&
+        transfersStartedCount == transfersTotalCount &&
+        !mQueuingSubtransfers &&
+        !transfer->accessCancelToken().isCancelled() &&
+        !startedTransferring)
+    {
+        // Apps expect this one called when all sub-transfers have
+        // been queued in SDK core already
+        notifyStage(MegaTransfer::STAGE_TRANSFERRING_FILES);
+        megaApi->fireOnFolderTransferUpdate(transfer, MegaTransfer::STAGE_TRANSFERRING_FILES, 0, 0, unsigned(transfersTotalCount), nullptr, nullptr);
+        startedTransferring = true;
+    }
+}
+
 void MegaRecursiveOperation::onTransferUpdate(MegaApi *, MegaTransfer *t)
 {
     assert(mMainThreadId == std::this_thread::get_id());
@@ -27280,7 +27394,7 @@ MegaFolderUploadController::~MegaFolderUploadController()
     //we shouldn't need to detach as transfer listener: all listened transfer should have been cancelled/completed
 }
 
-MegaFolderUploadController::scanFolder_result MegaFolderUploadController::scanFolder(Tree& tree, LocalPath& localPath, uint32_t& foldercount, uint32_t& filecount)
+MegaFolderUploadController::scanFolder_result MegaFolderUploadController::scanFolder(Tree& tree, LocalPath& localPath, uint32_t& foldercount, uint32_t& filecount, vector<Tree*>& folders)
 {
     recursive++;
     unique_ptr<DirAccess> da(fsaccess->newdiraccess());
@@ -27315,16 +27429,8 @@ MegaFolderUploadController::scanFolder_result MegaFolderUploadController::scanFo
         localPath.appendWithSeparator(localname, false);
         if (dirEntryType == FILENODE)
         {
-            // Do the fingerprinting for uploads on the scan thread, so we don't lock the main mutex for so long
-            FileFingerprint fp;
-            auto fa = fsaccess->newfileaccess();
-            if (fa->fopen(localPath, true, false, FSLogging::logOnError))
-            {
-                fp.genfingerprint(fa.get());
-            }
-
-            // if we couldn't get the fingerprint, !isvalid and we'll fail the transfer
-            tree.files.emplace_back(localPath, fp);
+            // fingerprinted later by fingerprintFiles()
+            tree.files.emplace_back(localPath, FileFingerprint());
 
             filecount += 1;
         }
@@ -27342,7 +27448,7 @@ MegaFolderUploadController::scanFolder_result MegaFolderUploadController::scanFo
             newTreeNode->newnode.nodehandle = nextUploadId();
             newTreeNode->newnode.parenthandle = tree.newnode.nodehandle;
 
-            scanFolder_result sr = scanFolder(*newTreeNode, localPath, foldercount, filecount);
+            scanFolder_result sr = scanFolder(*newTreeNode, localPath, foldercount, filecount, folders);
             if (sr != scanFolder_succeeded)
             {
                 recursive--;
@@ -27353,11 +27459,151 @@ MegaFolderUploadController::scanFolder_result MegaFolderUploadController::scanFo
             foldercount += 1;
         }
     }
+
+    // tree.files is complete, the records won't move anymore
+    if (!tree.files.empty())
+    {
+        folders.push_back(&tree);
+    }
+
     recursive--;
     return scanFolder_succeeded;
 }
 
-MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFolderBatch(Tree& tree, vector<NewNode>& newnodes, bool isBatchRootLevel)
+bool MegaFolderUploadController::fingerprintFiles(const vector<Tree*>& folders, weak_ptr<MegaFolderUploadController> weak_this)
+{
+    // files are taken folder by folder, so the first folders are ready early
+    vector<pair<Tree*, Tree::FileRecord*>> files;
+    for (Tree* t : folders)
+    {
+        t->filesToFingerprint = t->files.size();
+        for (auto& f : t->files)
+        {
+            files.emplace_back(t, &f);
+        }
+    }
+
+    // Do the fingerprinting for uploads on worker threads, so we don't lock the main mutex for so long
+    std::atomic<size_t> next(0);
+    auto fingerprintNext = [this, &files, &next, weak_this]()
+    {
+        for (size_t i = next++; i < files.size(); i = next++)
+        {
+            if (mWorkerThreadStopFlag || isCancelledByFolderTransferToken())
+            {
+                return;
+            }
+
+            // if we couldn't get the fingerprint, !isvalid and we'll fail the transfer
+            auto fa = fsaccess->newfileaccess();
+            if (fa->fopen(files[i].second->lp, true, false, FSLogging::logOnError))
+            {
+                files[i].second->fp.genfingerprint(fa.get());
+            }
+
+            if (--files[i].first->filesToFingerprint)
+            {
+                continue;
+            }
+
+            // last file of its folder: hand the folder over, waking up the MegaApiImpl's thread if it isn't already
+            bool wasEmpty;
+            {
+                std::lock_guard<std::mutex> g(mFingerprintedFoldersMutex);
+                wasEmpty = mFingerprintedFolders.empty();
+                mFingerprintedFolders.push_back(files[i].first);
+            }
+
+            if (wasEmpty)
+            {
+                megaApi->executeOnThread(std::make_shared<ExecuteOnce>([this, weak_this]() {
+                    if (!weak_this.lock()) return;
+                    onFoldersFingerprinted();
+                }));
+            }
+        }
+    };
+
+    // mostly waiting on disk reads, so a few threads help even on small machines
+    size_t numThreads = std::min<size_t>(std::max(std::thread::hardware_concurrency(), 4u), 8);
+    numThreads = std::max<size_t>(1, std::min(numThreads, files.size()));
+
+    vector<std::thread> helpers;
+    for (size_t i = 1; i < numThreads; ++i)
+    {
+        helpers.emplace_back(fingerprintNext);
+    }
+    fingerprintNext();
+    for (auto& t : helpers)
+    {
+        t.join();
+    }
+
+    if (mWorkerThreadStopFlag || isCancelledByFolderTransferToken())
+    {
+        LOG_debug << "MegaFolderUploadController::fingerprintFiles stopped";
+        return false;
+    }
+
+    LOG_debug << "MegaFolderUploadController fingerprinted " << files.size() << " files on " << numThreads << " threads";
+    return true;
+}
+
+void MegaFolderUploadController::onFoldersFingerprinted()
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+
+    vector<Tree*> folders;
+    {
+        std::lock_guard<std::mutex> g(mFingerprintedFoldersMutex);
+        folders.swap(mFingerprintedFolders);
+    }
+
+    for (Tree* t : folders)
+    {
+        t->filesFingerprinted = true;
+        queueFolderFiles(*t);
+    }
+
+    startReadyFileTransfers();
+    // no further code can be added here, this object may now be deleted
+}
+
+void MegaFolderUploadController::sendFolderBatches()
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+
+    // batches under different, already existing folders are independent,
+    // so several can be in flight instead of one round trip per batch
+    while (!mFinished && mFolderBatchesInFlight < MAX_FOLDER_BATCHES_IN_FLIGHT)
+    {
+        vector<NewNode> newnodes;
+        vector<Tree*> batchTrees;
+        batchResult r = createNextFolderBatch(mUploadTree, newnodes, batchTrees, true);
+
+        assert(r == batchResult_cancelled ||
+               r == batchResult_requestSent ||
+               r == batchResult_batchesComplete ||
+               r == batchResult_waitingForBatches);
+
+        if (r == batchResult_cancelled)
+        {
+            // no further code can be added here, this object may now be deleted
+            return;
+        }
+
+        if (r != batchResult_requestSent)
+        {
+            break;
+        }
+    }
+
+    // the walk found the folders that exist by now
+    startReadyFileTransfers();
+    // no further code can be added here, this object may now be deleted
+}
+
+MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFolderBatch(Tree& tree, vector<NewNode>& newnodes, vector<Tree*>& batchTrees, bool isBatchRootLevel)
 {
     assert(mMainThreadId == std::this_thread::get_id());
 
@@ -27381,11 +27627,22 @@ MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFo
            break;
         }
 
+        if (t->creationInFlight)
+        {
+            // being created by another batch, its subtree goes in later ones
+            continue;
+        }
+
         if (!t->megaNode && tree.megaNode) // check if our last call created it (or it always existed)
         {
             t->megaNode.reset(megaApi->getChildNodeOfType(tree.megaNode.get(), t->folderName.c_str(), MegaNode::TYPE_FOLDER));
         }
 
+        if (t->megaNode)
+        {
+            queueFolderFiles(*t);
+        }
+
         // if node doesn't exist yet and we haven't exceeded the limit per batch
         if (!t->megaNode && newnodes.size() < MAXNODESUPLOAD)
         {
@@ -27397,10 +27654,12 @@ MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFo
                 t->newnode.parenthandle = UNDEF;
             }
             newnodes.push_back(std::move(t->newnode));
+            batchTrees.push_back(t.get());
+            t->creationInFlight = true;
         }
 
         // if newnodes contains at least one newNode, isBatchRootLevel will be false
-        batchResult br = createNextFolderBatch(*t, newnodes, newnodes.empty());
+        batchResult br = createNextFolderBatch(*t, newnodes, batchTrees, newnodes.empty());
         if (br != batchResult_stillRecursing)
         {
             return br;
@@ -27409,7 +27668,7 @@ MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFo
 
     if (isCancelledByFolderTransferToken())
     {
-        complete(API_EINCOMPLETE, true);
+        completeWhenScanned(API_EINCOMPLETE, true);
         return batchResult_cancelled;
     }
 
@@ -27419,35 +27678,37 @@ MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFo
         // use a weak_ptr in case this operation was cancelled, and 'this' object doesn't exist
         // anymore when the request completes
         weak_ptr<MegaFolderUploadController> weak_this = shared_from_this();
+        ++mFolderBatchesInFlight;
         megaapiThreadClient()->putnodes(NodeHandle().set6byte(tree.megaNode->getHandle()), UseLocalVersioningFlag, std::move(newnodes), nullptr, megaapiThreadClient()->nextreqtag(), false,
-            [this, weak_this](const Error& e, targettype_t, vector<NewNode>&, bool, int tag)
+            [this, weak_this, batchTrees](const Error& e, targettype_t, vector<NewNode>&, bool, int tag)
             {
                 // double check our object still exists on request completion
                 if (!weak_this.lock()) return;
                 assert(weak_this.lock().get() == this);
                 assert(mMainThreadId == std::this_thread::get_id());
 
+                --mFolderBatchesInFlight;
+                for (Tree* t : batchTrees)
+                {
+                    t->creationInFlight = false;
+                }
+
+                if (mFinished) return;
+
                 // lambda function that will be executed as completion function in putnodes procresult
                 if (e)
                 {
-                    complete(e);
+                    completeWhenScanned(e);
                 }
                 else
                 {
-                    // start the next batch, if there are any left (or start transfers, if we are ready)
-                    vector<NewNode> newnodes;
-#ifndef NDEBUG
-                    batchResult r =
-#endif
-                    createNextFolderBatch(mUploadTree, newnodes, true);
-
-                    assert(r == batchResult_cancelled ||
-                           r == batchResult_requestSent ||
-                           r == batchResult_batchesComplete);
-
+                    // start the next batches, if there are any left (or start transfers, if we are ready)
+                    sendFolderBatches();
                 }
             });
 
+        DEBUG_TEST_HOOK_FOLDER_UPLOAD_BATCH_SENT(mFolderBatchesInFlight);
+
         unsigned existing = 0, total = 0;
         mUploadTree.recursiveCountFolders(existing, total);
         megaApi->fireOnFolderTransferUpdate(transfer, MegaTransfer::STAGE_CREATE_TREE, total, existing, 0, nullptr, nullptr);
@@ -27457,33 +27718,86 @@ MegaFolderUploadController::batchResult MegaFolderUploadController::createNextFo
 
     if (&tree == &mUploadTree)
     {
-        // we recursed the entire tree without finding any more folder nodes to create.
-        // time to set the file uploads in motion.
-
-        TransferQueue transferQueue;
-        if (!genUploadTransfersForFiles(mUploadTree, transferQueue))
-        {
-            complete(API_EINCOMPLETE, true);
-        }
-        else if (transferQueue.empty())
-        {
-            complete(API_OK);
-        }
-        else
+        if (mFolderBatchesInFlight)
         {
-            // once we call sendPendingTransfers, we are guaranteed start/finish callbacks for each file transfer
-            // the last callback of onFinish for one of these will also complete and destroy this MegaFolderUploadController
-            transfersTotalCount = transferQueue.size();
-            megaApi->sendPendingTransfers(&transferQueue, this);
-            // no further code can be added here, this object may now be deleted (eg, due to cancel token activation)
+            // nothing else can be sent until those complete
+            return batchResult_waitingForBatches;
         }
 
+        // we recursed the entire tree without finding any more folder nodes to create.
+        // the remaining file uploads start as soon as they are fingerprinted.
+        mFoldersCreated = true;
         return batchResult_batchesComplete;
     }
 
     return batchResult_stillRecursing;
 }
 
+void MegaFolderUploadController::queueFolderFiles(Tree& tree)
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+
+    if (!tree.filesQueued && tree.filesFingerprinted && tree.megaNode)
+    {
+        tree.filesQueued = true;
+        mFoldersReady.push_back(&tree);
+    }
+}
+
+void MegaFolderUploadController::startReadyFileTransfers()
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+
+    // wait for the folder structure, so transfers don't start before STAGE_CREATE_TREE
+    if (!mTreeReady || mFinished) return;
+
+    TransferQueue transferQueue;
+    bool cancelled = false;
+    for (Tree* t : mFoldersReady)
+    {
+        assert(mFilesNotQueued >= t->files.size());
+        mFilesNotQueued -= t->files.size();
+
+        if (!genUploadTransfersForFiles(*t, transferQueue))
+        {
+            cancelled = true;
+            break;
+        }
+    }
+    mFoldersReady.clear();
+
+    if (!transferQueue.empty())
+    {
+        // once we call sendPendingTransfers, we are guaranteed start/finish callbacks for each file transfer.
+        // While mQueuingSubtransfers is set, the last of them can't complete this MegaFolderUploadController
+        transfersTotalCount += transferQueue.size();
+        megaApi->sendPendingTransfers(&transferQueue, this);
+    }
+
+    if (cancelled || isCancelledByFolderTransferToken())
+    {
+        completeWhenScanned(API_EINCOMPLETE, true);
+        // no further code can be added here, this object may now be deleted
+        return;
+    }
+
+    checkQueuingComplete();
+    // no further code can be added here, this object may now be deleted
+}
+
+void MegaFolderUploadController::checkQueuingComplete()
+{
+    assert(mMainThreadId == std::this_thread::get_id());
+
+    if (!mFinished && mScanComplete && mFoldersCreated && !mFilesNotQueued)
+    {
+        // every file transfer was started: the last one to finish completes the folder transfer
+        mFinished = true;
+        finishQueuing(API_OK);
+        // no further code can be added here, this object may now be deleted
+    }
+}
+
 bool MegaFolderUploadController::genUploadTransfersForFiles(Tree& tree, TransferQueue& transferQueue)
 {
     for (const auto& localpath : tree.files)
@@ -27496,12 +27810,6 @@ bool MegaFolderUploadController::genUploadTransfersForFiles(Tree& tree, Transfer
         if (isCancelledByFolderTransferToken()) return false;
     }
 
-    for (auto& t : tree.subtrees)
-    {
-        genUploadTransfersForFiles(*t, transferQueue);
-        if (isCancelledByFolderTransferToken()) return false;
-    }
-
     return true;
 }
 
@@ -30197,6 +30505,7 @@ MegaHTTPServer::MegaHTTPServer(MegaApiImpl *megaApi, string basePath, bool useTL
     this->fileServerEnabled = true;
     this->folderServerEnabled = true;
     this->offlineAttribute = false;
+    this->metricsEnabled = false;
     this->subtitlesSupportEnabled = false;
 }
 
@@ -30391,6 +30700,16 @@ bool MegaHTTPServer::isOfflineAttributeEnabled()
     return offlineAttribute;
 }
 
+void MegaHTTPServer::enableMetrics(bool enable)
+{
+    this->metricsEnabled = enable;
+}
+
+bool MegaHTTPServer::isMetricsEnabled()
+{
+    return metricsEnabled;
+}
+
 bool MegaHTTPServer::isSubtitlesSupportEnabled()
 {
     return subtitlesSupportEnabled;
@@ -31122,6 +31441,28 @@ int MegaHTTPServer::onMessageComplete(http_parser *parser)
         return 0;
     }
 
+    if (httpctx->path == "/metrics" && httpserver->isMetricsEnabled()
+            && (parser->method == HTTP_GET || parser->method == HTTP_HEAD))
+    {
+        LOG_debug << "Metrics requested";
+        string metrics = MetricsRegistry::instance().toPrometheus();
+        response << "HTTP/1.1 200 OK\r\n"
+                 << "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                 << "Connection: close\r\n"
+                 << "Content-Length: " << metrics.size() << "\r\n"
+                 << "\r\n";
+
+        if (parser->method != HTTP_HEAD)
+        {
+            response << metrics;
+        }
+
+        httpctx->resultCode = API_OK;
+        string resstr = response.str();
+        sendHeaders(httpctx, &resstr);
+        return 0;
+    }
+
     if (httpctx->path == "/")
     {
         node = httpctx->megaApi->getRootNode();
@@ -1040,7 +1040,7 @@ bool MegaClient::isValidFolderLink()
         if (!h.isUndef())
         {
             Node *n = nodeByHandle(h);
-            if (n && (n->attrs.map.find('n') != n->attrs.map.end()))    // is it decrypted? (valid key)
+            if (n && (n->attrs().map.find('n') != n->attrs().map.end()))    // is it decrypted? (valid key)
             {
                 return true;
             }
@@ -1484,8 +1484,8 @@ void MegaClient::honorPreviousVersionAttrs(Node *previousNode, AttrMap &attrs)
     {
         for (const string& attr : Node::attributesToCopyIntoPreviousVersions) {
             nameid id = AttrMap::string2nameid(attr.c_str());
-            auto it = previousNode->attrs.map.find(id);
-            if (it != previousNode->attrs.map.end())
+            auto it = previousNode->attrs().map.find(id);
+            if (it != previousNode->attrs().map.end())
             {
                 attrs.map[id] = it->second;
             }
@@ -1560,7 +1560,7 @@ Node* MegaClient::childnodebyattribute(Node* p, nameid attrId, const char* attrV
     for (Node* child : childrenNodeList)
     {
         // find the attribute
-        const auto& attrMap = child->attrs.map;
+        const auto& attrMap = child->attrs().map;
         auto found = attrMap.find(attrId);
 
         if (found != attrMap.end() && found->second == attrValue)
@@ -1627,6 +1627,8 @@ void MegaClient::init()
     syncextraretry = false;
     syncsup = true;
     syncdownrequired = false;
+    syncdowndirty = false;
+    syncdownfullds = 0;
     syncuprequired = false;
 
     if (syncscanstate)
@@ -1773,6 +1775,7 @@ MegaClient::MegaClient(MegaApp* a, shared_ptr<Waiter> w, HttpIO* h, DbAccess* d,
     fsaccess->client = this;
     fsaccess->waiter = w.get();
     transferlist.client = this;
+    transferScheduler = mega::make_unique<TransferScheduler>();
 
     if ((app = a))
     {
@@ -2376,12 +2379,10 @@ void MegaClient::exec()
                                 pendingcs = NULL;
 
                                 notifypurge();
-                                if (sctable && pendingsccommit && !reqs.readyToSend())
+                                if (sctable && pendingsccommit && !reqs.readyToSend() && sccommitgroupdue())
                                 {
                                     LOG_debug << "Executing postponed DB commit 2 (sessionid: " << string(sessionid, sizeof(sessionid)) << ")";
-                                    sctable->commit();
-                                    assert(!sctable->inTransaction());
-                                    sctable->begin();
+                                    commitsc();
                                     app->notify_dbcommit();
                                     pendingsccommit = false;
                                 }
@@ -2774,7 +2775,7 @@ void MegaClient::exec()
 
         // do not process the SC result until all preconfigured syncs are up and running
         // except if SC packets are required to complete a fetchnodes
-        if (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownrequired && !syncdownretry)
+        if (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownrequired && !syncdowndirty && !syncdownretry)
 #else
         if (!scpaused && jsonsc.pos)
 #endif
@@ -2793,12 +2794,17 @@ void MegaClient::exec()
             else
             {
                 // remote changes require immediate attention of syncdown()
-                syncdownrequired = true;
+                // (the affected folders were marked when their nodes were notified)
+                syncdowndirty = true;
                 syncactivity = true;
             }
 #endif
         }
 
+        // scsns held back for a group commit: commit them once the window closes,
+        // even if no more actionpackets arrive
+        commitscgroup();
+
         if (!pendingsc && !pendingscUserAlerts && scsn.ready() && btsc.armed() && !mBlocked)
         {
             if (useralerts.begincatchup)
@@ -3128,7 +3134,7 @@ void MegaClient::exec()
         // halt all syncing while the local filesystem is pending a lock-blocked operation
         // or while we are fetching nodes
         // FIXME: indicate by callback
-        if (!syncdownretry && !syncadding && statecurrent && !syncdownrequired && !fetchingnodes)
+        if (!syncdownretry && !syncadding && statecurrent && !syncdownrequired && !syncdowndirty && !fetchingnodes)
         {
             // process active syncs, stop doing so while transient local fs ops are pending
             if (syncs.hasRunningSyncs() || syncactivity)
@@ -3336,7 +3342,7 @@ void MegaClient::exec()
                 if (prevpending && !totalpending)
                 {
                     LOG_debug << "Scan queue processed, triggering a scan";
-                    syncdownrequired = true;
+                    syncdowndirty = true;
                 }
 
                 notifypurge();
@@ -3525,12 +3531,15 @@ void MegaClient::exec()
                 syncdownrequired = true;
             }
 
-            if (syncdownrequired)
+            if (syncdownrequired || syncdowndirty)
             {
+                // periodically fall back to a full pass, as a safety net
+                bool fullsyncdown = syncdownrequired || Waiter::ds - syncdownfullds >= SYNCDOWN_FULL_INTERVAL_DS;
                 syncdownrequired = false;
+                syncdowndirty = false;
                 if (!fetchingnodes)
                 {
-                    LOG_verbose << "Running syncdown";
+                    LOG_verbose << "Running syncdown" << (fullsyncdown ? "" : " on dirty subtrees");
                     bool success = true;
                     syncs.forEachRunningSync([&](Sync* sync) {
                         // make sure that the remote synced folder still exists
@@ -3550,7 +3559,7 @@ void MegaClient::exec()
                                 LOG_debug << "Running syncdown on demand: "
                                           << toHandle(sync->getConfig().mBackupId);
 
-                                if (!syncdown(sync->localroot.get(), localpath))
+                                if (!syncdown(sync->localroot.get(), localpath, !fullsyncdown))
                                 {
                                     // a local filesystem item was locked - schedule periodic retry
                                     // and force a full rescan afterwards as the local item may
@@ -3564,6 +3573,11 @@ void MegaClient::exec()
                         }
                     });
 
+                    if (fullsyncdown)
+                    {
+                        syncdownfullds = Waiter::ds;
+                    }
+
                     // notify the app if a lock is being retried
                     if (success)
                     {
@@ -3747,7 +3761,7 @@ int MegaClient::preparewait()
 #ifdef ENABLE_SYNC
     // sync directory scans in progress or still processing sc packet without having
     // encountered a locally locked item? don't wait.
-    if (syncactivity || syncdownrequired || (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownretry))
+    if (syncactivity || syncdownrequired || syncdowndirty || (!scpaused && jsonsc.pos && (syncsup || !statecurrent) && !syncdownretry))
     {
         nds = Waiter::ds;
     }
@@ -3794,6 +3808,16 @@ int MegaClient::preparewait()
             btcs.update(&nds);
         }
 
+        // end of the window of scsns held back for a group commit
+        if (sctable && pendingsccommit && sccommitgroupds)
+        {
+            dstime due = sccommitgroupstart + sccommitgroupds;
+            if (due < nds)
+            {
+                nds = due;
+            }
+        }
+
         // retry failed server-client requests
         if (!pendingsc && !pendingscUserAlerts && scsn.ready() && !mBlocked)
         {
@@ -3876,7 +3900,7 @@ int MegaClient::preparewait()
 
         // retrying of transient failed read ops
         if (syncfslockretry && !syncdownretry && !syncadding
-                && statecurrent && !syncdownrequired && !syncfsopsfailed)
+                && statecurrent && !syncdownrequired && !syncdowndirty && !syncfsopsfailed)
         {
             LOG_debug << "Waiting for a temporary error checking filesystem notification";
             syncfslockretrybt.update(&nds);
@@ -4358,6 +4382,12 @@ void MegaClient::dispatchTransfers()
 
                 // app-side transfer preparations (populate localname, create thumbnail...)
                 app->transfer_prepare(nexttransfer);
+
+                if (nexttransfer->type == GET && localcopydownloads && startLocalContentCopy(nexttransfer))
+                {
+                    // its slot completes it once the copy is verified, or queues it again to be fetched
+                    continue;
+                }
             }
 
             bool openok = false;
@@ -4429,6 +4459,12 @@ void MegaClient::dispatchTransfers()
 
                 if (openfinished && openok)
                 {
+                    if (nexttransfer->type == PUT)
+                    {
+                        // uploads read the file from start to end
+                        ts->fa->setreadpattern(FileAccess::READ_SEQUENTIAL);
+                    }
+
                     NodeHandle h;
                     bool hprivate = true;
                     const char *privauth = NULL;
@@ -5160,6 +5196,81 @@ void MegaClient::httprequest(const char *url, int method, bool binary, const cha
     }
 }
 
+bool MegaClient::sccommitgroupdue()
+{
+    return !sccommitgroupds
+        || Waiter::ds - sccommitgroupstart >= sccommitgroupds
+        || (sccommitgrouprows && sctable->transactionChanges() >= sccommitgrouprows);
+}
+
+void MegaClient::commitsc()
+{
+    static const MetricsRegistry::Id commits = MetricsRegistry::instance().counter("Statecache_scsnCommits", "Statecache commits closing actionpacket scsns");
+    static const MetricsRegistry::Id scsns = MetricsRegistry::instance().counter("Statecache_scsnsCommitted", "Actionpacket scsns committed to the statecache");
+    static const MetricsRegistry::Id rows = MetricsRegistry::instance().counter("Statecache_rowsCommitted", "Rows changed by statecache commits closing actionpacket scsns");
+    static const MetricsRegistry::Id delay = MetricsRegistry::instance().histogram("Statecache_scsnCommitDelay", "Time from the first scsn of a commit to the commit");
+
+    if (sccommitgroupscsns)
+    {
+        MetricsRegistry::instance().add(commits);
+        MetricsRegistry::instance().add(scsns, sccommitgroupscsns);
+        MetricsRegistry::instance().add(rows, sctable->transactionChanges());
+    }
+
+    sctable->commit();
+    assert(!sctable->inTransaction());
+    sctable->begin();
+
+    if (sccommitgroupscsns)
+    {
+        MetricsRegistry::instance().recordDuration(delay, std::chrono::steady_clock::now() - sccommitgroupsince);
+        sccommitgroupscsns = 0;
+    }
+}
+
+void MegaClient::scsncommit()
+{
+    if (!pendingsccommit)
+    {
+        // first scsn since the last commit
+        sccommitgroupscsns = 0;
+        sccommitgroupstart = Waiter::ds;
+        sccommitgroupsince = std::chrono::steady_clock::now();
+    }
+    sccommitgroupscsns++;
+
+    if (!pendingcs && !csretrying && !reqs.readyToSend() && !sccommitgroupdue())
+    {
+        // let the next scsns share this commit (see sccommitgroupds)
+        pendingsccommit = true;
+    }
+    else if (!pendingcs && !csretrying && !reqs.readyToSend())
+    {
+        LOG_debug << "DB transaction COMMIT (sessionid: " << string(sessionid, sizeof(sessionid)) << ", scsns: " << sccommitgroupscsns << ")";
+        commitsc();
+        app->notify_dbcommit();
+        pendingsccommit = false;
+    }
+    else
+    {
+        LOG_debug << "Postponing DB commit until cs requests finish";
+        pendingsccommit = true;
+    }
+}
+
+void MegaClient::commitscgroup()
+{
+    // never in the middle of a batch of actionpackets
+    if (sctable && pendingsccommit && sccommitgroupds && !jsonsc.pos
+            && !pendingcs && !csretrying && !reqs.readyToSend() && sccommitgroupdue())
+    {
+        LOG_debug << "DB transaction COMMIT (sessionid: " << string(sessionid, sizeof(sessionid)) << ", scsns: " << sccommitgroupscsns << ")";
+        commitsc();
+        app->notify_dbcommit();
+        pendingsccommit = false;
+    }
+}
+
 // process server-client request
 bool MegaClient::procsc()
 {
@@ -5196,20 +5307,7 @@ bool MegaClient::procsc()
                     notifypurge();
                     if (sctable)
                     {
-                        if (!pendingcs && !csretrying && !reqs.readyToSend())
-                        {
-                            LOG_debug << "DB transaction COMMIT (sessionid: " << string(sessionid, sizeof(sessionid)) << ")";
-                            sctable->commit();
-                            assert(!sctable->inTransaction());
-                            sctable->begin();
-                            app->notify_dbcommit();
-                            pendingsccommit = false;
-                        }
-                        else
-                        {
-                            LOG_debug << "Postponing DB commit until cs requests finish";
-                            pendingsccommit = true;
-                        }
+                        scsncommit();
                     }
                     break;
 
@@ -5234,9 +5332,7 @@ bool MegaClient::procsc()
                             if (sctable)
                             {
                                 LOG_debug << "DB transaction COMMIT (sessionid: " << string(sessionid, sizeof(sessionid)) << ")";
-                                sctable->commit();
-                                assert(!sctable->inTransaction());
-                                sctable->begin();
+                                commitsc();
                                 pendingsccommit = false;
                             }
 
@@ -5854,9 +5950,7 @@ void MegaClient::initsc()
             // We have the data, and we have the corresponding scsn, all from fetchnodes finishing just now.
             // Commit now, otherwise we'll have to do fetchnodes again (on restart) if no actionpackets arrive.
             LOG_debug << "DB transaction COMMIT (sessionid: " << string(sessionid, sizeof(sessionid)) << ")";
-            sctable->commit();
-            assert(!sctable->inTransaction());
-            sctable->begin();
+            commitsc();
             pendingsccommit = false;
         }
     }
@@ -8329,6 +8423,8 @@ void MegaClient::sc_ub()
 // purge removed nodes after notification
 void MegaClient::notifypurge(void)
 {
+    CodeCounter::ScopeTimer ccst(performanceStats.notifyPurge);
+
     int i, t;
 
     handle tscsn = cachedscsn;
@@ -8829,24 +8925,24 @@ error MegaClient::setattr(Node* n, attr_map&& updates, CommandSetAttr::Completio
         std::vector<nameid> nameIds = { AttrMap::string2nameid("fav"), AttrMap::string2nameid("lbl") };
         for (nameid& nameId : nameIds)
         {
-            auto itAttr= n->attrs.map.find(nameId);
-            if (itAttr != n->attrs.map.end() && (itAttr->second.empty() || itAttr->second == "0"))
+            auto itAttr= n->attrs().map.find(nameId);
+            if (itAttr != n->attrs().map.end() && (itAttr->second.empty() || itAttr->second == "0"))
             {
                 updates[nameId] = "";
             }
         }
     }
-    n->changed.name = n->attrs.hasUpdate('n', updates);
-    n->changed.favourite = n->attrs.hasUpdate(AttrMap::string2nameid("fav"), updates);
+    n->changed.name = n->attrs().hasUpdate('n', updates);
+    n->changed.favourite = n->attrs().hasUpdate(AttrMap::string2nameid("fav"), updates);
     if (n->changed.favourite && (n->firstancestor()->getShareType() == ShareType_t::IN_SHARES)) // Avoid an inshare to be tagged as favourite by the sharee
     {
         return API_EACCESS;
     }
 
-    n->changed.sensitive = n->attrs.hasUpdate(AttrMap::string2nameid("sen"), updates);
+    n->changed.sensitive = n->attrs().hasUpdate(AttrMap::string2nameid("sen"), updates);
 
     // when we merge SIC removal, the local object won't be changed unless/until the command succeeds
-    n->attrs.applyUpdates(updates);
+    n->attrs().applyUpdates(updates);
 
     n->changed.attrs = true;
     n->changed.modifiedByThisClient = true;
@@ -9151,7 +9247,7 @@ error MegaClient::rename(Node* n, Node* p, syncdel_t syncdel, NodeHandle prevpar
                     // deleted node
                     char base64Handle[12];
                     Base64::btoa((byte*)&prevParent->nodehandle, MegaClient::NODEHANDLE, base64Handle);
-                    if (strcmp(base64Handle, n->attrs.map[rrname].c_str()))
+                    if (strcmp(base64Handle, n->attrs().map[rrname].c_str()))
                     {
                         LOG_debug << "Adding rr attribute";
                         attrUpdates[rrname] = base64Handle;
@@ -9162,8 +9258,8 @@ error MegaClient::rename(Node* n, Node* p, syncdel_t syncdel, NodeHandle prevpar
                      && newRoot->nodeHandle() != rubbishHandle)
             {
                 // undeleted node
-                attr_map::iterator it = n->attrs.map.find(rrname);
-                if (it != n->attrs.map.end())
+                attr_map::iterator it = n->attrs().map.find(rrname);
+                if (it != n->attrs().map.end())
                 {
                     LOG_debug << "Removing rr attribute";
                     attrUpdates[rrname] = "";
@@ -9518,6 +9614,188 @@ uint64_t MegaClient::stringhash64(string* s, SymmCipher* c)
     return MemAccess::get<uint64_t>((const char*)hash);
 }
 
+// Decrypts node keys and attributes of a fetchnodes response on the worker threads, a few batches
+// ahead of readnodes. It scans the node array with its own JSON cursor, and readnodes takes the
+// results in order through Node::applykey(), which checks each one against the key it would use.
+class NodeKeyPrefetcher
+{
+public:
+    // `array` is positioned just inside the node array
+    NodeKeyPrefetcher(MegaClient& client, const JSON& array)
+        : mClient(client), mCursor(array)
+    {
+    }
+
+    // result for the `index`th node of the array, or nullptr if it wasn't prefetched.
+    // Indices must be requested in increasing order.
+    PrefetchedNodeKey* get(size_t index)
+    {
+        while (!mBatches.empty() && index >= mBatches.front()->first + mBatches.front()->keys.size())
+        {
+            mBatches.pop_front();
+        }
+
+        // keep the workers busy with the following batches while this one is consumed
+        while (mBatches.size() <= BATCHES_AHEAD && dispatch())
+        {
+        }
+
+        if (mBatches.empty() || index < mBatches.front()->first)
+        {
+            return nullptr;
+        }
+
+        Batch& batch = *mBatches.front();
+        {
+            std::unique_lock<std::mutex> g(batch.mutex);
+            batch.cv.wait(g, [&batch]() { return !batch.pendingJobs; });
+        }
+        return &batch.keys[index - batch.first];
+    }
+
+private:
+    static const size_t BATCH = 4096;
+    static const size_t JOB = 256;
+    static const size_t BATCHES_AHEAD = 2;
+
+    // the batch outlives the prefetcher if a worker is still on it
+    struct Batch
+    {
+        size_t first = 0;
+        std::vector<PrefetchedNodeKey> keys;
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t pendingJobs = 0;
+    };
+
+    MegaClient& mClient;
+    JSON mCursor;
+    bool mDone = false;
+    size_t mScanned = 0;
+    std::deque<shared_ptr<Batch>> mBatches;
+
+    // scan the next batch of nodes and queue them for decryption
+    bool dispatch()
+    {
+        if (mDone)
+        {
+            return false;
+        }
+
+        auto batch = std::make_shared<Batch>();
+        batch->first = mScanned;
+        batch->keys.reserve(BATCH);
+
+        while (batch->keys.size() < BATCH && !mDone)
+        {
+            if (!mCursor.enterobject())
+            {
+                mDone = true;
+                break;
+            }
+
+            nodetype_t t = TYPE_UNKNOWN;
+            const char* a = nullptr;
+            const char* k = nullptr;
+            nameid name;
+
+            while ((name = mCursor.getnameid()) != EOO)
+            {
+                switch (name)
+                {
+                    case 't':
+                        t = (nodetype_t)mCursor.getint();
+                        break;
+
+                    case 'a':
+                        a = mCursor.getvalue();
+                        break;
+
+                    case 'k':
+                        k = mCursor.getvalue();
+                        break;
+
+                    default:
+                        if (!mCursor.storeobject())
+                        {
+                            // readnodes will fail on it as well
+                            mDone = true;
+                        }
+                }
+
+                if (mDone)
+                {
+                    break;
+                }
+            }
+
+            batch->keys.emplace_back();
+            if (!mDone && a && k && (t == FILENODE || t == FOLDERNODE))
+            {
+                prepare(batch->keys.back(), t, a, k);
+            }
+        }
+
+        if (batch->keys.empty())
+        {
+            return false;
+        }
+        mScanned += batch->keys.size();
+
+        size_t n = batch->keys.size();
+        batch->pendingJobs = (n + JOB - 1) / JOB;
+        for (size_t begin = 0; begin < n; begin += JOB)
+        {
+            size_t end = std::min(n, begin + JOB);
+            mClient.mAsyncQueue.push([batch, begin, end](SymmCipher& sc)
+            {
+                for (size_t i = begin; i < end; ++i)
+                {
+                    if (batch->keys[i].keyLength)
+                    {
+                        batch->keys[i].decrypt(sc);
+                    }
+                }
+
+                std::lock_guard<std::mutex> g(batch->mutex);
+                if (!--batch->pendingJobs)
+                {
+                    batch->cv.notify_all();
+                }
+            }, false);
+        }
+
+        mBatches.push_back(std::move(batch));
+        return true;
+    }
+
+    // pick the key with what is known now (keyLength stays 0 if there is nothing to decrypt here)
+    void prepare(PrefetchedNodeKey& p, nodetype_t t, const char* a, const char* k)
+    {
+        JSON::copystring(&p.keydata, k);
+        JSON::copystring(&p.attrstring, a);
+
+        SymmCipher* sc = &mClient.key;
+        bool foreign = false;
+        const char* subkey = Node::findkey(mClient, p.keydata, sc, foreign);
+        if (!subkey)
+        {
+            return;
+        }
+
+        // RSA-encrypted keys are left to MegaClient::decryptkey(), which also queues their rewrite
+        size_t length = strcspn(subkey, "/");
+        if (length > 4 * FILENODEKEYLENGTH / 3 + 1)
+        {
+            return;
+        }
+
+        p.keyOffset = size_t(subkey - p.keydata.c_str());
+        memcpy(p.wrappingKey, sc->key, sizeof p.wrappingKey);
+        p.keyLength = (t == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
+    }
+};
+
 // read and add/verify node array
 int MegaClient::readnodes(JSON* j, int notify, putsource_t source, vector<NewNode>* nn, bool modifiedByThisClient, bool applykeys)
 {
@@ -9532,7 +9810,15 @@ int MegaClient::readnodes(JSON* j, int notify, putsource_t source, vector<NewNod
 
     NodeManager::MissingParentNodes missingParentNodes;
 
-    while (j->enterobject())
+    // fetchnodes: decrypt keys and attributes ahead on the worker threads
+    unique_ptr<NodeKeyPrefetcher> prefetcher;
+    if (!notify && applykeys && mAsyncQueue.threadCount())
+    {
+        prefetcher.reset(new NodeKeyPrefetcher(*this, *j));
+    }
+    size_t index = 0;
+
+    for (; j->enterobject(); ++index)
     {
         handle h = UNDEF, ph = UNDEF;
         handle u = 0, su = UNDEF;
@@ -9853,7 +10139,7 @@ int MegaClient::readnodes(JSON* j, int notify, putsource_t source, vector<NewNod
 
             if (applykeys)
             {
-                n->applykey();
+                n->applykey(prefetcher ? prefetcher->get(index) : nullptr);
             }
 
             if (notify)
@@ -13998,25 +14284,32 @@ void MegaClient::setkeypair()
 
 bool MegaClient::fetchsc(DbTable* sctable)
 {
-    uint32_t id;
-    string data;
-    Node* n;
-    User* u;
-    PendingContactRequest* pcr;
+    uint32_t lastId = 0;
+    bool firstRecord = true;
 
     LOG_info << "Loading session from local cache";
 
     sctable->rewind();
 
-    bool hasNext = sctable->next(&id, &data, &key);
-    WAIT_CLASS::bumpds();
-    fnstats.timeToFirstByte = Waiter::ds - fnstats.startTime;
-
     bool isDbUpgraded = false;      // true when legacy DB is migrated to NOD's DB schema
 
     std::map<NodeHandle, std::vector<Node*>> delayedParents;
-    while (hasNext)
+
+    // records are decrypted in parallel by the worker threads, and applied here in order
+    bool loaded = sctable->nextAllDecrypted(mAsyncQueue, &key, [&](uint32_t id, string& data)
     {
+        Node* n;
+        User* u;
+        PendingContactRequest* pcr;
+
+        if (firstRecord)
+        {
+            firstRecord = false;
+            WAIT_CLASS::bumpds();
+            fnstats.timeToFirstByte = Waiter::ds - fnstats.startTime;
+        }
+        lastId = id;
+
         switch (id & (DbTable::IDSPACING - 1))
         {
             case CACHEDSCSN:
@@ -14123,10 +14416,21 @@ bool MegaClient::fetchsc(DbTable* sctable)
                 break;
             }
         }
-        hasNext = sctable->next(&id, &data, &key);
+        return true;
+    });
+
+    if (!loaded)
+    {
+        return false;
     }
 
-    LOG_debug << "Max dbId after resume session: " << id;
+    if (firstRecord)
+    {
+        WAIT_CLASS::bumpds();
+        fnstats.timeToFirstByte = Waiter::ds - fnstats.startTime;
+    }
+
+    LOG_debug << "Max dbId after resume session: " << lastId;
 
     if (isDbUpgraded)   // nodes loaded during migration from `statecache` to `nodes` table and kept in RAM
     {
@@ -16651,6 +16955,16 @@ void MegaClient::stopxfers(LocalNode* l, TransferDbCommitter& committer)
     stopxfer(l, &committer);
 }
 
+// stop the LocalNode's upload, if any, and release its transfer state
+void MegaClient::stopxfer(LocalNode* l, TransferDbCommitter* committer)
+{
+    if (l->upload)
+    {
+        stopxfer(l->upload.get(), committer);
+        l->upload.reset();
+    }
+}
+
 // add child to nchildren hash (deterministically prefer newer/larger versions
 // of identical names to avoid flapping)
 // apply standard unescaping, if necessary (use *strings as ephemeral storage
@@ -16688,11 +17002,12 @@ void MegaClient::addchild(remotenode_map* nchildren, string* name, Node* n, list
 // * attempt to execute renames, moves and deletions (deletions require the
 // rubbish flag to be set)
 // returns false if any local fs op failed transiently
-bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath)
+bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, bool dirtyOnly)
 {
     static const dstime MONITOR_DELAY_SEC = 5;
 
     SyncdownContext cxt;
+    cxt.mDirtyOnly = dirtyOnly;
 
     if (!syncdown(l, localpath, cxt))
     {
@@ -16751,9 +17066,70 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
     // only use for LocalNodes with a corresponding and properly linked Node
     if (l->type != FOLDERNODE || !l->node || (l->parent && l->node->parent->localnode != l->parent))
     {
+        // not compared: keep its marks reachable for a later pass
+        l->restoreSyncdownDirty(l->syncdownDirty, l->syncdownDescendantDirty);
         return true;
     }
 
+    // take the marks before the pass, so that anything marked while it runs is kept for the next one
+    bool dirty = l->syncdownDirty;
+    bool descendantDirty = l->syncdownDescendantDirty;
+    l->syncdownDirty = false;
+    l->syncdownDescendantDirty = false;
+
+    bool noTransientErrors = syncdownfolder(l, localpath, cxt, dirty, descendantDirty);
+
+    if (!noTransientErrors || cxt.mBackupForeignChangeDetected)
+    {
+        // the pass didn't get through this folder
+        l->restoreSyncdownDirty(dirty, descendantDirty);
+    }
+
+    return noTransientErrors;
+}
+
+bool MegaClient::syncdownfolder(LocalNode* l, LocalPath& localpath, SyncdownContext& cxt, bool dirty, bool descendantDirty)
+{
+    if (cxt.mDirtyOnly && !dirty)
+    {
+        // nothing changed at this level: only descend towards the marked folders
+        bool noTransientErrors = true;
+
+        if (descendantDirty)
+        {
+            // collect first, recursion may move LocalNodes between folders
+            vector<LocalNode*> marked;
+            for (auto& child : l->children)
+            {
+                LocalNode* ll = child.second;
+                if (ll->type == FOLDERNODE && (ll->syncdownDirty || ll->syncdownDescendantDirty))
+                {
+                    marked.push_back(ll);
+                }
+            }
+
+            for (LocalNode* ll : marked)
+            {
+                if (ll->parent == l)
+                {
+                    ScopedLengthRestore restoreLen(localpath);
+                    localpath.appendWithSeparator(ll->getLocalname(), true);
+
+                    noTransientErrors &= syncdown(ll, localpath, cxt);
+
+                    if (cxt.mBackupForeignChangeDetected)
+                    {
+                        break;
+                    }
+                }
+            }
+        }
+
+        return noTransientErrors;
+    }
+
+    DEBUG_TEST_HOOK_SYNCDOWN_FOLDER(l);
+
     list<string> strings;
     remotenode_map nchildren;
     remotenode_map::iterator rit;
@@ -16777,7 +17153,7 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
         // be considered - also, prevent clashes with the local debris folder
         if (((*it)->syncdeleted == SYNCDEL_NONE
              && !(*it)->attrstring
-             && (ait = (*it)->attrs.map.find('n')) != (*it)->attrs.map.end()
+             && (ait = (*it)->attrs().map.find('n')) != (*it)->attrs().map.end()
              && ait->second.size())
          && (l->parent || l->sync->debris != ait->second))
         {
@@ -16859,7 +17235,13 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
 
                 ll->setnode(rit->second);
 
-                if (*ll == *(FileFingerprint*)rit->second)
+                if (!ll->isvalid && *ll == *(FileFingerprint*)rit->second)
+                {
+                    // same size and mtime, but the CRCs are deferred while the file settles:
+                    // syncup() computes them and uploads the file if it turns out to differ
+                    nchildren.erase(rit);
+                }
+                else if (*ll == *(FileFingerprint*)rit->second)
                 {
                     // both files are identical
                     nchildren.erase(rit);
@@ -16899,7 +17281,7 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
                 else
                 {
                     // means that the localnode is going to be overwritten
-                    if (rit->second->localnode && rit->second->localnode->transfer)
+                    if (rit->second->localnode && rit->second->localnode->upload)
                     {
                         LOG_debug << "Stopping an unneeded upload";
                         TransferDbCommitter committer(tctable);
@@ -16949,7 +17331,8 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
                     FileFingerprint fp;
                     fp.genfingerprint(fa.get());
 
-                    if (!(fp == *(FileFingerprint*)ll))
+                    // without its CRCs, the file can't be known to be unchanged
+                    if (!ll->isvalid || !(fp == *(FileFingerprint*)ll))
                     {
                         ll->deleted = false;
                     }
@@ -17013,7 +17396,7 @@ bool MegaClient::syncdown(LocalNode* l, LocalPath& localpath, SyncdownContext& c
     for (rit = nchildren.begin(); rit != nchildren.end(); rit++)
     {
 
-        localname = rit->second->attrs.map.find('n')->second;
+        localname = rit->second->attrs().map.find('n')->second;
 
         ScopedLengthRestore restoreLen(localpath);
         localpath.appendWithSeparator(LocalPath::fromRelativeName(localname, *fsaccess, l->sync->mFilesystemType), true);
@@ -17283,7 +17666,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                 }
 
                 // ...or a node name attribute missing
-                if ((ait = (*it)->attrs.map.find('n')) == (*it)->attrs.map.end())
+                if ((ait = (*it)->attrs().map.find('n')) == (*it)->attrs().map.end())
                 {
                     LOG_warn << "Node name missing, not syncing subtree: " << l->name.c_str();
 
@@ -17324,7 +17707,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                 ll->reported = true;
 
                 char report[256];
-                snprintf(report, sizeof(report), "%d %d %d %d", (int)lit->first.reportSize(), (int)localname.size(), (int)ll->name.size(), (int)ll->type);
+                snprintf(report, sizeof(report), "%d %d %d %d", (int)lit->first->reportSize(), (int)localname.size(), (int)ll->name.size(), (int)ll->type);
                 // report a "no-name localnode" event
                 reportevent("LN", report, 0);
             }
@@ -17369,8 +17752,9 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                     }
                     ll->setnode(rit->second);
 
-                    // check if file is likely to be identical
-                    if (*ll == *(FileFingerprint*)rit->second)
+                    // check if file is likely to be identical (if its CRCs were deferred, they
+                    // are computed below once it settles, and the files are compared again)
+                    if (ll->isvalid && *ll == *(FileFingerprint*)rit->second)
                     {
                         // files have the same size and the same mtime (or the
                         // same fingerprint, if available): no action needed
@@ -17396,7 +17780,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                                 {
                                     char me64[12];
                                     Base64::btoa((const byte*)&me, MegaClient::USERHANDLE, me64);
-                                    if (ll->node->attrs.map.find('f') == ll->node->attrs.map.end() || ll->node->attrs.map['f'] != me64)
+                                    if (ll->node->attrs().map.find('f') == ll->node->attrs().map.end() || ll->node->attrs().map['f'] != me64)
                                     {
                                         LOG_debug << "Restoring missing attributes: " << ll->name;
                                         SymmCipher *symmcipher = ll->node->nodecipher();
@@ -17419,7 +17803,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                         }
 
                         // if this localnode is being uploaded, but it's already synced
-                        if (ll->transfer)
+                        if (ll->upload)
                         {
                             LOG_debug << "Stopping unneeded upload";
                             TransferDbCommitter committer(tctable);
@@ -17449,7 +17833,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                             continue;
                         }
 
-                        if (ll->size == rit->second->size && memcmp(ll->crc.data(), rit->second->crc.data(), sizeof ll->crc) < 0)
+                        if (ll->isvalid && ll->size == rit->second->size && memcmp(ll->crc.data(), rit->second->crc.data(), sizeof ll->crc) < 0)
                         {
                             LOG_warn << "Syncup. Same mtime and size, but lower CRC: " << ll->name
                                      << " mtime: " << ll->mtime << " size: " << ll->size << " Nhandle: " << LOG_NODEHANDLE(rit->second->nodehandle);
@@ -17543,12 +17927,12 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
             // do not begin transfer until the file size / mtime has stabilized
             insync = false;
 
-            if (ll->transfer)
+            if (ll->upload)
             {
                 continue;
             }
 
-            LOG_verbose << "Unsynced LocalNode (file): " << ll->name << " " << ll << " " << (ll->transfer != 0);
+            LOG_verbose << "Unsynced LocalNode (file): " << ll->name << " " << ll << " " << (ll->upload != nullptr);
             ll->treestate(TREESTATE_PENDING);
 
             if (Waiter::ds < ll->nagleds)
@@ -17641,7 +18025,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                     if (t)
                     {
                         ll->sync->localbytes -= ll->size;
-                        ll->genfingerprint(fa.get());
+                        ll->updatefingerprint(fa.get());
                         ll->sync->localbytes += ll->size;
 
                         ll->sync->statecacheadd(ll);
@@ -17660,6 +18044,33 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                     continue;
                 }
 
+                if (!ll->isvalid)
+                {
+                    // the file has settled: compute the CRCs deferred while it was being written
+                    ll->genfingerprint(fa.get());
+                    ll->sync->statecacheadd(ll);
+
+                    if (!ll->isvalid)
+                    {
+                        ll->bumpnagleds();
+                        if (ll->nagleds < *nds)
+                        {
+                            *nds = ll->nagleds;
+                        }
+                        continue;
+                    }
+
+                    if (ll->node)
+                    {
+                        // compare with the cloud file again, now that the CRCs are known
+                        if (Waiter::ds < *nds)
+                        {
+                            *nds = Waiter::ds;
+                        }
+                        continue;
+                    }
+                }
+
                 ll->created = false;
             }
         }
@@ -17699,7 +18110,7 @@ bool MegaClient::syncup(LocalNode* l, dstime* nds, size_t& parentPending)
                 {
                     int namelen;
 
-                    if ((ait = ll->node->attrs.map.find('n')) != ll->node->attrs.map.end())
+                    if ((ait = ll->node->attrs().map.find('n')) != ll->node->attrs().map.end())
                     {
                         namelen = int(ait->second.size());
                     }
@@ -17827,23 +18238,13 @@ void MegaClient::syncupdate(localnode_vector& synccreate, bool canChangeVault)
             n = NULL;
             l = synccreate[i];
 
-            if (l->type == FILENODE)
-            {
-                if (l->parent->node)
-                {
-                    l->h = l->parent->node->nodeHandle();
-                }
-
-                l->previousNode = l->node;
-            }
-
             bool makeNewFolderOrCloneFile = false;
 
             if (l->type == FOLDERNODE)
             {
                 makeNewFolderOrCloneFile = true;
             }
-            else if ((n = nodebyfingerprint(l)))
+            else if (l->isvalid && (n = nodebyfingerprint(l)))
             {
 
                 string ext1, ext2;
@@ -17893,7 +18294,7 @@ void MegaClient::syncupdate(localnode_vector& synccreate, bool canChangeVault)
                     // FIXME: move instead of creating a copy if it is in
                     // rubbish to reduce node creation load
                     nnp->nodekey = n->nodekey();
-                    tattrs.map = n->attrs.map;
+                    tattrs.map = n->attrs().map;
 
                     nameid rrname = AttrMap::string2nameid("rr");
                     attr_map::iterator it = tattrs.map.find(rrname);
@@ -17929,9 +18330,15 @@ void MegaClient::syncupdate(localnode_vector& synccreate, bool canChangeVault)
                 l->treestate(TREESTATE_PENDING);
 
                 // the overwrite (or replace) will happen upon PUT completion
-                startxfer(PUT, l, committer, false, false, false, UseLocalVersioningFlag, nullptr, nextreqtag());
-
-                l->sync->threadSafeState->transferBegin(PUT, l->size);
+                l->upload.reset(new SyncFilePut(l));
+                if (startxfer(PUT, l->upload.get(), committer, false, false, false, UseLocalVersioningFlag, nullptr, nextreqtag()))
+                {
+                    l->sync->threadSafeState->transferBegin(PUT, l->size);
+                }
+                else
+                {
+                    l->upload.reset();
+                }
 
                 LOG_debug << "Sync - sending file " << l->getLocalPath();
             }
@@ -17945,10 +18352,6 @@ void MegaClient::syncupdate(localnode_vector& synccreate, bool canChangeVault)
             {
                 syncadding++;
 
-                // this assert fails for the case of two different files uploaded to the same path, and both putnodes occurring in the same exec()
-                assert(localNode->type == FOLDERNODE
-                       || localNode->h == localNode->parent->node->nodehandle); // if it's a file, it should match
-
                 auto nextTag = nextreqtag();
                 reqs.add(new CommandPutNodes(this,
                                                 localNode->parent->node->nodeHandle(),
@@ -18322,12 +18725,66 @@ void MegaClient::putnodes_syncdebris_result(error, vector<NewNode>& nn)
 }
 #endif
 
+bool MegaClient::startLocalContentCopy(Transfer* t)
+{
+    // without a valid fingerprint (the file key stands in for it) there is nothing to look up
+    if (!t->isvalid)
+    {
+        return false;
+    }
+
+    auto copy = std::make_shared<LocalContentCopy>();
+    for (auto& candidate : localcontentindex.find(*t))
+    {
+        if (candidate != t->localfilename)
+        {
+            copy->candidates.push_back(candidate);
+        }
+    }
+
+    if (copy->candidates.empty())
+    {
+        return false;
+    }
+
+    copy->target = t->localfilename;
+    copy->size = t->size;
+    copy->mtime = t->mtime;
+    copy->transferkey = t->transferkey;
+    copy->ctriv = t->ctriv;
+    copy->metamac = t->metamac;
+
+    // an active slot like any other, so doio() gets to complete it (and retry that if needed)
+    TransferSlot* ts = t->slot ? t->slot : new TransferSlot(t);
+    ts->mLocalCopy = copy;
+    ts->slots_it = tslots.insert(tslots.begin(), ts);
+
+    for (file_list::iterator it = t->files.begin(); it != t->files.end(); it++)
+    {
+        (*it)->start();
+    }
+    app->transfer_update(t);
+
+    performanceStats.transferStarts += 1;
+
+    LOG_debug << "Copying download from " << copy->candidates.size() << " local candidate(s): " << t->localfilename;
+
+    // copying and MACing a large file takes a while, keep it off this thread
+    mAsyncQueue.push([copy](SymmCipher& sc)
+    {
+        FSACCESS_CLASS fsaccess;
+        copy->run(fsaccess, sc);
+    }, false);
+
+    return true;
+}
+
 // inject file into transfer subsystem
 // if file's fingerprint is not valid, it will be obtained from the local file
 // (PUT) or the file's key (GET)
 bool MegaClient::startxfer(direction_t d, File* f, TransferDbCommitter& committer, bool skipdupes, bool startfirst, bool donotpersist, VersioningOption vo, error* cause, int tag)
 {
-    //assert(f->getLocalname().isAbsolute());  // this will be true after we merge SRW, since LocalNodes are Files for now
+    //assert(f->getLocalname().isAbsolute());  // this will be true after we merge SRW
     f->mVersioningOption = vo;
 
     // Dummy to avoid checking later.
@@ -19993,6 +20450,7 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
         << dispatchTransfers.report(reset) << "\n"
         << applyKeys.report(reset) << "\n"
         << scProcessingTime.report(reset) << "\n"
+        << notifyPurge.report(reset) << "\n"
         << csResponseProcessingTime.report(reset) << "\n"
         << csSuccessProcessingTime.report(reset) << "\n"
         << " cs Request waiting time: " << csRequestWaitTime.report(reset) << "\n"
@@ -20000,7 +20458,13 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
         << " transfers active time: " << transfersActiveTime.report(reset) << "\n"
         << " transfer starts/finishes: " << transferStarts << " " << transferFinishes << "\n"
         << " transfer temperror/fails: " << transferTempErrors << " " << transferFails << "\n"
-        << " nowait reason: immedate: " << prepwaitImmediate << " zero: " << prepwaitZero << " httpio: " << prepwaitHttpio << " fsaccess: " << prepwaitFsaccess << " nonzero waits: " << nonzeroWait << "\n";
+        << " nowait reason: immedate: " << prepwaitImmediate << " zero: " << prepwaitZero << " httpio: " << prepwaitHttpio << " fsaccess: " << prepwaitFsaccess << " nonzero waits: " << nonzeroWait << "\n"
+        << " transfer slot tuning: evaluations: " << transferSlotTuning.evaluations
+        << " connections +/-: " << transferSlotTuning.connectionIncreases << "/" << transferSlotTuning.connectionDecreases
+        << " request size +/-: " << transferSlotTuning.requestSizeIncreases << "/" << transferSlotTuning.requestSizeDecreases << "\n";
+    TransferBufferPool::Stats bufferStats = TransferBufferPool::instance().stats();
+    s << " transfer buffers: in use: " << bufferStats.inUseBytes << " idle: " << bufferStats.idleBytes
+      << " allocations/reuses: " << bufferStats.allocations << "/" << bufferStats.reuses << "\n";
 #ifdef USE_CURL
     if (auto curlhttpio = dynamic_cast<CurlHttpIO*>(httpio))
     {
@@ -20013,6 +20477,14 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
             << curlhttpio->countProcessAresEventsCode.report(reset) << "\n"
 #endif
             << curlhttpio->countProcessCurlEventsCode.report(reset) << "\n";
+
+        const CurlHttpIO::ConnectionStats& cs = curlhttpio->connectionStats;
+        s << " http requests: " << cs.requests << " over http2: " << cs.http2Requests << " http2 errors: " << cs.http2Errors
+          << " connections new/reused: " << cs.newConnections << "/" << cs.reusedConnections << "\n";
+        if (reset)
+        {
+            curlhttpio->connectionStats = CurlHttpIO::ConnectionStats();
+        }
     }
 #endif
 #ifdef WIN32
@@ -20025,6 +20497,7 @@ std::string MegaClient::PerformanceStats::report(bool reset, HttpIO* httpio, Wai
     {
         transferStarts = transferFinishes = transferTempErrors = transferFails = 0;
         prepwaitImmediate = prepwaitZero = prepwaitHttpio = prepwaitFsaccess = nonzeroWait = 0;
+        transferSlotTuning = TransferSlotTuner::Stats();
     }
     return s.str();
 }
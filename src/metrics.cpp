@@ -0,0 +1,296 @@
+/**
+ * @file metrics.cpp
+ * @brief Always-on registry of performance counters and latency histograms
+ *
+ * (c) 2013-2023 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "mega/metrics.h"
+#include "mega/logging.h"
+
+#include <algorithm>
+#include <sstream>
+
+namespace mega {
+
+const MetricsRegistry::Id MetricsRegistry::NONE;
+const unsigned MetricsRegistry::HISTOGRAM_BUCKETS;
+const unsigned MetricsRegistry::MAX_SLOTS;
+
+// histogram layout within the slots: sample count, sum of nanoseconds, then the buckets
+enum { HISTOGRAM_COUNT = 0, HISTOGRAM_SUM = 1, HISTOGRAM_FIRST_BUCKET = 2 };
+
+MetricsRegistry& MetricsRegistry::instance()
+{
+    // never destroyed, as threads may still record while statics are being torn down
+    static MetricsRegistry* registry = new MetricsRegistry;
+    return *registry;
+}
+
+MetricsRegistry::Shard::Shard()
+{
+    for (auto& s : slots)
+    {
+        s.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Each thread's shard, which hands its totals over when the thread exits.
+// Kept here rather than as a static member, as MSVC rejects thread_local data in a dllexport class.
+struct MetricsThreadShard
+{
+    MetricsRegistry::Shard* shard = nullptr;
+
+    ~MetricsThreadShard()
+    {
+        if (shard)
+        {
+            MetricsRegistry::instance().retire(shard);
+        }
+    }
+};
+
+static thread_local MetricsThreadShard tlsShard;
+
+MetricsRegistry::Shard& MetricsRegistry::threadShard()
+{
+    if (!tlsShard.shard)
+    {
+        tlsShard.shard = new Shard;
+        std::lock_guard<std::mutex> g(mMutex);
+        mShards.push_back(tlsShard.shard);
+    }
+    return *tlsShard.shard;
+}
+
+void MetricsRegistry::retire(Shard* shard)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+    for (unsigned i = 0; i < mNextSlot; i++)
+    {
+        mRetired.slots[i].fetch_add(shard->slots[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    mShards.erase(std::remove(mShards.begin(), mShards.end(), shard), mShards.end());
+    delete shard;
+}
+
+MetricsRegistry::Id MetricsRegistry::registerInstrument(const std::string& name, const std::string& help, Kind kind, unsigned slots)
+{
+    std::lock_guard<std::mutex> g(mMutex);
+
+    for (auto& i : mInstruments)
+    {
+        if (i.name == name)
+        {
+            return i.kind == kind ? i.firstSlot : NONE;
+        }
+    }
+
+    if (mNextSlot + slots > MAX_SLOTS)
+    {
+        LOG_warn << "Metrics registry full, not recording " << name;
+        return NONE;
+    }
+
+    mInstruments.push_back(Instrument{name, help, kind, mNextSlot});
+    mNextSlot += slots;
+    return mInstruments.back().firstSlot;
+}
+
+MetricsRegistry::Id MetricsRegistry::counter(const std::string& name, const std::string& help)
+{
+    return registerInstrument(name, help, COUNTER, 1);
+}
+
+MetricsRegistry::Id MetricsRegistry::histogram(const std::string& name, const std::string& help)
+{
+    return registerInstrument(name, help, HISTOGRAM, HISTOGRAM_FIRST_BUCKET + HISTOGRAM_BUCKETS);
+}
+
+void MetricsRegistry::recordDuration(Id id, std::chrono::steady_clock::duration d)
+{
+    if (id == NONE)
+    {
+        return;
+    }
+
+    uint64_t nanos = uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    uint64_t micros = nanos / 1000;
+
+    unsigned bucket = 0;
+    while (bucket + 1 < HISTOGRAM_BUCKETS && (micros >> bucket))
+    {
+        bucket++;
+    }
+
+    add(id + HISTOGRAM_COUNT);
+    add(id + HISTOGRAM_SUM, nanos);
+    add(id + HISTOGRAM_FIRST_BUCKET + bucket);
+}
+
+std::vector<MetricsRegistry::Metric> MetricsRegistry::snapshot()
+{
+    std::lock_guard<std::mutex> g(mMutex);
+
+    auto slot = [this](Id i)
+    {
+        uint64_t v = mRetired.slots[i].load(std::memory_order_relaxed);
+        for (Shard* s : mShards)
+        {
+            v += s->slots[i].load(std::memory_order_relaxed);
+        }
+        return v;
+    };
+
+    std::vector<Metric> result;
+    result.reserve(mInstruments.size());
+    for (auto& i : mInstruments)
+    {
+        result.emplace_back();
+        Metric& m = result.back();
+        m.name = i.name;
+        m.help = i.help;
+        m.kind = i.kind;
+
+        if (i.kind == COUNTER)
+        {
+            m.count = slot(i.firstSlot);
+        }
+        else
+        {
+            m.count = slot(i.firstSlot + HISTOGRAM_COUNT);
+            m.sumNanoseconds = slot(i.firstSlot + HISTOGRAM_SUM);
+            for (unsigned b = 0; b < HISTOGRAM_BUCKETS; b++)
+            {
+                m.buckets[b] = slot(i.firstSlot + HISTOGRAM_FIRST_BUCKET + b);
+            }
+        }
+    }
+    return result;
+}
+
+std::string MetricsRegistry::toJson()
+{
+    std::ostringstream s;
+    s << "{";
+
+    bool first = true;
+    for (auto& m : snapshot())
+    {
+        s << (first ? "" : ",") << "\"" << m.name << "\":{\"type\":";
+        first = false;
+
+        if (m.kind == COUNTER)
+        {
+            s << "\"counter\",\"value\":" << m.count << "}";
+            continue;
+        }
+
+        s << "\"histogram\",\"count\":" << m.count << ",\"sum_us\":" << m.sumNanoseconds / 1000 << ",\"buckets\":{";
+        for (unsigned b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            s << (b ? "," : "") << "\"";
+            if (b + 1 < HISTOGRAM_BUCKETS)
+            {
+                s << (uint64_t(1) << b);
+            }
+            else
+            {
+                s << "+Inf";
+            }
+            s << "\":" << m.buckets[b];
+        }
+        s << "}}";
+    }
+
+    s << "}";
+    return s.str();
+}
+
+std::string MetricsRegistry::toPrometheus()
+{
+    std::ostringstream s;
+
+    for (auto& m : snapshot())
+    {
+        std::string name = "mega_" + m.name;
+        for (char& c : name)
+        {
+            if (!isalnum(static_cast<unsigned char>(c)) && c != '_')
+            {
+                c = '_';
+            }
+        }
+
+        if (m.kind == COUNTER)
+        {
+            name += "_total";
+        }
+        else
+        {
+            name += "_seconds";
+        }
+
+        if (!m.help.empty())
+        {
+            s << "# HELP " << name << " " << m.help << "\n";
+        }
+
+        if (m.kind == COUNTER)
+        {
+            s << "# TYPE " << name << " counter\n" << name << " " << m.count << "\n";
+            continue;
+        }
+
+        s << "# TYPE " << name << " histogram\n";
+        uint64_t cumulative = 0;
+        for (unsigned b = 0; b < HISTOGRAM_BUCKETS; b++)
+        {
+            cumulative += m.buckets[b];
+            s << name << "_bucket{le=\"";
+            if (b + 1 < HISTOGRAM_BUCKETS)
+            {
+                s << double(uint64_t(1) << b) / 1e6;
+            }
+            else
+            {
+                s << "+Inf";
+            }
+            s << "\"} " << cumulative << "\n";
+        }
+        s << name << "_sum " << double(m.sumNanoseconds) / 1e9 << "\n"
+          << name << "_count " << m.count << "\n";
+    }
+
+    return s.str();
+}
+
+namespace CodeCounter {
+
+uint32_t registerScope(const std::string& name)
+{
+    return MetricsRegistry::instance().histogram(name);
+}
+
+void recordScope(uint32_t metric, std::chrono::steady_clock::duration d)
+{
+    MetricsRegistry::instance().recordDuration(metric, d);
+}
+
+} // namespace CodeCounter
+
+} // namespace
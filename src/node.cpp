@@ -644,7 +644,8 @@ Node *Node::unserialize(MegaClient& client, const std::string *d, bool fromOldCa
         }
     }
 
-    ptr = n->attrs.unserialize(ptr, end);
+    // attributes are kept packed until needed, except when migrating the cache
+    ptr = fromOldCache ? n->mAttrs.unserialize(ptr, end) : n->packAttrs(ptr, end);
     if (!ptr)
     {
         LOG_err << "Failed to unserialize attrs";
@@ -658,8 +659,8 @@ Node *Node::unserialize(MegaClient& client, const std::string *d, bool fromOldCa
         // the updated version of utf8proc doesn't provide
         // exactly the same output as the previous one that
         // we were using
-        attr_map::iterator it = n->attrs.map.find('n');
-        if (it != n->attrs.map.end())
+        attr_map::iterator it = n->mAttrs.map.find('n');
+        if (it != n->mAttrs.map.end())
         {
             LocalPath::utf8_normalize(&(it->second));
         }
@@ -749,6 +750,172 @@ Node *Node::unserialize(MegaClient& client, const std::string *d, bool fromOldCa
     }
 }
 
+// validate the attributes serialized by AttrMap and keep them as they are, return final offset
+const char* Node::packAttrs(const char* ptr, const char* end)
+{
+    const char* start = ptr;
+    unsigned char l;
+    unsigned short ll;
+    bool terminated = false;
+
+    while (ptr < end)
+    {
+        if (!(l = static_cast<unsigned char>(*ptr++)))
+        {
+            terminated = true;
+            break;
+        }
+
+        if (ptr + l + sizeof ll > end)
+        {
+            return NULL;
+        }
+        ptr += l;
+
+        ll = MemAccess::get<unsigned short>(ptr);
+        ptr += sizeof ll;
+
+        if (ptr + ll > end)
+        {
+            return NULL;
+        }
+        ptr += ll;
+    }
+
+    if (ptr - start > 1)
+    {
+        mPackedAttrs.reset(new PackedAttrs);
+        mPackedAttrs->data.assign(start, ptr);
+        if (!terminated)
+        {
+            // the buffer ended without a terminator (the last value may well end in a NUL)
+            mPackedAttrs->data.push_back('\0');
+        }
+    }
+
+    return ptr;
+}
+
+// move the packed attributes to mAttrs (those already requested via attr() are there)
+void Node::unpackAttrs() const
+{
+    if (!mPackedAttrs)
+    {
+        return;
+    }
+
+    const char* ptr = mPackedAttrs->data.data();
+    unsigned char l;
+    unsigned short ll;
+
+    while ((l = static_cast<unsigned char>(*ptr++)))
+    {
+        nameid id = 0;
+        while (l--)
+        {
+            id = (id << 8) + static_cast<unsigned char>(*ptr++);
+        }
+
+        ll = MemAccess::get<unsigned short>(ptr);
+        ptr += sizeof ll;
+
+        mAttrs.map.emplace(id, string(ptr, ll));
+        ptr += ll;
+    }
+
+    mPackedAttrs.reset();
+}
+
+AttrMap& Node::attrs()
+{
+    unpackAttrs();
+    return mAttrs;
+}
+
+const AttrMap& Node::attrs() const
+{
+    unpackAttrs();
+    return mAttrs;
+}
+
+const string* Node::attr(nameid name) const
+{
+    auto it = mAttrs.map.find(name);
+    if (it != mAttrs.map.end())
+    {
+        return &it->second;
+    }
+
+    if (mPackedAttrs)
+    {
+        vector<nameid>& absent = mPackedAttrs->absent;
+        if (std::find(absent.begin(), absent.end(), name) != absent.end())
+        {
+            return nullptr;
+        }
+
+        const char* ptr = mPackedAttrs->data.data();
+        unsigned char l;
+        unsigned short ll;
+
+        while ((l = static_cast<unsigned char>(*ptr++)))
+        {
+            nameid id = 0;
+            while (l--)
+            {
+                id = (id << 8) + static_cast<unsigned char>(*ptr++);
+            }
+
+            ll = MemAccess::get<unsigned short>(ptr);
+            ptr += sizeof ll;
+
+            if (id == name)
+            {
+                return &mAttrs.map.emplace(id, string(ptr, ll)).first->second;
+            }
+            ptr += ll;
+        }
+
+        absent.push_back(name);
+    }
+
+    return nullptr;
+}
+
+vector<nameid> Node::attrNames() const
+{
+    vector<nameid> names;
+
+    if (!mPackedAttrs)
+    {
+        names.reserve(mAttrs.map.size());
+        for (auto& a : mAttrs.map)
+        {
+            names.push_back(a.first);
+        }
+        return names;
+    }
+
+    const char* ptr = mPackedAttrs->data.data();
+    unsigned char l;
+    unsigned short ll;
+
+    while ((l = static_cast<unsigned char>(*ptr++)))
+    {
+        nameid id = 0;
+        while (l--)
+        {
+            id = (id << 8) + static_cast<unsigned char>(*ptr++);
+        }
+
+        ll = MemAccess::get<unsigned short>(ptr);
+        ptr += sizeof ll + ll;
+
+        names.push_back(id);
+    }
+    return names;
+}
+
 // serialize node - nodes with pending or RSA keys are unsupported
 bool Node::serialize(string* d) const
 {
@@ -910,7 +1077,14 @@ bool Node::serialize(string* d) const
         }
     }
 
-    attrs.serialize(d);
+    if (mPackedAttrs)
+    {
+        d->append(mPackedAttrs->data);
+    }
+    else
+    {
+        mAttrs.serialize(d);
+    }
 
     if (isExported)
     {
@@ -1015,36 +1189,81 @@ void Node::setattr()
 
     if (attrstring && (cipher = nodecipher()) && (buf = decryptattr(cipher, attrstring->c_str(), attrstring->size())))
     {
-        JSON json;
-        nameid name;
-        string* t;
+        AttrMap newAttrs;
+        parseattrjson((char*)buf, newAttrs);
+        delete[] buf;
+        setattrs(newAttrs);
+    }
+}
 
-        AttrMap oldAttrs(attrs);
-        attrs.map.clear();
-        json.begin((char*)buf + 5);
+void Node::setattr(PrefetchedNodeKey& prefetched)
+{
+    if (!attrstring || !prefetched.attrsDecrypted)
+    {
+        return;
+    }
 
-        while ((name = json.getnameid()) != EOO && json.storeobject((t = &attrs.map[name])))
-        {
-            JSON::unescape(t);
+    setattrs(prefetched.attrs);
+}
 
-            if (name == 'n')
-            {
-                LocalPath::utf8_normalize(t);
-            }
+void PrefetchedNodeKey::decrypt(SymmCipher& sc)
+{
+    // as the symmetric case of MegaClient::decryptkey()
+    sc.setkey(wrappingKey);
+    if (Base64::atob(keydata.c_str() + keyOffset, key, int(keyLength)) != int(keyLength))
+    {
+        return;
+    }
+    sc.ecb_decrypt(key, keyLength);
+    keyDecrypted = true;
+
+    // as Node::setattr() once the key is applied
+    string nodekey(reinterpret_cast<const char*>(key), keyLength);
+    if (sc.setkey(&nodekey))
+    {
+        std::unique_ptr<byte[]> decrypted(Node::decryptattr(&sc, attrstring.c_str(), attrstring.size()));
+        if (decrypted)
+        {
+            Node::parseattrjson(reinterpret_cast<const char*>(decrypted.get()), attrs);
+            attrsDecrypted = true;
         }
+    }
+}
 
-        changed.name = attrs.hasDifferentValue('n', oldAttrs.map);
-        changed.favourite = attrs.hasDifferentValue(AttrMap::string2nameid("fav"), oldAttrs.map);
-        changed.sensitive = attrs.hasDifferentValue(AttrMap::string2nameid("sen"), oldAttrs.map);
+void Node::parseattrjson(const char* decrypted, AttrMap& attrs)
+{
+    JSON json;
+    nameid name;
+    string* t;
 
-        setfingerprint();
+    json.begin(decrypted + 5);
 
-        delete[] buf;
+    while ((name = json.getnameid()) != EOO && json.storeobject((t = &attrs.map[name])))
+    {
+        JSON::unescape(t);
 
-        attrstring.reset();
+        if (name == 'n')
+        {
+            LocalPath::utf8_normalize(t);
+        }
     }
 }
 
+// `newAttrs` is left with the previous attributes
+void Node::setattrs(AttrMap& newAttrs)
+{
+    AttrMap& nodeAttrs = attrs();
+    nodeAttrs.map.swap(newAttrs.map);
+
+    changed.name = nodeAttrs.hasDifferentValue('n', newAttrs.map);
+    changed.favourite = nodeAttrs.hasDifferentValue(AttrMap::string2nameid("fav"), newAttrs.map);
+    changed.sensitive = nodeAttrs.hasDifferentValue(AttrMap::string2nameid("sen"), newAttrs.map);
+
+    setfingerprint();
+
+    attrstring.reset();
+}
+
 nameid Node::sdsId()
 {
     constexpr nameid nid = MAKENAMEID3('s', 'd', 's');
@@ -1053,7 +1272,8 @@ nameid Node::sdsId()
 
 bool Node::isMarkedSensitive() const
 {
-    return attrs.getBool("sen");
+    const string* value = attr(AttrMap::string2nameid("sen"));
+    return value && *value == "1";
 }
 
 bool Node::isSensitiveInherited() const
@@ -1111,10 +1331,10 @@ vector<pair<handle, int>> Node::getSdsBackups() const
 {
     vector<pair<handle, int>> bkps;
 
-    auto it = attrs.map.find(sdsId());
-    if (it != attrs.map.end())
+    const string* sds = attr(sdsId());
+    if (sds)
     {
-        std::istringstream is(it->second);  // "b64aa:8,b64bb:8"
+        std::istringstream is(*sds);  // "b64aa:8,b64bb:8"
         while (!is.eof())
         {
             string b64BkpIdStr;
@@ -1172,11 +1392,11 @@ void Node::setfingerprint()
     {
         client->mNodeManager.removeFingerprint(this);
 
-        attr_map::iterator it = attrs.map.find('c');
+        const string* fingerprint = attr('c');
 
-        if (it != attrs.map.end())
+        if (fingerprint)
         {
-            if (!unserializefingerprint(&it->second))
+            if (!unserializefingerprint(fingerprint))
             {
                 LOG_warn << "Invalid fingerprint";
             }
@@ -1196,15 +1416,15 @@ void Node::setfingerprint()
 
 bool Node::hasName(const string& name) const
 {
-    auto it = attrs.map.find('n');
-    return it != attrs.map.end() && it->second == name;
+    const string* n = attr('n');
+    return n && *n == name;
 }
 
 bool Node::hasName() const
 {
-    auto i = attrs.map.find('n');
+    const string* n = attr('n');
 
-    return i != attrs.map.end() && !i->second.empty();
+    return n && !n->empty();
 }
 
 // return file/folder name or special status strings
@@ -1223,11 +1443,9 @@ const char* Node::displayname() const
         return "NO_KEY";
     }
 
-    attr_map::const_iterator it;
-
-    it = attrs.map.find('n');
+    const string* name = attr('n');
 
-    if (it == attrs.map.end())
+    if (!name)
     {
         if (type < ROOTNODE || type > RUBBISHNODE)
         {
@@ -1242,7 +1460,7 @@ const char* Node::displayname() const
         return "CRYPTO_ERROR";
     }
 
-    if (!it->second.size())
+    if (!name->size())
     {
         LOG_debug << "BLANK " << type << " " << size << " " << nodehandle;
 #ifdef ENABLE_SYNC
@@ -1254,7 +1472,7 @@ const char* Node::displayname() const
         return "BLANK";
     }
 
-    return it->second.c_str();
+    return name->c_str();
 }
 
 string Node::displaypath() const
@@ -1359,33 +1577,20 @@ int Node::hasfileattribute(const string *fileattrstring, fatype t)
     return static_cast<int>(fileattrstring->find(buf) + 1);
 }
 
-// attempt to apply node key - sets nodekey to a raw key if successful
-bool Node::applykey()
+const char* Node::findkey(MegaClient& client, const string& keydata, SymmCipher*& sc, bool& foreign)
 {
-    if (type > FOLDERNODE)
-    {
-        //Root nodes contain an empty attrstring
-        attrstring.reset();
-    }
-
-    if (keyApplied() || !nodekeydata.size())
-    {
-        return false;
-    }
-
     int l = -1;
     size_t t = 0;
     handle h;
     const char* k = NULL;
-    SymmCipher* sc = &client->key;
-    handle me = client->loggedIntoFolder() ? client->mNodeManager.getRootNodeFiles().as8byte() : client->me;
+    handle me = client.loggedIntoFolder() ? client.mNodeManager.getRootNodeFiles().as8byte() : client.me;
 
-    while ((t = nodekeydata.find_first_of(':', t)) != string::npos)
+    while ((t = keydata.find_first_of(':', t)) != string::npos)
     {
         // compound key: locate suitable subkey (always symmetric)
         h = 0;
 
-        l = Base64::atob(nodekeydata.c_str() + (nodekeydata.find_last_of('/', t) + 1), (byte*)&h, sizeof h);
+        l = Base64::atob(keydata.c_str() + (keydata.find_last_of('/', t) + 1), (byte*)&h, sizeof h);
         t++;
 
         if (l == MegaClient::USERHANDLE)
@@ -1402,12 +1607,12 @@ bool Node::applykey()
             if (h != me)
             {
                 // this is a share node handle - check if share key is available
-                if (client->mKeyManager.isSecure() && client->mKeyManager.generation())
+                if (client.mKeyManager.isSecure() && client.mKeyManager.generation())
                 {
-                    std::string key = client->mKeyManager.getShareKey(h);
+                    std::string key = client.mKeyManager.getShareKey(h);
                     if (key.size())
                     {
-                        sc = client->getRecycledTemporaryNodeCipher(&key);
+                        sc = client.getRecycledTemporaryNodeCipher(&key);
                     }
                     else
                     {
@@ -1416,11 +1621,11 @@ bool Node::applykey()
                 }
                 else // check at new keys repository and, if not found, at the root node of share
                 {
-                    auto it = client->mNewKeyRepository.find(NodeHandle().set6byte(h));
-                    if (it == client->mNewKeyRepository.end())
+                    auto it = client.mNewKeyRepository.find(NodeHandle().set6byte(h));
+                    if (it == client.mNewKeyRepository.end())
                     {
                         Node* n;
-                        if (!(n = client->nodebyhandle(h)) || !n->sharekey)
+                        if (!(n = client.nodebyhandle(h)) || !n->sharekey)
                         {
                             continue;
                         }
@@ -1429,42 +1634,86 @@ bool Node::applykey()
                     }
                     else
                     {
-                        sc = client->getRecycledTemporaryNodeCipher(it->second.data());
+                        sc = client.getRecycledTemporaryNodeCipher(it->second.data());
                     }
                 }
 
                 // this key will be rewritten when the node leaves the outbound share
-                foreignkey = true;
+                foreign = true;
             }
         }
 
-        k = nodekeydata.c_str() + t;
+        k = keydata.c_str() + t;
         break;
     }
 
     // no: found => personal key, use directly
     // otherwise, no suitable key available yet - bail (it might arrive soon)
+    if (!k && l < 0)
+    {
+        k = keydata.c_str();
+    }
+
+    return k;
+}
+
+// attempt to apply node key - sets nodekey to a raw key if successful
+bool Node::applykey(PrefetchedNodeKey* prefetched)
+{
+    if (type > FOLDERNODE)
+    {
+        //Root nodes contain an empty attrstring
+        attrstring.reset();
+    }
+
+    if (keyApplied() || !nodekeydata.size())
+    {
+        return false;
+    }
+
+    SymmCipher* sc = &client->key;
+    bool foreign = false;
+    const char* k = findkey(*client, nodekeydata, sc, foreign);
+    if (foreign)
+    {
+        foreignkey = true;
+    }
+
     if (!k)
     {
-        if (l < 0)
-        {
-            k = nodekeydata.c_str();
-        }
-        else
-        {
-            return false;
-        }
+        return false;
     }
 
     byte key[FILENODEKEYLENGTH];
     unsigned keylength = (type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH;
 
-    if (client->decryptkey(k, key, keylength, sc, 0, nodehandle))
+    // the prefetched result is only valid if it was computed from the same inputs
+    bool usePrefetched = prefetched
+            && prefetched->keyDecrypted
+            && prefetched->keyLength == keylength
+            && prefetched->keyOffset == size_t(k - nodekeydata.c_str())
+            && !memcmp(prefetched->wrappingKey, sc->key, sizeof prefetched->wrappingKey)
+            && prefetched->keydata == nodekeydata
+            && (attrstring ? prefetched->attrstring == *attrstring : prefetched->attrstring.empty());
+
+    if (usePrefetched)
+    {
+        memcpy(key, prefetched->key, keylength);
+    }
+
+    if (usePrefetched || client->decryptkey(k, key, keylength, sc, 0, nodehandle))
     {
         std::string undecryptedKey = nodekeydata;
         client->mAppliedKeyNodeCount++;
         nodekeydata.assign((const char*)key, keylength);
-        setattr();
+        if (usePrefetched)
+        {
+            setattr(*prefetched);
+        }
+        else
+        {
+            setattr();
+        }
         if (attrstring)
         {
             if (foreignkey)
@@ -1745,14 +1994,30 @@ void LocalNode::setnameparent(LocalNode* newparent, const LocalPath* newlocalpat
 
     assert(!newparent || newparent->node || newnode);
 
+    if (!sync->mDestructorRunning)
+    {
+        if (parent)
+        {
+            parent->setSyncdownDirty();
+        }
+
+        if (newparent && newparent != parent)
+        {
+            newparent->setSyncdownDirty();
+        }
+    }
+
     if (parent)
     {
         // remove existing child linkage
-        parent->children.erase(getLocalname());
+        parent->children.erase(childkey());
 
         if (slocalname)
         {
-            parent->schildren.erase(*slocalname);
+            if (parent->schildren)
+            {
+                parent->schildren->erase(slocalname.get());
+            }
             slocalname.reset();
         }
     }
@@ -1771,7 +2036,7 @@ void LocalNode::setnameparent(LocalNode* newparent, const LocalPath* newlocalpat
 
             if (node)
             {
-                if (name != node->attrs.map['n'])
+                if (name != node->attrs().map['n'])
                 {
                     if (node->type == FILENODE)
                     {
@@ -1782,7 +2047,7 @@ void LocalNode::setnameparent(LocalNode* newparent, const LocalPath* newlocalpat
                         sync->client->app->syncupdate_treestate(sync->getConfig(), getLocalPath(), ts, type);
                     }
 
-                    string prevname = node->attrs.map['n'];
+                    string prevname = node->attrs().map['n'];
 
                     // set new name
                     auto client = sync->client;
@@ -1849,12 +2114,17 @@ void LocalNode::setnameparent(LocalNode* newparent, const LocalPath* newlocalpat
         }
 
         // (we don't construct a UTF-8 or sname for the root path)
-        parent->children[getLocalname()] = this;
+        parent->children[childkey()] = this;
 
         if (newshortname && *newshortname != getLocalname())
         {
             slocalname = std::move(newshortname);
-            parent->schildren[*slocalname] = this;
+
+            if (!parent->schildren)
+            {
+                parent->schildren.reset(new localnode_map);
+            }
+            (*parent->schildren)[slocalname.get()] = this;
         }
         else
         {
@@ -1915,8 +2185,67 @@ LocalNode::LocalNode(Sync* csync)
 , reported{false}
 , checked{false}
 , needsRescan(false)
+, syncdownDirty(false)
+, syncdownDescendantDirty(false)
 {}
 
+LocalPath LocalNode::getLocalname() const
+{
+    lock_guard<mutex> g(File::localname_mutex);
+    return localname_multithreaded;
+}
+
+void LocalNode::setLocalname(const LocalPath& ln)
+{
+    lock_guard<mutex> g(File::localname_mutex);
+    localname_multithreaded = ln;
+}
+
+void LocalNode::setSyncdownDirty()
+{
+    syncdownDirty = true;
+
+    // always walk up to the root: syncdown() may have cleared an ancestor without reaching us
+    for (LocalNode* p = parent; p; p = p->parent)
+    {
+        p->syncdownDescendantDirty = true;
+    }
+}
+
+void LocalNode::restoreSyncdownDirty(bool dirty, bool descendantDirty)
+{
+    if (dirty)
+    {
+        setSyncdownDirty();
+    }
+    else if (descendantDirty)
+    {
+        for (LocalNode* p = this; p; p = p->parent)
+        {
+            p->syncdownDescendantDirty = true;
+        }
+    }
+}
+
+bool LocalNode::updatefingerprint(FileAccess* fa)
+{
+    // a file that was modified moments ago is likely still being written: reading its
+    // sampled blocks now would be repeated on every change notification
+    m_time_t now = m_time();
+    if (type == FILENODE && fa->mtime <= now && now - fa->mtime < Sync::FINGERPRINT_SETTLE_SECS)
+    {
+        bool changed = size != fa->size || mtime != fa->mtime || isvalid;
+
+        size = fa->size;
+        mtime = fa->mtime;
+        isvalid = false;
+
+        return changed;
+    }
+
+    return genfingerprint(fa);
+}
+
 // initialize fresh LocalNode object - must be called exactly once
 void LocalNode::init(nodetype_t ctype, LocalNode* cparent, const LocalPath& cfullpath, std::unique_ptr<LocalPath> shortname)
 {
@@ -1927,7 +2256,8 @@ void LocalNode::init(nodetype_t ctype, LocalNode* cparent, const LocalPath& cful
     created = false;
     reported = false;
     needsRescan = false;
-    syncxfer = true;
+    syncdownDirty = true;
+    syncdownDescendantDirty = false;
     newnode.reset();
     parent_dbid = 0;
     slocalname = NULL;
@@ -1953,9 +2283,6 @@ void LocalNode::init(nodetype_t ctype, LocalNode* cparent, const LocalPath& cful
 
     scanseqno = sync->scanseqno;
 
-    // mark fsid as not valid
-    fsid_it = sync->client->fsidnode.end();
-
     // enable folder notification
     if (type == FOLDERNODE && sync->dirnotify)
     {
@@ -2041,6 +2368,12 @@ void LocalNode::setnode(Node* cnode)
     {
         cnode->localnode.reset();
         node.crossref(cnode, this);
+
+        // a synced file is a local copy of its node's content, for downloads of the same
+        if (cnode->type == FILENODE && cnode->isvalid && sync && sync->client->localcopydownloads)
+        {
+            sync->client->localcontentindex.add(*cnode, getLocalPath());
+        }
     }
 }
 
@@ -2084,27 +2417,29 @@ void LocalNode::setfsid(handle newfsid, handlelocalnode_map& fsidnodes)
         return;
     }
 
-    if (fsid_it != fsidnodes.end())
+    auto it = fsidnodes.find(fsid);
+    if (it != fsidnodes.end() && it->second == this)
     {
         if (newfsid == fsid)
         {
             return;
         }
 
-        fsidnodes.erase(fsid_it);
+        fsidnodes.erase(it);
     }
 
     fsid = newfsid;
 
-    pair<handlelocalnode_map::iterator, bool> r = fsidnodes.insert(std::make_pair(fsid, this));
-
-    fsid_it = r.first;
+    // replaces any previous fsid assignment (the node is likely about to be deleted)
+    fsidnodes[fsid] = this;
+}
 
-    if (!r.second)
+void LocalNode::unlinkfsid(handlelocalnode_map& fsidnodes)
+{
+    auto it = fsidnodes.find(fsid);
+    if (it != fsidnodes.end() && it->second == this)
     {
-        // remove previous fsid assignment (the node is likely about to be deleted)
-        fsid_it->second->fsid_it = fsidnodes.end();
-        fsid_it->second = this;
+        fsidnodes.erase(it);
     }
 }
 
@@ -2117,6 +2452,9 @@ LocalNode::~LocalNode()
         return;
     }
 
+    // stop the upload while our path and parent are still valid
+    upload.reset();
+
     if (!sync->mDestructorRunning && (
         sync->state() == SYNC_ACTIVE || sync->state() == SYNC_INITIALSCAN))
     {
@@ -2146,10 +2484,7 @@ LocalNode::~LocalNode()
     }
 
     // remove from fsidnode map, if present
-    if (fsid_it != sync->client->fsidnode.end())
-    {
-        sync->client->fsidnode.erase(fsid_it);
-    }
+    unlinkfsid(sync->client->fsidnode);
 
     sync->client->totalLocalNodes--;
     sync->localnodes[type]--;
@@ -2254,7 +2589,8 @@ LocalNode* LocalNode::childbyname(LocalPath* localname)
 {
     localnode_map::iterator it;
 
-    if (!localname || ((it = children.find(*localname)) == children.end() && (it = schildren.find(*localname)) == schildren.end()))
+    if (!localname || ((it = children.find(localname)) == children.end()
+                       && (!schildren || (it = schildren->find(localname)) == schildren->end())))
     {
         return NULL;
     }
@@ -2262,54 +2598,6 @@ LocalNode* LocalNode::childbyname(LocalPath* localname)
     return it->second;
 }
 
-void LocalNode::prepare(FileSystemAccess&)
-{
-    getlocalpath(transfer->localfilename);
-    assert(transfer->localfilename.isAbsolute());
-
-
-    // is this transfer in progress? update file's filename.
-    if (transfer->slot && transfer->slot->fa && !transfer->slot->fa->nonblocking_localname.empty())
-    {
-        transfer->slot->fa->updatelocalname(transfer->localfilename, false);
-    }
-
-    treestate(TREESTATE_SYNCING);
-}
-
-void LocalNode::terminated(error e)
-{
-    sync->threadSafeState->transferFailed(PUT, size);
-
-    File::terminated(e);
-}
-
-// complete a sync upload: complete to //bin if a newer node exists (which
-// would have been caused by a race condition)
-void LocalNode::completed(Transfer* t, putsource_t source)
-{
-    sync->threadSafeState->transferComplete(PUT, size);
-
-    // complete to rubbish for later retrieval if the parent node does not
-    // exist or is newer
-    if (!parent || !parent->node || (node && mtime < node->mtime))
-    {
-        h = t->client->mNodeManager.getRootNodeRubbish();
-    }
-    else
-    {
-        // otherwise, overwrite node if it already exists and complete in its
-        // place
-        h = parent->node->nodeHandle();
-    }
-
-    bool canChangeVault = sync->isBackup();
-
-    // we are overriding completed() for sync upload, we don't use the File::completed version at all.
-    assert(t->type == PUT);
-    sendPutnodesOfUpload(t->client, t->uploadhandle, *t->ultoken, t->filekey, source, NodeHandle(), nullptr, this, nullptr, canChangeVault);
-}
-
 // serialize/unserialize the following LocalNode properties:
 // - type/size
 // - fsid
@@ -2317,45 +2605,49 @@ void LocalNode::completed(Transfer* t, putsource_t source)
 // - corresponding Node handle
 // - local name
 // - fingerprint crc/mtime (filenodes only)
-bool LocalNode::serialize(string* d) const
+void LocalNode::CacheRecord::serialize(string* d) const
 {
     CacheableWriter w(*d);
     w.serializei64(type ? -type : size);
     w.serializehandle(fsid);
-    w.serializeu32(parent ? parent->dbid : 0);
-    w.serializenodehandle(node ? node->nodehandle : UNDEF);
-    w.serializestring(getLocalname().platformEncoded());
+    w.serializeu32(parent_dbid);
+    w.serializenodehandle(nodehandle);
+    w.serializestring(localname);
     if (type == FILENODE)
     {
         w.serializebinary((byte*)crc.data(), sizeof(crc));
         w.serializecompressedi64(mtime);
     }
-    w.serializebyte(mSyncable);
-    w.serializeexpansionflags(1);  // first flag indicates we are storing slocalname.  Storing it is much, much faster than looking it up on startup.
-    auto tmpstr = slocalname ? slocalname->platformEncoded() : string();
-    w.serializepstr(slocalname ? &tmpstr : nullptr);
+    w.serializebyte(syncable);
 
-    return true;
+    // first flag indicates we are storing slocalname.  Storing it is much, much faster than looking it up on startup.
+    // second flag: a folder's scan snapshot follows, so it needn't be enumerated on startup if unchanged
+    // third flag: the CRCs above are stale, the file was still being written
+    bool hasSnapshot = type == FOLDERNODE && snapshotMtime;
+    w.serializeexpansionflags(1, hasSnapshot, type == FILENODE && crcStale);
+    w.serializestring(shortname);
+    if (hasSnapshot)
+    {
+        w.serializecompressedi64(snapshotMtime);
+        w.serializeu32(snapshotEntries);
+    }
 }
 
-LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
+bool LocalNode::CacheRecord::unserialize(const string& d)
 {
-    if (d->size() < sizeof(m_off_t)         // type/size combo
-                  + sizeof(handle)          // fsid
-                  + sizeof(uint32_t)        // parent dbid
-                  + MegaClient::NODEHANDLE  // handle
-                  + sizeof(short))          // localname length
+    if (d.size() < sizeof(m_off_t)         // type/size combo
+                 + sizeof(handle)          // fsid
+                 + sizeof(uint32_t)        // parent dbid
+                 + MegaClient::NODEHANDLE  // handle
+                 + sizeof(short))          // localname length
     {
         LOG_err << "LocalNode unserialization failed - short data";
-        return NULL;
+        return false;
     }
 
-    CacheableReader r(*d);
-
-    nodetype_t type;
-    m_off_t size;
+    CacheableReader r(d);
 
-    if (!r.unserializei64(size)) return nullptr;
+    if (!r.unserializei64(size)) return false;
 
     if (size < 0 && size >= -FOLDERNODE)
     {
@@ -2368,59 +2660,93 @@ LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
         type = FILENODE;
     }
 
-    handle fsid;
-    uint32_t parent_dbid;
-    handle h = 0;
-    string localname, shortname;
-    m_time_t mtime = 0;
-    int32_t crc[4];
-    memset(crc, 0, sizeof crc);
-    byte syncable = 1;
+    byte syncableByte = 1;
     unsigned char expansionflags[8] = { 0 };
 
     if (!r.unserializehandle(fsid) ||
         !r.unserializeu32(parent_dbid) ||
-        !r.unserializenodehandle(h) ||
+        !r.unserializenodehandle(nodehandle) ||
         !r.unserializestring(localname) ||
-        (type == FILENODE && !r.unserializebinary((byte*)crc, sizeof(crc))) ||
+        (type == FILENODE && !r.unserializebinary((byte*)crc.data(), sizeof(crc))) ||
         (type == FILENODE && !r.unserializecompressedi64(mtime)) ||
-        (r.hasdataleft() && !r.unserializebyte(syncable)) ||
-        (r.hasdataleft() && !r.unserializeexpansionflags(expansionflags, 1)) ||
-        (expansionflags[0] && !r.unserializecstr(shortname, false)))
+        (r.hasdataleft() && !r.unserializebyte(syncableByte)) ||
+        (r.hasdataleft() && !r.unserializeexpansionflags(expansionflags, 3)) ||
+        (expansionflags[0] && !r.unserializecstr(shortname, false)) ||
+        (expansionflags[1] && !r.unserializecompressedi64(snapshotMtime)) ||
+        (expansionflags[1] && !r.unserializeu32(snapshotEntries)))
     {
         LOG_err << "LocalNode unserialization failed at field " << r.fieldnum;
-        return nullptr;
+        return false;
     }
     assert(!r.hasdataleft());
 
+    syncable = syncableByte == 1;
+    shortnameInDb = 0 != expansionflags[0];
+    crcStale = 0 != expansionflags[2];
+    return true;
+}
+
+bool LocalNode::serialize(string* d) const
+{
+    CacheRecord record;
+    record.type = type;
+    record.size = size;
+    record.fsid = fsid;
+    record.parent_dbid = parent ? parent->dbid : 0;
+    record.nodehandle = node ? node->nodehandle : UNDEF;
+    record.localname = getLocalname().platformEncoded();
+    if (slocalname)
+    {
+        record.shortname = slocalname->platformEncoded();
+    }
+    record.crc = crc;
+    record.mtime = mtime;
+    record.syncable = mSyncable;
+    record.crcStale = !isvalid;
+    record.snapshotMtime = scanSnapshotMtime;
+    record.snapshotEntries = scanSnapshotEntries;
+
+    record.serialize(d);
+    return true;
+}
+
+LocalNode* LocalNode::unserialize(Sync* sync, const string* d)
+{
+    CacheRecord record;
+    if (!record.unserialize(*d))
+    {
+        return nullptr;
+    }
+
     LocalNode* l = new LocalNode(sync);
 
-    l->type = type;
-    l->size = size;
+    l->type = record.type;
+    l->size = record.size;
 
-    l->parent_dbid = parent_dbid;
+    l->parent_dbid = record.parent_dbid;
 
-    l->fsid = fsid;
-    l->fsid_it = sync->client->fsidnode.end();
+    l->fsid = record.fsid;
 
-    l->setLocalname(LocalPath::fromPlatformEncodedRelative(localname));
-    l->slocalname.reset(shortname.empty() ? nullptr : new LocalPath(LocalPath::fromPlatformEncodedRelative(shortname)));
-    l->slocalname_in_db = 0 != expansionflags[0];
+    l->setLocalname(LocalPath::fromPlatformEncodedRelative(record.localname));
+    l->slocalname.reset(record.shortname.empty() ? nullptr : new LocalPath(LocalPath::fromPlatformEncodedRelative(record.shortname)));
+    l->slocalname_in_db = record.shortnameInDb;
     l->name = l->getLocalname().toName(*sync->syncs.fsaccess);
 
-    memcpy(l->crc.data(), crc, sizeof crc);
-    l->mtime = mtime;
-    l->isvalid = true;
+    l->crc = record.crc;
+    l->mtime = record.mtime;
+    l->isvalid = !record.crcStale;
+    l->scanSnapshotMtime = record.snapshotMtime;
+    l->scanSnapshotEntries = record.snapshotEntries;
 
-    l->node.store_unchecked(sync->client->nodebyhandle(h));
+    l->node.store_unchecked(sync->client->nodebyhandle(record.nodehandle));
     l->parent = nullptr;
     l->sync = sync;
-    l->mSyncable = syncable == 1;
+    l->mSyncable = record.syncable;
 
     // FIXME: serialize/unserialize
     l->created = false;
     l->reported = false;
-    l->checked = h != UNDEF; // TODO: Is this a bug? h will never be UNDEF
+    l->checked = record.nodehandle != UNDEF; // TODO: Is this a bug? h will never be UNDEF
     l->needsRescan = false;
 
     return l;
@@ -2437,6 +2763,27 @@ void NodeCounter::operator += (const NodeCounter& o)
     versionStorage += o.versionStorage;
 }
 
+void NodeCounter::addNode(nodetype_t type, m_off_t size, bool isVersion)
+{
+    if (type == FILENODE)
+    {
+        if (isVersion)
+        {
+            versions++;
+            versionStorage += size;
+        }
+        else
+        {
+            files++;
+            storage += size;
+        }
+    }
+    else if (type == FOLDERNODE)
+    {
+        folders++;
+    }
+}
+
 void NodeCounter::operator -= (const NodeCounter& o)
 {
     storage -= o.storage;
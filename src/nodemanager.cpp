@@ -91,6 +91,7 @@ bool NodeManager::setrootnode_internal(Node* node)
 void NodeManager::notifyNode(Node* n, node_vector* nodesToReport)
 {
     LockGuard g(mMutex);
+    n->changed.counterOnly = false;
     notifyNode_internal(n, nodesToReport);
 }
 
@@ -140,6 +141,18 @@ void NodeManager::notifyNode_internal(Node* n, node_vector* nodesToReport)
         }
 
 #ifdef ENABLE_SYNC
+        // let the next syncdown() know which folders to compare: the one the node was in,
+        // and the one it is in now
+        if (n->localnode && n->localnode->parent)
+        {
+            n->localnode->parent->setSyncdownDirty();
+        }
+
+        if (n->parent && n->parent->localnode)
+        {
+            n->parent->localnode->setSyncdownDirty();
+        }
+
         // is this a synced node that was moved to a non-synced location? queue for
         // deletion from LocalNodes.
         if (n->localnode && n->localnode->parent && n->parent && !n->parent->localnode)
@@ -1006,8 +1019,17 @@ void NodeManager::setNodeCounter(Node* n, const NodeCounter &counter, bool notif
 
     if (notify)
     {
+        // ancestors of added, moved and removed nodes only need their counter written to DB,
+        // unless they have other changes pending or applying their key (upon notification) changes them
+        bool counterOnly = !n->notified && (n->type > FOLDERNODE ? !n->attrstring : n->keyApplied());
+
         n->changed.counter = true;
         notifyNode_internal(n, nodesToReport);
+
+        if (counterOnly)
+        {
+            n->changed.counterOnly = true;
+        }
     }
 }
 
@@ -1034,79 +1056,111 @@ void NodeManager::updateTreeCounter(Node *origin, NodeCounter nc, OperationType
     }
 }
 
-NodeCounter NodeManager::calculateNodeCounter(const NodeHandle& nodehandle, nodetype_t parentType, Node* node, bool isInRubbish)
+void NodeManager::calculateNodeCounters(const node_vector& roots)
 {
     assert(mMutex.locked());
 
-    NodeCounter nc;
-    if (!mTable)
+    // Subtrees are walked depth-first from the DB, using the parenthandle index, with an explicit stack.
+    // Only nodes with children are kept to descend into: the children without children of their own
+    // (most of them, in practice) are counted as they are streamed and written with one statement per parent
+    struct Pending
     {
-        assert(false);
-        return nc;
-    }
+        NodeSizeTypeAndFlags properties;
+        Node* node;
+        bool isVersion;
+        NodeCounter nc;
+        std::vector<NodeSizeTypeAndFlags> parents;
+        size_t nextParent = 0;
+    };
+    std::vector<Pending> stack;
 
-    m_off_t nodeSize = 0u;
-    uint64_t flags = 0;
-    nodetype_t nodeType = TYPE_UNKNOWN;
-    if (node)
-    {
-        nodeType = node->type;
-        nodeSize = node->size;
-        flags = node->getDBFlags();
-    }
-    else
-    {
-        if (!mTable->getNodeSizeTypeAndFlags(nodehandle, nodeSize, nodeType, flags))
-        {
-            assert(false);
-            return nc;
-        }
-        std::bitset<Node::FLAGS_SIZE> bitset(flags);
-        flags = Node::getDBFlags(flags, isInRubbish, parentType == FILENODE, bitset.test(Node::FLAGS_IS_MARKED_SENSTIVE));
-    }
+    const uint64_t derivedFlags = Node::Flags().set(Node::FLAGS_IS_VERSION).set(Node::FLAGS_IS_IN_RUBBISH).to_ulong();
 
-    const nodePtr_map* children = nullptr;
-    auto it = mNodes.find(nodehandle);
-    if (it != mNodes.end())
+    for (Node* root : roots)
     {
-        children = it->second.mChildren.get();
-    }
+        bool isInRubbish = root->type == RUBBISHNODE;
 
-    if (children)
-    {
-        for (const auto& itNode : *children)
+        auto push = [&](const NodeSizeTypeAndFlags& properties, Node* node, nodetype_t parentType)
         {
-            nc += calculateNodeCounter(itNode.first, nodeType, itNode.second, isInRubbish);
-        }
-    }
+            Pending p;
+            p.properties = properties;
+            p.node = node ? node : getNodeInRAM(properties.handle);
+            p.isVersion = parentType == FILENODE;
+            if (p.node)
+            {
+                p.properties.flags = p.node->getDBFlags();
+            }
+            else
+            {
+                std::bitset<Node::FLAGS_SIZE> bitset(properties.flags);
+                p.properties.flags = Node::getDBFlags(properties.flags, isInRubbish, p.isVersion, bitset.test(Node::FLAGS_IS_MARKED_SENSTIVE));
+            }
 
-    if (nodeType == FILENODE)
-    {
-        bool isVersion = parentType == FILENODE;
-        if (isVersion)
-        {
-            nc.versions++;
-            nc.versionStorage += nodeSize;
-        }
-        else
+            bool hasLeaves = false;
+            bool scanned = mTable->getChildrenSizeTypeAndFlags(properties.handle, [&](const NodeSizeTypeAndFlags& child, bool hasChildren)
+            {
+                if (hasChildren)
+                {
+                    p.parents.push_back(child);
+                    return;
+                }
+
+                NodeCounter nc;
+                nc.addNode(child.type, child.size, properties.type == FILENODE);
+                p.nc += nc;
+                hasLeaves = true;
+
+                if (Node* childNode = getNodeInRAM(child.handle))
+                {
+                    setNodeCounter(childNode, nc, false, nullptr);
+                }
+            });
+            assert(scanned);
+
+            if (hasLeaves)
+            {
+                Node::Flags flags;
+                flags.set(Node::FLAGS_IS_VERSION, properties.type == FILENODE);
+                flags.set(Node::FLAGS_IS_IN_RUBBISH, isInRubbish);
+                mTable->updateLeafChildrenCounterAndFlags(properties.handle, properties.type == FILENODE, derivedFlags, flags.to_ulong());
+            }
+
+            stack.push_back(std::move(p));
+        };
+
+        NodeSizeTypeAndFlags rootProperties;
+        rootProperties.handle = root->nodeHandle();
+        rootProperties.type = root->type;
+        rootProperties.size = root->size;
+        push(rootProperties, root, TYPE_UNKNOWN);
+
+        while (!stack.empty())
         {
-            nc.files++;
-            nc.storage += nodeSize;
-        }
-    }
-    else if (nodeType == FOLDERNODE)
-    {
-        nc.folders++;
-    }
+            Pending& top = stack.back();
+            if (top.nextParent < top.parents.size())
+            {
+                NodeSizeTypeAndFlags child = top.parents[top.nextParent++];
+                push(child, nullptr, top.properties.type);
+                continue;
+            }
 
-    if (node)
-    {
-        setNodeCounter(node, nc, false, nullptr);
-    }
+            NodeCounter nc = top.nc;
+            nc.addNode(top.properties.type, top.properties.size, top.isVersion);
 
-    mTable->updateCounterAndFlags(nodehandle, flags, nc.serialize());
+            if (top.node)
+            {
+                setNodeCounter(top.node, nc, false, nullptr);
+            }
+
+            mTable->updateCounterAndFlags(top.properties.handle, top.properties.flags, nc.serialize());
 
-    return nc;
+            stack.pop_back();
+            if (!stack.empty())
+            {
+                stack.back().nc += nc;
+            }
+        }
+    }
 }
 
 std::vector<NodeHandle> NodeManager::getFavouritesNodeHandles(NodeHandle node, uint32_t count)
@@ -1307,6 +1361,26 @@ void NodeManager::applyKeys_internal(uint32_t appliedKeys)
     }
 }
 
+// whether the counter is all that changed since the node was notified
+// (modifiedByThisClient and syncdown_node_matched_here are internal and don't change the node)
+static bool onlyCounterChanged(const Node& n)
+{
+    return !n.changed.removed
+        && !n.changed.attrs
+        && !n.changed.owner
+        && !n.changed.ctime
+        && !n.changed.fileattrstring
+        && !n.changed.inshare
+        && !n.changed.outshares
+        && !n.changed.pendingshares
+        && !n.changed.parent
+        && !n.changed.publiclink
+        && !n.changed.newnode
+        && !n.changed.name
+        && !n.changed.favourite
+        && !n.changed.sensitive;
+}
+
 void NodeManager::notifyPurge()
 {
     // only lock to get the nodes to report
@@ -1509,10 +1583,13 @@ void NodeManager::notifyPurge()
         unsigned removed = 0;
         unsigned added = 0;
 
+        unsigned countersUpdated = 0;
+
         // check all notified nodes for removed status and purge
         for (size_t i = 0; i < nodesToReport.size(); i++)
         {
             Node* n = nodesToReport[i];
+            bool counterOnly = n->changed.counterOnly && onlyCounterChanged(*n);
 
             if (n->attrstring)
             {
@@ -1580,6 +1657,10 @@ void NodeManager::notifyPurge()
 
                 removed += 1;
             }
+            else if (counterOnly && mTable->updateCounter(n->nodeHandle(), n->getCounter().serialize()))
+            {
+                countersUpdated += 1;
+            }
             else
             {
                 putNodeInDb(n);
@@ -1596,6 +1677,10 @@ void NodeManager::notifyPurge()
         {
             LOG_verbose << mClient.clientname << "Added " << added << " nodes to database";
         }
+        if (countersUpdated)
+        {
+            LOG_verbose << mClient.clientname << "Updated the counters of " << countersUpdated << " nodes in database";
+        }
     }
 }
 
@@ -1793,13 +1878,10 @@ void NodeManager::initCompleted_internal()
         return;
     }
 
-    node_vector rootNodes = getRootNodesAndInshares();
-    for (Node* node : rootNodes)
-    {
-        calculateNodeCounter(node->nodeHandle(), TYPE_UNKNOWN, node, node->type == RUBBISHNODE);
-    }
-
+    // the counters are computed by walking children, which needs the parenthandle index
     mTable->createIndexes();
+
+    calculateNodeCounters(getRootNodesAndInshares());
 }
 
 NodeCounter NodeManager::getCounterOfRootNodes()
@@ -48,6 +48,11 @@ extern JavaVM *MEGAjvm;
 #endif /* ! __ANDROID__ */
 
 #include <sys/vfs.h>
+#include <sys/syscall.h>
+
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif /* ! FICLONE */
 
 #ifndef FUSEBLK_SUPER_MAGIC
 #define FUSEBLK_SUPER_MAGIC 0x65735546ul
@@ -289,10 +294,33 @@ bool PosixFileAccess::sysopen(bool, FSLogging fsl)
             LOG_err << "Failed to open('" << adjustBasePath(nonblocking_localname) << "'): error " << errorcode << ": " << getErrorMessage(errorcode);
         }
     }
+    else if (mReadPattern != READ_NORMAL)
+    {
+        // the hint belongs to the open file description, so it's given again on each open
+        sysreadpattern();
+    }
 
     return fd >= 0;
 }
 
+void PosixFileAccess::sysreadpattern()
+{
+    if (fd < 0)
+    {
+        return;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    int advice = mReadPattern == READ_SEQUENTIAL ? POSIX_FADV_SEQUENTIAL
+               : mReadPattern == READ_RANDOM ? POSIX_FADV_RANDOM
+               : POSIX_FADV_NORMAL;
+    posix_fadvise(fd, 0, 0, advice);
+#elif defined(F_RDAHEAD)
+    // no fadvise (macOS): readahead can only be turned off for random reads
+    fcntl(fd, F_RDAHEAD, mReadPattern == READ_RANDOM ? 0 : 1);
+#endif
+}
+
 void PosixFileAccess::sysclose()
 {
     assert(nonblocking_localname.empty() || fd >= 0);
@@ -979,6 +1007,76 @@ bool PosixFileSystemAccess::renamelocal(const LocalPath& oldname, const LocalPat
     return false;
 }
 
+#ifdef __linux__
+// Copy all of sfd into tfd (both freshly opened), preferring the cheapest mechanism the filesystems
+// support: a copy on write clone (btrfs, XFS, ...), then an in-kernel copy (which NFS and SMB can
+// offload to the server), then sendfile.
+static bool copyFileData(int sfd, int tfd, FileSystemAccess::CopyMethod& method)
+{
+    if (!ioctl(tfd, FICLONE, sfd))
+    {
+        method = FileSystemAccess::COPY_CLONE;
+        return true;
+    }
+
+#if defined(__NR_copy_file_range) && !defined(__ANDROID__)
+    // (not on Android, whose seccomp policy kills apps making syscalls it doesn't allow)
+    {
+        ssize_t t;
+        off_t copied = 0;
+
+        while ((t = syscall(__NR_copy_file_range, sfd, nullptr, tfd, nullptr, 1024 * 1024 * 1024, 0u)) > 0)
+        {
+            copied += t;
+        }
+
+        if (!t)
+        {
+            method = FileSystemAccess::COPY_FILE_RANGE;
+            return true;
+        }
+
+        // not supported between these files (e.g. different filesystems on older kernels): start over
+        if (copied && (lseek(sfd, 0, SEEK_SET) || lseek(tfd, 0, SEEK_SET) || ftruncate(tfd, 0)))
+        {
+            return false;
+        }
+    }
+#endif
+
+#ifdef HAVE_SENDFILE
+    // keep the bulk copy out of the page cache, where the filesystem allows it
+    fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) | O_DIRECT);
+    fcntl(tfd, F_SETFL, fcntl(tfd, F_GETFL) | O_DIRECT);
+
+    ssize_t t;
+    bool direct = true;
+
+    while ((t = sendfile(tfd, sfd, NULL, 1024 * 1024 * 1024)) > 0
+           || (t < 0 && errno == EINVAL && direct))
+    {
+        if (t < 0)
+        {
+            // O_DIRECT can't write the unaligned tail of the file
+            fcntl(sfd, F_SETFL, fcntl(sfd, F_GETFL) & ~O_DIRECT);
+            fcntl(tfd, F_SETFL, fcntl(tfd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+        }
+    }
+
+    method = FileSystemAccess::COPY_SENDFILE;
+#else
+    char buf[16384];
+    ssize_t t;
+    while (((t = read(sfd, buf, sizeof buf)) > 0) && write(tfd, buf, t) == t);
+
+    method = FileSystemAccess::COPY_READWRITE;
+#endif
+
+    return !t;
+}
+#endif
+
 bool PosixFileSystemAccess::copylocal(const LocalPath& oldname, const LocalPath& newname, m_time_t mtime)
 {
 #ifdef USE_IOS
@@ -992,28 +1090,29 @@ bool PosixFileSystemAccess::copylocal(const LocalPath& oldname, const LocalPath&
 
     int sfd, tfd;
     ssize_t t = -1;
+    CopyMethod method = COPY_NONE;
 
-#ifdef HAVE_SENDFILE
-    // Linux-specific - kernel 2.6.33+ required
-    if ((sfd = open(oldnamestr.c_str(), O_RDONLY | O_DIRECT)) >= 0)
+    last_copy_method = COPY_NONE;
+
+#ifdef __linux__
+    if ((sfd = open(oldnamestr.c_str(), O_RDONLY)) >= 0)
     {
-        LOG_verbose << "Copying via sendfile";
         mode_t mode = umask(0);
-        if ((tfd = open(newnamestr.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, defaultfilepermissions)) >= 0)
+        if ((tfd = open(newnamestr.c_str(), O_WRONLY | O_CREAT | O_TRUNC, defaultfilepermissions)) >= 0)
         {
             umask(mode);
-            while ((t = sendfile(tfd, sfd, NULL, 1024 * 1024 * 1024)) > 0);
+            t = copyFileData(sfd, tfd, method) ? 0 : -1;
 #else
     char buf[16384];
 
     if ((sfd = open(oldnamestr.c_str(), O_RDONLY)) >= 0)
     {
-        LOG_verbose << "Copying via read/write";
         mode_t mode = umask(0);
         if ((tfd = open(newnamestr.c_str(), O_WRONLY | O_CREAT | O_TRUNC, defaultfilepermissions)) >= 0)
         {
             umask(mode);
             while (((t = read(sfd, buf, sizeof buf)) > 0) && write(tfd, buf, t) == t);
+            method = COPY_READWRITE;
 #endif
             close(tfd);
         }
@@ -1033,6 +1132,8 @@ bool PosixFileSystemAccess::copylocal(const LocalPath& oldname, const LocalPath&
 
     if (!t)
     {
+        LOG_verbose << "Copied via " << copyMethodName(method);
+
 #ifdef ENABLE_SYNC
         t = !setmtimelocal(newname, mtime);
 #else
@@ -1046,6 +1147,8 @@ bool PosixFileSystemAccess::copylocal(const LocalPath& oldname, const LocalPath&
         LOG_debug << "Unable to copy file: " << oldnamestr << " to " << newnamestr << ". Error code: " << e;
     }
 
+    last_copy_method = t ? COPY_NONE : method;
+
     return !t;
 }
 
@@ -366,6 +366,11 @@ CurlHttpIO::CurlHttpIO()
     curltimeoutreset[PUT] = -1;
     arerequestspaused[PUT] = false;
 
+    for (CURLM* m : curlm)
+    {
+        sethttp2options(m);
+    }
+
     curlsh = curl_share_init();
     curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
     curl_share_setopt(curlsh, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
@@ -927,6 +932,11 @@ void CurlHttpIO::disconnect()
     curltimeoutreset[PUT] = -1;
     arerequestspaused[PUT] = false;
 
+    for (CURLM* m : curlm)
+    {
+        sethttp2options(m);
+    }
+
     disconnecting = false;
 #ifdef MEGA_USE_C_ARES
     if (dnsservers.size())
@@ -969,6 +979,97 @@ m_off_t CurlHttpIO::getmaxuploadspeed()
     return maxspeed[PUT];
 }
 
+bool CurlHttpIO::sethttp2(bool enable, long maxStreamsPerConnection)
+{
+#if LIBCURL_VERSION_NUM >= 0x073200 // At least cURL 7.50.0
+    if (enable && !(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2))
+    {
+        LOG_warn << "cURL built without HTTP/2 support";
+        return false;
+    }
+
+    http2configured = true;
+    http2 = enable;
+    http2MaxStreams = std::max(1L, maxStreamsPerConnection);
+    http2ConsecutiveErrors = 0;
+
+    for (CURLM* m : curlm)
+    {
+        sethttp2options(m);
+    }
+
+    LOG_info << "HTTP/2 multiplexing " << (enable ? "enabled" : "disabled") << " (max streams per connection: " << http2MaxStreams << ")";
+    return true;
+#else
+    LOG_warn << "cURL too old for HTTP/2 multiplexing";
+    return false;
+#endif
+}
+
+void CurlHttpIO::sethttp2options(CURLM* m)
+{
+#if LIBCURL_VERSION_NUM >= 0x073200 // At least cURL 7.50.0
+    if (!http2configured)
+    {
+        return;
+    }
+
+    curl_multi_setopt(m, CURLMOPT_PIPELINING, http2 ? CURLPIPE_MULTIPLEX : CURLPIPE_NOTHING);
+#if LIBCURL_VERSION_NUM >= 0x074300 // At least cURL 7.67.0
+    curl_multi_setopt(m, CURLMOPT_MAX_CONCURRENT_STREAMS, http2MaxStreams);
+#endif
+#endif
+}
+
+void CurlHttpIO::updateconnectionstats(CURL* curl, CURLcode errorCode)
+{
+    connectionStats.requests++;
+
+    long connects = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects) == CURLE_OK)
+    {
+        if (connects)
+        {
+            connectionStats.newConnections += uint64_t(connects);
+        }
+        else
+        {
+            connectionStats.reusedConnections++;
+        }
+    }
+
+#if LIBCURL_VERSION_NUM >= 0x073200 // At least cURL 7.50.0
+    long version = 0;
+    if (curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version) == CURLE_OK && version == CURL_HTTP_VERSION_2_0)
+    {
+        connectionStats.http2Requests++;
+    }
+
+    if (!http2)
+    {
+        return;
+    }
+
+    if (errorCode == CURLE_HTTP2 || errorCode == CURLE_HTTP2_STREAM)
+    {
+        connectionStats.http2Errors++;
+        if (++http2ConsecutiveErrors >= HTTP2_MAX_CONSECUTIVE_ERRORS)
+        {
+            LOG_warn << "Too many HTTP/2 errors, falling back to HTTP/1.1";
+            http2 = false;
+            for (CURLM* m : curlm)
+            {
+                sethttp2options(m);
+            }
+        }
+    }
+    else if (errorCode == CURLE_OK)
+    {
+        http2ConsecutiveErrors = 0;
+    }
+#endif
+}
+
 bool CurlHttpIO::cacheresolvedurls(const std::vector<string>& urls, std::vector<string>&& ips)
 {
     // for each URL there should be 2 IPs (IPv4 first, IPv6 second)
@@ -1556,6 +1657,16 @@ void CurlHttpIO::send_request(CurlHttpContext* httpctx)
         curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_callback);
         curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, (void*)req);
         curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+#if LIBCURL_VERSION_NUM >= 0x073200 // At least cURL 7.50.0
+        if (httpio->http2configured)
+        {
+            // HTTP/2 is negotiated via ALPN, so hosts without it are still reached over HTTP/1.1
+            curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, httpio->http2 ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_1_1);
+
+            // prefer waiting for a stream on an existing connection to opening a new one
+            curl_easy_setopt(curl, CURLOPT_PIPEWAIT, httpio->http2 ? 1L : 0L);
+        }
+#endif
 #ifndef MEGA_USE_C_ARES
         curl_easy_setopt(curl, CURLOPT_QUICK_EXIT, 1L);
 #endif
@@ -2231,6 +2342,7 @@ bool CurlHttpIO::multidoio(CURLM *curlmhandle)
             if (msg->msg == CURLMSG_DONE)
             {
                 CURLcode errorCode = msg->data.result;
+                updateconnectionstats(msg->easy_handle, errorCode);
                 if (errorCode != CURLE_OK)
                 {
                     LOG_debug << req->logname << "CURLMSG_DONE with error " << errorCode << ": " << curl_easy_strerror(errorCode);
@@ -108,20 +108,20 @@ FaultyServers g_faultyServers;
 
 RaidBufferManager::FilePiece::FilePiece()
     : pos(0)
-    , buf(NULL, 0, 0)
+    , buf(NULL, 0, 0, 0)
 {
 }
 
 RaidBufferManager::FilePiece::FilePiece(m_off_t p, size_t len)
     : pos(p)
-    , buf(new byte[len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR)], 0, len)   // SymmCipher::ctr_crypt requirement: decryption: data must be padded to BLOCKSIZE.  Also make sure we can xor up to RAIDSECTOR more for convenience
+    , buf(TransferBufferPool::instance().acquire(len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR)), 0, len, len + std::min<size_t>(SymmCipher::BLOCKSIZE, RAIDSECTOR))   // SymmCipher::ctr_crypt requirement: decryption: data must be padded to BLOCKSIZE.  Also make sure we can xor up to RAIDSECTOR more for convenience
 {
 }
 
 
 RaidBufferManager::FilePiece::FilePiece(m_off_t p, HttpReq::http_buf_t* b) // taking ownership
     : pos(p)
-    , buf(NULL, 0, 0)
+    , buf(NULL, 0, 0, 0)
 {
     buf.swap(*b);  // take its buffer and copy other members
     delete b;  // client no longer owns it so we must delete.  Similar to move semantics where we would just assign
@@ -404,7 +404,7 @@ std::pair<m_off_t, m_off_t> RaidBufferManager::nextNPosForConnection(unsigned co
         }
         if (unusedRaidConnection == connectionNum && npos > curpos)
         {
-            submitBuffer(connectionNum, new RaidBufferManager::FilePiece(curpos, new HttpReq::http_buf_t(NULL, 0, size_t(npos - curpos))));
+            submitBuffer(connectionNum, new RaidBufferManager::FilePiece(curpos, new HttpReq::http_buf_t(NULL, 0, size_t(npos - curpos), 0)));
             transferPos(connectionNum) = npos;
             newInputBufferSupplied = true;
         }
@@ -36,10 +36,223 @@
 
 namespace mega {
 
+SyncExclusionMatcher::SyncExclusionMatcher(const vector<string>& names, const vector<string>& paths)
+{
+    for (const string& name : names)
+    {
+        auto wildcards = std::count(name.begin(), name.end(), '*') + std::count(name.begin(), name.end(), '?');
+
+        if (!wildcards)
+        {
+            mNames.insert(name);
+        }
+        else if (wildcards == 1 && name.size() > 1 && name.front() == '*')
+        {
+            mNameSuffixes.insert(name.substr(1));
+            mNameSuffixLengths.insert(name.size() - 1);
+        }
+        else if (wildcards == 1 && name.size() > 1 && name.back() == '*')
+        {
+            mNamePrefixes.insert(name.substr(0, name.size() - 1));
+            mNamePrefixLengths.insert(name.size() - 1);
+        }
+        else
+        {
+            mNamePatterns.push_back(name);
+        }
+    }
+
+    for (const string& path : paths)
+    {
+        auto lp = LocalPath::fromAbsolutePath(path);
+
+        // the path itself, with or without wildcards, is always a containment rule
+        mPaths.push_back(lp);
+
+        string leaf = lp.leafName().toPath(false);
+        if (leaf.empty())
+        {
+            // e.g. a trailing separator: checked at every level
+            mUnindexedPaths.push_back(mPaths.size() - 1);
+        }
+        else
+        {
+            mPathsByLeaf.emplace(leafKey(leaf), mPaths.size() - 1);
+        }
+
+        if (path.find_first_of("*?") != string::npos)
+        {
+            mPathPatterns.push_back(path);
+        }
+    }
+}
+
+string SyncExclusionMatcher::leafKey(const string& name)
+{
+#ifdef _WIN32
+    // path rules match case insensitively here (see Utils::pcasecmp), so the index must fold case too.
+    // Folding all of Unicode can only add candidates, which isContainingPathOf() then rules out.
+    return Utils::toLowerUtf8(name);
+#else
+    // path rules match exactly, and names need not be valid UTF-8
+    return name;
+#endif
+}
+
+bool SyncExclusionMatcher::nameExcluded(const string& name) const
+{
+    // Skip these system files on OS X.
+    if (name == "Icon\x0d" || mNames.count(name))
+    {
+        return true;
+    }
+
+    for (size_t len : mNameSuffixLengths)
+    {
+        if (len > name.size())
+        {
+            break;
+        }
+        if (mNameSuffixes.count(name.substr(name.size() - len)))
+        {
+            return true;
+        }
+    }
+
+    for (size_t len : mNamePrefixLengths)
+    {
+        if (len > name.size())
+        {
+            break;
+        }
+        if (mNamePrefixes.count(name.substr(0, len)))
+        {
+            return true;
+        }
+    }
+
+    for (const string& pattern : mNamePatterns)
+    {
+        if (wildcardMatch(name.c_str(), pattern.c_str()))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool SyncExclusionMatcher::componentExcluded(const LocalPath& path, const string& name) const
+{
+    if (nameExcluded(name))
+    {
+        return true;
+    }
+
+    // an exact path rule for this level necessarily has the same leaf name
+    auto range = mPathsByLeaf.equal_range(leafKey(name));
+    for (auto it = range.first; it != range.second; ++it)
+    {
+        if (mPaths[it->second].isContainingPathOf(path))
+        {
+            return true;
+        }
+    }
+
+    for (size_t i : mUnindexedPaths)
+    {
+        if (mPaths[i].isContainingPathOf(path))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool SyncExclusionMatcher::containedInPathRule(const LocalPath& path) const
+{
+    for (const LocalPath& xp : mPaths)
+    {
+        if (xp.isContainingPathOf(path))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SyncExclusionMatcher::inheritedExcluded(const LocalPath& root, const LocalPath& path) const
+{
+    // rules above the root exclude everything in the sync
+    if (containedInPathRule(root))
+    {
+        return true;
+    }
+
+    auto p = path;
+    while (root.isContainingPathOf(p) && p != root)
+    {
+        auto nameIndex = p.getLeafnameByteIndex();
+
+        if (componentExcluded(p, p.subpathFrom(nameIndex).toPath(false)))
+        {
+            return true;
+        }
+
+        p.truncate(nameIndex - 1);
+    }
+
+    return false;
+}
+
+bool SyncExclusionMatcher::excluded(const LocalPath& root, const LocalPath& localpath)
+{
+    if (!root.isContainingPathOf(localpath) || localpath == root)
+    {
+        // outside of the sync: path rules only
+        return containedInPathRule(localpath)
+            || std::any_of(mPathPatterns.begin(), mPathPatterns.end(), [&localpath](const string& pattern) {
+                   return wildcardMatch(localpath.toPath(true).c_str(), pattern.c_str());
+               });
+    }
+
+    auto nameIndex = localpath.getLeafnameByteIndex();
+    auto folder = localpath;
+    folder.truncate(nameIndex - 1);
+
+    if (mLastFolder.empty() || folder != mLastFolder || root != mLastRoot)
+    {
+        mLastRoot = root;
+        mLastFolder = folder;
+        mLastFolderExcluded = inheritedExcluded(root, folder);
+    }
+
+    if (mLastFolderExcluded || componentExcluded(localpath, localpath.subpathFrom(nameIndex).toPath(false)))
+    {
+        return true;
+    }
+
+    if (!mPathPatterns.empty())
+    {
+        auto temp = localpath.toPath(true);
+        for (const string& pattern : mPathPatterns)
+        {
+            if (wildcardMatch(temp.c_str(), pattern.c_str()))
+            {
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
 const int Sync::SCANNING_DELAY_DS = 5;
 const int Sync::EXTRA_SCANNING_DELAY_DS = 150;
 const int Sync::FILE_UPDATE_DELAY_DS = 30;
 const int Sync::FILE_UPDATE_MAX_DELAY_SECS = 60;
+const int Sync::FINGERPRINT_SETTLE_SECS = 3;
 const dstime Sync::RECENT_VERSION_INTERVAL_SECS = 10800;
 
 namespace {
@@ -236,12 +449,8 @@ void collectAllLocalNodes(FingerprintCache& fingerprints, FingerprintLocalNodeMa
                           LocalNode& l, handlelocalnode_map& fsidnodes)
 {
     // invalidate fsid of `l`
+    l.unlinkfsid(fsidnodes);
     l.fsid = mega::UNDEF;
-    if (l.fsid_it != fsidnodes.end())
-    {
-        fsidnodes.erase(l.fsid_it);
-        l.fsid_it = fsidnodes.end();
-    }
     // collect fingerprint
     LightFileFingerprint ffp;
     if (computeFingerprint(ffp, l))
@@ -999,13 +1208,13 @@ void Sync::addstatecachechildren(uint32_t parent_dbid, idlocalnode_map* tmap, Lo
     {
         LocalNode* const l = it->second;
 
-        auto preExisting = p->children.find(l->getLocalname());
+        auto preExisting = p->children.find(l->childkey());
         if (preExisting != p->children.end())
         {
             // tidying up from prior versions of the SDK which might have duplicate LocalNodes
             LOG_debug << "Removing duplicate LocalNode: " << preExisting->second->debugGetParentList();
             delete preExisting->second;   // also detaches and preps removal from db
-            assert(p->children.find(l->getLocalname()) == p->children.end());
+            assert(p->children.find(l->childkey()) == p->children.end());
             // l will be added in its place.  Later entries were the ones used by the old algorithm
         }
 
@@ -1360,8 +1569,8 @@ LocalNode* Sync::localnodebypath(LocalNode* l, const LocalPath& localpath, Local
         }
 
         localnode_map::iterator it;
-        if ((it = l->children.find(component)) == l->children.end()
-            && (it = l->schildren.find(component)) == l->schildren.end())
+        if ((it = l->children.find(&component)) == l->children.end()
+            && (!l->schildren || (it = l->schildren->find(&component)) == l->schildren->end()))
         {
             // no full match: store residual path, return NULL with the
             // matching component LocalNode in parent
@@ -1397,8 +1606,12 @@ bool Sync::assignfsids()
 
 // scan localpath, add or update child nodes, call recursively for folder nodes
 // localpath must be prefixed with Sync
-bool Sync::scan(LocalPath localpath, FileAccess* fa)
+CodeCounter::ScopeStats g_syncScanTime("Sync_scan");
+
+bool Sync::scan(LocalPath localpath, FileAccess* fa, size_t* entries)
 {
+    CodeCounter::ScopeTimer ccst(g_syncScanTime);
+
     if (fa)
     {
         assert(fa->type == FOLDERNODE);
@@ -1426,6 +1639,12 @@ bool Sync::scan(LocalPath localpath, FileAccess* fa)
                 ScopedLengthRestore restoreLen(localpath);
                 localpath.appendWithSeparator(localname, false);
 
+                // excluded entries count too: the rules may be relaxed later
+                if (entries)
+                {
+                    ++*entries;
+                }
+
                 // check if this record is to be ignored
                 if (client->app->sync_syncable(this, name.c_str(), localpath))
                 {
@@ -1458,6 +1677,78 @@ bool Sync::scan(LocalPath localpath, FileAccess* fa)
     else return false;
 }
 
+bool Sync::scanfolder(LocalNode* l, const LocalPath& localpath, FileAccess* fa)
+{
+#ifndef _WIN32
+    // the folder's mtime changes whenever an entry is added, removed or renamed
+    // (but not when a file is modified, so files are still checked one by one)
+    bool useSnapshot = fa && fa->type == FOLDERNODE && fa->fsidvalid && !isnetwork;
+#else
+    bool useSnapshot = false;
+#endif
+
+    // only when every entry of the folder is a known child: entries that were excluded
+    // (or skipped otherwise) must be looked at again, in case the rules changed since
+    if (initializing && useSnapshot
+            && l->scanSnapshotMtime && l->scanSnapshotMtime == fa->mtime
+            && l->scanSnapshotEntries == l->children.size())
+    {
+        LOG_verbose << "Folder unchanged since its last scan: " << localpath;
+        scanknownentries(l, localpath);
+        return true;
+    }
+
+    size_t entries = 0;
+    bool success = scan(localpath, fa, &entries);
+
+    // a folder modified within the last seconds could still change without a new mtime
+    m_time_t snapshotMtime = success && useSnapshot && fa->mtime < m_time() - 1 ? fa->mtime : 0;
+
+    if (l->scanSnapshotMtime != snapshotMtime || l->scanSnapshotEntries != entries)
+    {
+        l->scanSnapshotMtime = snapshotMtime;
+        l->scanSnapshotEntries = uint32_t(entries);
+
+        if (l != localroot.get())
+        {
+            statecacheadd(l);
+        }
+    }
+
+    return success;
+}
+
+void Sync::scanknownentries(LocalNode* l, LocalPath localpath)
+{
+    // checkpath() may move or delete children
+    vector<LocalPath> names;
+    names.reserve(l->children.size());
+    for (auto& child : l->children)
+    {
+        names.push_back(child.second->getLocalname());
+    }
+
+    for (const LocalPath& localname : names)
+    {
+        ScopedLengthRestore restoreLen(localpath);
+        localpath.appendWithSeparator(localname, false);
+
+        // the exclusion rules may have changed since the last scan
+        if (!client->app->sync_syncable(this, localname.toName(*syncs.fsaccess).c_str(), localpath)
+                || localdebris.isContainingPathOf(localpath))
+        {
+            continue;
+        }
+
+        LocalNode* child = checkpath(NULL, &localpath, nullptr, nullptr, false, nullptr);
+
+        if (!child || child == (LocalNode*)~0)
+        {
+            dirnotify->notify(DirNotify::DIREVENTS, NULL, LocalPath(localpath), false, false);
+        }
+    }
+}
+
 // check local path - if !localname, localpath is relative to l, with l == NULL
 // being the root of the sync
 // if localname is set, localpath is absolute and localname its last component
@@ -1594,7 +1885,7 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
 
                     if (l->type == FOLDERNODE)
                     {
-                        scan(*localpathNew, fa.get());
+                        scanfolder(l, *localpathNew, fa.get());
                     }
                     else
                     {
@@ -1732,7 +2023,7 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
 
                             m_off_t dsize = l->size > 0 ? l->size : 0;
 
-                            if (l->genfingerprint(fa.get()) && l->size >= 0)
+                            if (l->updatefingerprint(fa.get()) && l->size >= 0)
                             {
                                 localbytes -= dsize - l->size;
                             }
@@ -1989,7 +2280,7 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
             {
                 if (newnode || l->needsRescan)
                 {
-                    scan(*localpathNew, fa.get());
+                    scanfolder(l, *localpathNew, fa.get());
                     l->needsRescan = false;
 
                     if (newnode)
@@ -2027,7 +2318,7 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
                         localbytes -= l->size;
                     }
 
-                    if (l->genfingerprint(fa.get()))
+                    if (l->updatefingerprint(fa.get()))
                     {
                         changed = true;
                         l->bumpnagleds();
@@ -2062,6 +2353,11 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
 
         if (changed || newnode)
         {
+            if (l && l->parent)
+            {
+                l->parent->setSyncdownDirty();
+            }
+
             if (isnetwork && l->type == FILENODE)
             {
                 LOG_debug << "Queueing extra fs notification for new file";
@@ -2087,7 +2383,7 @@ LocalNode* Sync::checkpath(LocalNode* l, LocalPath* input_localpath, string* con
         else if (l)
         {
             // immediately stop outgoing transfer, if any
-            if (l->transfer)
+            if (l->upload)
             {
                 TransferDbCommitter committer(client->tctable); // TODO:  can we use one committer for all the files in the folder?  Or for the whole recursion?
                 client->stopxfer(l, &committer);
@@ -2158,7 +2454,7 @@ bool Sync::checkValidNotification(int q, Notification& notification)
             || (ll && success && ll->node && ll->node->localnode == ll
                 && !(notification.recursive | ll->needsRescan)
                 && (ll->type != FILENODE || (*(FileFingerprint *)ll) == (*(FileFingerprint *)ll->node))
-                && (ait = ll->node->attrs.map.find('n')) != ll->node->attrs.map.end()
+                && (ait = ll->node->attrs().map.find('n')) != ll->node->attrs().map.end()
                 && ait->second == ll->name
                 && fa->fsidvalid && fa->fsid == ll->fsid && fa->type == ll->type
                 && (ll->type != FILENODE || (ll->mtime == fa->mtime && ll->size == fa->size))))
@@ -2380,9 +2676,9 @@ m_off_t Sync::getInflightProgress()
     {
         for (auto file : tslot->transfer->files)
         {
-            if (auto ln = dynamic_cast<LocalNode*>(file))
+            if (auto sfp = dynamic_cast<SyncFilePut*>(file))
             {
-                if (ln->sync == this)
+                if (sfp->localNode->sync == this)
                 {
                     progressSum += tslot->progressreported;
                 }
@@ -782,6 +782,11 @@ void Transfer::complete(TransferDbCommitter& committer)
                 if (success)
                 {
                     (*it)->setLocalname(finalpath);  // so the app may report an accurate final name
+
+                    if (client->localcopydownloads)
+                    {
+                        client->localcontentindex.add(*this, finalpath);
+                    }
                 }
                 else if (transient_error)
                 {
@@ -802,7 +807,7 @@ void Transfer::complete(TransferDbCommitter& committer)
                             keys.insert(n->nodekey());
 
                             // check if restoration of missing attributes failed in the past (no access)
-                            if (n->attrs.map.find('f') == n->attrs.map.end() || n->attrs.map['f'] != me64)
+                            if (n->attrs().map.find('f') == n->attrs().map.end() || n->attrs().map['f'] != me64)
                             {
                                 // check for missing imagery
                                 int missingattr = 0;
@@ -913,11 +918,11 @@ void Transfer::complete(TransferDbCommitter& committer)
 
 #ifdef ENABLE_SYNC
             LocalPath synclocalpath;
-            LocalNode *ll = dynamic_cast<LocalNode *>(f);
-            if (ll)
+            SyncFilePut *sfp = dynamic_cast<SyncFilePut *>(f);
+            if (sfp)
             {
                 LOG_debug << "Verifying sync upload";
-                synclocalpath = ll->getLocalPath();
+                synclocalpath = sfp->localNode->getLocalPath();
                 localpath = synclocalpath;
             }
 #endif
@@ -940,7 +945,16 @@ void Transfer::complete(TransferDbCommitter& committer)
                 }
             }
 
-            if (!isOpen || f->genfingerprint(fa.get()))
+            // a sync upload checks against its LocalNode, which the sync keeps comparing with the cloud
+            FileFingerprint* fp = f;
+#ifdef ENABLE_SYNC
+            if (sfp)
+            {
+                fp = sfp->localNode;
+            }
+#endif
+
+            if (!isOpen || fp->genfingerprint(fa.get()))
             {
                 if (!isOpen)
                 {
@@ -2265,8 +2279,15 @@ std::array<vector<Transfer*>, 6> TransferList::nexttransfers(std::function<bool(
 
     static direction_t putget[] = { PUT, GET };
 
+    TransferScheduler* scheduler = client ? client->transferScheduler.get() : nullptr;
+    bool fair = scheduler && scheduler->hasGroups();
+
     for (direction_t direction : putget)
     {
+        // with fair scheduling, the ready transfers are gathered per group and size type over the
+        // whole list before choosing, so one full size type doesn't hide the other
+        TransferScheduler::ReadyMap ready;
+
         for (Transfer *transfer : transfers[direction])
         {
             if (!transfer->slot)
@@ -2290,6 +2311,12 @@ std::array<vector<Transfer*>, 6> TransferList::nexttransfers(std::function<bool(
                 || (transfer->asyncopencontext
                     && transfer->asyncopencontext->finished))
             {
+                if (fair)
+                {
+                    ready[scheduler->groupOf(transfer)].add(transfer);
+                    continue;
+                }
+
                 TransferCategory tc(transfer);
 
                 if (tc.sizetype == LARGEFILE && continueLarge)
@@ -2314,10 +2341,184 @@ std::array<vector<Transfer*>, 6> TransferList::nexttransfers(std::function<bool(
                 }
             }
         }
+
+        if (fair)
+        {
+            scheduler->choose(ready,
+                              [&](Transfer* transfer)
+                              {
+                                  if (!continuefunction(transfer))
+                                  {
+                                      return false;
+                                  }
+                                  chosenTransfers[TransferCategory(transfer).index()].push_back(transfer);
+                                  return true;
+                              },
+                              [&]() { return directionContinuefunction(direction); });
+        }
     }
     return chosenTransfers;
 }
 
+const m_off_t TransferScheduler::MIN_COST;
+const m_off_t TransferScheduler::MAX_COST;
+const size_t TransferScheduler::MAX_READY_PER_GROUP;
+
+TransferScheduler::GroupId TransferScheduler::groupOf(Transfer*)
+{
+    return 0;
+}
+
+void TransferScheduler::setGroup(GroupId group, unsigned weight, unsigned priorityClass)
+{
+    assert(weight > 0);
+    Group& g = mGroups.emplace(group, Group()).first->second;
+    g.weight = std::max(1u, weight);
+    g.priorityClass = priorityClass;
+    mConfigured.insert(group);
+}
+
+void TransferScheduler::removeGroup(GroupId group)
+{
+    mConfigured.erase(group);
+    mGroups.erase(group);
+}
+
+void TransferScheduler::Ready::add(Transfer* transfer)
+{
+    queued += 1;
+    queuedBytes += transfer->size;
+
+    std::deque<Transfer*>& queue = bySize[TransferCategory(transfer).sizetype];
+    if (queue.size() < MAX_READY_PER_GROUP)
+    {
+        queue.push_back(transfer);
+    }
+}
+
+void TransferScheduler::choose(ReadyMap& ready,
+                               const std::function<bool(Transfer*)>& accept,
+                               const std::function<bool()>& more)
+{
+    for (auto& g : mGroups)
+    {
+        g.second.stats.queued = 0;
+        g.second.stats.queuedBytes = 0;
+    }
+
+    // resolve each group once, so picking doesn't look them up again
+    struct Candidate
+    {
+        Ready* ready;
+        Group* group;
+
+        // the gathered transfer that comes first in the list, whichever its size type
+        std::deque<Transfer*>* next()
+        {
+            std::deque<Transfer*>* large = &ready->bySize[LARGEFILE];
+            std::deque<Transfer*>* small = &ready->bySize[SMALLFILE];
+            if (large->empty()) return small->empty() ? nullptr : small;
+            if (small->empty()) return large;
+            return small->front()->priority < large->front()->priority ? small : large;
+        }
+    };
+    std::vector<Candidate> candidates;
+    candidates.reserve(ready.size());
+
+    for (auto& r : ready)
+    {
+        if (!r.second.queued)
+        {
+            continue;
+        }
+
+        // groups not configured by the app get the default share
+        auto it = mGroups.find(r.first);
+        if (it == mGroups.end())
+        {
+            it = mGroups.emplace(r.first, Group()).first;
+        }
+
+        Group& g = it->second;
+        g.stats.queued = r.second.queued;
+        g.stats.queuedBytes = r.second.queuedBytes;
+
+        // a group that was idle doesn't get credit for the time it wasn't competing
+        g.finishTag = std::max(g.finishTag, mVirtualTime);
+
+        candidates.push_back({ &r.second, &g });
+    }
+
+    while (more())
+    {
+        // the next transfer comes from the best priority class, and within it from the group that's most behind
+        Candidate* best = nullptr;
+        std::deque<Transfer*>* bestQueue = nullptr;
+        for (Candidate& c : candidates)
+        {
+            std::deque<Transfer*>* queue = c.next();
+            if (!queue)
+            {
+                continue;
+            }
+
+            if (!best
+                || c.group->priorityClass < best->group->priorityClass
+                || (c.group->priorityClass == best->group->priorityClass && c.group->finishTag < best->group->finishTag))
+            {
+                best = &c;
+                bestQueue = queue;
+            }
+        }
+
+        if (!best)
+        {
+            break;
+        }
+
+        // one that isn't accepted is dropped from this round, and the walk goes on past it
+        Transfer* transfer = bestQueue->front();
+        bestQueue->pop_front();
+
+        if (accept(transfer))
+        {
+            Group& g = *best->group;
+            m_off_t cost = std::min(std::max(transfer->size, MIN_COST), MAX_COST);
+
+            mVirtualTime = g.finishTag;
+            g.finishTag += double(cost) / g.weight;
+
+            g.stats.dispatched += 1;
+            g.stats.dispatchedBytes += transfer->size;
+            g.stats.queued -= 1;
+            g.stats.queuedBytes -= transfer->size;
+        }
+    }
+
+    // groups the app didn't configure are forgotten once they have nothing queued
+    for (auto it = mGroups.begin(); it != mGroups.end(); )
+    {
+        if (!it->second.stats.queued && !mConfigured.count(it->first))
+        {
+            it = mGroups.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+std::map<TransferScheduler::GroupId, TransferScheduler::GroupStats> TransferScheduler::groupStats() const
+{
+    std::map<GroupId, GroupStats> stats;
+    for (auto& g : mGroups)
+    {
+        stats[g.first] = g.second.stats;
+    }
+    return stats;
+}
+
 Transfer *TransferList::transferat(direction_t direction, unsigned int position)
 {
     if (transfers[direction].size() > position)
@@ -71,6 +71,153 @@ const dstime TransferSlot::PROGRESSTIMEOUT = 10;
 
 const m_off_t TransferSlot::MAX_GAP_SIZE = 256 * 1024 * 1024; // 256 MB
 
+const dstime TransferSlotTuner::EVALUATION_PERIOD_DS;
+const int TransferSlotTuner::SIGNIFICANT_CHANGE_PERCENT;
+const unsigned TransferSlotTuner::HOLD_EVALUATIONS;
+const m_off_t TransferSlotTuner::MIN_REQUEST_SIZE;
+
+void TransferSlotTuner::Stats::add(const Stats& other)
+{
+    evaluations += other.evaluations;
+    connectionIncreases += other.connectionIncreases;
+    connectionDecreases += other.connectionDecreases;
+    requestSizeIncreases += other.requestSizeIncreases;
+    requestSizeDecreases += other.requestSizeDecreases;
+}
+
+void TransferSlotTuner::start(unsigned maxConnections, m_off_t maxRequestSize, bool tuneRequestSize, dstime now)
+{
+    mMaxConnections = std::max(1u, maxConnections);
+    mActiveConnections = (mMaxConnections + 1) / 2;
+    mMaxRequestSize = maxRequestSize;
+    mRequestSize = tuneRequestSize ? std::max(std::min(MIN_REQUEST_SIZE, maxRequestSize), maxRequestSize / 2) : maxRequestSize;
+    mTuneRequestSize = tuneRequestSize;
+    mLastAction = NONE;
+    mLastSpeed = 0;
+    mLastEvaluation = now;
+    mHoldEvaluations = 0;
+}
+
+bool TransferSlotTuner::evaluate(m_off_t speed, dstime now)
+{
+    if (!enabled() || now - mLastEvaluation < EVALUATION_PERIOD_DS)
+    {
+        return false;
+    }
+    mLastEvaluation = now;
+    ++mStats.evaluations;
+
+    m_off_t threshold = mLastSpeed * SIGNIFICANT_CHANGE_PERCENT / 100;
+    bool improved = speed > mLastSpeed + threshold;
+    bool worse = speed < mLastSpeed - threshold;
+
+    Action previous = mLastAction;
+    mLastAction = NONE;
+    mLastSpeed = speed;
+
+    if (previous != NONE)
+    {
+        if (improved)
+        {
+            // keep going in the direction that paid off
+            if (apply(previous))
+            {
+                mLastAction = previous;
+                return true;
+            }
+            return false;
+        }
+
+        if (worse || previous == ADD_CONNECTION || previous == GROW_REQUEST)
+        {
+            // it cost throughput, or it used more resources for no gain: undo it, and try the other dimension next time
+            apply(opposite(previous));
+            mHoldEvaluations = HOLD_EVALUATIONS;
+            mProbeRequestSizeNext = !mProbeRequestSizeNext;
+            return true;
+        }
+
+        // using fewer resources for the same throughput is kept
+        return false;
+    }
+
+    if (mHoldEvaluations)
+    {
+        --mHoldEvaluations;
+        return false;
+    }
+
+    Action probe = nextProbe();
+    if (probe != NONE && apply(probe))
+    {
+        mLastAction = probe;
+        return true;
+    }
+    return false;
+}
+
+TransferSlotTuner::Action TransferSlotTuner::nextProbe() const
+{
+    // growing is tried first; shrinking only once there's no room to grow
+    Action connectionProbe = mActiveConnections < mMaxConnections ? ADD_CONNECTION :
+                             mActiveConnections > 1 ? REMOVE_CONNECTION : NONE;
+
+    Action requestProbe = !mTuneRequestSize ? NONE :
+                          mRequestSize < mMaxRequestSize ? GROW_REQUEST :
+                          mRequestSize > MIN_REQUEST_SIZE ? SHRINK_REQUEST : NONE;
+
+    if (mProbeRequestSizeNext && requestProbe != NONE)
+    {
+        return requestProbe;
+    }
+    return connectionProbe != NONE ? connectionProbe : requestProbe;
+}
+
+TransferSlotTuner::Action TransferSlotTuner::opposite(Action action)
+{
+    switch (action)
+    {
+        case ADD_CONNECTION: return REMOVE_CONNECTION;
+        case REMOVE_CONNECTION: return ADD_CONNECTION;
+        case GROW_REQUEST: return SHRINK_REQUEST;
+        case SHRINK_REQUEST: return GROW_REQUEST;
+        default: return NONE;
+    }
+}
+
+bool TransferSlotTuner::apply(Action action)
+{
+    switch (action)
+    {
+        case ADD_CONNECTION:
+            if (mActiveConnections >= mMaxConnections) return false;
+            ++mActiveConnections;
+            ++mStats.connectionIncreases;
+            return true;
+
+        case REMOVE_CONNECTION:
+            if (mActiveConnections <= 1) return false;
+            --mActiveConnections;
+            ++mStats.connectionDecreases;
+            return true;
+
+        case GROW_REQUEST:
+            if (!mTuneRequestSize || mRequestSize >= mMaxRequestSize) return false;
+            mRequestSize = std::min(mMaxRequestSize, mRequestSize * 2);
+            ++mStats.requestSizeIncreases;
+            return true;
+
+        case SHRINK_REQUEST:
+            if (!mTuneRequestSize || mRequestSize <= MIN_REQUEST_SIZE) return false;
+            mRequestSize = std::max(MIN_REQUEST_SIZE, mRequestSize / 2);
+            ++mStats.requestSizeDecreases;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
 TransferSlot::TransferSlot(Transfer* ctransfer)
     : fa(ctransfer->client->fsaccess->newfileaccess(), ctransfer)
     , retrybt(ctransfer->client->rng, ctransfer->client->transferSlotsBackoff)
@@ -146,6 +293,13 @@ bool TransferSlot::createconnectionsonce()
 
         connections = transferbuf.isRaid() ? RAIDPARTS : (transfer->size > 131072 ? transfer->client->connections[transfer->type] : 1);
         LOG_debug << "Populating transfer slot with " << connections << " connections, max request size of " << maxRequestSize << " bytes";
+
+        if (transfer->client->adaptivetransferslots && !transferbuf.isRaid() && connections > 1)
+        {
+            mTuner.start(unsigned(connections), maxRequestSize, transfer->type == GET, Waiter::ds);
+            LOG_debug << "Adaptive transfer slot starts with " << mTuner.activeConnections() << " connections and request size of " << mTuner.requestSize() << " bytes";
+        }
+
         reqs.resize(connections);
         mReqSpeeds.resize(connections);
         asyncIO = new AsyncIOContext*[connections]();
@@ -158,6 +312,12 @@ bool TransferSlot::createconnectionsonce()
 TransferSlot::~TransferSlot()
 {
     LOG_verbose << "Deleting TransferSlot";
+
+    if (mLocalCopy)
+    {
+        mLocalCopy->abandoned = true;
+    }
+
     if (transfer->type == GET && !transfer->finished
             && transfer->progresscompleted != transfer->size
             && !transfer->asyncopencontext)
@@ -271,6 +431,11 @@ TransferSlot::~TransferSlot()
 
     transfer->slot = NULL;
 
+    if (mTuner.enabled())
+    {
+        transfer->client->performanceStats.transferSlotTuning.add(mTuner.stats());
+    }
+
     if (slots_it != transfer->client->tslots.end())
     {
         // advance main loop iterator if deleting next in line
@@ -490,11 +655,111 @@ bool TransferSlot::testForSlowRaidConnection(unsigned connectionNum, bool& incre
     return false;
 }
 
+void LocalContentCopy::run(FileSystemAccess& fsaccess, SymmCipher& cipher)
+{
+    cipher.setkey(transferkey.data());
+
+    for (auto& candidate : candidates)
+    {
+        if (abandoned)
+        {
+            break;
+        }
+
+        auto fa = fsaccess.newfileaccess();
+        if (!fa->fopen(candidate, true, false, FSLogging::logExceptFileNotFound) || fa->size != size)
+        {
+            LOG_debug << "Local copy no longer matches: " << candidate;
+            rejected.push_back(candidate);
+            continue;
+        }
+        fa.reset();
+
+        if (!fsaccess.copylocal(candidate, target, mtime))
+        {
+            continue;
+        }
+
+        // check what was actually copied against the MAC of the cloud content
+        fa = fsaccess.newfileaccess();
+        if (fa->fopen(target, true, false, FSLogging::logOnError))
+        {
+            auto result = generateMetaMac(cipher, *fa, ctriv);
+            verified = result.first && result.second == metamac;
+        }
+        fa.reset();
+
+        if (verified)
+        {
+            source = candidate;
+            method = fsaccess.last_copy_method;
+            break;
+        }
+
+        LOG_debug << "Local copy failed verification: " << candidate;
+        rejected.push_back(candidate);
+        fsaccess.unlinklocal(target);
+    }
+
+    if (verified && abandoned)
+    {
+        // nobody will complete the transfer, don't leave the copy behind
+        fsaccess.unlinklocal(target);
+        verified = false;
+    }
+
+    finished = true;
+}
+
+void TransferSlot::finishLocalContentCopy(MegaClient* client, TransferDbCommitter& committer)
+{
+    auto copy = std::move(mLocalCopy);
+
+    for (auto& path : copy->rejected)
+    {
+        client->localcontentindex.remove(*transfer, path);
+    }
+
+    if (!copy->verified)
+    {
+        LOG_debug << "No usable local copy, downloading instead: " << transfer->localfilename;
+
+        // back to the queue, dispatchTransfers() sets up a regular download for it
+        transfer->state = TRANSFERSTATE_QUEUED;
+        client->nextDispatchTransfersDs = 0;
+        client->looprequested = true;
+        delete this;
+        return;
+    }
+
+    LOG_debug << "Download served from local copy " << copy->source
+              << " via " << FileSystemAccess::copyMethodName(copy->method);
+
+    // the temporary file already holds the content: complete without fetching it
+    transfer->pos = transfer->size;
+    transfer->progresscompleted = transfer->size;
+    progressreported = transfer->size;
+    client->app->transfer_update(transfer);
+
+    // as for downloads, a completion that has to wait for its targets retries via doio()
+    transfer->complete(committer);
+}
+
 // file transfer state machine
 void TransferSlot::doio(MegaClient* client, TransferDbCommitter& committer)
 {
     CodeCounter::ScopeTimer pbt(client->performanceStats.transferslotDoio);
 
+    if (mLocalCopy)
+    {
+        // the worker making the copy wakes us up once it's done
+        if (mLocalCopy->finished)
+        {
+            finishLocalContentCopy(client, committer);
+        }
+        return;
+    }
+
     if (!fa || (transfer->size && transfer->progresscompleted == transfer->size)
             || (transfer->type == PUT && transfer->ultoken))
     {
@@ -541,6 +806,7 @@ void TransferSlot::doio(MegaClient* client, TransferDbCommitter& committer)
     }
 
     dstime backoff = 0;
+    bool waitingForBuffers = false;
     m_off_t p = 0;
     bool earliestUploadCompleted = false;
 
@@ -550,6 +816,10 @@ void TransferSlot::doio(MegaClient* client, TransferDbCommitter& committer)
         return transfer->failed(lasterror, committer);
     }
 
+    // connections beyond these are left idle once their current request is done
+    int activeConnections = mTuner.enabled() ? int(mTuner.activeConnections()) : connections;
+    m_off_t requestSize = mTuner.enabled() ? mTuner.requestSize() : maxRequestSize;
+
     // main loop over connections
     for (int i = connections; i--; )
     {
@@ -1117,9 +1387,26 @@ void TransferSlot::doio(MegaClient* client, TransferDbCommitter& committer)
         {
             if (!reqs[i] || (reqs[i]->status == REQ_READY))
             {
+                if (i >= activeConnections
+                        && !(transfer->type == PUT && asyncIO[i])   // a failed read to retry
+                        && !transferbuf.getAsyncOutputBufferPointer(i))
+                {
+                    continue;
+                }
+
+                // transfer memory is capped: don't start new download requests until
+                // buffers are written out (raid is excluded, its connections depend on each other)
+                if (transfer->type == GET && !transferbuf.isRaid()
+                        && TransferBufferPool::instance().overLimit()
+                        && !transferbuf.getAsyncOutputBufferPointer(i))
+                {
+                    waitingForBuffers = true;
+                    continue;
+                }
+
                 bool newInputBufferSupplied = false;
                 bool pauseConnectionInputForRaid = false;
-                std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, maxRequestSize, connections, newInputBufferSupplied, pauseConnectionInputForRaid, client->httpio->uploadSpeed);
+                std::pair<m_off_t, m_off_t> posrange = transferbuf.nextNPosForConnection(i, requestSize, unsigned(activeConnections), newInputBufferSupplied, pauseConnectionInputForRaid, client->httpio->uploadSpeed);
 
                 // we might have a raid-reassembled block to write, or a previously loaded block, or a skip block to process.
                 bool newOutputBufferSupplied = false;
@@ -1329,6 +1616,11 @@ void TransferSlot::doio(MegaClient* client, TransferDbCommitter& committer)
         progress();
     }
 
+    if (mTuner.enabled() && mTuner.evaluate(speedController.calculateSpeed(), Waiter::ds))
+    {
+        LOG_debug << "Adaptive transfer slot now uses " << mTuner.activeConnections() << " connections and request size of " << mTuner.requestSize() << " bytes";
+    }
+
     assert(lastdata != NEVER);
     if (Waiter::ds - lastdata >= XFERTIMEOUT && !failure)
     {
@@ -1385,6 +1677,11 @@ void TransferSlot::doio(MegaClient* client, TransferDbCommitter& committer)
         retrybt.backoff(backoff);
         retrying = true;  // we don't bother checking the `retrybt` before calling `doio` unless `retrying` is set.
     }
+    else if (!failure && waitingForBuffers)
+    {
+        // the pool wakes the client up when buffers are released, no need to poll for them
+        TransferBufferPool::instance().notifyWhenAvailable(client->waiter);
+    }
 }
 
 
@@ -119,10 +119,10 @@ void LocalTreeProcMove::proc(MegaClient*, LocalNode* localnode)
 
 void LocalTreeProcUpdateTransfers::proc(MegaClient *client, LocalNode *localnode)
 {
-    if (localnode->transfer && !localnode->transfer->localfilename.empty())
+    if (localnode->upload && localnode->upload->transfer && !localnode->upload->transfer->localfilename.empty())
     {
         LOG_debug << "Updating transfer path";
-        localnode->prepare(*client->fsaccess);
+        localnode->upload->prepare(*client->fsaccess);
     }
 }
 
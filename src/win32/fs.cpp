@@ -854,6 +854,7 @@ bool WinFileSystemAccess::copylocal(const LocalPath& oldnamePath, const LocalPat
     assert(oldnamePath.isAbsolute());
     assert(newnamePath.isAbsolute());
     bool r = !!CopyFileW(oldnamePath.localpath.c_str(), newnamePath.localpath.c_str(), FALSE);
+    last_copy_method = r ? COPY_SYSTEM : COPY_NONE;
 
     if (!r)
     {
@@ -0,0 +1,534 @@
+/**
+ * @file MockStorageServer.cpp
+ * @brief Local stand-in for the API and storage servers, for transfer benchmarks
+ *
+ * (c) 2013-2023 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include "MockStorageServer.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+using namespace mega;
+
+namespace mt {
+
+namespace {
+
+thread_local bool tlsServerThread = false;
+
+long long threadCpuNanos()
+{
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool sendAll(int fd, const char* data, size_t size)
+{
+    while (size)
+    {
+        ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (n <= 0)
+        {
+            return false;
+        }
+        data += n;
+        size -= size_t(n);
+    }
+    return true;
+}
+
+} // anonymous
+
+MockStorageServer::MockStorageServer()
+{
+}
+
+MockStorageServer::~MockStorageServer()
+{
+    stop();
+}
+
+bool MockStorageServer::start()
+{
+    mListenFd = ::socket(AF_INET, SOCK_STREAM, 0);
+    if (mListenFd < 0)
+    {
+        return false;
+    }
+
+    int one = 1;
+    setsockopt(mListenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof one);
+
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof addr);
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    socklen_t len = sizeof addr;
+    if (::bind(mListenFd, (sockaddr*)&addr, sizeof addr) < 0
+        || ::listen(mListenFd, 128) < 0
+        || ::getsockname(mListenFd, (sockaddr*)&addr, &len) < 0)
+    {
+        ::close(mListenFd);
+        mListenFd = -1;
+        return false;
+    }
+
+    mPort = ntohs(addr.sin_port);
+    mAcceptThread = std::thread([this]() { acceptLoop(); });
+    return true;
+}
+
+void MockStorageServer::stop()
+{
+    if (mListenFd < 0)
+    {
+        return;
+    }
+
+    mStopping = true;
+    ::shutdown(mListenFd, SHUT_RDWR);
+    ::close(mListenFd);
+    mListenFd = -1;
+
+    if (mAcceptThread.joinable())
+    {
+        mAcceptThread.join();
+    }
+
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> g(mMutex);
+        for (int fd : mConnectionFds)
+        {
+            ::shutdown(fd, SHUT_RDWR);
+        }
+        threads.swap(mConnectionThreads);
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+}
+
+std::string MockStorageServer::apiUrl() const
+{
+    return "http://127.0.0.1:" + std::to_string(mPort) + "/";
+}
+
+double MockStorageServer::serverCpuSeconds() const
+{
+    return static_cast<double>(mServerCpuNanos.load()) / 1e9;
+}
+
+bool MockStorageServer::isServerThread()
+{
+    return tlsServerThread;
+}
+
+MockStorageServer::PublicFile MockStorageServer::addFile(m_off_t size, bool raid)
+{
+    PublicFile pf;
+    pf.size = size;
+
+    std::unique_ptr<StoredFile> file(new StoredFile);
+    file->raid = raid;
+
+    // the data key, CTR IV and meta-MAC make up the node key, as for any uploaded file
+    byte key[SymmCipher::KEYLENGTH];
+    mRng.genblock(key, sizeof key);
+    int64_t ctriv;
+    mRng.genblock((byte*)&ctriv, sizeof ctriv);
+
+    SymmCipher cipher;
+    cipher.setkey(key);
+
+    file->encrypted.resize(size_t(size));
+    mRng.genblock((byte*)&file->encrypted[0], file->encrypted.size());
+
+    chunkmac_map macs;
+    std::vector<byte> chunk;
+    for (m_off_t pos = 0; pos < size; )
+    {
+        m_off_t end = ChunkedHash::chunkceil(pos, size);
+        unsigned n = unsigned(end - pos);
+
+        chunk.assign(n + SymmCipher::BLOCKSIZE, 0);
+        memcpy(chunk.data(), &file->encrypted[size_t(pos)], n);
+        macs.ctr_encrypt(pos, &cipher, chunk.data(), n, pos, ctriv, true);
+        memcpy(&file->encrypted[size_t(pos)], chunk.data(), n);
+
+        pos = end;
+    }
+
+    int64_t metamac = macs.macsmac(&cipher);
+
+    memcpy(pf.nodeKey + SymmCipher::KEYLENGTH, &ctriv, sizeof ctriv);
+    memcpy(pf.nodeKey + SymmCipher::KEYLENGTH + sizeof ctriv, &metamac, sizeof metamac);
+    memcpy(pf.nodeKey, key, SymmCipher::KEYLENGTH);
+    SymmCipher::xorblock(pf.nodeKey + SymmCipher::KEYLENGTH, pf.nodeKey);
+
+    if (raid)
+    {
+        // data sectors go round robin over parts 1-5, part 0 holds their XOR
+        const std::string& e = file->encrypted;
+        for (size_t line = 0; line < e.size(); line += RAIDLINE)
+        {
+            byte parity[RAIDSECTOR] = {};
+            size_t paritylen = 0;
+            for (unsigned p = 1; p < RAIDPARTS; p++)
+            {
+                size_t start = line + (p - 1) * RAIDSECTOR;
+                if (start >= e.size())
+                {
+                    break;
+                }
+
+                size_t n = std::min<size_t>(RAIDSECTOR, e.size() - start);
+                file->raidParts[p].append(e, start, n);
+                for (size_t i = 0; i < n; i++)
+                {
+                    parity[i] ^= byte(e[start + i]);
+                }
+                paritylen = std::max(paritylen, n);
+            }
+            file->raidParts[0].append((const char*)parity, paritylen);
+        }
+    }
+
+    string attrjson = "\"n\":\"bench" + std::to_string(mFilesById.size()) + "\"";
+    string attrs;
+    MegaClient::makeattr(&cipher, &attrs, attrjson.c_str());
+    file->attrs = Base64::btoa(attrs);
+
+    pf.publicHandle = 0;
+    mRng.genblock((byte*)&pf.publicHandle, MegaClient::NODEHANDLE);
+
+    std::lock_guard<std::mutex> g(mMutex);
+    mFilesById.push_back(file.get());
+    mFiles[Base64Str<MegaClient::NODEHANDLE>(pf.publicHandle).chars] = std::move(file);
+    return pf;
+}
+
+void MockStorageServer::acceptLoop()
+{
+    tlsServerThread = true;
+
+    while (!mStopping)
+    {
+        int fd = ::accept(mListenFd, nullptr, nullptr);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof one);
+
+        std::lock_guard<std::mutex> g(mMutex);
+        mConnectionFds.push_back(fd);
+        mConnectionThreads.emplace_back([this, fd]() { serveConnection(fd); });
+    }
+}
+
+void MockStorageServer::serveConnection(int fd)
+{
+    tlsServerThread = true;
+
+    std::string pending;
+    Request request;
+    long long cpu = threadCpuNanos();
+
+    while (!mStopping && readRequest(fd, pending, request))
+    {
+        bool sent;
+
+        if (request.method == "POST" && request.path.compare(0, 4, "/cs?") == 0)
+        {
+            std::string response = handleApi(request.body);
+            sent = sendResponse(fd, response.data(), response.size(), request.keepAlive);
+        }
+        else if (request.method == "GET" && request.path.compare(0, 4, "/dl/") == 0)
+        {
+            const char* data = nullptr;
+            size_t size = 0;
+            sent = handleDownload(request.path, data, size)
+                 ? sendResponse(fd, data, size, request.keepAlive)
+                 : sendResponse(fd, "-9", 2, false);
+        }
+        else if (request.method == "POST" && request.path.compare(0, 4, "/ul/") == 0)
+        {
+            std::string response = handleUpload(request.path, request.body.size());
+            sent = sendResponse(fd, response.data(), response.size(), request.keepAlive);
+        }
+        else
+        {
+            sent = sendResponse(fd, "-2", 2, false);
+        }
+
+        long long now = threadCpuNanos();
+        mServerCpuNanos += now - cpu;
+        cpu = now;
+
+        if (!sent || !request.keepAlive)
+        {
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> g(mMutex);
+    mConnectionFds.erase(std::remove(mConnectionFds.begin(), mConnectionFds.end(), fd), mConnectionFds.end());
+    ::close(fd);
+}
+
+bool MockStorageServer::readRequest(int fd, std::string& pending, Request& request)
+{
+    char buf[65536];
+    size_t headerEnd;
+
+    while ((headerEnd = pending.find("\r\n\r\n")) == std::string::npos)
+    {
+        ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        pending.append(buf, size_t(n));
+    }
+
+    std::istringstream header(pending.substr(0, headerEnd));
+    std::string line;
+    std::getline(header, line);
+    std::istringstream requestLine(line);
+    requestLine >> request.method >> request.path;
+
+    size_t contentLength = 0;
+    request.keepAlive = true;
+    while (std::getline(header, line))
+    {
+        std::string name = line.substr(0, line.find(':'));
+        std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+        std::string value = line.size() > name.size() + 1 ? line.substr(name.size() + 1) : std::string();
+
+        if (name == "content-length")
+        {
+            contentLength = size_t(atoll(value.c_str()));
+        }
+        else if (name == "connection" && value.find("close") != std::string::npos)
+        {
+            request.keepAlive = false;
+        }
+    }
+
+    pending.erase(0, headerEnd + 4);
+
+    while (pending.size() < contentLength)
+    {
+        ssize_t n = ::recv(fd, buf, sizeof buf, 0);
+        if (n <= 0)
+        {
+            return false;
+        }
+        pending.append(buf, size_t(n));
+    }
+
+    request.body.assign(pending, 0, contentLength);
+    pending.erase(0, contentLength);
+    return true;
+}
+
+bool MockStorageServer::sendResponse(int fd, const char* data, size_t size, bool keepAlive)
+{
+    // not text/html, which the client would take as a hint to switch to https
+    std::ostringstream s;
+    s << "HTTP/1.1 200 OK\r\n"
+      << "Content-Type: application/octet-stream\r\n"
+      << "Content-Length: " << size << "\r\n"
+      << "Connection: " << (keepAlive ? "keep-alive" : "close") << "\r\n\r\n";
+
+    std::string header = s.str();
+    return sendAll(fd, header.data(), header.size()) && sendAll(fd, data, size);
+}
+
+std::string MockStorageServer::handleApi(const std::string& body)
+{
+    std::string response = "[";
+
+    JSON json;
+    json.begin(body.c_str());
+    if (json.enterarray())
+    {
+        while (json.enterobject())
+        {
+            std::string command, handle;
+            m_off_t size = 0;
+
+            for (bool done = false; !done; )
+            {
+                switch (json.getnameid())
+                {
+                    case 'a':
+                        json.storeobject(&command);
+                        break;
+
+                    case 'p':
+                        json.storeobject(&handle);
+                        break;
+
+                    case 's':
+                        size = json.getint();
+                        break;
+
+                    case EOO:
+                        done = true;
+                        break;
+
+                    default:
+                        json.storeobject();
+                }
+            }
+            json.leaveobject();
+
+            if (response.size() > 1)
+            {
+                response.push_back(',');
+            }
+
+            std::lock_guard<std::mutex> g(mMutex);
+
+            if (command == "g")
+            {
+                auto it = mFiles.find(handle);
+                if (it == mFiles.end())
+                {
+                    response.append(std::to_string(API_ENOENT));
+                    continue;
+                }
+
+                size_t id = size_t(std::find(mFilesById.begin(), mFilesById.end(), it->second.get()) - mFilesById.begin());
+                std::string url = apiUrl() + "dl/" + std::to_string(id);
+                std::ostringstream s;
+
+                s << "{\"s\":" << it->second->encrypted.size() << ",\"at\":\"" << it->second->attrs << "\",\"g\":";
+                if (it->second->raid)
+                {
+                    s << "[";
+                    for (unsigned p = 0; p < RAIDPARTS; p++)
+                    {
+                        s << (p ? "," : "") << "\"" << url << "." << p << "\"";
+                    }
+                    s << "]";
+                }
+                else
+                {
+                    s << "\"" << url << "\"";
+                }
+                s << "}";
+                response.append(s.str());
+            }
+            else if (command == "u")
+            {
+                mUploads.emplace_back();
+                mUploads.back().size = size;
+                response.append("{\"p\":\"" + apiUrl() + "ul/" + std::to_string(mUploads.size() - 1) + "\"}");
+            }
+            else
+            {
+                response.append(std::to_string(API_EARGS));
+            }
+        }
+    }
+
+    response.push_back(']');
+    return response;
+}
+
+// /dl/<file>/<first>-<last> for plain files, /dl/<file>.<part>/<first>-<last> for cloudraid parts
+bool MockStorageServer::handleDownload(const std::string& path, const char*& data, size_t& size)
+{
+    unsigned long id = 0, part = 0;
+    unsigned long long first = 0, last = 0;
+    bool raid = false;
+
+    if (sscanf(path.c_str(), "/dl/%lu.%lu/%llu-%llu", &id, &part, &first, &last) == 4)
+    {
+        raid = true;
+    }
+    else if (sscanf(path.c_str(), "/dl/%lu/%llu-%llu", &id, &first, &last) != 3)
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> g(mMutex);
+    if (id >= mFilesById.size() || raid != mFilesById[id]->raid || part >= RAIDPARTS)
+    {
+        return false;
+    }
+
+    const std::string& content = raid ? mFilesById[id]->raidParts[part] : mFilesById[id]->encrypted;
+    if (first > content.size())
+    {
+        return false;
+    }
+
+    // the content never changes once added, so it can be sent without holding the lock
+    data = content.data() + first;
+    size = size_t(std::min<unsigned long long>(last + 1, content.size()) - first);
+    return true;
+}
+
+// /ul/<upload>/<position>?d=<crc>: acknowledge each chunk, and return the upload token with the last one
+std::string MockStorageServer::handleUpload(const std::string& path, size_t bodySize)
+{
+    unsigned long id = 0;
+    if (sscanf(path.c_str(), "/ul/%lu/", &id) != 1)
+    {
+        return std::to_string(API_EARGS);
+    }
+
+    std::lock_guard<std::mutex> g(mMutex);
+    if (id >= mUploads.size())
+    {
+        return std::to_string(API_ENOENT);
+    }
+
+    Upload& upload = mUploads[id];
+    upload.received += m_off_t(bodySize);
+    if (upload.received < upload.size)
+    {
+        return "0";
+    }
+
+    std::string token(UPLOADTOKENLEN, '\0');
+    mRng.genblock((byte*)&token[0], token.size());
+    return token;
+}
+
+} // namespace mt
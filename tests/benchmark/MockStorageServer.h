@@ -0,0 +1,119 @@
+/**
+ * @file MockStorageServer.h
+ * @brief Local stand-in for the API and storage servers, for transfer benchmarks
+ *
+ * (c) 2013-2023 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <mega.h>
+
+namespace mt {
+
+// A minimal HTTP/1.1 server on 127.0.0.1 that answers just enough of the API (`g` and `u` commands on /cs)
+// and of the storage servers (ranged GETs of plain and cloudraid files, chunked upload POSTs) for
+// MegaClient to run real transfers through TransferSlot, RaidBufferManager and CurlHttpIO.
+// File contents are encrypted up front, so serving them is little more than a send() per request.
+class MockStorageServer
+{
+public:
+    struct PublicFile
+    {
+        mega::handle publicHandle;
+        mega::byte nodeKey[mega::FILENODEKEYLENGTH];
+        m_off_t size;
+    };
+
+    MockStorageServer();
+    ~MockStorageServer();
+
+    // listen on an ephemeral port, returns false if the socket could not be set up
+    bool start();
+    void stop();
+
+    // base URL to use as the client's APIURL
+    std::string apiUrl() const;
+
+    // create a file of random content, served as a 6 part cloudraid file if `raid` is set
+    PublicFile addFile(m_off_t size, bool raid);
+
+    // CPU time spent by the server's own threads, so that it can be subtracted from process totals
+    double serverCpuSeconds() const;
+
+    // whether the calling thread is one of the server's (lets the benchmark keep them out of its allocation count)
+    static bool isServerThread();
+
+private:
+    struct StoredFile
+    {
+        std::string encrypted;
+        std::string raidParts[mega::RAIDPARTS];
+        bool raid = false;
+        std::string attrs;
+    };
+
+    struct Upload
+    {
+        m_off_t size = 0;
+        m_off_t received = 0;
+    };
+
+    struct Request
+    {
+        std::string method;
+        std::string path;
+        std::string body;
+        bool keepAlive = true;
+    };
+
+    void acceptLoop();
+    void serveConnection(int fd);
+    bool readRequest(int fd, std::string& pending, Request& request);
+    bool sendResponse(int fd, const char* data, size_t size, bool keepAlive);
+
+    std::string handleApi(const std::string& body);
+    bool handleDownload(const std::string& path, const char*& data, size_t& size);
+    std::string handleUpload(const std::string& path, size_t bodySize);
+
+    mega::PrnGen mRng;
+    int mListenFd = -1;
+    int mPort = 0;
+    std::atomic<bool> mStopping{false};
+    std::thread mAcceptThread;
+
+    std::mutex mMutex;
+    std::vector<std::thread> mConnectionThreads;
+    std::vector<int> mConnectionFds;
+
+    // keyed by the base64 public handle, as it appears in `g` commands
+    std::map<std::string, std::unique_ptr<StoredFile>> mFiles;
+    std::vector<StoredFile*> mFilesById;
+    std::vector<Upload> mUploads;
+
+    std::atomic<long long> mServerCpuNanos{0};
+};
+
+} // namespace mt
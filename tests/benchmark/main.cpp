@@ -0,0 +1,373 @@
+/**
+ * @file tests/benchmark/main.cpp
+ * @brief End to end transfer throughput benchmark against a local mock storage server
+ *
+ * (c) 2013-2023 by Mega Limited, Auckland, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+// Usage: test_benchmark [--files N] [--size MB] [--raid] [--no-download] [--no-upload] [--verbose]
+//
+// Runs N concurrent downloads (plain or cloudraid) and then N concurrent uploads of `size` MB each through
+// MegaClient, with the API and storage servers replaced by MockStorageServer on the loopback interface.
+// Reports throughput, client CPU time per GB (the mock server's own CPU time excluded) and heap
+// allocations per MB made by the client threads.
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+
+#include <mega.h>
+
+#include "MockStorageServer.h"
+
+using namespace mega;
+using std::cout;
+using std::endl;
+
+namespace {
+
+std::atomic<unsigned long long> gAllocations{0};
+
+} // anonymous
+
+// count heap allocations made outside of the mock server
+void* operator new(size_t size)
+{
+    if (!mt::MockStorageServer::isServerThread())
+    {
+        ++gAllocations;
+    }
+
+    if (void* p = malloc(size ? size : 1))
+    {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace {
+
+struct BenchmarkApp : public MegaApp
+{
+};
+
+struct Progress
+{
+    int completed = 0;
+    int failed = 0;
+};
+
+struct BenchmarkFile : public File
+{
+    Progress& mProgress;
+
+    explicit BenchmarkFile(Progress& p) : mProgress(p) { }
+
+    // no putnodes for uploads: the transfer itself is what is being measured
+    void completed(Transfer*, putsource_t) override
+    {
+        mProgress.completed++;
+        delete this;
+    }
+
+    void terminated(error e) override
+    {
+        LOG_err << "Benchmark transfer failed: " << e;
+        mProgress.failed++;
+        delete this;
+    }
+
+    bool failed(error, MegaClient*) override
+    {
+        return false;
+    }
+};
+
+struct Measurement
+{
+    std::chrono::steady_clock::time_point wall;
+    double cpu;
+    double serverCpu;
+    unsigned long long allocations;
+
+    static Measurement take(const mt::MockStorageServer& server)
+    {
+        rusage ru;
+        getrusage(RUSAGE_SELF, &ru);
+
+        Measurement m;
+        m.wall = std::chrono::steady_clock::now();
+        m.cpu = static_cast<double>(ru.ru_utime.tv_sec) + static_cast<double>(ru.ru_utime.tv_usec) / 1e6
+              + static_cast<double>(ru.ru_stime.tv_sec) + static_cast<double>(ru.ru_stime.tv_usec) / 1e6;
+        m.serverCpu = server.serverCpuSeconds();
+        m.allocations = gAllocations;
+        return m;
+    }
+};
+
+void report(const char* phase, const Measurement& start, const Measurement& end, m_off_t bytes, const Progress& progress)
+{
+    double seconds = std::chrono::duration<double>(end.wall - start.wall).count();
+    double mb = static_cast<double>(bytes) / 1048576.0;
+    double clientCpu = (end.cpu - start.cpu) - (end.serverCpu - start.serverCpu);
+
+    cout << std::fixed << std::setprecision(2)
+         << phase << ": " << progress.completed << " completed, " << progress.failed << " failed, "
+         << mb << " MB in " << seconds << " s" << endl
+         << "    throughput:       " << (seconds > 0 ? mb / seconds : 0) << " MB/s" << endl
+         << "    client CPU:       " << (mb > 0 ? clientCpu * 1024 / mb : 0) << " s/GB" << endl
+         << "    allocations:      " << (mb > 0 ? static_cast<double>(end.allocations - start.allocations) / mb : 0) << " per MB" << endl;
+}
+
+// drive the client until all transfers have finished one way or the other
+bool runUntilDone(MegaClient& client, const Progress& progress, int count)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::minutes(30);
+
+    while (progress.completed + progress.failed < count)
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            cout << "Timed out waiting for transfers" << endl;
+            return false;
+        }
+
+        client.wait();
+        client.exec();
+    }
+
+    return true;
+}
+
+} // anonymous
+
+int main(int argc, char** argv)
+{
+    int files = 8;
+    m_off_t size = 64 << 20;
+    bool raid = false;
+    bool download = true;
+    bool upload = true;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (!strcmp(argv[i], "--files") && i + 1 < argc)
+        {
+            files = atoi(argv[++i]);
+        }
+        else if (!strcmp(argv[i], "--size") && i + 1 < argc)
+        {
+            size = m_off_t(atof(argv[++i]) * 1048576);
+        }
+        else if (!strcmp(argv[i], "--raid"))
+        {
+            raid = true;
+        }
+        else if (!strcmp(argv[i], "--no-download"))
+        {
+            download = false;
+        }
+        else if (!strcmp(argv[i], "--no-upload"))
+        {
+            upload = false;
+        }
+        else if (!strcmp(argv[i], "--verbose"))
+        {
+            SimpleLogger::setLogLevel(logDebug);
+        }
+        else
+        {
+            cout << "Usage: " << argv[0] << " [--files N] [--size MB] [--raid] [--no-download] [--no-upload] [--verbose]" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (files <= 0 || size <= 0)
+    {
+        cout << "Both the file count and the size must be positive" << endl;
+        return EXIT_FAILURE;
+    }
+
+    mt::MockStorageServer server;
+    if (!server.start())
+    {
+        cout << "Unable to start the mock storage server" << endl;
+        return EXIT_FAILURE;
+    }
+
+    char dirTemplate[] = "/tmp/megabenchXXXXXX";
+    if (!mkdtemp(dirTemplate))
+    {
+        cout << "Unable to create a working folder" << endl;
+        return EXIT_FAILURE;
+    }
+    std::string workDir = dirTemplate;
+
+    BenchmarkApp app;
+    MegaClient client(&app, std::make_shared<WAIT_CLASS>(), new HTTPIO_CLASS, nullptr, nullptr, "BENCHMRK", "megabenchmark", 2);
+    client.httpio->APIURL = server.apiUrl();
+    client.httpio->disablepkp = true;
+    client.usehttps = false;
+    client.gfxdisabled = true;
+
+    cout << "Transferring " << files << " x " << (static_cast<double>(size) / 1048576.0) << " MB" << (raid ? " cloudraid" : "")
+         << " files via " << server.apiUrl() << endl;
+
+    int result = EXIT_SUCCESS;
+
+    if (download)
+    {
+        std::vector<mt::MockStorageServer::PublicFile> remote;
+        for (int i = 0; i < files; i++)
+        {
+            remote.push_back(server.addFile(size, raid));
+        }
+
+        Progress progress;
+        Measurement start = Measurement::take(server);
+        {
+            TransferDbCommitter committer(client.tctable);
+            for (int i = 0; i < files; i++)
+            {
+                BenchmarkFile* f = new BenchmarkFile(progress);
+                f->h.set6byte(remote[i].publicHandle);
+                f->hprivate = false;
+                f->hforeign = false;
+                memcpy(f->filekey, remote[i].nodeKey, sizeof f->filekey);
+                f->size = remote[i].size;
+                memcpy(f->crc.data(), f->filekey, sizeof f->crc);
+                f->name = "download" + std::to_string(i);
+                f->setLocalname(LocalPath::fromAbsolutePath(workDir + "/" + f->name));
+
+                if (!client.startxfer(GET, f, committer, false, false, false, NoVersioning, nullptr, client.nextreqtag()))
+                {
+                    delete f;
+                    progress.failed++;
+                }
+            }
+        }
+
+        if (!runUntilDone(client, progress, files))
+        {
+            result = EXIT_FAILURE;
+        }
+        report(raid ? "Download (cloudraid)" : "Download", start, Measurement::take(server), size * progress.completed, progress);
+
+        if (progress.failed)
+        {
+            result = EXIT_FAILURE;
+        }
+    }
+
+    if (upload)
+    {
+        std::vector<char> content(static_cast<size_t>(std::min<m_off_t>(size, 1 << 20)));
+        for (size_t i = 0; i < content.size(); i++)
+        {
+            content[i] = char(rand());
+        }
+
+        for (int i = 0; i < files; i++)
+        {
+            std::ofstream out(workDir + "/upload" + std::to_string(i), std::ios::binary);
+            for (m_off_t written = 0; written < size; written += m_off_t(content.size()))
+            {
+                content[0] = char(i);   // keep the fingerprints distinct
+                out.write(content.data(), std::streamsize(std::min<m_off_t>(size - written, m_off_t(content.size()))));
+            }
+        }
+
+        Progress progress;
+        Measurement start = Measurement::take(server);
+        {
+            TransferDbCommitter committer(client.tctable);
+            for (int i = 0; i < files; i++)
+            {
+                BenchmarkFile* f = new BenchmarkFile(progress);
+                f->name = "upload" + std::to_string(i);
+                f->setLocalname(LocalPath::fromAbsolutePath(workDir + "/" + f->name));
+
+                auto fa = client.fsaccess->newfileaccess();
+                if (fa->fopen(f->getLocalname(), true, false, FSLogging::logOnError))
+                {
+                    f->genfingerprint(fa.get());
+                }
+
+                if (!f->isvalid
+                    || !client.startxfer(PUT, f, committer, false, false, false, NoVersioning, nullptr, client.nextreqtag()))
+                {
+                    delete f;
+                    progress.failed++;
+                }
+            }
+        }
+
+        if (!runUntilDone(client, progress, files))
+        {
+            result = EXIT_FAILURE;
+        }
+        report("Upload", start, Measurement::take(server), size * progress.completed, progress);
+
+        if (progress.failed)
+        {
+            result = EXIT_FAILURE;
+        }
+    }
+
+    for (int i = 0; i < files; i++)
+    {
+        unlink((workDir + "/download" + std::to_string(i)).c_str());
+        unlink((workDir + "/upload" + std::to_string(i)).c_str());
+    }
+    rmdir(workDir.c_str());
+
+    return result;
+}
@@ -8462,6 +8462,138 @@ TEST_F(SdkTest, RecursiveDownloadWithLogout)
     ASSERT_EQ(true, megaApi[0]->setMaxDownloadSpeed(currentMaxDownloadSpeed)); // restore previous max download speed (bytes per second)
 }
 
+#ifdef MEGASDK_DEBUG_TEST_HOOKS_ENABLED
+namespace
+{
+    // Upload <p>/d0..d7 to the cloud, then add <p>/dN/sub/file locally,
+    // so the next upload of <p> needs one independent folder batch per dN
+    bool prepareIndependentFolderBatches(MegaApi* api, const fs::path& p, int n)
+    {
+        std::error_code ec;
+        fs::remove_all(p, ec);
+        for (int i = 0; i < n; ++i)
+        {
+            if (!fs::create_directories(p / ("d" + to_string(i)))) return false;
+        }
+
+        TransferTracker tt(api);
+        api->startUpload(p.u8string().c_str(), std::unique_ptr<MegaNode>{api->getRootNode()}.get(),
+                         nullptr /*fileName*/,
+                         ::mega::MegaApi::INVALID_CUSTOM_MOD_TIME,
+                         nullptr /*appData*/,
+                         false   /*isSourceTemporary*/,
+                         false   /*startFirst*/,
+                         nullptr /*cancelToken*/,
+                         &tt);
+        if (tt.waitForResult() != API_OK) return false;
+
+        for (int i = 0; i < n; ++i)
+        {
+            fs::path sub = p / ("d" + to_string(i)) / "sub";
+            if (!fs::create_directories(sub)) return false;
+            ofstream f((sub / "file").u8string());
+            f << "file in d" << i;
+        }
+        return true;
+    }
+
+    struct SubtransferStartTracker : public MegaTransferListener
+    {
+        std::function<void()> onSubtransferStart;
+        void onTransferStart(MegaApi*, MegaTransfer* t) override
+        {
+            if (t->getFolderTransferTag() > 0) onSubtransferStart();
+        }
+    };
+}
+
+TEST_F(SdkTest, FolderUploadKeepsIndependentBatchesInFlight)
+{
+    LOG_info << "___TEST FolderUploadKeepsIndependentBatchesInFlight___";
+    ASSERT_NO_FATAL_FAILURE(getAccountsForTest(1));
+
+    const int n = 8;
+    fs::path p = fs::current_path() / "batchup_mega_auto_test_sdk";
+    ASSERT_TRUE(prepareIndependentFolderBatches(megaApi[0].get(), p, n));
+
+    // both called on the MegaApi thread, read here once the upload finished
+    vector<unsigned> inFlight;
+    globalMegaTestHooks.onFolderUploadBatchSent = [&](unsigned batchesInFlight) { inFlight.push_back(batchesInFlight); };
+
+    TransferTracker tt(megaApi[0].get());
+    megaApi[0]->startUpload(p.u8string().c_str(), std::unique_ptr<MegaNode>{megaApi[0]->getRootNode()}.get(),
+                            nullptr /*fileName*/,
+                            ::mega::MegaApi::INVALID_CUSTOM_MOD_TIME,
+                            nullptr /*appData*/,
+                            false   /*isSourceTemporary*/,
+                            false   /*startFirst*/,
+                            nullptr /*cancelToken*/,
+                            &tt);
+    ASSERT_EQ(API_OK, tt.waitForResult());
+    globalMegaTestHooks.onFolderUploadBatchSent = nullptr;
+
+    // one batch per existing parent, up to 4 of them in flight, none sent twice
+    ASSERT_EQ(size_t(n), inFlight.size());
+    ASSERT_EQ(4u, *std::max_element(inFlight.begin(), inFlight.end()));
+    for (int i = 0; i < 4; ++i)
+    {
+        ASSERT_EQ(unsigned(i + 1), inFlight[i]) << "batch " << i << " was not sent before the earlier ones completed";
+    }
+
+    for (int i = 0; i < n; ++i)
+    {
+        string path = "/" + p.filename().u8string() + "/d" + to_string(i);
+        std::unique_ptr<MegaNode> d(megaApi[0]->getNodeByPath(path.c_str()));
+        ASSERT_TRUE(d) << path;
+        ASSERT_EQ(1, megaApi[0]->getNumChildFolders(d.get())) << path;
+        std::unique_ptr<MegaNode> file(megaApi[0]->getNodeByPath((path + "/sub/file").c_str()));
+        ASSERT_TRUE(file) << path;
+    }
+
+    std::error_code ec;
+    fs::remove_all(p, ec);
+}
+
+TEST_F(SdkTest, FolderUploadStartsFilesOfCreatedFolders)
+{
+    LOG_info << "___TEST FolderUploadStartsFilesOfCreatedFolders___";
+    ASSERT_NO_FATAL_FAILURE(getAccountsForTest(1));
+
+    const int n = 8;
+    fs::path p = fs::current_path() / "batchup_mega_auto_test_sdk";
+    ASSERT_TRUE(prepareIndependentFolderBatches(megaApi[0].get(), p, n));
+
+    // both called on the MegaApi thread, read here once the upload finished
+    string events;
+    globalMegaTestHooks.onFolderUploadBatchSent = [&](unsigned) { events += 'B'; };
+    SubtransferStartTracker starts;
+    starts.onSubtransferStart = [&]() { events += 'F'; };
+    megaApi[0]->addTransferListener(&starts);
+
+    TransferTracker tt(megaApi[0].get());
+    megaApi[0]->startUpload(p.u8string().c_str(), std::unique_ptr<MegaNode>{megaApi[0]->getRootNode()}.get(),
+                            nullptr /*fileName*/,
+                            ::mega::MegaApi::INVALID_CUSTOM_MOD_TIME,
+                            nullptr /*appData*/,
+                            false   /*isSourceTemporary*/,
+                            false   /*startFirst*/,
+                            nullptr /*cancelToken*/,
+                            &tt);
+    ASSERT_EQ(API_OK, tt.waitForResult());
+    megaApi[0]->removeTransferListener(&starts);
+    globalMegaTestHooks.onFolderUploadBatchSent = nullptr;
+
+    // only 4 of the 8 batches go out at first: the files of the folders created by those
+    // are uploaded while the last batches are still being sent
+    ASSERT_EQ(size_t(n), size_t(std::count(events.begin(), events.end(), 'B'))) << events;
+    ASSERT_EQ(size_t(n), size_t(std::count(events.begin(), events.end(), 'F'))) << events;
+    ASSERT_LT(events.find('F'), events.rfind('B')) << events;
+
+    std::error_code ec;
+    fs::remove_all(p, ec);
+}
+#endif
+
 TEST_F(SdkTest, QueryAds)
 {
     LOG_info << "___TEST QueryAds";
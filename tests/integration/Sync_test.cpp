@@ -30,7 +30,7 @@
 #include <stdio.h>
 #include <map>
 #include <future>
-//#include <mega/tsthooks.h>
+#include <mega/testhooks.h>
 #include <fstream>
 #include <atomic>
 #include <random>
@@ -1382,7 +1382,7 @@ void StandardClient::copy(const CloudItem& source,
         key.setkey((const ::mega::byte*)proc.nn[0].nodekey.data(), sourceNode->type);
 
         // Copy existing attributes.
-        AttrMap attrs = sourceNode->attrs;
+        AttrMap attrs = sourceNode->attrs();
 
         // Upate the node's name.
         attrs.map['n'] = std::move(name);
@@ -5962,8 +5962,8 @@ TEST_F(SyncTest, CmdChecks_RRAttributeAfterMoveNode)
     // check the restore-from-trash handle got set, and correctly
     nameid rrname = AttrMap::string2nameid("rr");
     ASSERT_EQ(f->nodehandle, original_f_handle);
-    ASSERT_EQ(f->attrs.map[rrname], string(Base64Str<MegaClient::NODEHANDLE>(original_f_parent_handle)));
-    ASSERT_EQ(f->attrs.map[rrname], string(Base64Str<MegaClient::NODEHANDLE>(pclientA1->gettestbasenode()->nodehandle)));
+    ASSERT_EQ(f->attrs().map[rrname], string(Base64Str<MegaClient::NODEHANDLE>(original_f_parent_handle)));
+    ASSERT_EQ(f->attrs().map[rrname], string(Base64Str<MegaClient::NODEHANDLE>(pclientA1->gettestbasenode()->nodehandle)));
 
     // move it back
     ASSERT_TRUE(pclientA1->movenode(f->nodehandle, pclientA1->basefolderhandle));
@@ -5972,7 +5972,7 @@ TEST_F(SyncTest, CmdChecks_RRAttributeAfterMoveNode)
     // check it's back and the rr attribute is gone
     f = pclientA1->drillchildnodebyname(pclientA1->gettestbasenode(), "f");
     ASSERT_TRUE(f != nullptr);
-    ASSERT_EQ(f->attrs.map[rrname], string());
+    ASSERT_EQ(f->attrs().map[rrname], string());
 }
 
 
@@ -6579,6 +6579,217 @@ TEST_F(SyncTest, BasicSync_NewVersionsCreatedWhenFilesModified)
     ASSERT_TRUE(matched);
 }
 
+TEST_F(SyncTest, BasicSync_FileWrittenInBurstsUploadedOnceSettled)
+{
+    const auto TESTROOT = makeNewTestRoot();
+    const auto TIMEOUT  = std::chrono::seconds(4);
+
+    auto c = g_clientManager->getCleanStandardClient(0, TESTROOT);
+    CatchupClients(c);
+
+    ASSERT_TRUE(c->resetBaseFolderMulticlient());
+    ASSERT_TRUE(c->makeCloudSubdirs("x", 0, 0));
+    ASSERT_TRUE(CatchupClients(c));
+
+    const auto id = c->setupSync_mainthread("s", "x", false, true);
+    ASSERT_NE(id, UNDEF);
+
+    const auto SYNCROOT = c->syncSet(id).localpath;
+
+    Model model;
+    model.addfile("f", "a");
+    model.generate(SYNCROOT);
+
+    c->triggerPeriodicScanEarly(id);
+    waitonsyncs(TIMEOUT, c);
+    ASSERT_TRUE(c->confirmModel_mainthread(model.root.get(), id));
+
+    // keep growing f for longer than Sync::FINGERPRINT_SETTLE_SECS, so every change
+    // is seen while the file is still being written and its CRCs are deferred
+    std::string content;
+    for (int i = 0; i < 10; ++i)
+    {
+        content.append(64 * 1024, char('b' + i));
+        model.addfile("f", content);
+        model.generate(SYNCROOT);
+        c->triggerPeriodicScanEarly(id);
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+    }
+
+    waitonsyncs(TIMEOUT, c);
+    ASSERT_TRUE(c->confirmModel_mainthread(model.root.get(), id));
+
+    // the last version was uploaded with the CRCs of the settled file
+    auto local = c->fingerprint(SYNCROOT / "f");
+    ASSERT_TRUE(local.isvalid);
+
+    auto* f = c->drillchildnodebyname(c->gettestbasenode(), "x/f");
+    ASSERT_TRUE(f);
+    ASSERT_TRUE(f->isvalid);
+    ASSERT_EQ(f->size, local.size);
+    ASSERT_TRUE(f->crc == local.crc);
+}
+
+TEST_F(SyncTest, BasicSync_UploadStateReleasedOnceUploaded)
+{
+    const auto TESTROOT = makeNewTestRoot();
+    const auto TIMEOUT  = std::chrono::seconds(4);
+
+    auto c = g_clientManager->getCleanStandardClient(0, TESTROOT);
+    CatchupClients(c);
+
+    ASSERT_TRUE(c->resetBaseFolderMulticlient());
+    ASSERT_TRUE(c->makeCloudSubdirs("x", 0, 0));
+    ASSERT_TRUE(CatchupClients(c));
+
+    const auto id = c->setupSync_mainthread("s", "x", false, true);
+    ASSERT_NE(id, UNDEF);
+
+    const auto SYNCROOT = c->syncSet(id).localpath;
+
+    Model model;
+    model.addfile("f0", "a");
+    model.addfile("d/f1", "b");
+    model.addfile("d/e/f2", "c");
+    model.generate(SYNCROOT);
+
+    c->triggerPeriodicScanEarly(id);
+    waitonsyncs(TIMEOUT, c);
+    ASSERT_TRUE(c->confirmModel_mainthread(model.root.get(), id));
+
+    // each upload's transfer state belongs to its LocalNode only while the upload runs
+    auto uploads = c->thread_do<unsigned>([id](StandardClient& sc, PromiseUnsignedSP result) {
+        unsigned n = 0;
+        std::function<void(LocalNode&)> count = [&](LocalNode& l) {
+            n += !!l.upload;
+            for (auto& child : l.children) count(*child.second);
+        };
+
+        if (Sync* sync = sc.syncByBackupId(id))
+        {
+            count(*sync->localroot);
+        }
+        result->set_value(n);
+    }, __FILE__, __LINE__);
+
+    ASSERT_EQ(uploads.get(), 0u);
+}
+
+#ifdef MEGASDK_DEBUG_TEST_HOOKS_ENABLED
+TEST_F(SyncTest, BasicSync_SyncdownDirtyOnlyComparesMarkedFolders)
+{
+    const auto TESTROOT = makeNewTestRoot();
+    const auto TIMEOUT  = std::chrono::seconds(4);
+
+    auto c = g_clientManager->getCleanStandardClient(0, TESTROOT);
+    CatchupClients(c);
+
+    ASSERT_TRUE(c->resetBaseFolderMulticlient());
+    ASSERT_TRUE(c->makeCloudSubdirs("x", 0, 0));
+    ASSERT_TRUE(CatchupClients(c));
+
+    const auto id = c->setupSync_mainthread("s", "x", false, true);
+    ASSERT_NE(id, UNDEF);
+
+    const auto SYNCROOT = c->syncSet(id).localpath;
+
+    Model model;
+    model.addfile("a/b/c/f0");
+    model.addfolder("a/d");
+    model.addfile("e/f/f1");
+    model.generate(SYNCROOT);
+
+    c->triggerPeriodicScanEarly(id);
+    waitonsyncs(TIMEOUT, c);
+    ASSERT_TRUE(c->confirmModel_mainthread(model.root.get(), id));
+
+    // run on the client thread, so no other pass runs in between
+    auto result = c->thread_do<bool>([id](StandardClient& sc, PromiseBoolSP pb) {
+        Sync* sync = sc.syncByBackupId(id);
+        if (!sync)
+        {
+            ADD_FAILURE() << "sync not running";
+            return pb->set_value(false);
+        }
+
+        auto childOf = [](LocalNode* l, const char* name) -> LocalNode* {
+            auto ln = LocalPath::fromRelativePath(name);
+            return l ? l->childbyname(&ln) : nullptr;
+        };
+
+        LocalNode* root = sync->localroot.get();
+        LocalNode* a = childOf(root, "a");
+        LocalNode* b = childOf(a, "b");
+        LocalNode* c = childOf(b, "c");
+        LocalNode* d = childOf(a, "d");
+        LocalNode* e = childOf(root, "e");
+        LocalNode* f = childOf(e, "f");
+        if (!c || !d || !f)
+        {
+            ADD_FAILURE() << "synced folders not found";
+            return pb->set_value(false);
+        }
+
+        const vector<LocalNode*> folders{root, a, b, c, d, e, f};
+        auto marked = [&]() {
+            vector<LocalNode*> v;
+            for (LocalNode* l : folders)
+            {
+                if (l->syncdownDirty || l->syncdownDescendantDirty) v.push_back(l);
+            }
+            return v;
+        };
+
+        vector<LocalNode*> compared;
+        globalMegaTestHooks.onSyncdownFolder = [&](LocalNode* l) { compared.push_back(l); };
+
+        // a completed full pass compares every folder and leaves none marked
+        LocalPath path = root->getLocalname();
+        EXPECT_TRUE(sc.client.syncdown(root, path, false));
+        EXPECT_EQ(compared.size(), folders.size());
+        EXPECT_TRUE(marked().empty());
+
+        // marking a folder flags it, and its ancestors as leading to it
+        b->setSyncdownDirty();
+        EXPECT_TRUE(b->syncdownDirty);
+        EXPECT_FALSE(b->syncdownDescendantDirty);
+        EXPECT_TRUE(a->syncdownDescendantDirty && !a->syncdownDirty);
+        EXPECT_TRUE(root->syncdownDescendantDirty && !root->syncdownDirty);
+        EXPECT_EQ(marked(), (vector<LocalNode*>{root, a, b}));
+
+        // the dirty-only pass compares just that folder, not its children or siblings
+        compared.clear();
+        EXPECT_TRUE(sc.client.syncdown(root, path, true));
+        EXPECT_EQ(compared, vector<LocalNode*>{b});
+        EXPECT_TRUE(marked().empty());
+
+        // two marked folders in different subtrees
+        c->setSyncdownDirty();
+        f->setSyncdownDirty();
+        EXPECT_EQ(marked(), (vector<LocalNode*>{root, a, b, c, e, f}));
+
+        compared.clear();
+        EXPECT_TRUE(sc.client.syncdown(root, path, true));
+        EXPECT_EQ(compared, (vector<LocalNode*>{c, f}));
+        EXPECT_TRUE(marked().empty());
+
+        // nothing marked: nothing compared
+        compared.clear();
+        EXPECT_TRUE(sc.client.syncdown(root, path, true));
+        EXPECT_TRUE(compared.empty());
+
+        // marks put back by a pass that didn't complete stay reachable from the root
+        d->restoreSyncdownDirty(true, false);
+        EXPECT_EQ(marked(), (vector<LocalNode*>{root, a, d}));
+
+        globalMegaTestHooks.onSyncdownFolder = nullptr;
+        pb->set_value(true);
+    }, __FILE__, __LINE__);
+
+    ASSERT_TRUE(result.get());
+}
+#endif
+
 TEST_F(SyncTest, BasicSync_ClientToSDKConfigMigration)
 {
     const auto TESTROOT = makeNewTestRoot();
@@ -8899,7 +9110,7 @@ struct TwoWaySyncSymmetryCase
         AttrMap attrs;
         string attrstring;
         key.setkey((const ::mega::byte*)tc.nn[0].nodekey.data(), n1->type);
-        attrs = n1->attrs;
+        attrs = n1->attrs();
         attrs.getjson(&attrstring);
         client1().client.makeattr(&key, tc.nn[0].attrstring, attrstring.c_str());
         changeClient().client.putnodes(n2->nodeHandle(), NoVersioning, std::move(tc.nn), nullptr, ++next_request_tag, false);
@@ -8932,7 +9143,7 @@ struct TwoWaySyncSymmetryCase
         AttrMap attrs;
         string attrstring;
         key.setkey((const ::mega::byte*)tc.nn[0].nodekey.data(), n1->type);
-        attrs = n1->attrs;
+        attrs = n1->attrs();
         LocalPath::utf8_normalize(&newname);
         attrs.map['n'] = newname;
         attrs.getjson(&attrstring);
@@ -0,0 +1,232 @@
+/**
+ * (c) 2023 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <chrono>
+#include <random>
+
+#include <gtest/gtest.h>
+
+#include <mega/base64.h>
+#include <mega/logging.h>
+
+namespace
+{
+
+// the original byte at a time codec, as the reference for the vector kernels
+unsigned char referenceFrom64(mega::byte c)
+{
+    if ((c >= 'A') && (c <= 'Z')) return static_cast<unsigned char>(c - 'A');
+    if ((c >= 'a') && (c <= 'z')) return static_cast<unsigned char>(c - 'a' + 26);
+    if ((c >= '0') && (c <= '9')) return static_cast<unsigned char>(c - '0' + 52);
+    if (c == '-' || c == '+') return 62;
+    if (c == '_' || c == '/') return 63;
+    return 255;
+}
+
+int referenceAtob(const char* a, mega::byte* b, int blen)
+{
+    mega::byte c[4] = {};
+    int i;
+    int p = 0;
+
+    for (;;)
+    {
+        for (i = 0; i < 4; i++)
+        {
+            if ((c[i] = referenceFrom64(static_cast<mega::byte>(*a++))) == 255) break;
+        }
+
+        if ((p >= blen) || !i) return p;
+        b[p++] = static_cast<mega::byte>((c[0] << 2) | ((c[1] & 0x30) >> 4));
+        if ((p >= blen) || (i < 3)) return p;
+        b[p++] = static_cast<mega::byte>((c[1] << 4) | ((c[2] & 0x3c) >> 2));
+        if ((p >= blen) || (i < 4)) return p;
+        b[p++] = static_cast<mega::byte>((c[2] << 6) | c[3]);
+    }
+}
+
+int referenceBtoa(const mega::byte* b, int blen, char* a)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+    int p = 0;
+
+    while (blen > 0)
+    {
+        a[p++] = table[*b >> 2];
+        a[p++] = table[((*b << 4) | (((blen > 1) ? b[1] : 0) >> 4)) & 63];
+        if (blen < 2) break;
+        a[p++] = table[((b[1] << 2) | (((blen > 2) ? b[2] : 0) >> 6)) & 63];
+        if (blen < 3) break;
+        a[p++] = table[b[2] & 63];
+        blen -= 3;
+        b += 3;
+    }
+
+    a[p] = 0;
+    return p;
+}
+
+std::vector<mega::Base64::Simd> availableLevels()
+{
+    std::vector<mega::Base64::Simd> levels;
+    for (auto level : { mega::Base64::SIMD_NONE, mega::Base64::SIMD_SSSE3, mega::Base64::SIMD_AVX2, mega::Base64::SIMD_NEON })
+    {
+        if (mega::Base64::setSimd(level))
+        {
+            levels.push_back(level);
+        }
+    }
+    mega::Base64::setSimd(mega::Base64::bestSimd());
+    return levels;
+}
+
+struct RestoreSimd
+{
+    ~RestoreSimd() { mega::Base64::setSimd(mega::Base64::bestSimd()); }
+};
+
+} // anonymous
+
+TEST(Base64, MatchesReferenceCodecAtEveryLevel)
+{
+    RestoreSimd restore;
+    std::mt19937 rng(42);
+    const std::string alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_+/";
+
+    for (auto level : availableLevels())
+    {
+        ASSERT_TRUE(mega::Base64::setSimd(level));
+
+        for (int round = 0; round < 2000; round++)
+        {
+            size_t len = rng() % (round < 1000 ? 100 : 2000);
+
+            // encoding
+            std::vector<mega::byte> in(len);
+            for (auto& b : in)
+            {
+                b = static_cast<mega::byte>(rng());
+            }
+
+            std::vector<char> expected(len * 4 / 3 + 4), actual(len * 4 / 3 + 4);
+            int expectedLen = referenceBtoa(in.data(), int(len), expected.data());
+            ASSERT_EQ(mega::Base64::btoa(in.data(), int(len), actual.data()), expectedLen) << "level " << level;
+            ASSERT_STREQ(actual.data(), expected.data()) << "level " << level;
+
+            // decoding, of text with both alphabets and the odd invalid character
+            std::string text(rng() % (round < 1000 ? 100 : 2000), 'A');
+            for (auto& c : text)
+            {
+                c = rng() % 500 ? alphabet[rng() % alphabet.size()] : static_cast<char>(rng() % 255 + 1);
+            }
+
+            int blen = int(rng() % (text.size() + 8));
+            std::vector<mega::byte> expectedBytes(size_t(blen) + 1), actualBytes(size_t(blen) + 1);
+            int expectedBytesLen = referenceAtob(text.c_str(), expectedBytes.data(), blen);
+            ASSERT_EQ(mega::Base64::atob(text.c_str(), actualBytes.data(), blen), expectedBytesLen) << "level " << level;
+            ASSERT_EQ(actualBytes, expectedBytes) << "level " << level;
+
+            std::string out;
+            std::vector<mega::byte> all(text.size() * 3 / 4 + 3);
+            int allLen = referenceAtob(text.c_str(), all.data(), int(all.size()));
+            ASSERT_EQ(mega::Base64::atob(text, out), allLen) << "level " << level;
+            ASSERT_EQ(out, std::string(reinterpret_cast<const char*>(all.data()), size_t(allLen))) << "level " << level;
+        }
+    }
+}
+
+TEST(Base64, RoundTripsLongBuffers)
+{
+    RestoreSimd restore;
+    std::mt19937 rng(7);
+
+    std::string data(1 << 20, '\0');
+    for (auto& c : data)
+    {
+        c = static_cast<char>(rng());
+    }
+
+    for (auto level : availableLevels())
+    {
+        ASSERT_TRUE(mega::Base64::setSimd(level));
+
+        std::string encoded = mega::Base64::btoa(data);
+        ASSERT_EQ(encoded.size(), (data.size() * 4 + 2) / 3);
+        ASSERT_EQ(mega::Base64::atob(encoded), data) << "level " << level;
+    }
+}
+
+// not a pass/fail test: logs how the levels compare to the reference codec
+TEST(Base64, Throughput)
+{
+    RestoreSimd restore;
+    std::mt19937 rng(1);
+
+    std::string data(4 << 20, '\0');
+    for (auto& c : data)
+    {
+        c = static_cast<char>(rng());
+    }
+
+    std::string encoded(data.size() * 4 / 3 + 4, '\0');
+    std::string decoded(data.size() + 3, '\0');
+    const int rounds = 10;
+
+    auto mbps = [&](std::chrono::steady_clock::duration d)
+    {
+        return double(data.size()) * rounds / 1048576.0 / std::chrono::duration<double>(d).count();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        referenceBtoa(reinterpret_cast<const mega::byte*>(data.data()), int(data.size()), &encoded[0]);
+    }
+    auto encodeTime = std::chrono::steady_clock::now() - start;
+
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < rounds; i++)
+    {
+        referenceAtob(encoded.c_str(), reinterpret_cast<mega::byte*>(&decoded[0]), int(decoded.size()));
+    }
+    auto decodeTime = std::chrono::steady_clock::now() - start;
+
+    LOG_info << "Base64 reference: encode " << mbps(encodeTime) << " MB/s, decode " << mbps(decodeTime) << " MB/s";
+
+    for (auto level : availableLevels())
+    {
+        ASSERT_TRUE(mega::Base64::setSimd(level));
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+        {
+            mega::Base64::btoa(reinterpret_cast<const mega::byte*>(data.data()), int(data.size()), &encoded[0]);
+        }
+        encodeTime = std::chrono::steady_clock::now() - start;
+
+        start = std::chrono::steady_clock::now();
+        for (int i = 0; i < rounds; i++)
+        {
+            mega::Base64::atob(encoded.c_str(), reinterpret_cast<mega::byte*>(&decoded[0]), int(decoded.size()));
+        }
+        decodeTime = std::chrono::steady_clock::now() - start;
+
+        LOG_info << "Base64 level " << level << ": encode " << mbps(encodeTime) << " MB/s, decode " << mbps(decodeTime) << " MB/s";
+        ASSERT_EQ(decoded.substr(0, data.size()), data);
+    }
+}
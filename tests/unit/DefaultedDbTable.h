@@ -114,6 +114,10 @@ public:
     {
         return false;
     }
+    bool getChildrenSizeTypeAndFlags(mega::NodeHandle, const std::function<void(const mega::NodeSizeTypeAndFlags&, bool)>&) override
+    {
+        return false;
+    }
     bool isAncestor(mega::NodeHandle, mega::NodeHandle, mega::CancelToken) override
     {
         return false;
@@ -136,13 +140,17 @@ public:
     {
         return false;
     }
-    void updateCounter(mega::NodeHandle, const std::string&) override
+    bool updateCounter(mega::NodeHandle, const std::string&) override
     {
-
+        return false;
     }
     void updateCounterAndFlags(mega::NodeHandle nodeHandle, uint64_t flags, const std::string& nodeCounterBlob) override
     {
 
+    }
+    void updateLeafChildrenCounterAndFlags(mega::NodeHandle, bool, uint64_t, uint64_t) override
+    {
+
     }
     void createIndexes() override
     {
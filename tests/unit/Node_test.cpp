@@ -0,0 +1,159 @@
+/**
+ * (c) 2023 by Mega Limited, Wellsford, New Zealand
+ *
+ * This file is part of the MEGA SDK - Client Access Engine.
+ *
+ * Applications using the MEGA API must present a valid application key
+ * and comply with the the rules set forth in the Terms of Service.
+ *
+ * The MEGA SDK is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ *
+ * @copyright Simplified (2-clause) BSD License.
+ *
+ * You should have received a copy of the license along with this
+ * program.
+ */
+
+#include <gtest/gtest.h>
+
+#include <mega/megaclient.h>
+#include <mega/megaapp.h>
+#include <mega/base64.h>
+
+#include "utils.h"
+
+namespace
+{
+
+struct EncryptedNode
+{
+    std::string keydata;
+    std::string attrstring;
+};
+
+// node key wrapped with the master key for `me`, and attributes encrypted with the node key
+EncryptedNode encryptNode(mega::MegaClient& client, const std::string& name)
+{
+    mega::byte nodeKey[mega::FOLDERNODEKEYLENGTH];
+    for (auto& b : nodeKey)
+    {
+        b = mt::nextRandomByte();
+    }
+
+    mega::SymmCipher nodeCipher;
+    nodeCipher.setkey(nodeKey, mega::FOLDERNODE);
+
+    EncryptedNode result;
+    std::string attrs = "\"n\":\"" + name + "\"";
+    std::string encryptedAttrs;
+    mega::MegaClient::makeattr(&nodeCipher, &encryptedAttrs, attrs.c_str());
+    mega::Base64::btoa(encryptedAttrs, result.attrstring);
+
+    mega::byte wrapped[mega::FOLDERNODEKEYLENGTH];
+    memcpy(wrapped, nodeKey, sizeof wrapped);
+    client.key.ecb_encrypt(wrapped, wrapped, sizeof wrapped);
+
+    char me[16], key[32];
+    mega::Base64::btoa(reinterpret_cast<const mega::byte*>(&client.me), mega::MegaClient::USERHANDLE, me);
+    mega::Base64::btoa(wrapped, sizeof wrapped, key);
+    result.keydata = std::string(me) + ":" + key;
+    return result;
+}
+
+mega::Node& makeEncryptedNode(mega::MegaClient& client, mega::handle h, const EncryptedNode& encrypted)
+{
+    auto& n = mt::makeNode(client, mega::FOLDERNODE, mega::NodeHandle().set6byte(h));
+    n.setKey(encrypted.keydata);
+    n.attrstring.reset(new std::string(encrypted.attrstring));
+    return n;
+}
+
+void prefetch(mega::MegaClient& client, const EncryptedNode& encrypted, mega::PrefetchedNodeKey& p)
+{
+    p.keydata = encrypted.keydata;
+    p.attrstring = encrypted.attrstring;
+
+    mega::SymmCipher* sc = &client.key;
+    bool foreign = false;
+    const char* subkey = mega::Node::findkey(client, p.keydata, sc, foreign);
+    ASSERT_NE(subkey, nullptr);
+    ASSERT_FALSE(foreign);
+
+    p.keyOffset = size_t(subkey - p.keydata.c_str());
+    memcpy(p.wrappingKey, sc->key, sizeof p.wrappingKey);
+    p.keyLength = mega::FOLDERNODEKEYLENGTH;
+
+    mega::SymmCipher workerCipher;
+    p.decrypt(workerCipher);
+}
+
+} // anonymous
+
+TEST(Node, AppliesPrefetchedKeyWhenItMatches)
+{
+    mega::MegaApp app;
+    auto client = mt::makeClient(app);
+    client->me = 0x0102030405060708;
+
+    mega::byte masterKey[mega::SymmCipher::KEYLENGTH];
+    for (auto& b : masterKey)
+    {
+        b = mt::nextRandomByte();
+    }
+    client->key.setkey(masterKey);
+
+    auto encrypted = encryptNode(*client, "folder");
+
+    mega::PrefetchedNodeKey p;
+    prefetch(*client, encrypted, p);
+    ASSERT_TRUE(p.keyDecrypted);
+    ASSERT_TRUE(p.attrsDecrypted);
+
+    auto& inline_ = makeEncryptedNode(*client, 1, encrypted);
+    ASSERT_TRUE(inline_.applykey());
+
+    auto& prefetched = makeEncryptedNode(*client, 2, encrypted);
+    ASSERT_TRUE(prefetched.applykey(&p));
+
+    ASSERT_EQ(prefetched.nodekey(), inline_.nodekey());
+    ASSERT_EQ(prefetched.attrs().map, inline_.attrs().map);
+    ASSERT_STREQ(prefetched.displayname(), "folder");
+    ASSERT_FALSE(prefetched.attrstring);
+}
+
+TEST(Node, IgnoresPrefetchedKeyFromOtherInputs)
+{
+    mega::MegaApp app;
+    auto client = mt::makeClient(app);
+    client->me = 0x0102030405060708;
+
+    mega::byte masterKey[mega::SymmCipher::KEYLENGTH];
+    for (auto& b : masterKey)
+    {
+        b = mt::nextRandomByte();
+    }
+    client->key.setkey(masterKey);
+
+    auto encrypted = encryptNode(*client, "folder");
+
+    // decrypted with a master key that has changed since
+    mega::PrefetchedNodeKey stale;
+    prefetch(*client, encrypted, stale);
+    stale.wrappingKey[0] ^= 1;
+    stale.attrs.map['n'] = "stale";
+
+    auto& n = makeEncryptedNode(*client, 1, encrypted);
+    ASSERT_TRUE(n.applykey(&stale));
+    ASSERT_STREQ(n.displayname(), "folder");
+
+    // decrypted from another attribute string
+    mega::PrefetchedNodeKey other;
+    prefetch(*client, encryptNode(*client, "other"), other);
+    other.keydata = encrypted.keydata;
+
+    auto& m = makeEncryptedNode(*client, 2, encrypted);
+    ASSERT_TRUE(m.applykey(&other));
+    ASSERT_STREQ(m.displayname(), "folder");
+}
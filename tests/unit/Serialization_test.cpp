@@ -256,7 +256,7 @@ void checkDeserializedNode(const mega::Node& dl, const mega::Node& ref, bool ign
     ASSERT_TRUE(!dl.attrstring || *dl.attrstring == *ref.attrstring);
     ASSERT_EQ(ref.nodekeyUnchecked(), dl.nodekeyUnchecked());
     ASSERT_EQ(ignore_fileattrstring ? "" : ref.fileattrstring, dl.fileattrstring);
-    ASSERT_EQ(ref.attrs.map, dl.attrs.map);
+    ASSERT_EQ(ref.attrs().map, dl.attrs().map);
     if (ref.plink)
     {
         ASSERT_NE(nullptr, dl.plink);
@@ -364,7 +364,7 @@ TEST(Serialization, Node_forFile_withoutShares_withoutFileAttrString_withoutPlin
     n->size = 12;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -375,6 +375,67 @@ TEST(Serialization, Node_forFile_withoutShares_withoutFileAttrString_withoutPlin
     checkDeserializedNode(*dn, *n);
 }
 
+TEST(Serialization, Node_attrsUnpackedOnFirstAccess)
+{
+    MockClient client;
+    auto& parent = mt::makeNode(*client.cli, mega::FOLDERNODE, ::mega::NodeHandle().set6byte(43));
+    std::unique_ptr<mega::Node> n{&mt::makeNode(*client.cli, mega::FILENODE, ::mega::NodeHandle().set6byte(42), &parent)};
+    n->size = 12;
+    n->attrs().map = std::map<mega::nameid, std::string>{
+        {'n', "name"},
+        {101, "foo"},
+    };
+    std::string data;
+    ASSERT_TRUE(n->serialize(&data));
+    auto dn = client.cli->mNodeManager.getNodeFromBlob(&data);
+
+    // single attributes and re-serialization don't need the map
+    const char* name = dn->displayname();
+    ASSERT_STREQ("name", name);
+    ASSERT_TRUE(dn->hasName("name"));
+    ASSERT_EQ(nullptr, dn->attr(102));
+    ASSERT_EQ(nullptr, dn->attr(102));
+    ASSERT_EQ((std::vector<mega::nameid>{101, 'n'}), dn->attrNames());
+    std::string again;
+    ASSERT_TRUE(dn->serialize(&again));
+    ASSERT_EQ(data, again);
+
+    // the name handed out before stays valid
+    ASSERT_EQ(n->attrs().map, dn->attrs().map);
+    ASSERT_STREQ("name", name);
+    ASSERT_EQ("foo", *dn->attr(101));
+    ASSERT_EQ(nullptr, dn->attr(102));
+    ASSERT_EQ((std::vector<mega::nameid>{101, 'n'}), dn->attrNames());
+}
+
+TEST(Serialization, Node_unterminatedAttrsEndingInNul)
+{
+    MockClient client;
+    auto& parent = mt::makeNode(*client.cli, mega::FOLDERNODE, ::mega::NodeHandle().set6byte(43));
+    std::unique_ptr<mega::Node> n{&mt::makeNode(*client.cli, mega::FILENODE, ::mega::NodeHandle().set6byte(42), &parent)};
+    n->size = 12;
+    n->attrs().map = std::map<mega::nameid, std::string>{
+        {'n', "name"},
+        {200, std::string("bar\0", 4)},
+    };
+    std::string data;
+    ASSERT_TRUE(n->serialize(&data));
+
+    // the attributes come last: drop their terminator, so the block ends with the value's NUL
+    ASSERT_EQ('\0', data.back());
+    data.pop_back();
+    ASSERT_EQ('\0', data.back());
+
+    auto dn = client.cli->mNodeManager.getNodeFromBlob(&data);
+    ASSERT_NE(nullptr, dn);
+    ASSERT_EQ(n->attrs().map, dn->attrs().map);
+
+    // and the block is stored terminated again
+    std::string again;
+    ASSERT_TRUE(dn->serialize(&again));
+    ASSERT_EQ(data + '\0', again);
+}
+
 TEST(Serialization, Node_forFile_withoutShares_withoutPlink)
 {
     MockClient client;
@@ -383,7 +444,7 @@ TEST(Serialization, Node_forFile_withoutShares_withoutPlink)
     n->size = 12;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -403,7 +464,7 @@ TEST(Serialization, Node_forFile_withoutShares)
     n->size = 12;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -425,7 +486,7 @@ TEST(Serialization, Node_forFile_withoutShares_withAuthKey)
     n->owner = 88;
     n->ctime = 44;
     using namespace mega;
-    n->attrs.map = map<nameid, string>{
+    n->attrs().map = map<nameid, string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -446,7 +507,7 @@ TEST(Serialization, Node_forFile_withoutShares_32bit)
     n->size = 12;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -496,7 +557,7 @@ TEST(Serialization, Node_forFolder_withoutShares_withoutFileAttrString_withoutPl
     n->size = -1;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -515,7 +576,7 @@ TEST(Serialization, Node_forFolder_withoutShares_withoutPlink)
     n->size = -1;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -535,7 +596,7 @@ TEST(Serialization, Node_forFolder_withoutShares)
     n->size = -1;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
@@ -557,7 +618,7 @@ TEST(Serialization, Node_forFolder_withoutShares_32bit)
     n->size = -1;
     n->owner = 88;
     n->ctime = 44;
-    n->attrs.map = std::map<mega::nameid, std::string>{
+    n->attrs().map = std::map<mega::nameid, std::string>{
         {101, "foo"},
         {102, "bar"},
     };
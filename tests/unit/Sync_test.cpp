@@ -1139,5 +1139,146 @@ TEST_F(SyncConfigStoreTest, Write)
 
 } // SyncConfigTests
 
+TEST(LocalNodeCacheRecord, RoundTripsStaleCrcs)
+{
+    mega::LocalNode::CacheRecord record;
+    record.type = mega::FILENODE;
+    record.size = 1024;
+    record.fsid = 7;
+    record.parent_dbid = 3;
+    record.nodehandle = 0x0000123456789abc;
+    record.localname = "file.txt";
+    record.crc = {{1, 2, 3, 4}};
+    record.mtime = 1700000000;
+    record.crcStale = true;
+
+    std::string data;
+    record.serialize(&data);
+
+    mega::LocalNode::CacheRecord read;
+    ASSERT_TRUE(read.unserialize(data));
+    EXPECT_EQ(read.type, mega::FILENODE);
+    EXPECT_EQ(read.size, 1024);
+    EXPECT_EQ(read.fsid, 7u);
+    EXPECT_EQ(read.parent_dbid, 3u);
+    EXPECT_EQ(read.nodehandle, record.nodehandle);
+    EXPECT_EQ(read.localname, "file.txt");
+    EXPECT_TRUE(read.shortname.empty());
+    EXPECT_TRUE(read.shortnameInDb);
+    EXPECT_EQ(read.crc, record.crc);
+    EXPECT_EQ(read.mtime, 1700000000);
+    EXPECT_TRUE(read.syncable);
+    EXPECT_TRUE(read.crcStale);
+
+    // settled files don't carry the flag
+    record.crcStale = false;
+    data.clear();
+    record.serialize(&data);
+    ASSERT_TRUE(read.unserialize(data));
+    EXPECT_FALSE(read.crcStale);
+}
+
+TEST(LocalNodeCacheRecord, ReadsRecordsWithoutStaleCrcFlag)
+{
+    const std::array<int32_t, 4> crc{{5, 6, 7, 8}};
+
+    // as written before the stale CRC flag existed: two expansion flags in use
+    std::string data;
+    mega::CacheableWriter w(data);
+    w.serializei64(2048);
+    w.serializehandle(9);
+    w.serializeu32(4);
+    w.serializenodehandle(0x0000cba987654321);
+    w.serializestring("old.txt");
+    w.serializebinary((mega::byte*)crc.data(), sizeof(crc));
+    w.serializecompressedi64(1600000000);
+    w.serializebyte(1);
+    w.serializeexpansionflags(1, 0);
+    w.serializestring("OLD~1.TXT");
+
+    mega::LocalNode::CacheRecord read;
+    ASSERT_TRUE(read.unserialize(data));
+    EXPECT_EQ(read.type, mega::FILENODE);
+    EXPECT_EQ(read.size, 2048);
+    EXPECT_EQ(read.localname, "old.txt");
+    EXPECT_EQ(read.shortname, "OLD~1.TXT");
+    EXPECT_TRUE(read.shortnameInDb);
+    EXPECT_EQ(read.crc, crc);
+    EXPECT_EQ(read.mtime, 1600000000);
+    EXPECT_FALSE(read.crcStale);
+
+    // the oldest records end at the fingerprint: no syncable byte, no flags
+    data.clear();
+    mega::CacheableWriter v(data);
+    v.serializei64(2048);
+    v.serializehandle(9);
+    v.serializeu32(4);
+    v.serializenodehandle(0x0000cba987654321);
+    v.serializestring("old.txt");
+    v.serializebinary((mega::byte*)crc.data(), sizeof(crc));
+    v.serializecompressedi64(1600000000);
+
+    mega::LocalNode::CacheRecord oldest;
+    ASSERT_TRUE(oldest.unserialize(data));
+    EXPECT_EQ(oldest.crc, crc);
+    EXPECT_FALSE(oldest.shortnameInDb);
+    EXPECT_FALSE(oldest.crcStale);
+}
+
+#ifndef _WIN32
+
+TEST(SyncExclusionMatcher, MatchesNamesAndPaths)
+{
+    using mega::LocalPath;
+    using mega::SyncExclusionMatcher;
+
+    SyncExclusionMatcher matcher({"*.tmp", "build*", ".git", "a?c"},
+                                 {"/sync/skip", "/sync/docs/*.bak", "/sync/\xc3\x84rger"});
+
+    auto root = LocalPath::fromAbsolutePath("/sync");
+    auto excluded = [&](const char* path) {
+        return matcher.excluded(root, LocalPath::fromAbsolutePath(path));
+    };
+
+    EXPECT_FALSE(excluded("/sync/file.txt"));
+    EXPECT_TRUE(excluded("/sync/file.tmp"));
+    EXPECT_TRUE(excluded("/sync/buildout"));
+    EXPECT_TRUE(excluded("/sync/.git"));
+    EXPECT_TRUE(excluded("/sync/abc"));
+    EXPECT_FALSE(excluded("/sync/abbc"));
+    EXPECT_TRUE(excluded("/sync/Icon\x0d"));
+
+    // excluded folders exclude their contents, names and paths alike
+    EXPECT_TRUE(excluded("/sync/.git/objects/file.txt"));
+    EXPECT_TRUE(excluded("/sync/skip"));
+    EXPECT_TRUE(excluded("/sync/skip/deeper/file.txt"));
+    EXPECT_FALSE(excluded("/sync/skipped/file.txt"));
+
+    // path rules match exactly here, non-ASCII names included
+    EXPECT_TRUE(excluded("/sync/\xc3\x84rger/file.txt"));
+    EXPECT_FALSE(excluded("/sync/\xc3\xa4rger/file.txt"));
+    EXPECT_FALSE(excluded("/sync/Skip"));
+
+    // path wildcards match the whole path
+    EXPECT_TRUE(excluded("/sync/docs/old.bak"));
+    EXPECT_FALSE(excluded("/sync/docs/old.txt"));
+
+    // entries of the same folder reuse its result; a new folder is evaluated again
+    EXPECT_FALSE(excluded("/sync/docs/new.txt"));
+    EXPECT_TRUE(excluded("/sync/x.tmp/file.txt"));
+    EXPECT_FALSE(excluded("/sync/docs/new.txt"));
+
+    // the sync root's own name is not subject to name rules
+    auto tmproot = LocalPath::fromAbsolutePath("/root.tmp");
+    EXPECT_FALSE(matcher.excluded(tmproot, LocalPath::fromAbsolutePath("/root.tmp/file.txt")));
+    EXPECT_FALSE(matcher.excluded(tmproot, tmproot));
+
+    // rules containing the root exclude the whole sync
+    auto skiproot = LocalPath::fromAbsolutePath("/sync/skip/inner");
+    EXPECT_TRUE(matcher.excluded(skiproot, LocalPath::fromAbsolutePath("/sync/skip/inner/file.txt")));
+}
+
+#endif
+
 #endif
 
@@ -16,11 +16,16 @@
  * program.
  */
 
+#include <chrono>
+#include <thread>
+
 #include <gtest/gtest.h>
 
+#include <mega/file.h>
 #include <mega/megaclient.h>
 #include <mega/megaapp.h>
 #include <mega/transfer.h>
+#include <mega/transferslot.h>
 
 #include "DefaultedFileSystemAccess.h"
 #include "utils.h"
@@ -87,3 +92,572 @@ TEST(Transfer, serialize_unserialize)
 }
 
 
+
+TEST(TransferSlotTuner, growsWhileThroughputImprovesAndBacksOffOtherwise)
+{
+    using mega::TransferSlotTuner;
+    const mega::dstime period = TransferSlotTuner::EVALUATION_PERIOD_DS;
+    const m_off_t maxRequestSize = 16 * 1024 * 1024;
+
+    TransferSlotTuner tuner;
+    ASSERT_FALSE(tuner.enabled());
+
+    mega::dstime now = 1000;
+    tuner.start(6, maxRequestSize, true, now);
+    ASSERT_TRUE(tuner.enabled());
+    ASSERT_EQ(tuner.activeConnections(), 3u);
+    ASSERT_EQ(tuner.requestSize(), maxRequestSize / 2);
+
+    // nothing happens before a full evaluation period has elapsed
+    ASSERT_FALSE(tuner.evaluate(1000000, now + period - 1));
+
+    // first evaluation probes with one more connection
+    now += period;
+    ASSERT_TRUE(tuner.evaluate(1000000, now));
+    ASSERT_EQ(tuner.activeConnections(), 4u);
+
+    // it paid off: keep adding
+    now += period;
+    ASSERT_TRUE(tuner.evaluate(1500000, now));
+    ASSERT_EQ(tuner.activeConnections(), 5u);
+
+    // no gain: the last connection is given back and the tuner holds
+    now += period;
+    ASSERT_TRUE(tuner.evaluate(1520000, now));
+    ASSERT_EQ(tuner.activeConnections(), 4u);
+
+    for (unsigned i = 0; i < TransferSlotTuner::HOLD_EVALUATIONS; ++i)
+    {
+        now += period;
+        ASSERT_FALSE(tuner.evaluate(1500000, now));
+    }
+
+    // the next probe tries the other dimension
+    now += period;
+    ASSERT_TRUE(tuner.evaluate(1500000, now));
+    ASSERT_EQ(tuner.requestSize(), maxRequestSize);
+    ASSERT_EQ(tuner.activeConnections(), 4u);
+
+    // which made it worse: undone
+    now += period;
+    ASSERT_TRUE(tuner.evaluate(1000000, now));
+    ASSERT_EQ(tuner.requestSize(), maxRequestSize / 2);
+
+    const TransferSlotTuner::Stats& stats = tuner.stats();
+    ASSERT_EQ(stats.evaluations, 5u + TransferSlotTuner::HOLD_EVALUATIONS);
+    ASSERT_EQ(stats.connectionIncreases, 2u);
+    ASSERT_EQ(stats.connectionDecreases, 1u);
+    ASSERT_EQ(stats.requestSizeIncreases, 1u);
+    ASSERT_EQ(stats.requestSizeDecreases, 1u);
+}
+
+TEST(TransferSlotTuner, staysWithinBounds)
+{
+    using mega::TransferSlotTuner;
+    const mega::dstime period = TransferSlotTuner::EVALUATION_PERIOD_DS;
+
+    // uploads don't tune the request size
+    TransferSlotTuner tuner;
+    mega::dstime now = 0;
+    tuner.start(2, 8 * 1024 * 1024, false, now);
+    ASSERT_EQ(tuner.activeConnections(), 1u);
+
+    m_off_t speed = 100000;
+    for (int i = 0; i < 20; ++i)
+    {
+        now += period;
+        tuner.evaluate(speed, now);
+        speed *= 2;
+        ASSERT_GE(tuner.activeConnections(), 1u);
+        ASSERT_LE(tuner.activeConnections(), 2u);
+        ASSERT_EQ(tuner.requestSize(), 8 * 1024 * 1024);
+    }
+}
+
+TEST(TransferScheduler, sharesByWeightAndPriorityClass)
+{
+    using mega::Transfer;
+    using mega::TransferScheduler;
+
+    mega::MegaApp app;
+    auto client = mt::makeClient(app);
+
+    std::vector<std::unique_ptr<Transfer>> transfers;
+    std::map<Transfer*, TransferScheduler::GroupId> groupOf;
+    const m_off_t large = 1024 * 1024;
+    const m_off_t small = 1024;
+
+    // transfers are added in list order, as nexttransfers() would find them
+    auto addReady = [&](TransferScheduler::ReadyMap& ready, TransferScheduler::GroupId group, size_t count, m_off_t size)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            transfers.emplace_back(new Transfer(client.get(), mega::GET));
+            transfers.back()->size = size;
+            transfers.back()->priority = transfers.size();
+            groupOf[transfers.back().get()] = group;
+            ready[group].add(transfers.back().get());
+        }
+    };
+
+    auto makeReady = [&](std::map<TransferScheduler::GroupId, size_t> counts)
+    {
+        TransferScheduler::ReadyMap ready;
+        for (auto& c : counts)
+        {
+            addReady(ready, c.first, c.second, large);
+        }
+        return ready;
+    };
+
+    auto dispatch = [&](TransferScheduler& scheduler, TransferScheduler::ReadyMap ready, size_t slots,
+                        std::function<bool(Transfer*)> acceptable = nullptr)
+    {
+        std::map<TransferScheduler::GroupId, size_t> chosen;
+        scheduler.choose(ready,
+                         [&](Transfer* t)
+                         {
+                             if (acceptable && !acceptable(t)) return false;
+                             ++chosen[groupOf[t]];
+                             return true;
+                         },
+                         [&]() { size_t n = 0; for (auto& c : chosen) n += c.second; return n < slots; });
+        return chosen;
+    };
+
+    // group 2 gets three times the share of group 1
+    TransferScheduler weighted;
+    weighted.setGroup(1, 1);
+    weighted.setGroup(2, 3);
+    ASSERT_TRUE(weighted.hasGroups());
+    auto chosen = dispatch(weighted, makeReady({{1, 20}, {2, 20}}), 8);
+    ASSERT_EQ(chosen[1], 2u);
+    ASSERT_EQ(chosen[2], 6u);
+    ASSERT_EQ(weighted.groupStats()[2].dispatched, 6u);
+    ASSERT_EQ(weighted.groupStats()[2].queued, 14u);
+
+    // a better priority class is served first, whatever the weights
+    TransferScheduler classes;
+    classes.setGroup(1, 10, 1);
+    classes.setGroup(2, 1, 0);
+    chosen = dispatch(classes, makeReady({{1, 5}, {2, 3}}), 6);
+    ASSERT_EQ(chosen[2], 3u);
+    ASSERT_EQ(chosen[1], 3u);
+
+    // a group that was idle doesn't catch up by starving the others
+    TransferScheduler idle;
+    idle.setGroup(1, 1);
+    idle.setGroup(2, 1);
+    dispatch(idle, makeReady({{1, 10}}), 10);
+    chosen = dispatch(idle, makeReady({{1, 10}, {2, 10}}), 4);
+    ASSERT_EQ(chosen[1], 2u);
+    ASSERT_EQ(chosen[2], 2u);
+
+    // groups the app didn't configure are only tracked while they have transfers queued
+    TransferScheduler unconfigured;
+    unconfigured.setGroup(1, 1);
+    dispatch(unconfigured, makeReady({{1, 2}, {7, 4}}), 4);
+    ASSERT_EQ(unconfigured.groupStats().count(7), 1u);
+    ASSERT_EQ(unconfigured.groupStats()[7].queued, 2u);
+    dispatch(unconfigured, makeReady({{7, 2}}), 4);
+    ASSERT_EQ(unconfigured.groupStats().count(7), 0u);
+    dispatch(unconfigured, makeReady({}), 4);
+    ASSERT_EQ(unconfigured.groupStats().size(), 1u);
+
+    // only MAX_READY_PER_GROUP of each size type are gathered, but the whole group is counted
+    const size_t full = TransferScheduler::MAX_READY_PER_GROUP;
+    TransferScheduler counting;
+    counting.setGroup(1, 1);
+    TransferScheduler::ReadyMap ready;
+    addReady(ready, 1, full * 3, large);
+    addReady(ready, 1, full * 2, small);
+    ASSERT_EQ(ready[1].bySize[mega::LARGEFILE].size(), full);
+    ASSERT_EQ(ready[1].bySize[mega::SMALLFILE].size(), full);
+    ASSERT_EQ(ready[1].queued, full * 5);
+    chosen = dispatch(counting, ready, 4);
+    ASSERT_EQ(chosen[1], 4u);
+    ASSERT_EQ(counting.groupStats()[1].queued, full * 5 - 4);
+    ASSERT_EQ(counting.groupStats()[1].queuedBytes, m_off_t(full * 3 - 4) * large + m_off_t(full * 2) * small);
+
+    // a full size type doesn't keep a group's transfers of the other type from being considered
+    TransferScheduler mixed;
+    mixed.setGroup(1, 1);
+    ready.clear();
+    addReady(ready, 1, full * 2, large);
+    addReady(ready, 1, 3, small);
+    std::vector<Transfer*> accepted;
+    dispatch(mixed, ready, 8, [&](Transfer* t)
+    {
+        if (t->size == large) return false;
+        accepted.push_back(t);
+        return true;
+    });
+    ASSERT_EQ(accepted.size(), 3u);
+    ASSERT_EQ(mixed.groupStats()[1].dispatched, 3u);
+
+    // within a group, the two size types are taken in list order
+    TransferScheduler ordered;
+    ordered.setGroup(1, 1);
+    ready.clear();
+    addReady(ready, 1, 1, small);
+    addReady(ready, 1, 1, large);
+    addReady(ready, 1, 1, small);
+    accepted.clear();
+    dispatch(ordered, ready, 3, [&](Transfer* t) { accepted.push_back(t); return true; });
+    ASSERT_EQ(accepted.size(), 3u);
+    ASSERT_EQ(accepted[0]->size, small);
+    ASSERT_EQ(accepted[1]->size, large);
+    ASSERT_EQ(accepted[2]->size, small);
+}
+
+#ifdef LIBCURL_VERSION_NUM
+TEST(CurlHttpIO, http2MultiplexingToggle)
+{
+    struct TestHttpIO : mega::CurlHttpIO
+    {
+        using mega::CurlHttpIO::http2configured;
+        using mega::CurlHttpIO::http2;
+        using mega::CurlHttpIO::http2MaxStreams;
+        using mega::CurlHttpIO::connectionStats;
+        using mega::CurlHttpIO::updateconnectionstats;
+    };
+
+    TestHttpIO httpio;
+    ASSERT_FALSE(httpio.http2configured);
+
+    bool supported = (curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2) != 0;
+    ASSERT_EQ(httpio.sethttp2(true, 0), supported && LIBCURL_VERSION_NUM >= 0x073200);
+    if (!httpio.http2configured)
+    {
+        // without HTTP/2 in cURL, enabling fails and the defaults stay untouched
+        ASSERT_FALSE(httpio.http2);
+        return;
+    }
+    ASSERT_TRUE(httpio.http2);
+    ASSERT_EQ(httpio.http2MaxStreams, 1);
+
+    // the settings survive the multi handles being rebuilt
+    httpio.sethttp2(false, 10);
+    httpio.disconnect();
+    ASSERT_TRUE(httpio.http2configured);
+    ASSERT_FALSE(httpio.http2);
+    ASSERT_EQ(httpio.http2MaxStreams, 10);
+
+    // HTTP/2 errors in a row turn it off, but not errors interleaved with successes
+    ASSERT_TRUE(httpio.sethttp2(true, 10));
+    CURL* curl = curl_easy_init();
+    httpio.updateconnectionstats(curl, CURLE_HTTP2_STREAM);
+    httpio.updateconnectionstats(curl, CURLE_HTTP2_STREAM);
+    httpio.updateconnectionstats(curl, CURLE_OK);
+    httpio.updateconnectionstats(curl, CURLE_HTTP2);
+    httpio.updateconnectionstats(curl, CURLE_HTTP2_STREAM);
+    ASSERT_TRUE(httpio.http2);
+    httpio.updateconnectionstats(curl, CURLE_HTTP2_STREAM);
+    ASSERT_FALSE(httpio.http2);
+    ASSERT_EQ(httpio.connectionStats.http2Errors, 5u);
+    ASSERT_EQ(httpio.connectionStats.requests, 6u);
+    curl_easy_cleanup(curl);
+}
+#endif
+
+TEST(TransferBufferPool, alignsReusesAndCaps)
+{
+    using mega::TransferBufferPool;
+
+    // size classes cover the request and waste at most 1/8
+    ASSERT_EQ(TransferBufferPool::classSize(1), TransferBufferPool::MIN_POOLED_SIZE);
+    for (size_t size : { size_t(100000), size_t(1 << 20), size_t((1 << 20) + 1), size_t(5000000) })
+    {
+        size_t c = TransferBufferPool::classSize(size);
+        ASSERT_GE(c, size);
+        ASSERT_LE(c - size, size / 8);
+        ASSERT_EQ(c % TransferBufferPool::ALIGNMENT, 0u);
+    }
+
+    TransferBufferPool pool;
+    mega::byte* a = pool.acquire(1000000);
+    ASSERT_EQ(reinterpret_cast<uintptr_t>(a) % TransferBufferPool::ALIGNMENT, 0u);
+    ASSERT_EQ(pool.stats().inUseBytes, TransferBufferPool::classSize(1000000));
+
+    // a buffer of the same class is handed out again
+    pool.release(a, 1000000);
+    ASSERT_EQ(pool.stats().inUseBytes, 0u);
+    mega::byte* b = pool.acquire(999999);
+    ASSERT_EQ(a, b);
+    ASSERT_EQ(pool.stats().reuses, 1u);
+    ASSERT_EQ(pool.stats().allocations, 1u);
+
+    // the cap only signals, allocations still succeed
+    ASSERT_FALSE(pool.overLimit());
+    pool.setLimit(2 * TransferBufferPool::classSize(1000000));
+    mega::byte* c = pool.acquire(1000000);
+    ASSERT_TRUE(pool.overLimit());
+    pool.release(c, 1000000);
+    ASSERT_FALSE(pool.overLimit());
+
+    // lowering the cap frees idle buffers
+    pool.release(b, 999999);
+    pool.setLimit(TransferBufferPool::classSize(1000000));
+    ASSERT_EQ(pool.stats().idleBytes, TransferBufferPool::classSize(1000000));
+    pool.setLimit(TransferBufferPool::MIN_POOLED_SIZE);
+    ASSERT_EQ(pool.stats().idleBytes, 0u);
+}
+
+TEST(TransferBufferPool, wakesWaitersWhenBuffersAreReleased)
+{
+    using mega::TransferBufferPool;
+
+    struct CountingWaiter : mega::Waiter
+    {
+        int notified = 0;
+        int wait() override { return 0; }
+        void notify() override { ++notified; }
+    };
+
+    TransferBufferPool pool;
+    pool.setLimit(TransferBufferPool::classSize(1000000));
+    mega::byte* a = pool.acquire(1000000);
+    ASSERT_TRUE(pool.overLimit());
+
+    auto waiter = std::make_shared<CountingWaiter>();
+    pool.notifyWhenAvailable(waiter);
+    pool.notifyWhenAvailable(waiter);
+    ASSERT_EQ(waiter->notified, 0);
+
+    // one wakeup for the release that gets under the cap, then it has to register again
+    pool.release(a, 1000000);
+    ASSERT_EQ(waiter->notified, 1);
+    a = pool.acquire(1000000);
+    pool.release(a, 1000000);
+    ASSERT_EQ(waiter->notified, 1);
+
+    // registering when there is room already wakes it right away
+    pool.notifyWhenAvailable(waiter);
+    ASSERT_EQ(waiter->notified, 2);
+
+    // so does lifting the cap, and clients gone meanwhile are skipped
+    a = pool.acquire(1000000);
+    pool.notifyWhenAvailable(waiter);
+    {
+        auto gone = std::make_shared<CountingWaiter>();
+        pool.notifyWhenAvailable(gone);
+    }
+    pool.setLimit(0);
+    ASSERT_EQ(waiter->notified, 3);
+    pool.release(a, 1000000);
+}
+
+namespace
+{
+
+class LocalCopyDownloadTest
+    : public ::testing::Test
+{
+public:
+    // a public file download into the test directory, downloading to a temporary file first
+    struct DownloadFile : mega::File
+    {
+        mega::LocalPath temporary;
+        bool done = false;
+
+        void prepare(mega::FileSystemAccess&) override
+        {
+            transfer->localfilename = temporary;
+        }
+
+        void completed(mega::Transfer*, mega::putsource_t) override
+        {
+            done = true;
+        }
+    };
+
+    mega::LocalPath path(const std::string& name) const
+    {
+        auto p = mRoot;
+        p.appendWithSeparator(mega::LocalPath::fromRelativePath(name), false);
+        return p;
+    }
+
+    bool write(const mega::LocalPath& p, const std::string& content)
+    {
+        auto fa = mFsAccess.newfileaccess(false);
+        return fa->fopen(p, false, true, mega::FSLogging::logOnError)
+               && fa->fwrite(reinterpret_cast<const mega::byte*>(content.data()), static_cast<unsigned>(content.size()), 0);
+    }
+
+    // set up file as a download of the content in source, keyed with a fresh key
+    void describe(DownloadFile& file, const mega::LocalPath& source)
+    {
+        using namespace mega;
+
+        std::array<byte, SymmCipher::KEYLENGTH> transferkey;
+        for (auto& b : transferkey) b = mt::nextRandomByte();
+        int64_t ctriv = 0x0123456789abcdefLL;
+
+        auto fa = mFsAccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(source, true, false, FSLogging::logOnError));
+        file.genfingerprint(fa.get());
+        ASSERT_TRUE(file.isvalid);
+
+        SymmCipher cipher;
+        cipher.setkey(transferkey.data());
+        auto metamac = generateMetaMac(cipher, *fa, ctriv);
+        ASSERT_TRUE(metamac.first);
+
+        // the node key layout that dispatchTransfers() takes apart again
+        byte* k = file.filekey;
+        MemAccess::set<int64_t>(k + SymmCipher::KEYLENGTH, ctriv);
+        MemAccess::set<int64_t>(k + SymmCipher::KEYLENGTH + sizeof(int64_t), metamac.second);
+        for (unsigned i = 0; i < SymmCipher::KEYLENGTH; i++)
+        {
+            k[i] = static_cast<byte>(transferkey[i] ^ k[SymmCipher::KEYLENGTH + i]);
+        }
+
+        file.hprivate = false;
+        file.name = "target";
+        file.temporary = path("download.tmp");
+    }
+
+    // what exec() does with the active slots
+    void runSlots(mega::MegaClient& client)
+    {
+        mega::TransferDbCommitter committer(client.tctable);
+        for (auto it = client.tslots.begin(); it != client.tslots.end(); )
+        {
+            mega::TransferSlot* ts = *it++;
+            if (!ts->retrying || ts->retrybt.armed())
+            {
+                ts->doio(&client, committer);
+            }
+        }
+    }
+
+    void SetUp() override
+    {
+        ASSERT_TRUE(mFsAccess.cwd(mRoot));
+        mRoot.appendWithSeparator(mega::LocalPath::fromRelativePath("localcopy"), false);
+
+        mFsAccess.emptydirlocal(mRoot);
+        mFsAccess.rmdirlocal(mRoot);
+        ASSERT_TRUE(mFsAccess.mkdirlocal(mRoot, false, true));
+    }
+
+    void TearDown() override
+    {
+        mFsAccess.emptydirlocal(mRoot);
+        mFsAccess.rmdirlocal(mRoot);
+    }
+
+    mega::FSACCESS_CLASS mFsAccess;
+    mega::LocalPath mRoot;
+}; // LocalCopyDownloadTest
+
+} // anonymous
+
+TEST_F(LocalCopyDownloadTest, completesThroughItsSlotAndRetriesCompletion)
+{
+    using namespace mega;
+
+    MegaApp app;
+    auto client = mt::makeClient(app);
+    client->localcopydownloads = true;
+
+    std::string content(300000, '\0');
+    for (auto& c : content) c = static_cast<char>(mt::nextRandomByte());
+
+    auto source = path("source");
+    ASSERT_TRUE(write(source, content));
+
+    // the target's folder is missing at first, so completing has to be retried
+    auto folder = path("folder");
+    auto target = folder;
+    target.appendWithSeparator(LocalPath::fromRelativePath("target"), false);
+
+    DownloadFile file;
+    ASSERT_NO_FATAL_FAILURE(describe(file, source));
+    file.setLocalname(target);
+    client->localcontentindex.add(file, source);
+
+    {
+        TransferDbCommitter committer(client->tctable);
+        error cause = API_OK;
+        ASSERT_TRUE(client->startxfer(GET, &file, committer, false, false, true, NoVersioning, &cause, 0));
+    }
+
+    client->dispatchTransfers();
+    ASSERT_TRUE(file.transfer);
+    ASSERT_TRUE(file.transfer->slot);
+    ASSERT_EQ(client->tslots.size(), 1u);
+
+    runSlots(*client);
+    ASSERT_FALSE(file.done);
+    ASSERT_TRUE(file.transfer);
+    ASSERT_TRUE(file.transfer->slot);
+    ASSERT_TRUE(file.transfer->slot->retrying);
+    ASSERT_EQ(client->tslots.size(), 1u);
+
+    ASSERT_TRUE(mFsAccess.mkdirlocal(folder, false, true));
+
+    // the retry backoff is about a second
+    for (int i = 0; i < 100 && !file.done; i++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        Waiter::bumpds();
+        runSlots(*client);
+    }
+
+    ASSERT_TRUE(file.done);
+    ASSERT_FALSE(file.transfer);
+    ASSERT_TRUE(client->tslots.empty());
+
+    std::string copied(content.size(), '\0');
+    auto fa = mFsAccess.newfileaccess(false);
+    ASSERT_TRUE(fa->fopen(target, true, false, FSLogging::logOnError));
+    ASSERT_EQ(fa->size, static_cast<m_off_t>(content.size()));
+    ASSERT_TRUE(fa->frawread(reinterpret_cast<byte*>(&copied[0]), static_cast<unsigned>(copied.size()), 0, true, FSLogging::logOnError));
+    ASSERT_TRUE(copied == content);
+}
+
+TEST_F(LocalCopyDownloadTest, queuesTheDownloadWhenNoCopyVerifies)
+{
+    using namespace mega;
+
+    MegaApp app;
+    auto client = mt::makeClient(app);
+    client->localcopydownloads = true;
+
+    std::string content(100000, 'a');
+    auto source = path("source");
+    ASSERT_TRUE(write(source, content));
+
+    DownloadFile file;
+    ASSERT_NO_FATAL_FAILURE(describe(file, source));
+    file.setLocalname(path("target"));
+
+    // same size, different content: its MAC can't match
+    auto stale = path("stale");
+    ASSERT_TRUE(write(stale, std::string(content.size(), 'b')));
+    client->localcontentindex.add(file, stale);
+
+    {
+        TransferDbCommitter committer(client->tctable);
+        error cause = API_OK;
+        ASSERT_TRUE(client->startxfer(GET, &file, committer, false, false, true, NoVersioning, &cause, 0));
+    }
+
+    client->dispatchTransfers();
+    ASSERT_EQ(client->tslots.size(), 1u);
+
+    runSlots(*client);
+
+    // back in the queue without a slot, to be fetched, and the stale entry is gone
+    ASSERT_FALSE(file.done);
+    ASSERT_TRUE(file.transfer);
+    ASSERT_FALSE(file.transfer->slot);
+    ASSERT_EQ(file.transfer->state, TRANSFERSTATE_QUEUED);
+    ASSERT_TRUE(client->tslots.empty());
+    ASSERT_TRUE(client->localcontentindex.find(file).empty());
+
+    auto fa = mFsAccess.newfileaccess(false);
+    ASSERT_FALSE(fa->fopen(file.temporary, true, false, FSLogging::logExceptFileNotFound));
+}
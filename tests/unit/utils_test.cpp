@@ -17,19 +17,26 @@
  */
 
 #include <array>
+#include <thread>
 #include <tuple>
 
 #include <gtest/gtest.h>
 
 #include <mega/base64.h>
 #include <mega/filesystem.h>
+#include <mega/backofftimer.h>
+#include <mega/metrics.h>
 #include <mega/utils.h>
 #include "megafs.h"
+#include "megawaiter.h"
 
 #include <mega/db.h>
 #include <mega/db/sqlite.h>
 #include <mega/json.h>
+#include <mega/megaapp.h>
+#include <mega/megaclient.h>
 #include "../integration/process.h"
+#include "utils.h"
 
 TEST(utils, hashCombine_integer)
 {
@@ -565,6 +572,125 @@ TEST(Filesystem, isContainingPathOf)
 #undef SEP
 }
 
+class CopyLocalTest
+    : public ::testing::Test
+{
+public:
+    void SetUp() override
+    {
+        // Retrieve the current working directory.
+        ASSERT_TRUE(mFsAccess.cwd(mPrefixPath));
+
+        // Compute absolute path to "container" directory.
+        mPrefixPath.appendWithSeparator(LocalPath::fromRelativePath("copylocal"), false);
+
+        // Remove container directory.
+        mFsAccess.emptydirlocal(mPrefixPath);
+        mFsAccess.rmdirlocal(mPrefixPath);
+
+        // Create container directory.
+        ASSERT_TRUE(mFsAccess.mkdirlocal(mPrefixPath, false, true));
+    }
+
+    void TearDown() override
+    {
+        // Destroy container directory.
+        mFsAccess.emptydirlocal(mPrefixPath);
+        mFsAccess.rmdirlocal(mPrefixPath);
+    }
+
+    LocalPath Append(const string& name) const
+    {
+        LocalPath path = mPrefixPath;
+        path.appendWithSeparator(LocalPath::fromRelativePath(name), false);
+        return path;
+    }
+
+    FSACCESS_CLASS mFsAccess;
+    LocalPath mPrefixPath;
+}; // CopyLocalTest
+
+TEST_F(CopyLocalTest, ReportsMethod)
+{
+    LocalPath source = Append("source");
+    LocalPath target = Append("target");
+
+    // not a multiple of any block size, for the paths that need aligned transfers
+    string content(3 * 1024 * 1024 + 17, '\0');
+    for (size_t i = 0; i < content.size(); i++)
+    {
+        content[i] = static_cast<char>(i * 31 + (i >> 12));
+    }
+
+    {
+        auto fa = mFsAccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(source, false, true, FSLogging::logOnError));
+        ASSERT_TRUE(fa->fwrite(reinterpret_cast<const byte*>(content.data()), static_cast<unsigned>(content.size()), 0));
+    }
+
+    ASSERT_TRUE(mFsAccess.copylocal(source, target, 1600000000));
+    EXPECT_NE(mFsAccess.last_copy_method, FileSystemAccess::COPY_NONE);
+
+    string copied(content.size(), '\0');
+    {
+        auto fa = mFsAccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(target, true, false, FSLogging::logOnError));
+        ASSERT_EQ(fa->size, static_cast<m_off_t>(content.size()));
+        ASSERT_TRUE(fa->frawread(reinterpret_cast<byte*>(&copied[0]), static_cast<unsigned>(copied.size()), 0, true, FSLogging::logOnError));
+    }
+    EXPECT_TRUE(copied == content);
+
+    // a failed copy doesn't report the method of the previous one
+    ASSERT_FALSE(mFsAccess.copylocal(Append("missing"), target, 0));
+    EXPECT_EQ(mFsAccess.last_copy_method, FileSystemAccess::COPY_NONE);
+}
+
+using ReadPatternTest = CopyLocalTest;
+
+TEST_F(ReadPatternTest, KeptAcrossReopensAndFingerprints)
+{
+    LocalPath path = Append("file");
+
+    string content(1024 * 1024 + 5, '\0');
+    for (size_t i = 0; i < content.size(); i++)
+    {
+        content[i] = static_cast<char>(i * 7 + (i >> 10));
+    }
+
+    {
+        auto fa = mFsAccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(path, false, true, FSLogging::logOnError));
+        ASSERT_TRUE(fa->fwrite(reinterpret_cast<const byte*>(content.data()), static_cast<unsigned>(content.size()), 0));
+    }
+
+    FileFingerprint expected;
+    {
+        auto fa = mFsAccess.newfileaccess(false);
+        ASSERT_TRUE(fa->fopen(path, FSLogging::logOnError));
+        EXPECT_EQ(fa->readpattern(), FileAccess::READ_NORMAL);
+        expected.genfingerprint(fa.get());
+    }
+
+    // nonblocking mode, as uploads open their files: the pattern applies when a read opens it
+    auto fa = mFsAccess.newfileaccess(false);
+    ASSERT_TRUE(fa->fopen(path, FSLogging::logOnError));
+    fa->setreadpattern(FileAccess::READ_SEQUENTIAL);
+
+    string chunk;
+    ASSERT_TRUE(fa->fread(&chunk, 4096, 0, 4096, FSLogging::logOnError));
+    EXPECT_EQ(chunk, content.substr(4096, 4096));
+
+    // the sparse sampling of a large file reads randomly, then leaves the caller's pattern
+    FileFingerprint fp;
+    fp.genfingerprint(fa.get());
+    EXPECT_TRUE(fp.isvalid);
+    EXPECT_EQ(fp.crc, expected.crc);
+    EXPECT_EQ(fa->readpattern(), FileAccess::READ_SEQUENTIAL);
+
+    ASSERT_TRUE(fa->fread(&chunk, 4096, 0, content.size() - 4096, FSLogging::logOnError));
+    EXPECT_EQ(chunk, content.substr(content.size() - 4096));
+}
+
 class SqliteDBTest
   : public ::testing::Test
 {
@@ -703,6 +829,387 @@ TEST_F(SqliteDBTest, RootPath)
     EXPECT_EQ(dbAccess.rootPath(), rootPath);
 }
 
+TEST_F(SqliteDBTest, TransactionChanges)
+{
+    SqliteDbAccess dbAccess(rootPath);
+    DbTablePtr dbTable(dbAccess.openTableWithNodes(rng, fsAccess, name, 0, nullptr));
+    ASSERT_TRUE(!!dbTable);
+
+    dbTable->begin();
+    EXPECT_EQ(dbTable->transactionChanges(), 0u);
+
+    string data = "data";
+    ASSERT_TRUE(dbTable->put(1 * DbTable::IDSPACING, &data));
+    ASSERT_TRUE(dbTable->put(2 * DbTable::IDSPACING, &data));
+    ASSERT_TRUE(dbTable->put(1 * DbTable::IDSPACING, &data));
+    ASSERT_TRUE(dbTable->del(2 * DbTable::IDSPACING));
+    EXPECT_EQ(dbTable->transactionChanges(), 4u);
+
+    // counted from the start of each transaction
+    dbTable->commit();
+    dbTable->begin();
+    EXPECT_EQ(dbTable->transactionChanges(), 0u);
+    ASSERT_TRUE(dbTable->del(1 * DbTable::IDSPACING));
+    EXPECT_EQ(dbTable->transactionChanges(), 1u);
+    dbTable->commit();
+}
+
+class ScsnCommitGroupTest
+  : public SqliteDBTest
+{
+public:
+    ScsnCommitGroupTest()
+      : dbAccess(rootPath)
+      , client(mt::makeClient(app))
+    {
+        client->sctable.reset(dbAccess.openTableWithNodes(rng, fsAccess, name, 0, nullptr));
+        if (client->sctable)
+        {
+            client->sctable->begin();
+        }
+
+        client->sccommitgroupds = 50;
+        client->sccommitgrouprows = 0;
+        Waiter::ds = 1000;
+    }
+
+    // the actionpackets of one scsn change `rows` statecache rows
+    void applyScsn(unsigned rows)
+    {
+        string data = "data";
+        for (unsigned i = 0; i < rows; ++i)
+        {
+            ASSERT_TRUE(client->sctable->put(++lastId * DbTable::IDSPACING, &data));
+        }
+        client->scsncommit();
+    }
+
+    // uncommitted rows
+    uint64_t pending() const
+    {
+        return client->sctable->transactionChanges();
+    }
+
+    MegaApp app;
+    SqliteDbAccess dbAccess;
+    std::shared_ptr<MegaClient> client;
+    uint32_t lastId = 0;
+}; // ScsnCommitGroupTest
+
+TEST_F(ScsnCommitGroupTest, HeldBackWithinWindow)
+{
+    ASSERT_TRUE(client->sctable);
+
+    applyScsn(1);
+    EXPECT_TRUE(client->pendingsccommit);
+    EXPECT_EQ(pending(), 1u);
+
+    Waiter::ds += 49;
+    applyScsn(2);
+    EXPECT_TRUE(client->pendingsccommit);
+    EXPECT_EQ(client->sccommitgroupscsns, 2u);
+    EXPECT_EQ(pending(), 3u);
+
+    // exec() leaves them alone until the window closes
+    client->commitscgroup();
+    EXPECT_TRUE(client->pendingsccommit);
+    EXPECT_EQ(pending(), 3u);
+}
+
+TEST_F(ScsnCommitGroupTest, CommittedWhenWindowClosesWithoutMoreActionpackets)
+{
+    ASSERT_TRUE(client->sctable);
+
+    applyScsn(1);
+    Waiter::ds += 10;
+    applyScsn(1);
+    ASSERT_TRUE(client->pendingsccommit);
+
+    // measured from the first scsn of the group, not the last
+    Waiter::ds += 40;
+    client->commitscgroup();
+    EXPECT_FALSE(client->pendingsccommit);
+    EXPECT_EQ(client->sccommitgroupscsns, 0u);
+    EXPECT_EQ(pending(), 0u);
+
+    // and the next scsn opens a new window
+    applyScsn(1);
+    EXPECT_TRUE(client->pendingsccommit);
+    EXPECT_EQ(client->sccommitgroupstart, Waiter::ds);
+}
+
+TEST_F(ScsnCommitGroupTest, CommittedByScsnArrivingAfterWindow)
+{
+    ASSERT_TRUE(client->sctable);
+
+    applyScsn(1);
+    ASSERT_TRUE(client->pendingsccommit);
+
+    Waiter::ds += 50;
+    applyScsn(1);
+    EXPECT_FALSE(client->pendingsccommit);
+    EXPECT_EQ(pending(), 0u);
+}
+
+TEST_F(ScsnCommitGroupTest, CommittedEarlyAtRowLimit)
+{
+    ASSERT_TRUE(client->sctable);
+    client->sccommitgrouprows = 5;
+
+    applyScsn(2);
+    EXPECT_TRUE(client->pendingsccommit);
+    EXPECT_EQ(pending(), 2u);
+
+    // well inside the window, but the group now changed 5 rows
+    Waiter::ds += 1;
+    applyScsn(3);
+    EXPECT_FALSE(client->pendingsccommit);
+    EXPECT_EQ(client->sccommitgroupscsns, 0u);
+    EXPECT_EQ(pending(), 0u);
+}
+
+TEST_F(ScsnCommitGroupTest, EveryScsnCommittedWithoutWindow)
+{
+    ASSERT_TRUE(client->sctable);
+    client->sccommitgroupds = 0;
+
+    applyScsn(1);
+    EXPECT_FALSE(client->pendingsccommit);
+    EXPECT_EQ(pending(), 0u);
+
+    applyScsn(1);
+    EXPECT_FALSE(client->pendingsccommit);
+    EXPECT_EQ(pending(), 0u);
+}
+
+TEST_F(SqliteDBTest, NodeBulkAccessOnEmptyTable)
+{
+    SqliteDbAccess dbAccess(rootPath);
+    DbTablePtr dbTable(dbAccess.openTableWithNodes(rng, fsAccess, name, 0, nullptr));
+    ASSERT_TRUE(!!dbTable);
+
+    auto nodeTable = dynamic_cast<DBTableNodes*>(dbTable.get());
+    ASSERT_TRUE(nodeTable);
+
+    size_t rows = 0;
+    EXPECT_TRUE(nodeTable->getChildrenSizeTypeAndFlags(NodeHandle().set6byte(1), [&rows](const NodeSizeTypeAndFlags&, bool) { ++rows; }));
+    EXPECT_EQ(rows, 0u);
+
+    // counters of nodes not in the table aren't written
+    dbTable->begin();
+    EXPECT_FALSE(nodeTable->updateCounter(NodeHandle().set6byte(1), NodeCounter().serialize()));
+    dbTable->commit();
+}
+
+TEST_F(SqliteDBTest, NodeCountersMatchRecursiveCount)
+{
+    MegaApp app;
+    SqliteDbAccess dbAccess(rootPath);
+    auto client = mt::makeClient(app);
+    client->sctable.reset(dbAccess.openTableWithNodes(rng, fsAccess, name, 0, nullptr));
+    auto nodeTable = dynamic_cast<DBTableNodes*>(client->sctable.get());
+    ASSERT_TRUE(nodeTable);
+    client->mNodeManager.setTable(nodeTable);
+
+    struct TreeNode
+    {
+        handle h;
+        handle parent;
+        nodetype_t type;
+        m_off_t size;
+    };
+
+    // nested folders, a file with two older versions, and a rubbish bin with content
+    std::vector<TreeNode> tree = {
+        { 1, UNDEF, ROOTNODE, -1 },
+        { 2, UNDEF, VAULTNODE, -1 },
+        { 3, UNDEF, RUBBISHNODE, -1 },
+        { 10, 1, FOLDERNODE, -1 },
+        { 11, 1, FILENODE, 100 },
+        { 20, 10, FOLDERNODE, -1 },
+        { 21, 10, FILENODE, 200 },
+        { 22, 21, FILENODE, 50 },
+        { 23, 22, FILENODE, 30 },
+        { 30, 20, FILENODE, 400 },
+        { 31, 20, FOLDERNODE, -1 },
+        { 40, 3, FOLDERNODE, -1 },
+        { 41, 40, FILENODE, 1000 },
+        { 42, 41, FILENODE, 7 },
+    };
+
+    auto addNode = [&](const TreeNode& t, bool notify)
+    {
+        NodeHandle parentHandle;
+        if (t.parent != UNDEF)
+        {
+            parentHandle.set6byte(t.parent);
+        }
+
+        auto n = new Node(*client, NodeHandle().set6byte(t.h), parentHandle, t.type, t.size, UNDEF, nullptr, 0);
+        n->setkey(reinterpret_cast<const byte*>(std::string((t.type == FILENODE) ? FILENODEKEYLENGTH : FOLDERNODEKEYLENGTH, 'X').c_str()));
+
+        // as readnodes() does: nodes from fetchnodes below the first level are only written to DB
+        NodeManager::MissingParentNodes missingParentNodes;
+        client->mNodeManager.addNode(n, notify, !notify, missingParentNodes);
+        if (notify)
+        {
+            client->mNodeManager.notifyNode(n);
+        }
+        else
+        {
+            client->mNodeManager.saveNodeInDb(n);
+        }
+    };
+
+    // what the former recursive calculation gives for a subtree
+    std::function<NodeCounter(handle, nodetype_t)> recursiveCount = [&](handle h, nodetype_t parentType)
+    {
+        NodeCounter nc;
+        nodetype_t type = TYPE_UNKNOWN;
+        m_off_t size = 0;
+        for (const TreeNode& t : tree)
+        {
+            if (t.h == h)
+            {
+                type = t.type;
+                size = t.size;
+            }
+        }
+
+        for (const TreeNode& t : tree)
+        {
+            if (t.parent == h)
+            {
+                nc += recursiveCount(t.h, type);
+            }
+        }
+
+        if (type == FILENODE && parentType == FILENODE)
+        {
+            nc.versions++;
+            nc.versionStorage += size;
+        }
+        else if (type == FILENODE)
+        {
+            nc.files++;
+            nc.storage += size;
+        }
+        else if (type == FOLDERNODE)
+        {
+            nc.folders++;
+        }
+        return nc;
+    };
+
+    auto checkCounters = [&]()
+    {
+        for (const TreeNode& t : tree)
+        {
+            nodetype_t parentType = TYPE_UNKNOWN;
+            for (const TreeNode& p : tree)
+            {
+                if (p.h == t.parent)
+                {
+                    parentType = p.type;
+                }
+            }
+            NodeCounter expected = recursiveCount(t.h, parentType);
+
+            NodeSerialized serialized;
+            ASSERT_TRUE(nodeTable->getNode(NodeHandle().set6byte(t.h), serialized)) << t.h;
+            NodeCounter stored(serialized.mNodeCounter);
+            EXPECT_EQ(stored.files, expected.files) << t.h;
+            EXPECT_EQ(stored.folders, expected.folders) << t.h;
+            EXPECT_EQ(stored.versions, expected.versions) << t.h;
+            EXPECT_EQ(stored.storage, expected.storage) << t.h;
+            EXPECT_EQ(stored.versionStorage, expected.versionStorage) << t.h;
+
+            // versions and nodes in the rubbish bin are flagged, whether they have children or not
+            m_off_t size;
+            nodetype_t type;
+            uint64_t flags;
+            ASSERT_TRUE(nodeTable->getNodeSizeTypeAndFlags(NodeHandle().set6byte(t.h), size, type, flags)) << t.h;
+            Node::Flags bits(flags);
+            EXPECT_EQ(bits.test(Node::FLAGS_IS_VERSION), parentType == FILENODE) << t.h;
+            EXPECT_EQ(bits.test(Node::FLAGS_IS_IN_RUBBISH), t.h >= 40) << t.h;
+        }
+    };
+
+    // initial counters, computed walking the children of each node in the table
+    for (const TreeNode& t : tree)
+    {
+        addNode(t, false);
+    }
+    client->mNodeManager.initCompleted();
+    client->mNodeManager.notifyPurge();
+    checkCounters();
+
+    // nodes added later: their ancestors, some only in DB, get just their counter written
+    std::vector<TreeNode> added = {
+        { 50, 31, FILENODE, 64 },
+        { 51, 40, FOLDERNODE, -1 },
+        { 52, 51, FILENODE, 8 },
+    };
+    for (const TreeNode& t : added)
+    {
+        tree.push_back(t);
+        addNode(t, true);
+    }
+    client->mNodeManager.notifyPurge();
+    checkCounters();
+}
+
+TEST_F(SqliteDBTest, NextAllDecrypted)
+{
+    SqliteDbAccess dbAccess(rootPath);
+    DbTablePtr dbTable(dbAccess.openTableWithNodes(rng, fsAccess, name, 0, nullptr));
+    ASSERT_TRUE(!!dbTable);
+
+    SymmCipher key;
+    byte keyBytes[SymmCipher::KEYLENGTH];
+    rng.genblock(keyBytes, sizeof(keyBytes));
+    key.setkey(keyBytes);
+
+    // more than one batch, and a last batch that is not a whole number of jobs
+    const uint32_t numRecords = uint32_t(DbTable::BULK_LOAD_BATCH + DbTable::BULK_LOAD_JOB + 3);
+
+    // record 0 is stored unencrypted
+    string scsn = "scsn0123";
+    ASSERT_TRUE(dbTable->put(0, &scsn));
+
+    for (uint32_t i = 1; i <= numRecords; ++i)
+    {
+        string data = "record " + std::to_string(i);
+        PaddedCBC::encrypt(rng, &data, &key);
+        ASSERT_TRUE(dbTable->put(i * DbTable::IDSPACING + 1, &data));
+    }
+
+    auto waiter = std::make_shared<WAIT_CLASS>();
+    MegaClientAsyncQueue queue(*waiter, 4);
+
+    std::vector<uint32_t> ids;
+    dbTable->rewind();
+    EXPECT_TRUE(dbTable->nextAllDecrypted(queue, &key, [&](uint32_t id, string& data)
+    {
+        EXPECT_EQ(data, id ? "record " + std::to_string(id / DbTable::IDSPACING) : scsn);
+        ids.push_back(id);
+        return true;
+    }));
+
+    ASSERT_EQ(ids.size(), numRecords + 1);
+    EXPECT_TRUE(std::is_sorted(ids.begin(), ids.end()));
+    EXPECT_EQ(dbTable->nextid, numRecords * DbTable::IDSPACING);
+
+    // iteration stops as soon as a record is rejected
+    size_t applied = 0;
+    dbTable->rewind();
+    EXPECT_FALSE(dbTable->nextAllDecrypted(queue, &key, [&](uint32_t, string&)
+    {
+        return ++applied < 10;
+    }));
+    EXPECT_EQ(applied, 10u);
+}
+
 #ifdef WIN32
 #define SEP "\\"
 #else // WIN32
@@ -808,6 +1315,44 @@ TEST(JSON, stripWhitespace)
     ASSERT_EQ(computed, expected);
 }
 
+TEST(JSON, storeobjectSkipsLargeValues)
+{
+    // long enough for the bulk scan, with brackets and quotes inside strings and values split across its windows
+    string element = "{\"h\":\"AbCdEfGh\",\"a\":\"[{\\\"]}\",\"n\":[1,-2.5e10,3E4,{}],\"s\":\"" + string(100, 'x') + "\"}";
+    string array = "[";
+    for (int i = 0; i < 50; i++)
+    {
+        array += (i ? "," : "") + element;
+    }
+    array += "]";
+
+    for (size_t offset = 0; offset < 16; offset++)
+    {
+        string input = string(offset, ' ') + array + ",\"next\":1}";
+
+        JSON json(input);
+        string value;
+        ASSERT_TRUE(json.storeobject(&value));
+        ASSERT_EQ(value, array);
+        ASSERT_EQ(string(json.pos), ",\"next\":1}");
+
+        // same without escapes or exponents, so that only whole windows are skipped
+        input = string(offset, ' ') + "{\"a\":[" + string(300, '1') + "],\"b\":{\"c\":\"" + string(300, ']') + "\"}}x";
+        json.begin(input.c_str());
+        ASSERT_TRUE(json.storeobject());
+        ASSERT_STREQ(json.pos, "x");
+    }
+
+    // unterminated values and characters the parser doesn't accept are still rejected
+    string unterminated = "[\"" + string(200, 'x');
+    JSON json(unterminated);
+    ASSERT_FALSE(json.storeobject());
+
+    string invalid = "[" + string(100, '1') + ",true," + string(100, '2') + "]";
+    json.begin(invalid.c_str());
+    ASSERT_FALSE(json.storeobject());
+}
+
 TEST(Utils, replace_char)
 {
     ASSERT_EQ(Utils::replace(string(""), '*', '@'), "");
@@ -1144,3 +1689,144 @@ TEST_F(SprintfTest, ResizeAndPrint) {
     // sprince = "1.20\0\0\0\..."
     ASSERT_EQ((string)sprice.c_str(), "1.20");
 }
+
+TEST(BackoffTimerGroupTracker, TracksSoonestTimeoutAcrossWheelLevels)
+{
+    using namespace mega;
+
+    dstime savedDs = Waiter::ds;
+    Waiter::ds = 1000;
+
+    PrnGen rng;
+    BackoffTimerGroupTracker tracker;
+
+    // one timer per wheel level, plus one beyond the wheel's range
+    BackoffTimerTracked near(rng, tracker), mid(rng, tracker), far(rng, tracker), overflow(rng, tracker);
+    near.backoff(5);
+    mid.backoff(300);
+    far.backoff(100000);
+    overflow.backoff(40000000);
+    ASSERT_EQ(tracker.size(), 4u);
+
+    dstime waituntil = NEVER;
+    tracker.update(&waituntil, false);
+    ASSERT_EQ(waituntil, 1005u);
+
+    // cancelling the soonest timer exposes the next one
+    near.reset();
+    ASSERT_EQ(tracker.size(), 3u);
+    ASSERT_EQ(tracker.nextTimeout(), 1300u);
+
+    // disabled timers keep their settings but leave the group
+    mid.enable(false);
+    ASSERT_EQ(tracker.nextTimeout(), 101000u);
+    mid.enable(true);
+    ASSERT_EQ(tracker.nextTimeout(), 1300u);
+
+    // moving past a deadline makes it due: update() fires it and transfers disarm it
+    Waiter::ds = 1300;
+    waituntil = NEVER;
+    tracker.update(&waituntil, true);
+    ASSERT_EQ(waituntil, 0u);
+    ASSERT_EQ(mid.nextset(), 0u);
+    ASSERT_EQ(tracker.size(), 2u);
+    ASSERT_EQ(tracker.nextTimeout(), 101000u);
+
+    // large jumps cascade the remaining timers into place
+    Waiter::ds = 100999;
+    waituntil = NEVER;
+    tracker.update(&waituntil, false);
+    ASSERT_EQ(waituntil, 101000u);
+
+    Waiter::ds = 40000999;
+    waituntil = NEVER;
+    tracker.update(&waituntil, true);
+    ASSERT_EQ(waituntil, 0u);
+    ASSERT_EQ(tracker.size(), 1u);
+    ASSERT_EQ(tracker.nextTimeout(), 40001000u);
+
+    Waiter::ds = 40001000;
+    waituntil = NEVER;
+    tracker.update(&waituntil, true);
+    ASSERT_EQ(waituntil, 0u);
+    ASSERT_EQ(tracker.size(), 0u);
+    ASSERT_EQ(tracker.nextTimeout(), NEVER);
+
+    Waiter::ds = savedDs;
+}
+
+TEST(MetricsRegistry, CountersAndHistogramsAreExported)
+{
+    auto& registry = MetricsRegistry::instance();
+
+    // the registry is process-wide, so only what this test adds is checked
+    auto metric = [&registry](const std::string& name)
+    {
+        for (auto& m : registry.snapshot())
+        {
+            if (m.name == name) return m;
+        }
+        return MetricsRegistry::Metric();
+    };
+
+    auto bytes = registry.counter("UtilsTest_bytes", "Bytes seen by the test");
+    auto latency = registry.histogram("UtilsTest_latency");
+    ASSERT_NE(bytes, MetricsRegistry::NONE);
+    ASSERT_NE(latency, MetricsRegistry::NONE);
+
+    // registering again returns the same instrument, a different kind is refused
+    ASSERT_EQ(registry.counter("UtilsTest_bytes"), bytes);
+    ASSERT_EQ(registry.histogram("UtilsTest_bytes"), MetricsRegistry::NONE);
+
+    auto bytesBefore = metric("UtilsTest_bytes");
+    auto latencyBefore = metric("UtilsTest_latency");
+
+    registry.add(bytes, 10);
+
+    // other threads' contributions survive the thread exiting
+    std::thread([&]()
+    {
+        registry.add(bytes, 5);
+        registry.recordDuration(latency, std::chrono::microseconds(3));
+    }).join();
+
+    registry.recordDuration(latency, std::chrono::microseconds(0));
+    registry.recordDuration(latency, std::chrono::hours(1));
+
+    auto bytesAfter = metric("UtilsTest_bytes");
+    ASSERT_EQ(bytesAfter.name, "UtilsTest_bytes");
+    ASSERT_EQ(bytesAfter.kind, MetricsRegistry::COUNTER);
+    ASSERT_EQ(bytesAfter.count - bytesBefore.count, 15u);
+
+    auto latencyAfter = metric("UtilsTest_latency");
+    ASSERT_EQ(latencyAfter.name, "UtilsTest_latency");
+    ASSERT_EQ(latencyAfter.kind, MetricsRegistry::HISTOGRAM);
+    ASSERT_EQ(latencyAfter.count - latencyBefore.count, 3u);
+    ASSERT_EQ(latencyAfter.sumNanoseconds - latencyBefore.sumNanoseconds, 3600000003000u);
+    ASSERT_EQ(latencyAfter.buckets[0] - latencyBefore.buckets[0], 1u);    // < 1us
+    ASSERT_EQ(latencyAfter.buckets[2] - latencyBefore.buckets[2], 1u);    // < 4us
+    ASSERT_EQ(latencyAfter.buckets[MetricsRegistry::HISTOGRAM_BUCKETS - 1] - latencyBefore.buckets[MetricsRegistry::HISTOGRAM_BUCKETS - 1], 1u);
+
+    auto bytesValue = std::to_string(bytesAfter.count);
+    auto latencyCount = std::to_string(latencyAfter.count);
+
+    auto json = registry.toJson();
+    ASSERT_NE(json.find("\"UtilsTest_bytes\":{\"type\":\"counter\",\"value\":" + bytesValue + "}"), std::string::npos);
+    ASSERT_NE(json.find("\"UtilsTest_latency\":{\"type\":\"histogram\",\"count\":" + latencyCount + ","), std::string::npos);
+
+    auto prometheus = registry.toPrometheus();
+    ASSERT_NE(prometheus.find("# HELP mega_UtilsTest_bytes_total Bytes seen by the test\n"), std::string::npos);
+    ASSERT_NE(prometheus.find("mega_UtilsTest_bytes_total " + bytesValue + "\n"), std::string::npos);
+    ASSERT_NE(prometheus.find("mega_UtilsTest_latency_seconds_bucket{le=\"+Inf\"} " + latencyCount + "\n"), std::string::npos);
+    ASSERT_NE(prometheus.find("mega_UtilsTest_latency_seconds_count " + latencyCount + "\n"), std::string::npos);
+
+    // ScopeStats feed the registry in every build
+    auto scopeBefore = metric("UtilsTest_scope");
+    CodeCounter::ScopeStats scope("UtilsTest_scope");
+    {
+        CodeCounter::ScopeTimer timer(scope);
+    }
+    auto scopeAfter = metric("UtilsTest_scope");
+    ASSERT_EQ(scopeAfter.kind, MetricsRegistry::HISTOGRAM);
+    ASSERT_EQ(scopeAfter.count - scopeBefore.count, 1u);
+}